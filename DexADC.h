@@ -12,6 +12,7 @@
 
 #include <NIDAQmx.h>
 #include "Dexterous.h"
+#include "DexForceSynthesizer.h"
 
 /********************************************************************************/
 
@@ -142,3 +143,113 @@ public:
 	bool	GetCurrentAnalogSample( AnalogSample &sample );
 
 };
+
+/********************************************************************************/
+
+// A simulated ADC that synthesizes the raw strain gauge voltages of the two
+// ATI sensors from a scripted force profile. The voltages are computed by
+// inverting the same calibration matrices that DexApparatus uses to compute
+// forces and torques, so the whole force path can be exercised and checked 
+// without the hardware. Samples are a function of time only, so a recording
+// of any length can be retrieved at once, much faster than real time.
+
+class DexSyntheticADC : public DexADC {
+
+private:
+
+	bool		acquisitionOn;
+	bool		overrun;
+	DexTimer	clockTimer;
+	DexTimer	acquisitionTimer;
+	double		acquisitionStart;
+	double		duration;
+
+	char		*calibrationFilename[N_FORCE_TRANSDUCERS];
+	
+protected:
+
+public:
+
+	// The signal generator. Set its noise, offsets, drift and saturation directly.
+	DexForceSynthesizer	synthesizer;
+
+	DexSyntheticADC( int channels = GLM_CHANNELS, 
+		char *left_calibration = DEFAULT_LEFT_ATI_CALFILE, 
+		char *right_calibration = DEFAULT_RIGHT_ATI_CALFILE,
+		unsigned long seed = 1 );
+
+	void Initialize( void );
+	void Quit( void );
+
+	int  Update( void );
+	void StartAcquisition( float max_duration );
+	void StopAcquisition( void );
+	bool GetAcquisitionState( void );
+	bool CheckAcquisitionOverrun( void );
+
+	int		RetrieveAnalogSamples( AnalogSample samples[], int max_samples );
+	bool	GetCurrentAnalogSample( AnalogSample &sample );
+
+	// Set the 6x6 gauge-to-force/torque matrix of a sensor directly, rather than
+	// from the ATI calibration file, e.g. to run without the ATI library.
+	bool	SetCalibrationMatrix( int unit, const double ft_from_volts[6][N_GAUGES] );
+	void	SetForceProfile( const DexForceKeyframe frames[], int n, bool loop = true );
+	// Fill the samples for times start, start + samplePeriod, ... 
+	// Returns the number of samples, so this can be used directly 
+	// as a benchmark of the post-acquisition force path.
+	int		SynthesizeAnalogSamples( AnalogSample samples[], int n, double start );
+	void	SynthesizeAnalogSample( AnalogSample &sample, double time );
+
+};
+
+/********************************************************************************/
+
+// An ADC that plays back the analog data of a trial saved by 
+// DexApparatus::SaveAcquisition() (the .adc file), in the same way 
+// as DexReplayTracker does for the markers.
+
+// Write the analog data of a trial in the form that DexReplayADC reads (the .adc file).
+// Returns false if the file could not be written.
+bool DexWriteAnalogFile( const char *filename, const AnalogSample samples[], int n_samples, int n_channels );
+
+class DexReplayADC : public DexADC {
+
+private:
+
+	bool		acquisitionOn;
+	bool		overrun;
+	DexTimer	acquisitionTimer;
+	double		duration;
+	double		maxDuration;
+	char		fileroot[256];
+
+	// The recording is kept in recordedAnalogSamples[].
+	int			nReplaySamples;
+
+	int			CurrentSample( void );
+	void		ReplaySample( AnalogSample &sample, int smpl );
+	
+protected:
+
+public:
+
+	double		speed;
+
+	DexReplayADC( const char *fileroot, double speed = 1.0 );
+
+	// Load another trial. Returns false if the file cannot be read.
+	bool LoadTrial( const char *fileroot );
+
+	void Initialize( void );
+	void Quit( void );
+
+	int  Update( void );
+	void StartAcquisition( float max_duration );
+	void StopAcquisition( void );
+	bool GetAcquisitionState( void );
+	bool CheckAcquisitionOverrun( void );
+
+	int		RetrieveAnalogSamples( AnalogSample samples[], int max_samples );
+	bool	GetCurrentAnalogSample( AnalogSample &sample );
+
+};
@@ -153,6 +153,112 @@ void DexApparatus::ZeroForceTransducers( void ) {
 	}
 }
 
+// Computes the strain gauge offsets directly from the stream of ADC samples,
+// without making and saving a recording. The mean and variance of each gauge
+// are accumulated as the samples come in, and we stop as soon as the confidence 
+// interval on every mean is smaller than the tolerance (in ADC units), or when
+// max_duration runs out. The standard deviations are sent to the ground as a 
+// measure of the noise on each gauge.
+
+// The tag is not used here. It is needed when the offsets can only be 
+// computed from a recording, as for DexCompiler.
+
+int DexApparatus::MeasureAndNullifyStrainGaugeOffsets( const char *tag, double max_duration, double tolerance, 
+														const char *msg, const char *picture ) {
+
+	AnalogSample sample;
+	double	mean[N_FORCE_TRANSDUCERS][N_GAUGES];
+	double	sum_squares[N_FORCE_TRANSDUCERS][N_GAUGES];
+	float	offsets[N_GAUGES];
+	float	noise[N_GAUGES];
+	double	value, delta, interval, worst = 0.0;
+	double	previous_timestamp = -1.0;
+	bool	converged = false;
+	int		unit, gge, n = 0;
+
+	DexTimer	measurement_timer, elapsed_timer;
+
+	// Only the first nGauges are measured, but all N_GAUGES offsets are applied
+	// and reported, so the others are zeroed here and stay that way.
+	for ( unit = 0; unit < nForceTransducers; unit++ ) {
+		for ( gge = 0; gge < N_GAUGES; gge++ ) {
+			mean[unit][gge] = 0.0;
+			sum_squares[unit][gge] = 0.0;
+		}
+	}
+
+	DexTimerSet( measurement_timer, max_duration );
+	DexTimerStart( elapsed_timer );
+	while ( !DexTimerTimeout( measurement_timer ) ) {
+
+		// Keep the display and the ground up to date while we wait.
+		Update();
+
+		// Make sure that we take new samples.
+		adc->GetCurrentAnalogSample( sample );
+		if ( sample.time == previous_timestamp ) continue;
+		previous_timestamp = sample.time;
+		n++;
+
+		// Update the running mean and sum of squared deviations (Welford).
+		for ( unit = 0; unit < nForceTransducers; unit++ ) {
+			for ( gge = 0; gge < nGauges; gge++ ) {
+				value = sample.channel[ftAnalogChannel[unit] + gge];
+				delta = value - mean[unit][gge];
+				mean[unit][gge] += delta / (double) n;
+				sum_squares[unit][gge] += delta * ( value - mean[unit][gge] );
+			}
+		}
+
+		// Don't trust the variance until we have a few samples.
+		if ( n < nSamplesForAverage ) continue;
+		worst = 0.0;
+		for ( unit = 0; unit < nForceTransducers; unit++ ) {
+			for ( gge = 0; gge < nGauges; gge++ ) {
+				interval = OFFSET_CONFIDENCE_FACTOR * sqrt( sum_squares[unit][gge] / (double) ( n - 1 ) / (double) n );
+				if ( interval > worst ) worst = interval;
+			}
+		}
+		if ( worst < tolerance ) {
+			converged = true;
+			break;
+		}
+	}
+
+	// Apply the offsets, even if they are not as precise as requested.
+	// It is still the best that we have.
+	if ( n > 1 ) {
+		for ( unit = 0; unit < nForceTransducers; unit++ ) {
+			for ( gge = 0; gge < N_GAUGES; gge++ ) {
+				offsets[gge] = (float) mean[unit][gge];
+				noise[gge] = (float) sqrt( sum_squares[unit][gge] / (double) ( n - 1 ) );
+			}
+			NullifyStrainGaugeOffsets( unit, offsets );
+			monitor->SendEvent( "Strain gauge noise (SD).\n Unit: %d < %f %f %f %f %f %f >", 
+				unit, noise[0], noise[1], noise[2], noise[3], noise[4], noise[5] );
+		}
+	}
+	monitor->SendEvent( "Strain gauge offsets from %d samples in %.3f s. Confidence interval: %f (%f)",
+		n, DexTimerElapsedTime( elapsed_timer ), worst, tolerance );
+
+	if ( !converged ) {
+
+		// If the user provided a message to signal the error, use it.
+		// If not, generate a generic message.
+		if ( !msg ) msg = "Strain gauge offsets are unstable.";
+		int response = fSignalError( MB_ABORTRETRYIGNORE, picture, "%s\n  Samples: %d\n  Confidence interval: %f (%f)", 
+			msg, n, worst, tolerance );
+
+		if ( response == IDABORT ) return( ABORT_EXIT );
+		if ( response == IDRETRY ) return( RETRY_EXIT );
+		if ( response == IDIGNORE ) return( IGNORE_EXIT );
+
+	}
+
+	return( NORMAL_EXIT );
+
+}
+
 /***************************************************************************/
 
 void DexApparatus::ComputeForceTorque(  Vector3 &force, Vector3 &torque, int unit, AnalogSample analog ) {
@@ -193,6 +299,29 @@ void DexApparatus::GetForceTorque( Vector3 &force, Vector3 &torque, int unit ) {
 
 /***************************************************************************/
 
+// Compute the forces, torques, centers of pressure and accelerations for 
+// the whole of the most recently acquired (or reloaded) analog data.
+
+void DexApparatus::ComputeAcquiredForces( void ) {
+
+	for ( int smpl = 0; smpl < nAcqSamples; smpl++ ) {
+		for ( int unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+			ComputeForceTorque( acquiredForce[unit][smpl], acquiredTorque[unit][smpl], unit, acquiredAnalog[smpl] );
+			ComputeCOP( acquiredCOP[unit][smpl], acquiredForce[unit][smpl], acquiredTorque[unit][smpl] );
+		}
+		acquiredGripForce[smpl] = ComputeGripForce( acquiredForce[0][smpl], acquiredForce[1][smpl] );
+		acquiredLoadForceMagnitude[smpl] = 
+			ComputePlanarLoadForce( acquiredLoadForce[smpl], acquiredForce[0][smpl], acquiredForce[1][smpl] );
+		acquiredAcceleration[smpl][X] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + X];
+		acquiredAcceleration[smpl][Y] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + Y];
+		acquiredAcceleration[smpl][Z] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + Z];
+		acquiredHighAcceleration[smpl] = acquiredAnalog[smpl].channel[highAccAnalogChannel];
+	}
+
+}
+
+/***************************************************************************/
+
 double DexApparatus::ComputeCOP( Vector3 &cop, Vector3 &force, Vector3 &torque, double threshold ) {
 	// If there is enough normal force, compute the center of pressure.
 	if ( fabs( force[Z] ) > threshold ) {
@@ -54,6 +54,9 @@ DexApparatus::DexApparatus( void ) {
 	this->sounds = NULL;
 	this->adc = NULL;
 
+	PrepareRigidBodyModel( manipulandumModel, ManipulandumBody, nManipulandumMarkers );
+	ResetPoseTracker();
+
 }
 
 DexApparatus::DexApparatus( DexTracker  *tracker,
@@ -80,6 +83,9 @@ DexApparatus::DexApparatus( DexTracker  *tracker,
 	update_period = DEX_SIMULATOR_UPDATE_PERIOD;
 	DexTimerSet( update_timer, update_period );
 
+	PrepareRigidBodyModel( manipulandumModel, ManipulandumBody, nManipulandumMarkers );
+	ResetPoseTracker();
+
 	nEvents = 0;
 
 }
@@ -94,6 +100,9 @@ void DexApparatus::Initialize( void ) {
 	tracker->Initialize();
 	adc->Initialize();
 
+	// Placements of the CODA units from previous sessions.
+	tracker->LoadUnitPlacementHistory( DEFAULT_PLACEMENT_HISTORY_FILENAME );
+
 	nVerticalTargets = targets->nVerticalTargets;
 	nHorizontalTargets = targets->nHorizontalTargets;
 	nTargets = nVerticalTargets + nHorizontalTargets;
@@ -417,10 +426,17 @@ int DexApparatus::CheckTrackerPlacement( int unit,
 
 	Vector3 delta_pos;
 	double distance, angle;
+	long elapsed;
 
 	// Get the placement of the CODA unit, expressed as a position vector and a rotation quaternion.
+	// This only asks the tracker the first time after an alignment.
 	tracker->GetUnitPlacement( unit, pos, ori );
 
+	// Say how much the unit moved since it was last placed, possibly in an earlier session.
+	if ( tracker->GetUnitPlacementDrift( unit, distance, angle, elapsed ) ) {
+		monitor->SendEvent( "Unit %d drift: %.1f mm %.2f deg over %.1f h.", unit, distance, angle, elapsed / 3600.0 );
+	}
+
 	// Compare with the expected values.
 	SubtractVectors( delta_pos, pos, expected_pos );
 	distance = VectorNorm( delta_pos );
@@ -488,6 +504,7 @@ bool DexApparatus::ComputeManipulandumPosition( Vector3 pos, Quaternion ori, Cod
 	Vector3		selected_model[DEX_MAX_MARKERS];
 	Vector3		selected_actual[DEX_MAX_MARKERS];
 
+	unsigned long visibility = 0;
 	bool		visible;
 
 	// Select the visible output markers and the corresponding inputs.
@@ -497,18 +514,236 @@ bool DexApparatus::ComputeManipulandumPosition( Vector3 pos, Quaternion ori, Cod
 		if ( marker_frame.marker[mrk].visibility ) {
 			CopyVector( selected_model[n_markers], ManipulandumBody[i] );
 			CopyVector( selected_actual[n_markers], marker_frame.marker[mrk].position );
+			visibility |= ( 0x01L << i );
 			n_markers++;
 		}
 	}
 
 	// ComputeRigidBodyPose() does it all!
-	visible = ComputeRigidBodyPose( pos, ori, 
-									selected_model, selected_actual, n_markers, 
-									default_orientation );
+	// The model side has been done once and for all in the constructor,
+	// unless the manipulandum has too many markers to tabulate.
+	if ( manipulandumModel.nMarkers > 0 ) {
+		visible = ComputeRigidBodyPose( pos, ori, 
+										manipulandumModel, visibility, selected_actual, 
+										default_orientation );
+	}
+	else {
+		visible = ComputeRigidBodyPose( pos, ori, 
+										selected_model, selected_actual, n_markers, 
+										default_orientation );
+	}
 	return( visible );
 
 }
 
+// Compute the 3D position and orientation of the manipulandum, as above, but using
+// the pose computed on the previous call as the starting point. The orientation
+// is refined with a couple of Gauss-Newton steps on the marker residuals,
+// which is a lot cheaper than the full solution. We fall back on the full
+// solution the first time through, whenever the set of visible markers changes
+// and whenever the refined pose does not fit the markers well enough.
+bool DexApparatus::TrackManipulandumPosition( Vector3 pos, Quaternion ori, CodaFrame &marker_frame, Quaternion default_orientation ) {
+
+	Vector3		selected_model[DEX_MAX_MARKERS];
+	Vector3		selected_actual[DEX_MAX_MARKERS];
+	Vector3		model_centroid, actual_centroid;
+	Vector3		rotated, residual, moment, gradient, step;
+	Matrix3x3	hessian, inverse;
+	Quaternion	increment, refined;
+
+	unsigned long visibility = 0;
+	double	angle, sum_squared;
+	bool	visible;
+	int		i, j, iteration;
+
+	DexTimer	cost_timer;
+	// This measures the computing time, so it must run on the real clock.
+	DexTimerStartWallClock( cost_timer );
+
+	// Select the visible output markers and the corresponding inputs,
+	// keeping track of which ones we are using.
+	int n_markers = 0;
+	for ( i = 0; i < nManipulandumMarkers; i++ ) {
+		int mrk = ManipulandumMarkerID[i];
+		if ( marker_frame.marker[mrk].visibility ) {
+			CopyVector( selected_model[n_markers], ManipulandumBody[i] );
+			CopyVector( selected_actual[n_markers], marker_frame.marker[mrk].position );
+			visibility |= ( 0x01L << i );
+			n_markers++;
+		}
+	}
+
+	// Refine the previous orientation, if we can.
+	visible = false;
+	if ( poseTrackerLocked && n_markers >= 3 && visibility == poseTrackerVisibility ) {
+
+		// The position drops out if we work relative to the centroids.
+		CopyVector( model_centroid, zeroVector );
+		CopyVector( actual_centroid, zeroVector );
+		for ( i = 0; i < n_markers; i++ ) {
+			AddVectors( model_centroid, model_centroid, selected_model[i] );
+			AddVectors( actual_centroid, actual_centroid, selected_actual[i] );
+		}
+		ScaleVector( model_centroid, model_centroid, 1.0 / (double) n_markers );
+		ScaleVector( actual_centroid, actual_centroid, 1.0 / (double) n_markers );
+		for ( i = 0; i < n_markers; i++ ) {
+			SubtractVectors( selected_model[i], selected_model[i], model_centroid );
+			SubtractVectors( selected_actual[i], selected_actual[i], actual_centroid );
+		}
+
+		CopyQuaternion( ori, poseTrackerOrientation );
+		visible = true;
+		for ( iteration = 0; iteration < POSE_TRACKER_ITERATIONS && visible; iteration++ ) {
+
+			// A small rotation w moves each rotated model marker b by w x b.
+			// Minimizing the residuals gives the normal equations 
+			//  sum( |b|^2 I - b b' ) w = sum( b x residual ).
+			CopyMatrix( hessian, zeroMatrix );
+			CopyVector( gradient, zeroVector );
+			for ( i = 0; i < n_markers; i++ ) {
+				RotateVector( rotated, ori, selected_model[i] );
+				SubtractVectors( residual, selected_actual[i], rotated );
+				ComputeCrossProduct( moment, rotated, residual );
+				AddVectors( gradient, gradient, moment );
+				double norm2 = DotProduct( rotated, rotated );
+				for ( j = 0; j < 3; j++ ) {
+					for ( int k = 0; k < 3; k++ ) hessian[j][k] -= rotated[j] * rotated[k];
+					hessian[j][j] += norm2;
+				}
+			}
+			// If the markers are nearly aligned, the rotation around them is undefined.
+			if ( fabs( InvertMatrix( inverse, hessian ) ) < 1.0e-9 ) {
+				visible = false;
+				break;
+			}
+			MultiplyVector( step, gradient, inverse );
+
+			// Apply the incremental rotation on top of the current one.
+			angle = VectorNorm( step );
+			if ( angle < 1.0e-12 ) break;
+			increment[M] = cos( 0.5 * angle );
+			ScaleVector( increment, step, sin( 0.5 * angle ) / angle );
+			MultiplyQuaternions( refined, increment, ori );
+			NormalizeQuaternion( refined );
+			CopyQuaternion( ori, refined );
+		}
+
+		// See how well the refined pose explains the markers.
+		if ( visible ) {
+			sum_squared = 0.0;
+			for ( i = 0; i < n_markers; i++ ) {
+				RotateVector( rotated, ori, selected_model[i] );
+				SubtractVectors( residual, selected_actual[i], rotated );
+				sum_squared += DotProduct( residual, residual );
+			}
+			if ( sqrt( sum_squared / (double) n_markers ) > POSE_TRACKER_MAX_RESIDUAL ) visible = false;
+		}
+
+		// The position is whatever puts the rotated model centroid on the actual centroid.
+		if ( visible ) {
+			RotateVector( rotated, ori, model_centroid );
+			SubtractVectors( pos, actual_centroid, rotated );
+		}
+	}
+
+	// Otherwise, start from scratch.
+	if ( !visible ) {
+		visible = ComputeManipulandumPosition( pos, ori, marker_frame, default_orientation );
+		poseTrackerFullSolves++;
+		// Keep the quaternion in the same hemisphere as before, so that the
+		// orientation that we report does not flip sign across visibility changes.
+		if ( visible && poseTrackerLocked &&
+			 ori[X] * poseTrackerOrientation[X] + ori[Y] * poseTrackerOrientation[Y] + 
+			 ori[Z] * poseTrackerOrientation[Z] + ori[M] * poseTrackerOrientation[M] < 0.0 ) {
+			ori[X] = - ori[X]; ori[Y] = - ori[Y]; ori[Z] = - ori[Z]; ori[M] = - ori[M];
+		}
+	}
+
+	// We can only start from here the next time around if the orientation was
+	// actually computed from the markers, as opposed to being the default.
+	poseTrackerLocked = ( visible && n_markers >= 3 );
+	if ( poseTrackerLocked ) {
+		CopyQuaternion( poseTrackerOrientation, ori );
+		poseTrackerVisibility = visibility;
+	}
+
+	poseTrackerReads++;
+	poseTrackerTime += DexTimerElapsedTime( cost_timer );
+
+	return( visible );
+
+}
+
+// Forget the previous pose and the statistics.
+void DexApparatus::ResetPoseTracker( void ) {
+	poseTrackerLocked = false;
+	poseTrackerVisibility = 0;
+	CopyQuaternion( poseTrackerOrientation, nullQuaternion );
+	poseTrackerReads = 0;
+	poseTrackerFullSolves = 0;
+	poseTrackerTime = 0.0;
+}
+
+// Say how much time has been spent computing the manipulandum pose in real time
+// since the last report, and how often we had to fall back on the full solution.
+void DexApparatus::ReportPoseTrackerCost( void ) {
+	if ( poseTrackerReads > 0 && monitor ) {
+		monitor->SendEvent( "Pose tracker: %d reads, %d full solutions, %.1f us per read.",
+			poseTrackerReads, poseTrackerFullSolves, 1.0e6 * poseTrackerTime / (double) poseTrackerReads );
+	}
+	poseTrackerReads = 0;
+	poseTrackerFullSolves = 0;
+	poseTrackerTime = 0.0;
+}
+
+// Compute the manipulandum position and orientation at each time step of a recording.
+// Here we can afford to check that the markers fit the rigid body model and to
+// recompute the pose without a ghost marker or with two exchanged markers put back
+// in place, so that a single bad marker does not spoil the trial. 
+void DexApparatus::ComputeManipulandumTrajectory( ManipulandumState state[], CodaFrame marker_frame[], int n_frames ) {
+
+	Vector3		selected_actual[DEX_MAX_MARKERS];
+	double		residual;
+	int			frm, i, mrk, n_markers;
+	int			n_rejected = 0, n_swapped = 0;
+
+	for ( frm = 0; frm < n_frames; frm++ ) {
+
+		state[frm].time = marker_frame[frm].time;
+		state[frm].rejectedMarkers = 0;
+		state[frm].swappedMarkers = false;
+		state[frm].residual = 0.0f;
+
+		// The robust solution needs the tabulated model.
+		if ( manipulandumModel.nMarkers == 0 ) {
+			state[frm].visibility = ComputeManipulandumPosition( state[frm].position, state[frm].orientation, marker_frame[frm] );
+			continue;
+		}
+
+		unsigned long visibility = 0;
+		n_markers = 0;
+		for ( i = 0; i < nManipulandumMarkers; i++ ) {
+			mrk = ManipulandumMarkerID[i];
+			if ( marker_frame[frm].marker[mrk].visibility ) {
+				CopyVector( selected_actual[n_markers++], marker_frame[frm].marker[mrk].position );
+				visibility |= ( 0x01L << i );
+			}
+		}
+		state[frm].visibility = ComputeRigidBodyPoseRobust( state[frm].position, state[frm].orientation, 
+															manipulandumModel, visibility, selected_actual,
+															ROBUST_POSE_MAX_RESIDUAL, residual, 
+															state[frm].rejectedMarkers, state[frm].swappedMarkers );
+		state[frm].residual = (float) residual;
+		if ( state[frm].rejectedMarkers ) n_rejected++;
+		if ( state[frm].swappedMarkers ) n_swapped++;
+	}
+
+	if ( ( n_rejected || n_swapped ) && monitor ) {
+		monitor->SendEvent( "Manipulandum markers: %d frames with a marker rejected, %d with markers exchanged.", n_rejected, n_swapped );
+	}
+
+}
+
 // Compute the 3D position of the target frame.
 bool DexApparatus::ComputeTargetFramePosition( Vector3 pos, Quaternion ori, CodaFrame &frame  ) {
 
@@ -553,7 +788,8 @@ bool DexApparatus::GetManipulandumPosition( Vector3 pos, Quaternion ori, Quatern
 	tracker->GetCurrentMarkerFrame( marker_frame );
 
 	// Compute the position vector and orientation quaternion from the markers.
-	visible = ComputeManipulandumPosition( pos, ori, marker_frame, default_orientation );
+	// Successive calls see nearly the same pose, so we refine the previous one.
+	visible = TrackManipulandumPosition( pos, ori, marker_frame, default_orientation );
 
 	// For testing purposes, output the computed position and orientation.
 	fprintf( fp, "%f\t%d\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
@@ -609,10 +845,17 @@ void DexApparatus::Update( void ) {
 		DispatchMessage( &msg );
 	}
 
+	// With the virtual clock, this is where time goes by: one step per update,
+	// so that the devices never miss more than one sample in between.
+	DexTimerTick();
+
 	// Now do what really needs to be done by the DexApparatus.
 	// But don't actually run the update more often than necessary.
 	if ( !DexTimerTimeout( update_timer ) ) return;
 
+	// Show log messages that may have come from other threads.
+	DexRefreshLogGUI();
+
 	// Allow each of the components to update as needed.
 	if ( exit_status = targets->Update() ) exit( exit_status );
 	if ( exit_status = tracker->Update() ) exit( exit_status );
@@ -910,7 +1153,6 @@ void DexApparatus::FindAnalysisFrameRange( int &first, int &last ) {
 // Show the status to the subject.
 
 void DexApparatus::ShowStatus ( const char *message, const char *picture ) {
-	char picture_filename[1024];
 	char message_text[1024];
 
 	// Show the message in the text window.
@@ -925,16 +1167,10 @@ void DexApparatus::ShowStatus ( const char *message, const char *picture ) {
 	SetDlgItemText( workspace_dlg, IDC_STATUS_TEXT, message_text );
 
 	// And show the picture. Blank by default.
-	strcpy( picture_filename, PictureFilenamePrefix );
-	strcat( picture_filename, "blank.bmp" );
-	HBITMAP bitmap = (HBITMAP) LoadImage( NULL, picture_filename, IMAGE_BITMAP, 595 * .6, 421 * .6, LR_CREATEDIBSECTION | LR_LOADFROMFILE | LR_VGACOLOR );
+	// The pictures come already decoded and scaled from the cache, so this is just a swap of bitmaps.
+	HBITMAP bitmap = ( picture ? DexGetPictureBitmap( picture, DEX_STATUS_PICTURE ) : NULL );
+	if ( !bitmap ) bitmap = DexGetPictureBitmap( "blank.bmp", DEX_STATUS_PICTURE );
 	SendDlgItemMessage( workspace_dlg, IDC_PICTURE, STM_SETIMAGE, IMAGE_BITMAP, (LPARAM) bitmap );
-	if ( picture ) {
-		strcpy( picture_filename, PictureFilenamePrefix );
-		strcat( picture_filename, picture );
-		bitmap = (HBITMAP) LoadImage( NULL, picture_filename, IMAGE_BITMAP, 595 * .6, 421 * .6, LR_CREATEDIBSECTION | LR_LOADFROMFILE | LR_VGACOLOR );
-		if ( bitmap ) SendDlgItemMessage( workspace_dlg, IDC_PICTURE, STM_SETIMAGE, IMAGE_BITMAP, (LPARAM) bitmap );
-	}
 
 	// Doing an update here is helpful (I think) to update the menus and target states in the simulator.
 	Update();
@@ -1894,17 +2130,10 @@ int DexApparatus::StopAcquisition( const char *msg ) {
 	for ( unit = 0; unit <= nCodas; unit++ ) {
 		nAcqFrames = tracker->RetrieveMarkerFrames( acquiredPosition[unit], DEX_MAX_MARKER_FRAMES, unit );
 	}
+	// Tell the ground what the real-time manipulandum reads have been costing us.
+	ReportPoseTrackerCost();
 	// Compute the manipulandum positions.
-	for ( int i = 0; i < nAcqFrames; i++ ) {
-		Vector3		pos;
-		Quaternion	ori;
-		// Compute the manipulandum position and orientation at each time step.
-		acquiredManipulandumState[i].visibility = 
-			ComputeManipulandumPosition( pos, ori, acquiredPosition[0][i] );
-		acquiredManipulandumState[i].time = acquiredPosition[0][i].time;
-		CopyVector( acquiredManipulandumState[i].position, pos );
-		CopyQuaternion( acquiredManipulandumState[i].orientation, ori );
-	}
+	ComputeManipulandumTrajectory( acquiredManipulandumState, acquiredPosition[0], nAcqFrames );
 	// Send the marker recording by telemetry to the ground for monitoring.
 	monitor->SendRecording( acquiredManipulandumState, nAcqFrames, INVISIBLE );
 
@@ -1921,19 +2150,7 @@ int DexApparatus::StopAcquisition( const char *msg ) {
 
 #ifndef NOATI
 	// Compute forces from analog data.
-	for ( int smpl = 0; smpl < nAcqSamples; smpl++ ) {
-		for ( int unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
-			ComputeForceTorque( acquiredForce[unit][smpl], acquiredTorque[unit][smpl], unit, acquiredAnalog[smpl] );
-			ComputeCOP( acquiredCOP[unit][smpl], acquiredForce[unit][smpl], acquiredTorque[unit][smpl] );
-		}
-		acquiredGripForce[smpl] = ComputeGripForce( acquiredForce[0][smpl], acquiredForce[1][smpl] );
-		acquiredLoadForceMagnitude[smpl] = 
-			ComputePlanarLoadForce( acquiredLoadForce[smpl], acquiredForce[0][smpl], acquiredForce[1][smpl] );
-		acquiredAcceleration[smpl][X] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + X];
-		acquiredAcceleration[smpl][Y] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + Y];
-		acquiredAcceleration[smpl][Z] = acquiredAnalog[smpl].channel[lowAccAnalogChannel + Z];
-		acquiredHighAcceleration[smpl] = acquiredAnalog[smpl].channel[highAccAnalogChannel];
-	}
+	ComputeAcquiredForces();
 #endif
 
 	return( NORMAL_EXIT );
@@ -1943,8 +2160,9 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 	
 	FILE *fp;
 	char fileroot[256], filename[512];
+	CodaFrame *pages[DEX_MAX_CODAS+1];
 
-	int unit, frm, mrk, smpl, chan;
+	int unit, frm, smpl;
 	
 	// TODO: Automatically generate a file name.
 	// Here we use the same name each time, but just add the tag.
@@ -1952,30 +2170,14 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 	
 	// Write a file with raw marker data.
 	ShowStatus( "Writing marker data ...", "wait.bmp" );
+	// The same format is read back by DexReplayTracker.
 	sprintf( filename, "%s.mrk", fileroot );
-	fp = fopen( filename, "w" );
-	fprintf( fp, "Sample\tTime" );
-	for ( mrk = 0; mrk < nMarkers; mrk++ ) fprintf( fp, "\tM%02dV\tM%02dX\tM%02dY\tM%02dZ", mrk, mrk, mrk, mrk );
-	for ( unit = 0; unit <= nCodas; unit++ ) {
-		for ( mrk = 0; mrk < nMarkers; mrk++ ) {
-			fprintf( fp, "\tU%1dM%02dV\tU%1dM%02dX\tU%1dM%02dY\tU%1dM%02dZ", unit, mrk, unit, mrk, unit, mrk, unit, mrk );
-		}
-	}
-	fprintf( fp, "\n" );
-	for ( frm = 0; frm < nAcqFrames; frm++ ) {
-		fprintf( fp, "%d\t%.3f", frm, acquiredManipulandumState[frm].time ); 
-		for ( unit = 0; unit <= nCodas; unit++ ) {
-		for ( mrk = 0; mrk < nMarkers; mrk++ ) {
-				fprintf( fp, "\t%d\t%f\t%f\t%f", 
-					acquiredPosition[unit][frm].marker[mrk].visibility,
-					acquiredPosition[unit][frm].marker[mrk].position[X],
-					acquiredPosition[unit][frm].marker[mrk].position[Y],
-					acquiredPosition[unit][frm].marker[mrk].position[Z] );
-		}
-		}
-		fprintf( fp, "\n" );
+	for ( unit = 0; unit <= nCodas; unit++ ) pages[unit] = acquiredPosition[unit];
+	if ( !DexWriteMarkerFile( filename, pages, nCodas + 1, nMarkers, acquiredManipulandumState, nAcqFrames ) ) {
+		fMessageBox( MB_OK, "DexApparatus", "Error openning file for write:\n %s", filename );
+		HideStatus();
+		return;
 	}
-	fclose( fp );
 	// Note that the file was written.
 	monitor->SendEvent( "Data file written: %s", filename );
 	
@@ -1983,9 +2185,14 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 	ShowStatus( "Writing kinematic data ...", "wait.bmp" );
 	sprintf( filename, "%s.mnp", fileroot );
 	fp = fopen( filename, "w" );
-	fprintf( fp, "Sample\tTime\tVisible\tPx\tPy\tPz\tQx\tQy\tQz\tQm\n" );
+	if ( !fp ) {
+		fMessageBox( MB_OK, "DexApparatus", "Error openning file for write:\n %s", filename );
+		HideStatus();
+		return;
+	}
+	fprintf( fp, "Sample\tTime\tVisible\tPx\tPy\tPz\tQx\tQy\tQz\tQm\tResidual\tRejected\tSwapped\n" );
 	for ( frm = 0; frm < nAcqFrames; frm++ ) {
-		fprintf( fp, "%d\t%.3f\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n", 
+		fprintf( fp, "%d\t%.3f\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%lu\t%d\n", 
 			frm, 
 			acquiredManipulandumState[frm].time, 
 			acquiredManipulandumState[frm].visibility,
@@ -1995,7 +2202,10 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 			acquiredManipulandumState[frm].orientation[X], 
 			acquiredManipulandumState[frm].orientation[Y], 
 			acquiredManipulandumState[frm].orientation[Z],
-			acquiredManipulandumState[frm].orientation[M] );
+			acquiredManipulandumState[frm].orientation[M],
+			acquiredManipulandumState[frm].residual,
+			acquiredManipulandumState[frm].rejectedMarkers,
+			acquiredManipulandumState[frm].swappedMarkers );
 	}
 	fclose( fp );
 	// Note that the file was written.
@@ -2003,17 +2213,13 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 
 	// Write a file with raw adc data.
 	ShowStatus( "Writing ADC data ...", "wait.bmp" );
+	// And this by DexReplayADC.
 	sprintf( filename, "%s.adc", fileroot );
-	fp = fopen( filename, "w" );
-	fprintf( fp, "Sample\tTime" );
-	for ( chan = 0; chan < nChannels; chan++ ) fprintf( fp, "\tCH%02d", chan );
-	fprintf( fp, "\n" );
-	for ( smpl = 0; smpl < nAcqSamples; smpl++ ) {
-		fprintf( fp, "%d\t%.3f", smpl, acquiredAnalog[smpl].time );
-		for ( chan = 0; chan < nChannels; chan++ ) fprintf( fp, "\t%f", acquiredAnalog[smpl].channel[chan] );
-		fprintf( fp, "\n" );
+	if ( !DexWriteAnalogFile( filename, acquiredAnalog, nAcqSamples, nChannels ) ) {
+		fMessageBox( MB_OK, "DexApparatus", "Error openning file for write:\n %s", filename );
+		HideStatus();
+		return;
 	}
-	fclose( fp );
 	// Note that the file was written.
 	monitor->SendEvent( "Data file written: %s", filename );
 		
@@ -2021,6 +2227,11 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 	ShowStatus( "Writing computed analog data ...", "wait.bmp" );
 	sprintf( filename, "%s.frc", fileroot );
 	fp = fopen( filename, "w" );
+	if ( !fp ) {
+		fMessageBox( MB_OK, "DexApparatus", "Error openning file for write:\n %s", filename );
+		HideStatus();
+		return;
+	}
 	fprintf( fp, "Sample\tTime" );
 	fprintf( fp, "\tGF" );
 	fprintf( fp, "\tLF" );
@@ -2046,6 +2257,23 @@ void DexApparatus::SaveAcquisition( const char *tag ) {
 	fclose( fp );
 	// Note that the file was written.
 	monitor->SendEvent( "Data file written: %s", filename );
+
+	// Write a file with the events that were marked during the trial.
+	// The post hoc tests use them to delimit the analysis, so we need them
+	// if the tests are to be repeated off line on the archived data.
+	sprintf( filename, "%s.evt", fileroot );
+	fp = fopen( filename, "w" );
+	if ( !fp ) {
+		fMessageBox( MB_OK, "DexApparatus", "Error openning file for write:\n %s", filename );
+		HideStatus();
+		return;
+	}
+	fprintf( fp, "Event\tTime\tCode\tParam\n" );
+	for ( int evt = 0; evt < nEvents; evt++ ) {
+		fprintf( fp, "%d\t%.3f\t%d\t%lu\n", evt, eventList[evt].time, eventList[evt].event, eventList[evt].param );
+	}
+	fclose( fp );
+	monitor->SendEvent( "Data file written: %s", filename );
 	HideStatus();
 
 	
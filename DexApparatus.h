@@ -56,6 +56,12 @@ private:
 	DexTimer	update_timer;
 	int			update_count;
 
+	// State of the incremental pose tracker used by GetManipulandumPosition().
+	// The last good orientation and the set of markers that were used to compute it.
+	bool			poseTrackerLocked;
+	unsigned long	poseTrackerVisibility;
+	Quaternion		poseTrackerOrientation;
+
 	// Saves force values between calls, so that recursive filtering 
 	// can be applied.
 	double		filteredLoad;
@@ -77,6 +83,14 @@ protected:
 	unsigned long horizontalTargetMask;
 	unsigned long verticalTargetMask;
 
+	// Model-side quantities for each subset of visible manipulandum markers.
+	RigidBodyModel	manipulandumModel;
+
+	// Statistics on what the pose tracker costs, reported after each acquisition.
+	int				poseTrackerReads;
+	int				poseTrackerFullSolves;
+	double			poseTrackerTime;
+
 	int  CheckOverrun(  const char *msg );	 // To be integrated with stop acquisition.
 	void SaveAcquisition( const char *tag ); // To be integrated with stop acquisition.
 
@@ -291,6 +305,18 @@ public:
 	virtual int CheckMovementDirection(  int n_false_directions, Vector3 direction, float threshold, const char *msg, const char *picture );
 	virtual int CheckForcePeaks( float min_force, float max_force, int max_bad_peaks, const char *msg, const char *picture );
 	virtual int CheckAccelerationPeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture );
+
+	// The measurements on which the post hoc tests are based, without the thresholds
+	// and without any interaction with the subject. They work only from the acquired
+	// data and the event list, so they can also be applied off line to archived trials.
+	void	MeasureVisibility( int &cumulative_dropout_frames, int &max_continuous_dropout_frames );
+	double	MeasureMovementAmplitude( const Vector3 direction, int &valid_frames );
+	int		MeasureMovementCycles( const Vector3 direction, float hysteresis, int &valid_frames );
+	int		MeasureEarlyStarts( float hold_time, float threshold, float filter_constant, int &valid_frames );
+	int		MeasureBadStartPositions( int target_id, float tolX, float tolY, float tolZ, int &movements );
+	int		MeasureFalseDirections( const Vector3 direction, float threshold, int &movements, int &starts );
+	int		MeasureForcePeaks( double peaks[], int max_peaks );
+	int		MeasureAccelerationPeaks( double peaks[], int max_peaks );
 	
 	// Signalling events to the ground.
 	virtual void SignalConfiguration( void );
@@ -336,6 +362,16 @@ public:
 												CodaFrame &marker_frame, 
 												Quaternion default_orientation = NULL );
 	virtual bool ComputeTargetFramePosition( Vector3 pos, Quaternion ori, CodaFrame &marker_frame );
+	// Compute the manipulandum state for a whole recording, rejecting 
+	// ghost markers and detecting exchanged markers along the way.
+	virtual void ComputeManipulandumTrajectory( ManipulandumState state[], CodaFrame marker_frame[], int n_frames );
+	// Same as ComputeManipulandumPosition(), but starting from the previous solution.
+	// Meant for successive frames of the real-time data.
+	virtual bool TrackManipulandumPosition( Vector3 pos, Quaternion ori, 
+												CodaFrame &marker_frame, 
+												Quaternion default_orientation = NULL );
+	void ResetPoseTracker( void );
+	void ReportPoseTrackerCost( void );
 	
 	// Get the latest marker data and compute from it the manipulandum position and orientation.
 	virtual bool GetManipulandumPosition( Vector3 pos, Quaternion ori, Quaternion default_orientation = NULL );
@@ -355,8 +391,11 @@ public:
 	virtual void ZeroForceTransducers( void );
 	virtual void NullifyStrainGaugeOffsets( int unit, float gauge_offsets[N_GAUGES] );
 	virtual void ComputeAndNullifyStrainGaugeOffsets( void );
+	virtual int MeasureAndNullifyStrainGaugeOffsets( const char *tag, double max_duration, double tolerance, 
+														const char *msg, const char *picture );
 	
 	void ComputeForceTorque( Vector3 &force, Vector3 &torque, int unit, AnalogSample analog );
+	void ComputeAcquiredForces( void );
 	void GetForceTorque( Vector3 &force, Vector3 &torque, int unit );
 	double ComputeCOP( Vector3 &cop, Vector3 &force, Vector3 &torque, double threshold = DEFAULT_COP_THRESHOLD );
 	double GetCOP( Vector3 &cop, int unit, double threshold = DEFAULT_COP_THRESHOLD );
@@ -458,6 +497,8 @@ public:
 	int CheckForcePeaks( float min_force, float max_force, int max_bad_peaks, const char *msg, const char *picture );
 	int CheckAccelerationPeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture );
 	void ComputeAndNullifyStrainGaugeOffsets( void );
+	int MeasureAndNullifyStrainGaugeOffsets( const char *tag, double max_duration, double tolerance, 
+												const char *msg, const char *picture );
 
 	void MarkEvent( int event, unsigned long param = 0x00L );
 
@@ -488,4 +529,75 @@ public:
 
 };
 
+/************************************************************************************/
+
+// A sweep of the thresholds of one of the post hoc tests, as run by DexPostHocBatch.
+// The meaning of a and b for each test is given in DexPostHocBatch.cpp.
+
+#define DEX_MAX_SWEEP_POINTS	32
+
+typedef enum {
+	VISIBILITY_CHECK = 0,
+	AMPLITUDE_CHECK,
+	CYCLES_CHECK,
+	EARLY_STARTS_CHECK,
+	START_POSITION_CHECK,
+	DIRECTION_CHECK,
+	FORCE_PEAKS_CHECK,
+	ACCELERATION_PEAKS_CHECK,
+	N_POST_HOC_CHECKS
+} DexPostHocCheck;
+
+typedef struct {
+
+	DexPostHocCheck	check;
+	double			a[DEX_MAX_SWEEP_POINTS];
+	double			b[DEX_MAX_SWEEP_POINTS];
+	int				nA, nB;
+
+	// Parameters of the tests that are not swept.
+	Vector3			direction;
+	int				maxCount;
+	float			holdTime;
+	float			filterConstant;
+	int				targetID;
+
+} DexPostHocSweep;
+
+// An apparatus without any devices that holds a single archived trial, 
+// as written by SaveAcquisition(), so that the post hoc measurements
+// can be repeated off line. See DexPostHocBatch.cpp.
+
+class DexPostHocAnalyzer : public DexApparatus {
+
+private:
+
+	// There is no ADC, so we keep track of the analog sample period here.
+	// The marker sample period is kept in a bare DexTracker.
+	double	analogSamplePeriod;
+
+	int		ReadFields( char *line, double value[], int max_values );
+
+	// The peaks of the force and acceleration tests. Each analyzer has its
+	// own, so that several can run in parallel.
+	double	peak[DEX_MAX_EVENTS];
+
+protected:
+
+public:
+
+	DexPostHocAnalyzer( void );
+	~DexPostHocAnalyzer( void );
+
+	// Reload the manipulandum, analog and event data for the trial whose files
+	//  start with fileroot (e.g. DexSimulatorOutput.tag) and recompute the forces.
+	bool LoadTrial( const char *fileroot );
+	int  TimeToSample( float elapsed_time );
+
+	// Add one to pass[a][b] for each point of the sweep at which the trial
+	//  that is loaded passes the test, with the criteria of the Check* routine.
+	void EvaluateSweep( const DexPostHocSweep &sweep, int pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS] );
+
+};
+
 #endif
\ No newline at end of file
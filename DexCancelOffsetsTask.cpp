@@ -24,6 +24,7 @@
 
 // Force offset parameters.
 double offsetAcquireTime = 2.0;			// How long of a sample to acquire when computing strain gauge offsets.
+double offsetTolerance = 0.001;			// Required 95% confidence interval on each strain gauge offset.
 
 /*********************************************************************************/
 
@@ -54,16 +55,14 @@ int RunTransducerOffsetCompensation( DexApparatus *apparatus, const char *params
 	status = apparatus->SelfTest();
 	if ( status == ABORT_EXIT ) return( status );
 
-	// Acquire some data.
-	apparatus->ShowStatus( MsgAcquiringBaseline, "wait.bmp" );
-	apparatus->StartAcquisition( tag, maxTrialDuration );
-	apparatus->Wait( offsetAcquireTime );
-	apparatus->ShowStatus( "Saving data ...", "wait.bmp" );
-	apparatus->StopAcquisition( "Error during file save." );
-
-	apparatus->ShowStatus( "Processing data ...", "wait.bmp" );
-	// Compute the offsets and insert them into force calculations.
-	apparatus->ComputeAndNullifyStrainGaugeOffsets();
+	// Measure the offsets on the fly and insert them into force calculations.
+	// This stops as soon as the offsets are known well enough, and at most after offsetAcquireTime.
+	do {
+		apparatus->ShowStatus( MsgAcquiringBaseline, "wait.bmp" );
+		status = apparatus->MeasureAndNullifyStrainGaugeOffsets( tag, offsetAcquireTime, offsetTolerance, 
+																	"Strain gauge offsets are unstable.", "alert.bmp" );
+		if ( status == ABORT_EXIT ) return( status );
+	} while ( status == RETRY_EXIT );
 	apparatus->ShowStatus( "Force offsets nullified.", "ok.bmp" );
 	BlinkAll( apparatus );
 	apparatus->Wait( 1.0 );
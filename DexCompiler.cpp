@@ -498,6 +498,19 @@ void DexCompiler::ComputeAndNullifyStrainGaugeOffsets( void ) {
 	fprintf( fp, "CMD_NULLIFY_FORCES, ERROR????\n" );
 };
 
+// DEX can only compute the offsets from a recording, so generate the same
+// sequence of commands that the offset task used before it could measure them on the fly.
+int DexCompiler::MeasureAndNullifyStrainGaugeOffsets( const char *tag, double max_duration, double tolerance, 
+														const char *msg, const char *picture ) {
+	StartAcquisition( tag, DEX_MAX_DURATION );
+	Wait( max_duration );
+	ShowStatus( "Saving data ...", "wait.bmp" );
+	StopAcquisition( "Error during file save." );
+	ShowStatus( "Processing data ...", "wait.bmp" );
+	ComputeAndNullifyStrainGaugeOffsets();
+	return( NORMAL_EXIT );
+};
+
 
 /**************************************************************************************************************/
 
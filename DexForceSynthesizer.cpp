@@ -0,0 +1,251 @@
+/***************************************************************************/
+/*                                                                         */
+/*                            DexForceSynthesizer                          */
+/*                                                                         */
+/***************************************************************************/
+
+// The strain gauge voltages that the ATI sensors would give for a scripted
+// profile of grip and load forces, found by inverting the ATI calibrations.
+// This is the part of DexSyntheticADC that does not depend on the ATI
+// library, on the timers nor on the GUI. Windows is only included for the
+// socket types in Dexterous.h.
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include <VectorsMixin.h>
+#include "Dexterous.h"
+#include "DexForceSynthesizer.h"
+#include "DexNoise.h"
+
+/*********************************************************************************/
+
+// By default, rest for half a second, squeeze and then move the manipulandum
+// up and down at 1 Hz, with the grip following the load.
+static DexForceKeyframe defaultProfile[] = {
+	{ 0.00, 0.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 0.50, 0.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 1.00, 5.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 1.25, 8.0, {  0.0,  4.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.01 },
+	{ 1.50, 5.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 1.75, 8.0, {  0.0, -4.0, 0.0 }, { 0.002, -0.001, 0.0 }, -0.01 },
+	{ 2.00, 5.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 2.25, 8.0, {  0.0,  4.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.01 },
+	{ 2.50, 5.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 2.75, 8.0, {  0.0, -4.0, 0.0 }, { 0.002, -0.001, 0.0 }, -0.01 },
+	{ 3.00, 5.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 },
+	{ 3.50, 0.0, {  0.0,  0.0, 0.0 }, { 0.002, -0.001, 0.0 }, 0.0 }
+};
+
+DexForceSynthesizer::DexForceSynthesizer( int channels, unsigned long seed ) {
+
+	nChannels = channels;
+	samplePeriod = ANALOG_SAMPLE_PERIOD;
+
+	// Levels that look like what we see on the real hardware.
+	this->seed = seed;
+	noise = 0.002;
+	offset = 0.2;
+	drift = 0.0;
+	saturation = DEX_ADC_MAX_VOLTS;
+
+	for ( int unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+		for ( int gge = 0; gge < N_GAUGES; gge++ ) {
+			for ( int i = 0; i < 6; i++ ) voltsFromForces[unit][gge][i] = 0.0;
+		}
+	}
+
+	SetForceProfile( defaultProfile, sizeof( defaultProfile ) / sizeof( *defaultProfile ), true );
+
+}
+
+/*********************************************************************************/
+
+// Invert the gauge-to-force/torque matrix and combine it with the inverse of
+// the rotation that DexApparatus applies to bring the sensor frame into the
+// manipulandum frame. The rotations must be the same as in InitForceTransducers().
+
+bool DexForceSynthesizer::SetCalibrationMatrix( int unit, const double ft_from_volts[6][N_GAUGES] ) {
+
+	double		a[6][2 * N_GAUGES];
+	double		pivot, factor, swap;
+	Quaternion	alignment, align, flip;
+	Vector3		axis[3];
+	int			i, j, k, row;
+
+	// Gauss-Jordan elimination with partial pivoting.
+	for ( i = 0; i < 6; i++ ) {
+		for ( j = 0; j < N_GAUGES; j++ ) {
+			a[i][j] = ft_from_volts[i][j];
+			a[i][N_GAUGES + j] = ( i == j ? 1.0 : 0.0 );
+		}
+	}
+	for ( i = 0; i < 6; i++ ) {
+		row = i;
+		for ( k = i + 1; k < 6; k++ ) if ( fabs( a[k][i] ) > fabs( a[row][i] ) ) row = k;
+		if ( fabs( a[row][i] ) < 1.0e-12 ) return( false );
+		if ( row != i ) {
+			for ( j = 0; j < 2 * N_GAUGES; j++ ) {
+				swap = a[i][j];
+				a[i][j] = a[row][j];
+				a[row][j] = swap;
+			}
+		}
+		pivot = a[i][i];
+		for ( j = 0; j < 2 * N_GAUGES; j++ ) a[i][j] /= pivot;
+		for ( k = 0; k < 6; k++ ) {
+			if ( k == i ) continue;
+			factor = a[k][i];
+			for ( j = 0; j < 2 * N_GAUGES; j++ ) a[k][j] -= factor * a[i][j];
+		}
+	}
+
+	if ( unit == LEFT_ATI ) SetQuaterniond( alignment, LEFT_ATI_ROTATION, kVector );
+	else {
+		SetQuaterniond( align, RIGHT_ATI_ROTATION, kVector );
+		SetQuaterniond( flip, 180.0, iVector );
+		MultiplyQuaternions( alignment, flip, align );
+	}
+	// Sensor axes expressed in the manipulandum frame.
+	RotateVector( axis[X], alignment, iVector );
+	RotateVector( axis[Y], alignment, jVector );
+	RotateVector( axis[Z], alignment, kVector );
+
+	// Component i of a sensor force is the projection of the force onto axis i.
+	for ( j = 0; j < N_GAUGES; j++ ) {
+		for ( k = 0; k < 3; k++ ) {
+			voltsFromForces[unit][j][k] = 0.0;
+			voltsFromForces[unit][j][3 + k] = 0.0;
+			for ( i = 0; i < 3; i++ ) {
+				voltsFromForces[unit][j][k] += a[j][N_GAUGES + i] * axis[i][k];
+				voltsFromForces[unit][j][3 + k] += a[j][N_GAUGES + 3 + i] * axis[i][k];
+			}
+		}
+	}
+
+	return( true );
+
+}
+
+void DexForceSynthesizer::SetForceProfile( const DexForceKeyframe frames[], int n, bool loop ) {
+
+	if ( n > DEX_MAX_FORCE_KEYFRAMES ) n = DEX_MAX_FORCE_KEYFRAMES;
+	for ( int i = 0; i < n; i++ ) profile[i] = frames[i];
+	nKeyframes = n;
+	loopProfile = loop;
+
+}
+
+/*********************************************************************************/
+
+void DexForceSynthesizer::InterpolateProfile( DexForceKeyframe &frame, double time ) {
+
+	double	period, relative;
+	int		lo, hi, mid;
+
+	if ( nKeyframes < 1 ) {
+		memset( &frame, 0, sizeof( frame ) );
+		return;
+	}
+
+	period = profile[nKeyframes - 1].time - profile[0].time;
+	if ( loopProfile && period > 0.0 ) time = profile[0].time + fmod( time - profile[0].time, period );
+
+	if ( time <= profile[0].time ) {
+		frame = profile[0];
+		return;
+	}
+	if ( time >= profile[nKeyframes - 1].time ) {
+		frame = profile[nKeyframes - 1];
+		return;
+	}
+
+	// Find the keyframes on either side.
+	lo = 0;
+	hi = nKeyframes - 1;
+	while ( hi - lo > 1 ) {
+		mid = ( lo + hi ) / 2;
+		if ( profile[mid].time <= time ) lo = mid;
+		else hi = mid;
+	}
+
+	relative = ( time - profile[lo].time ) / ( profile[hi].time - profile[lo].time );
+	frame.time = time;
+	frame.grip = profile[lo].grip + relative * ( profile[hi].grip - profile[lo].grip );
+	frame.twist = profile[lo].twist + relative * ( profile[hi].twist - profile[lo].twist );
+	for ( int i = 0; i < 3; i++ ) {
+		frame.load[i] = profile[lo].load[i] + relative * ( profile[hi].load[i] - profile[lo].load[i] );
+		frame.cop[i] = profile[lo].cop[i] + relative * ( profile[hi].cop[i] - profile[lo].cop[i] );
+	}
+
+}
+
+// Gaussian noise with unit variance. It is hashed from the sample and the channel
+// (see DexNoise.h), so it does not depend on the order in which the samples are generated.
+
+double DexForceSynthesizer::Noise( unsigned long index, int channel ) {
+
+	unsigned long h1 = DexHash( seed ^ DexHash( index * 2 * DEX_MAX_CHANNELS + 2 * channel ) );
+	unsigned long h2 = DexHash( seed ^ DexHash( index * 2 * DEX_MAX_CHANNELS + 2 * channel + 1 ) );
+	return( DexHashGaussian( h1, h2 ) );
+
+}
+
+/*********************************************************************************/
+
+void DexForceSynthesizer::SynthesizeAnalogSample( AnalogSample &sample, double time ) {
+
+	DexForceKeyframe	frame;
+	double				ft[6];
+	double				volts, bias;
+	unsigned long		index;
+	int					unit, gge, chan, i;
+
+	InterpolateProfile( frame, time );
+	index = (unsigned long) floor( time / samplePeriod + 0.5 );
+	sample.time = time;
+
+	for ( chan = 0; chan < nChannels; chan++ ) {
+		sample.channel[chan] = (float) ( noise != 0.0 ? noise * Noise( index, chan ) : 0.0 );
+	}
+
+	for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+
+		// Each finger carries half the load. Unit 0 pushes along +Z and unit 1 along -Z.
+		ft[X] = frame.load[X] / 2.0;
+		ft[Y] = frame.load[Y] / 2.0;
+		ft[Z] = ( unit == LEFT_ATI ? frame.grip : - frame.grip ) + frame.load[Z] / 2.0;
+		// Torques that put the center of pressure where the profile says (see ComputeCOP()).
+		ft[3 + X] = - frame.cop[Y] * ft[Z];
+		ft[3 + Y] = - frame.cop[X] * ft[Z];
+		ft[3 + Z] = frame.twist / 2.0;
+
+		for ( gge = 0; gge < N_GAUGES; gge++ ) {
+			chan = ( unit == LEFT_ATI ? LEFT_ATI_FIRST_CHANNEL : RIGHT_ATI_FIRST_CHANNEL ) + gge;
+			if ( chan >= nChannels ) break;
+			volts = 0.0;
+			for ( i = 0; i < 6; i++ ) volts += voltsFromForces[unit][gge][i] * ft[i];
+			// Fixed offset for each gauge, between -offset and +offset.
+			bias = offset * ( 2.0 * (double) DexHash( seed ^ DexHash( chan + 1 ) ) / 4294967295.0 - 1.0 );
+			volts += sample.channel[chan] + bias + drift * time;
+			// The ADC clips at full scale.
+			if ( volts > saturation ) volts = saturation;
+			if ( volts < - saturation ) volts = - saturation;
+			sample.channel[chan] = (float) volts;
+		}
+	}
+
+}
+
+int DexForceSynthesizer::SynthesizeAnalogSamples( AnalogSample samples[], int n, double start ) {
+
+	for ( int smpl = 0; smpl < n; smpl++ ) {
+		SynthesizeAnalogSample( samples[smpl], start + (double) smpl * samplePeriod );
+	}
+	return( n );
+
+}
@@ -0,0 +1,83 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                              DexForceSynthesizer.h                            */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+ * Raw strain gauge voltages of the two ATI sensors for a scripted force profile.
+ * This is the signal generator of DexSyntheticADC. It needs neither the ATI
+ * library nor a clock, only the 6x6 calibration matrices, so it can be used
+ * and checked on its own.
+ */
+
+#ifndef DexForceSynthesizerH
+#define DexForceSynthesizerH
+
+#include <VectorsMixin.h>
+#include "Dexterous.h"
+
+// Full scale of the ADC inputs (see DexNiDaqADC.cpp).
+#define DEX_ADC_MAX_VOLTS		5.0
+#define DEX_MAX_FORCE_KEYFRAMES	64
+
+// One point of a force profile. The profile is interpolated linearly 
+// between points. Everything is in the common manipulandum frame in which 
+// DexApparatus reports the forces (N, m and N-m).
+typedef struct {
+
+	double	time;
+	double	grip;		// Squeeze of each finger, along the pinch (Z) axis.
+	Vector3	load;		// Net force on the manipulandum.
+	Vector3	cop;		// Center of pressure of each finger (X and Y).
+	double	twist;		// Net torque around the pinch axis.
+
+} DexForceKeyframe;
+
+class DexForceSynthesizer : public VectorsMixin {
+
+private:
+
+	// Maps the forces and torques in the manipulandum frame to the 
+	// gauge voltages of each sensor, i.e. the inverse of the ATI calibration
+	// combined with the inverse of the alignment of the sensor.
+	double		voltsFromForces[N_FORCE_TRANSDUCERS][N_GAUGES][6];
+
+	DexForceKeyframe	profile[DEX_MAX_FORCE_KEYFRAMES];
+	int					nKeyframes;
+	bool				loopProfile;
+
+	double	Noise( unsigned long index, int channel );
+
+public:
+
+	int				nChannels;
+	double			samplePeriod;
+
+	// Noise, offsets and offset drift are in volts (volts per second for the drift).
+	// The noise is a function of the seed and the sample index only, so that
+	// two runs with the same seed give exactly the same samples.
+	unsigned long	seed;
+	double			noise;
+	double			offset;
+	double			drift;
+	double			saturation;
+
+	DexForceSynthesizer( int channels = GLM_CHANNELS, unsigned long seed = 1 );
+
+	// Set the 6x6 gauge-to-force/torque matrix of a sensor, i.e. the matrix
+	// that the ATI library applies to the unbiased voltages. Returns false
+	// if it cannot be inverted.
+	bool	SetCalibrationMatrix( int unit, const double ft_from_volts[6][N_GAUGES] );
+	void	SetForceProfile( const DexForceKeyframe frames[], int n, bool loop = true );
+	void	InterpolateProfile( DexForceKeyframe &frame, double time );
+
+	// Fill the samples for times start, start + samplePeriod, ... 
+	// Returns the number of samples, so this can be used directly 
+	// as a benchmark of the post-acquisition force path.
+	int		SynthesizeAnalogSamples( AnalogSample samples[], int n, double start );
+	void	SynthesizeAnalogSample( AnalogSample &sample, double time );
+
+};
+
+#endif
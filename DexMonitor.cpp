@@ -8,7 +8,8 @@
 
 // One is the DexMonitorServer. It provide a mechanism for the DEX apparatus
 // to transmit data to the ground or to a remote computer.
-// There are three flavors: UDP based, pipe based and sending to a local GUI.
+// There are four flavors: UDP based, pipe based, sending to a local GUI and
+// publishing in shared memory for any number of local readers.
 
 // The second implements a graphical interface that receives the transmitted
 // data and displays it on the screen.
@@ -54,10 +55,13 @@
 #include <Layouts.h>
 
 
+#include "DexUDPServices.h"
+#include "DexSHMServices.h"
+#include "DexTelemetry.h"
+
 #include "DexMonitor.h"
 #include "DexMonitorServer.h"
 
-#include "DexUDPServices.h"
 #include "DexSimulatorGUI.h"
 
 // #define AUTOSCALE
@@ -68,12 +72,23 @@ float plot_max =  800.0;
 /*********************************************************************************/
 
 // This implements the graphical monitoring of the data that is sent from DEX.
+// Packets are received by a thread of their own (see RunReceiver()).
+
+static DWORD WINAPI DexMonitorReceiverThread( LPVOID param ) {
+	( (DexMonitor *) param )->RunReceiver();
+	return( 0 );
+}
 
 DexMonitor::DexMonitor( int screen_left, int screen_top, int n_vertical_targets, int n_horizontal_targets, int n_codas ) {
 	
 	nTargets = n_vertical_targets + n_horizontal_targets;
 	nCodas = n_codas;
 	nAcqFrames = 0;
+	nReceivedFrames = 0;
+	recordingID = 0;
+	recordingSamples = 0;
+	DexTelemetryReceiverInit( &link );
+	DexTelemetryRepairInit( &repair );
 
 	int screen_width = 600;
 	int screen_height = 768;
@@ -171,6 +186,15 @@ DexMonitor::DexMonitor( int screen_left, int screen_top, int n_vertical_targets,
 	LayoutSetDisplayEdgesRelative( layout, 0.31, 0.01, 0.99, 0.99 );
 	
 	DexUDPInitClient( &udp_parameters, NULL );
+
+	inboxHead = 0;
+	inboxTail = 0;
+	inboxFull = 0;
+	badPackets = 0;
+	textRecording = 0;
+	textFrames = 0;
+	stopReceiving = false;
+	receiveThread = CreateThread( NULL, 0, DexMonitorReceiverThread, this, 0, NULL );
 	
 }
 
@@ -315,138 +339,232 @@ void DexMonitor::Plot( void ) {
 
 /*********************************************************************************/
 
-// Parse packets of data sent by DexMonitorServer.
-
-void DexMonitor::ParseInputPacket( char *packet ) {
-	
-	int	updateCounter;
-	int	n_codas, n_targets;
-	int	acquisition_state;
-	int	visibility;
-	unsigned long	target_state;
-	
-	DexTargetBarConfiguration		target_bar_config;
-	DexSubjectPosture				subject_posture;
-	DexTappingSurfaceConfiguration	tapping_surface_config;
-	
-	float x, y, z;
-	float pos[3], ori[4];
-	
-	int   frames, sample;
-	int   i, j;
-	char  token[256];
-	
-	sscanf( packet, "%s", token );
-	
-	if ( !strcmp( token, "DEX_QUIT" ) ) exit( 0 );
-	
-	if ( !strcmp( token, "DEX_CONFIGURATION" ) ) {
-		int items = sscanf( packet, "%s %8u %1d %2d [%d %d %d]", 
-			token, &updateCounter, &n_codas, &n_targets, &subject_posture, &target_bar_config, &tapping_surface_config );
-		
-		if ( items < 7 ) {
-			char msg[1024];
-			sprintf( msg, "Items: %d\n%s", items, packet );
-			MessageBox( NULL, msg, "DexMonitor", MB_OK );
-			exit( 0 );
-		}
-		targets->SetConfiguration( subject_posture, target_bar_config, tapping_surface_config );
-		
-	}
-	
-	if ( !strcmp( token, "DEX_EVENT" ) ) {
+// Parse binary packets sent by DexMonitorServer.
 
-		char *event_message;
-		char datestr[256], timestr[256];
-		int items = sscanf( packet, "%s %8u %s %s", token, &updateCounter, datestr, timestr );
+void DexMonitor::ParseTelemetry( DexTelemetryMessage &message ) {
 
-		event_message = strchr( packet, '*' );
-		if ( !event_message ) event_message = "???";
-		
-		// Display the text of the event.
-		// Should log them to a file as well.
-
-		// Take only the first line of the error message.
-//		for ( char *ptr = event_message; *ptr; ptr++ ) {
-//			if ( *ptr == '\n' ) {
-//				*ptr = 0;
-//				break;
-//			}
-//		}
-		// Add a time stamp and print it.
-		fprintf( stderr, "%s %s %s\n", datestr, timestr, event_message );
-		fflush( stderr );
-		
-		// Debugging
-		if ( items < 4 ) {
-			char msg[1024];
-			sprintf( msg, "Items: %d\n%s", items, packet );
-			MessageBox( NULL, msg, "DexMonitor", MB_OK );
-			exit( 0 );
+	struct tm *newtime;
+	time_t wall_clock;
+	int frm;
+	float *data;
+
+	switch ( message.type ) {
+
+	case DEX_TLM_QUIT:
+		exit( 0 );
+		break;
+
+	case DEX_TLM_CONFIGURATION:
+		targets->SetConfiguration( (DexSubjectPosture) message.posture, 
+			(DexTargetBarConfiguration) message.targetBar, 
+			(DexTappingSurfaceConfiguration) message.tappingSurface );
+		break;
+
+	case DEX_TLM_EVENT:
+		// Same display as for the text packets.
+		wall_clock = (time_t) message.clock;
+		newtime = localtime( &wall_clock );
+		if ( newtime ) {
+			fprintf( stderr, "%4d/%02d/%02d %02d:%02d:%02d * %s\n", 
+				newtime->tm_year + 1900, newtime->tm_mon + 1, newtime->tm_mday,
+				newtime->tm_hour, newtime->tm_min, newtime->tm_sec, message.text );
 		}
-	}
-	
-	if ( !strcmp( token, "DEX_STATE" ) ) {
+		else fprintf( stderr, "????/??/?? ??:??:?? * %s\n", message.text );
+		fflush( stderr );
+		break;
 
-		int items = sscanf( packet, "%s %d (%d) | %lx | %d < %f %f %f > [ %f %f %f %f ]",
-			token, &updateCounter, &acquisition_state, &target_state,
-			&visibility, &pos[X], &pos[Y], &pos[Z], &ori[X], &ori[Y], &ori[Z], &ori[M] );
-		
-		if ( acquisition_state ) StartAcquisition();
+	case DEX_TLM_STATE:
+		if ( message.acquisition ) StartAcquisition();
 		else StopAcquisition();
-		
-		targets->SetTargetState( target_state ) ;
+		targets->SetTargetState( message.targets ) ;
+		if ( message.visibility ) SetManipulandumPosition( message.position );
+		break;
 
-		if ( visibility ) SetManipulandumPosition( pos );
-		
-		if ( items < 12 ) {
-			char msg[1024];
-			sprintf( msg, "Items: %d\n%s", items, packet );
-			MessageBox( NULL, msg, "DexMonitor Error", MB_OK );
-			exit( 0 );
+	case DEX_TLM_STATE_CHANGE:
+		// Only the parts of the pose that moved are in the packet.
+		if ( message.acquisition ) StartAcquisition();
+		else StopAcquisition();
+		targets->SetTargetState( message.targets ) ;
+		if ( message.visibility && ( message.changed & DEX_TLM_POSITION_CHANGED ) ) SetManipulandumPosition( message.position );
+		break;
+
+	case DEX_TLM_RECORDING_START:
+		// Samples that never arrive will show up as gaps in the plots.
+		recordingID = message.recording;
+		recordingSamples = message.samples;
+		nAcqFrames = 0;
+		nReceivedFrames = 0;
+		for ( frm = 0; frm < message.samples && frm < DEX_MAX_MARKER_FRAMES; frm++ ) {
+			recordedPosition[frm * 3 + X] = recordedPosition[frm * 3 + Y] = recordedPosition[frm * 3 + Z] = INVISIBLE;
+		}
+		fprintf( stderr, "Start receiving recording. %lu %d\n", message.recording, message.samples );
+		break;
+
+	case DEX_TLM_RECORDING_RECORD:
+	case DEX_TLM_RECORDING_PACKED:
+		// Each record says where its samples go, so a lost one does not shift the others.
+		if ( message.recording != recordingID ) break;
+		data = message.data;
+		if ( message.type == DEX_TLM_RECORDING_PACKED ) {
+			if ( DexTelemetryUnpack( &message, unpacked, INVISIBLE ) < 0 ) break;
+			data = unpacked;
 		}
+		// Records that do not fit in the recording are dropped whole.
+		if ( DexTelemetryStoreRecord( &message, data, recordedTime, recordedPosition, DEX_MAX_MARKER_FRAMES ) < 0 ) break;
+		if ( message.first + message.count > nAcqFrames ) nAcqFrames = message.first + message.count;
+		nReceivedFrames += message.count;
+		break;
+
+	case DEX_TLM_RECORDING_END:
+		if ( message.recording != recordingID ) break;
+		recordingSamples = message.samples;
+		if ( message.samples > nAcqFrames ) nAcqFrames = ( message.samples < DEX_MAX_MARKER_FRAMES ? message.samples : DEX_MAX_MARKER_FRAMES );
+		missed_frames = ( nReceivedFrames != message.samples );
+		fprintf( stderr, "End   receiving recording. %lu %d %d Missed frames: %s\n", 
+			message.recording, message.samples, nReceivedFrames, (missed_frames ? "YES" : "NO" ) );
+		break;
+
+	case DEX_TLM_ACK:
+		// Passed on by the receive thread once all the reliable packets are in.
+		if ( message.recording != recordingID ) break;
+		missed_frames = ( nReceivedFrames != recordingSamples );
+		fprintf( stderr, "Recording %lu complete. %d of %d samples (%lu recovered, %lu lost).\n", 
+			message.recording, nReceivedFrames, recordingSamples, link.recovered, link.abandoned );
+		break;
+
 	}
+
+}
+
+// Turn a packet sent by DexMonitorServer into a message. The old text packets 
+// are converted, so that the display only has to deal with one kind.
+// Returns the number of bytes used, or 0 if there is nothing in the packet
+// or if it cannot be read.
+
+int DexMonitor::DecodePacket( char *packet, int size, DexTelemetryMessage &message ) {
 	
-	if ( !strcmp( token, "DEX_RECORDING_START" ) ) {
-		nAcqFrames = 0;
-		sscanf( packet, "%s %d %d", token, &updateCounter, &frames );
-		fprintf( stderr, "Start receiving recording. %d %d\n", updateCounter, frames );
+	int	bytes;
+
+	// Packets that do not decode are simply dropped.
+	if ( DexTelemetryIsBinary( (unsigned char *) packet, size ) ) {
+		bytes = DexTelemetryDecode( (unsigned char *) packet, size, &message );
+		return( bytes > 0 ? bytes : 0 );
 	}
 	
-	if ( !strcmp( token, "DEX_RECORDING_END" ) ) {
-		sscanf( packet, "%s %d %d", token, &updateCounter, &frames );
-		if ( frames == nAcqFrames ) missed_frames = false;
-		else missed_frames = true;
-		fprintf( stderr, "End   receiving recording. %d %d %d Missed frames: %s\n", 
-			updateCounter, frames, nAcqFrames, (missed_frames ? "YES" : "NO" ) );
-		
-	}
+	bytes = DexTelemetryDecodeText( packet, size, &message );
+	if ( bytes == DEX_TLM_BAD_FIELD ) badPackets++;
+	if ( bytes <= 0 ) return( 0 );
 	
-	// Receive one slice of data.
-	if ( !strcmp( token, "DEX_RECORDING_SAMPLE" ) ) {
-		sscanf( packet, "%s %d %f %f %f", token, &sample, &x, &y, &z );
-		recordedPosition[nAcqFrames*3 + X] = x;
-		recordedPosition[nAcqFrames*3 + Y] = y;
-		recordedPosition[nAcqFrames*3 + Z] = z;
-		nAcqFrames++;
+	// The text recordings are numbered by the counter of their start packet
+	// and the records are put one after the other.
+	if ( message.type == DEX_TLM_RECORDING_START ) {
+		textRecording = message.recording;
+		textFrames = 0;
+	}
+	if ( message.type == DEX_TLM_RECORDING_RECORD ) {
+		message.recording = textRecording;
+		message.first = textFrames;
+		textFrames += message.count;
 	}
+
+	return( bytes );
+
+}
+
+// Parse packets of data sent by DexMonitorServer, as they are read from a stream.
+
+void DexMonitor::ParseInputPacket( char *packet, int size ) {
+	if ( DecodePacket( packet, size, telemetry ) ) ParseTelemetry( telemetry );
+}
+
+// Decode a packet that has arrived via UDP and hand it on to the display.
+// This runs in the receive thread, which looks after the reliable packets.
+
+void DexMonitor::ReceivePacket( char *packet, int size ) {
+
+	// Decode straight into the next free slot.
+	DexTelemetryMessage *message = NextInboxSlot();
+	int bytes;
+
+	// We are quitting.
+	if ( !message ) return;
+	// Second copies of reliable packets are dropped here as well.
+	if ( ( bytes = DecodePacket( packet, size, *message ) ) <= 0 ) return;
+	if ( message->flags & DEX_TLM_PROTECTED ) DexTelemetryRepairKeep( &repair, (unsigned char *) packet, bytes, message->sequence );
+	if ( message->type == DEX_TLM_PARITY ) {
+		// A packet that can be rebuilt goes through here as if it had arrived.
+		char rebuilt[DEX_TLM_MAX_RECORD_SIZE];
+		if ( ( bytes = DexTelemetryRepairRebuild( &repair, message, (unsigned char *) rebuilt ) ) > 0 ) ReceivePacket( rebuilt, bytes );
+		return;
+	}
+	if ( DexTelemetryReceiverAccept( &link, message ) ) PostInboxSlot();
+
+}
+
+// The slot for the next message to the display, waiting for it to make room if need be.
+// Returns NULL if the monitor is quitting, since the display may never make room.
+
+DexTelemetryMessage *DexMonitor::NextInboxSlot( void ) {
+	while ( (unsigned long) ( inboxTail - inboxHead ) >= DEX_MONITOR_INBOX ) {
+		if ( stopReceiving ) return( NULL );
+		inboxFull++;
+		Sleep( 1 );
+	}
+	return( &inbox[(unsigned long) inboxTail % DEX_MONITOR_INBOX] );
+}
+
+// Hand the message in that slot to the display.
+
+void DexMonitor::PostInboxSlot( void ) {
+	InterlockedExchange( (long *) &inboxTail, inboxTail + 1 );
+}
+
+/*********************************************************************************/
+
+// Read the packets as they arrive, answer for the reliable ones and 
+// queue up the messages for the display.
+
+void DexMonitor::RunReceiver( void ) {
 	
-	if ( !strcmp( token, "DEX_RECORDING_RECORD" ) ) {
-		
-		int frames_in_packet;
-		sscanf( packet, "%s %d", token, &frames_in_packet );
-		fprintf( stderr, "%s %d %d\n", token, frames_in_packet, nAcqFrames );
-		
-		float *ptr = (float *) (packet + DEX_UDP_HEADER_SIZE);
-		j = 0;
-		for ( i = 0, j = 0; i < frames_in_packet; i++, j += DEX_FLOATS_PER_SAMPLE ) {
-			recordedTime[nAcqFrames] = ptr[j];
-			recordedPosition[nAcqFrames * 3 + X] = ptr[j+1];
-			recordedPosition[nAcqFrames * 3 + Y] = ptr[j+2];
-			recordedPosition[nAcqFrames * 3 + Z] = ptr[j+3];
-			nAcqFrames ++;
-		}	
+	int size, n, i;
+	DexTelemetryMessage reply, *message;
+	char packet[DEX_UDP_PACKET_SIZE];
+	
+	while ( !stopReceiving ) {
+
+		if ( DexUDPWaitForPacket( &udp_parameters, DEX_MONITOR_POLL ) ) {
+			n = DexUDPGetPackets( &udp_parameters, received, DEX_UDP_BATCH );
+			for ( i = 0; i < n; i++ ) {
+				// Terminate text packets that arrive without a null.
+				received[i].data[received[i].size] = 0;
+				ReceivePacket( received[i].data, received[i].size );
+			}
+		}
+
+		// Ask for any reliable packets that are missing and say when a recording is complete.
+		while ( DexTelemetryReceiverReply( &link, &reply, timeGetTime() ) ) {
+			reply.sequence = 0;
+			reply.time = 0;
+			size = DexTelemetryEncode( (unsigned char *) packet, sizeof( packet ), &reply );
+			if ( size > 0 ) DexUDPReply( &udp_parameters, packet, size );
+			// The display reports the completed recording.
+			if ( reply.type == DEX_TLM_ACK && ( message = NextInboxSlot() ) ) {
+				*message = reply;
+				PostInboxSlot();
+			}
+		}
 	}
+
+}
+
+/*********************************************************************************/
+
+// Keep a copy of every packet that arrives from here on, as DexMonitorServerUDP::LogPackets().
+
+bool DexMonitor::LogPackets( const char *filename ) {
+	if ( DexUDPOpenLog( &udp_parameters, filename ) == 0 ) return( true );
+	fOutputDebugString( "DexMonitor: Could not open %s to log the packets.\n", filename );
+	return( false );
 }
 
 /*********************************************************************************/
@@ -458,7 +576,7 @@ void DexMonitor::ParseInputStream( FILE *fp ) {
 	while ( !feof( fp ) ) {
 		
 		if ( NULL != fgets( line, sizeof( line ), fp ) ) {
-			ParseInputPacket( line );
+			ParseInputPacket( line, strlen( line ) + 1 );
 		}
 	}
 }
@@ -467,13 +585,12 @@ void DexMonitor::ParseInputStream( FILE *fp ) {
 
 int DexMonitor::Update( void ) {
 	
-	int i = 0;
 	int exit_status = NORMAL_EXIT;
 	
-	char packet[DEX_UDP_PACKET_SIZE];
-	
-	while( DexUDPGetPacket( &udp_parameters, packet ) != DEX_UDP_NODATA ) {
-		ParseInputPacket( packet );
+	// Take in everything that the receive thread has decoded since the last time.
+	while ( inboxHead != inboxTail ) {
+		ParseTelemetry( inbox[(unsigned long) inboxHead % DEX_MONITOR_INBOX] );
+		InterlockedExchange( (long *) &inboxHead, inboxHead + 1 );
 	}
 	
 	if ( display ) {
@@ -495,6 +612,13 @@ int DexMonitor::Update( void ) {
 
 void DexMonitor::Quit( void ) {
 	
+	// The thread stops within DEX_MONITOR_POLL, and must be gone before the log is closed.
+	stopReceiving = true;
+	WaitForSingleObject( receiveThread, INFINITE );
+	CloseHandle( receiveThread );
+	DexUDPCloseLog( &udp_parameters );
+	if ( inboxFull ) fOutputDebugString( "DexMonitor: receive thread waited %lu times for the display.\n", inboxFull );
+	if ( badPackets ) fOutputDebugString( "DexMonitor: %lu text packets could not be read.\n", badPackets );
 	window->Destroy();
 	
 }
@@ -514,7 +638,7 @@ void DexMonitor::RunWindow( void ) {
 			// This kills everything - not very nice!
 			exit( exit_status );
 		}
-		Sleep( 100 );
+		Sleep( DEX_MONITOR_REFRESH );
 	}
 }
 
@@ -530,9 +654,64 @@ void DexMonitor::RunWindow( void ) {
 DexMonitorServer::DexMonitorServer( int n_vertical_targets, int n_horizontal_targets, int n_codas ) {
 	
 	messageCounter = 0;
+	packetCounter = 0;
+	reliableCounter = 0;
+	startTime = timeGetTime();
+	protocol = DEX_TEXT_PROTOCOL;
+	reliable = false;
+	parityBlock = 0;
+	parity.nProtected = 0;
+	fullResolution = false;
+
+	DexTelemetryStateFilterInit( &stateFilter, DEX_STATE_POSITION_DEADBAND, DEX_STATE_ORIENTATION_DEADBAND, 
+		DEX_STATE_INTERVAL, DEX_STATE_KEYFRAME );
 
 }
 
+// Encode a message in the binary format and send it out.
+
+void DexMonitorServer::SendTelemetry( DexTelemetryMessage &message, int priority ) {
+
+	unsigned char packet[DEX_TLM_MAX_PACKET_SIZE];
+	int size;
+
+	// Only the recordings are worth the trouble.
+	if ( ( reliable || parityBlock > 0 ) && ( message.type == DEX_TLM_RECORDING_PACKED
+		|| ( message.type >= DEX_TLM_RECORDING_START && message.type <= DEX_TLM_RECORDING_END ) ) ) {
+		message.flags = ( reliable ? DEX_TLM_RELIABLE : 0 ) | ( parityBlock > 0 ? DEX_TLM_PROTECTED : 0 );
+		message.sequence = reliableCounter++;
+	}
+	else {
+		message.flags = 0;
+		message.sequence = packetCounter++;
+	}
+	message.time = timeGetTime() - startTime;
+	size = DexTelemetryEncode( packet, sizeof( packet ), &message );
+	if ( size <= 0 ) return;
+	SendPacket( (char *) packet, size, priority );
+
+	// Close the block at the end of a recording, rather than have the 
+	// parity wait for the next one.
+	if ( message.flags & DEX_TLM_PROTECTED ) {
+		DexTelemetryParityAdd( &parity, packet, size, message.sequence );
+		if ( parity.nProtected >= parityBlock || parity.nProtected >= DEX_TLM_MAX_PARITY_BLOCK 
+			|| message.type == DEX_TLM_RECORDING_END ) {
+			parity.flags = 0;
+			parity.sequence = packetCounter++;
+			parity.time = message.time;
+			size = DexTelemetryEncode( packet, sizeof( packet ), &parity );
+			if ( size > 0 ) SendPacket( (char *) packet, size, DEX_NORMAL_PRIORITY );
+			parity.nProtected = 0;
+		}
+	}
+
+}
+
+// Only the servers that queue their packets have anything to wait for.
+
+void DexMonitorServer::Flush( void ) {}
+void DexMonitorServer::Close( void ) {}
+
 /*********************************************************************************/
 
 // Send out a record with the recorded manipulandum movement.
@@ -544,11 +723,79 @@ void DexMonitorServer::SendRecording( ManipulandumState state[], int samples, fl
 	float *ptr;
 
 	int skip = samples / DEX_SAMPLES_PER_PACKET + 1;
-	int samples_to_send = samples / skip + 1;
+	int samples_to_send = ( samples + skip - 1 ) / skip;
+
+	if ( protocol == DEX_BINARY_PROTOCOL && fullResolution ) {
+
+		DexTelemetryPredictor predictor;
+		float value[DEX_TLM_FLOATS_PER_SAMPLE];
+
+		telemetry.type = DEX_TLM_RECORDING_START;
+		telemetry.recording = messageCounter;
+		telemetry.samples = samples;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+
+		// Fill each packet as far as it will go.
+		DexTelemetryPackStart( &telemetry, &predictor, 0 );
+		int sample = 0;
+		while ( sample < samples ) {
+			value[0] = (float) state[sample].time;
+			value[1] = (float) state[sample].position[X];
+			value[2] = (float) state[sample].position[Y];
+			value[3] = (float) state[sample].position[Z];
+			if ( DexTelemetryPackSample( &telemetry, &predictor, value, state[sample].visibility ) ) sample++;
+			else {
+				SendTelemetry( telemetry, DEX_NORMAL_PRIORITY );
+				DexTelemetryPackStart( &telemetry, &predictor, sample );
+			}
+		}
+		if ( telemetry.count > 0 ) SendTelemetry( telemetry, DEX_NORMAL_PRIORITY );
+
+		telemetry.type = DEX_TLM_RECORDING_END;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+
+		messageCounter++;
+		return;
+
+	}
+
+	if ( protocol == DEX_BINARY_PROTOCOL ) {
+
+		telemetry.type = DEX_TLM_RECORDING_START;
+		telemetry.recording = messageCounter;
+		telemetry.samples = samples_to_send;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+
+		// Each record is sized to the samples that it holds.
+		telemetry.type = DEX_TLM_RECORDING_RECORD;
+		telemetry.first = 0;
+		int sample = 0;
+		while ( sample < samples ) {
+			float *data = telemetry.data;
+			telemetry.count = 0;
+			while ( sample < samples && telemetry.count < DEX_TLM_MAX_SAMPLES ) {
+				*data++ = (float) state[sample].time;
+				*data++ = (float) state[sample].position[X];
+				*data++ = (float) state[sample].position[Y];
+				*data++ = (float) state[sample].position[Z];
+				sample += skip;
+				telemetry.count++;
+			}
+			SendTelemetry( telemetry, DEX_NORMAL_PRIORITY );
+			telemetry.first += telemetry.count;
+		}
+
+		telemetry.type = DEX_TLM_RECORDING_END;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+
+		messageCounter++;
+		return;
+
+	}
 
 	// Send out on a data stream. Could be stdout or a pipe to another process.
 	sprintf( packet, "DEX_RECORDING_START %8u %d", messageCounter, samples_to_send );
-	SendPacket( packet );
+	SendPacket( packet, sizeof( packet ), DEX_HIGH_PRIORITY );
 		
 	// Send out a subset of samples to the UDP broadcast.
 	int sample = 0;
@@ -564,12 +811,12 @@ void DexMonitorServer::SendRecording( ManipulandumState state[], int samples, fl
 			samples_in_packet++;
 		}
 		sprintf( packet, "DEX_RECORDING_RECORD %8d", samples_in_packet );
-		SendPacket( packet );
+		SendPacket( packet, sizeof( packet ), DEX_NORMAL_PRIORITY );
 	}
 
 	// Signal that we are done on both streams.
 	sprintf( packet, "DEX_RECORDING_END %8u %d", messageCounter, samples_to_send );
-	SendPacket( packet );
+	SendPacket( packet, sizeof( packet ), DEX_HIGH_PRIORITY );
 	
 	messageCounter++;
 	
@@ -588,10 +835,21 @@ int DexMonitorServer::SendConfiguration( int nCodas, int nTargets,
 	
 	// Send a packet with the current state of the apparatus.
 	
-	sprintf( packet, "DEX_CONFIGURATION %8u %1d %2d [%d %d %d]", 
-		messageCounter, nCodas, nTargets, 
-		subjectPosture, targetBarConfig, tappingSurfaceConfig );
-	SendPacket( packet );
+	if ( protocol == DEX_BINARY_PROTOCOL ) {
+		telemetry.type = DEX_TLM_CONFIGURATION;
+		telemetry.codas = nCodas;
+		telemetry.nTargets = nTargets;
+		telemetry.posture = subjectPosture;
+		telemetry.targetBar = targetBarConfig;
+		telemetry.tappingSurface = tappingSurfaceConfig;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+	}
+	else {
+		sprintf( packet, "DEX_CONFIGURATION %8u %1d %2d [%d %d %d]", 
+			messageCounter, nCodas, nTargets, 
+			subjectPosture, targetBarConfig, tappingSurfaceConfig );
+		SendPacket( packet, sizeof( packet ), DEX_HIGH_PRIORITY );
+	}
 	
 	messageCounter++;
 	
@@ -608,14 +866,30 @@ int DexMonitorServer::SendState( bool acquisitionState, unsigned long targetStat
 	int exit_status = NORMAL_EXIT;
 	unsigned long bit = 0x01;
 	char packet[DEX_UDP_PACKET_SIZE];
-	
+
+	// Decide whether there is anything worth sending (see DexTelemetryFilterState()).
+	telemetry.type = DEX_TLM_STATE;
+	telemetry.acquisition = acquisitionState;
+	telemetry.targets = targetState;
+	telemetry.visibility = manipulandum_visibility;
+	for ( i = 0; i < 3; i++ ) telemetry.position[i] = (float) manipulandum_position[i];
+	for ( i = 0; i < 4; i++ ) telemetry.orientation[i] = (float) manipulandum_orientation[i];
+	if ( !DexTelemetryFilterState( &stateFilter, &telemetry, timeGetTime() ) ) return( exit_status );
+
 	// Send a packet with the current state of the apparatus.	
-	sprintf( packet, 
-		"DEX_STATE %8u (%1d) | 0x%08x | %1d < %.3f %.3f %.3f >  [ %.3f %.3f %.3f %.3f ] ", 
-		messageCounter, acquisitionState, targetState,
-		manipulandum_visibility, manipulandum_position[X],  manipulandum_position[Y],  manipulandum_position[Z],
-		manipulandum_orientation[X],  manipulandum_orientation[Y],  manipulandum_orientation[Z], manipulandum_orientation[M] );
-	SendPacket( packet );
+	if ( protocol == DEX_BINARY_PROTOCOL ) {
+		// In between keyframes, leave out whatever part of the pose has not moved.
+		// The acquisition, targets and visibility are in every packet.
+		SendTelemetry( telemetry, DEX_LOW_PRIORITY );
+	}
+	else {
+		sprintf( packet, 
+			"DEX_STATE %8u (%1d) | 0x%08x | %1d < %.3f %.3f %.3f >  [ %.3f %.3f %.3f %.3f ] ", 
+			messageCounter, acquisitionState, targetState,
+			manipulandum_visibility, manipulandum_position[X],  manipulandum_position[Y],  manipulandum_position[Z],
+			manipulandum_orientation[X],  manipulandum_orientation[Y],  manipulandum_orientation[Z], manipulandum_orientation[M] );
+		SendPacket( packet, sizeof( packet ), DEX_LOW_PRIORITY );
+	}
 	
 	messageCounter++;
 	
@@ -645,14 +919,22 @@ int DexMonitorServer::SendEvent( const char* format, ... ) {
 	sprintf( datestr, "%4d/%02d/%02d", newtime->tm_year + 1900, newtime->tm_mon + 1, newtime->tm_mday );
 	sprintf( timestr, "%02d:%02d:%02d", newtime->tm_hour, newtime->tm_min, newtime->tm_sec );
 	
+	// Take out any newlines.
+	for ( char *ptr = message; *ptr && ptr < message + sizeof( message ); ptr++ ) if ( *ptr == '\n' ) *ptr = '|';
+
 	// Create a timestamped event.
 	sprintf( packet, "DEX_EVENT %8u %s %s * %s", messageCounter, datestr, timestr, message );
-
-	// Take out any newlines.
-	for ( char *ptr = packet; *ptr && ptr < packet + sizeof( packet ); ptr++ ) if ( *ptr == '\n' ) *ptr = '|';
 	
 	// Broadcast the event.
-	SendPacket( packet );
+	if ( protocol == DEX_BINARY_PROTOCOL ) {
+		telemetry.type = DEX_TLM_EVENT;
+		telemetry.clock = ltime;
+		telemetry.length = strlen( message );
+		if ( telemetry.length > DEX_TLM_MAX_TEXT ) telemetry.length = DEX_TLM_MAX_TEXT;
+		memcpy( telemetry.text, message, telemetry.length );
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+	}
+	else SendPacket( packet, sizeof( packet ), DEX_HIGH_PRIORITY );
 
 	// Show it in the Debug window.
 	fOutputDebugString( "%s\n", packet );
@@ -671,27 +953,227 @@ int DexMonitorServer::SendEvent( const char* format, ... ) {
 void DexMonitorServer::Quit( void ) {
 	
 	char packet[DEX_UDP_PACKET_SIZE];
-	sprintf( packet, "DEX_QUIT\n" );
-	SendPacket( packet );
+
+	// The monitor stops listening when it gets the quit, so let 
+	// everything else get through first.
+	Flush();
+	if ( protocol == DEX_BINARY_PROTOCOL ) {
+		telemetry.type = DEX_TLM_QUIT;
+		SendTelemetry( telemetry, DEX_HIGH_PRIORITY );
+	}
+	else {
+		sprintf( packet, "DEX_QUIT\n" );
+		SendPacket( packet, sizeof( packet ), DEX_HIGH_PRIORITY );
+	}
+	Flush();
+	Close();
 	
 }
 
 /*********************************************************************************/
 
 // Send out packets via UDP, to be monitored on the ground.
+// The packets are queued and sent by a background thread, so that 
+// neither the subject nor the apparatus ever waits for the link.
+
+static DWORD WINAPI DexMonitorSenderThread( LPVOID param ) {
+	( (DexMonitorServerUDP *) param )->RunSender();
+	return( 0 );
+}
 
 DexMonitorServerUDP::DexMonitorServerUDP( int n_vertical_targets, int n_horizontal_targets, int n_codas ) {
 	
 	messageCounter = 0;
+	// The binary packets are sized to their contents, so there is much less to send.
+	protocol = DEX_BINARY_PROTOCOL;
 	DexUDPInitServer( &udp_parameters, NULL );
-	Sleep( 1000 );
+
+	DexSendQueueInit( &queue, DEX_UDP_RATE, DEX_UDP_BURST, timeGetTime() );
+	sentPackets = 0;
+	sentBytes = 0;
+	DexTelemetrySenderInit( &window );
+
+	InitializeCriticalSection( &queueLock );
+	queueEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+	stopSender = false;
+	senderThread = CreateThread( NULL, 0, DexMonitorSenderThread, this, 0, NULL );
 	
 }
 
-void DexMonitorServerUDP::SendPacket( const char *packet ) {
-	// Broadcast the event.
-	DexUDPSendPacket( &udp_parameters, packet );
-	Sleep( DEX_UDP_WAIT );
+void DexMonitorServerUDP::SetRateLimit( double bytes_per_second, double burst_bytes ) {
+	EnterCriticalSection( &queueLock );
+	DexSendQueueSetRate( &queue, bytes_per_second, burst_bytes );
+	LeaveCriticalSection( &queueLock );
+}
+
+void DexMonitorServerUDP::SimulateLoss( double fraction, unsigned long seed ) {
+	DexUDPSetLoss( &udp_parameters, fraction, seed );
+}
+
+bool DexMonitorServerUDP::LogPackets( const char *filename ) {
+	if ( DexUDPOpenLog( &udp_parameters, filename ) == 0 ) return( true );
+	fOutputDebugString( "DexMonitorServerUDP: Could not open %s to log the packets.\n", filename );
+	return( false );
+}
+
+// Queue a packet and return immediately.
+
+void DexMonitorServerUDP::SendPacket( const char *packet, int size, int priority ) {
+
+	if ( size < 0 ) return;
+	if ( size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+
+	EnterCriticalSection( &queueLock );
+
+	// Keep a copy of the reliable packets, even if they do not make it out 
+	// of the queue, so that they can be sent again when the monitor asks.
+	DexTelemetrySenderKeep( &window, (unsigned char *) packet, size );
+	DexSendQueuePut( &queue, packet, size, priority );
+
+	LeaveCriticalSection( &queueLock );
+	SetEvent( queueEvent );
+
+}
+
+// Send the queued packets in order, waiting for the bucket to hold 
+// enough tokens for each one. Whatever the bucket allows goes out in
+// one batch, so that the queue is locked once per batch, not per packet.
+
+void DexMonitorServerUDP::RunSender( void ) {
+
+	int slot[DEX_UDP_BATCH], size[DEX_UDP_BATCH];
+	const char *data[DEX_UDP_BATCH];
+	int n, bytes, i;
+	unsigned long wait;
+	DexTelemetryMessage header;
+
+	while ( !stopSender ) {
+
+		// Keep an ear out for the monitor, even when there is nothing to send.
+		if ( reliable && sentPackets > 0 ) ServiceReplies();
+
+		EnterCriticalSection( &queueLock );
+		n = DexSendQueueTake( &queue, timeGetTime(), slot, DEX_UDP_BATCH, &wait );
+		LeaveCriticalSection( &queueLock );
+		if ( n == 0 ) {
+			// New packets also wake us up, in case they replace the one at the head.
+			if ( wait == 0 ) wait = ( reliable ? DEX_UDP_REPLY_POLL : INFINITE );
+			else if ( reliable && wait > DEX_UDP_REPLY_POLL ) wait = DEX_UDP_REPLY_POLL;
+			WaitForSingleObject( queueEvent, wait );
+			continue;
+		}
+
+		// The slots that were taken are out of the queue until they are released.
+		for ( i = 0, bytes = 0; i < n; i++ ) {
+			data[i] = queue.slot[slot[i]].data;
+			size[i] = queue.slot[slot[i]].size;
+			bytes += size[i];
+		}
+		DexUDPSendPackets( &udp_parameters, data, size, n );
+		sentPackets += n;
+		sentBytes += bytes;
+		for ( i = 0; i < n; i++ ) {
+			if ( DexTelemetryDecodeHeader( (unsigned char *) data[i], size[i], &header ) > 0 
+				&& ( header.flags & DEX_TLM_RELIABLE ) ) break;
+		}
+
+		// The window, like the queue, is only touched under the lock.
+		EnterCriticalSection( &queueLock );
+		if ( i < n ) window.lastTime = timeGetTime();
+		DexSendQueueRelease( &queue, slot, n );
+		LeaveCriticalSection( &queueLock );
+
+	}
+
+}
+
+// Queue a reliable packet again, if we still have it.
+// This is called by the sender thread.
+
+void DexMonitorServerUDP::Retransmit( unsigned long sequence ) {
+
+	char packet[DEX_TLM_MAX_PACKET_SIZE];
+	int size;
+
+	EnterCriticalSection( &queueLock );
+	size = DexTelemetrySenderCopy( &window, sequence, (unsigned char *) packet );
+	LeaveCriticalSection( &queueLock );
+
+	if ( size > 0 ) SendPacket( packet, size, DEX_NORMAL_PRIORITY );
+
+}
+
+// Handle the NACKs and ACKs sent back by the monitor.
+
+void DexMonitorServerUDP::ServiceReplies( void ) {
+
+	char reply[DEX_UDP_PACKET_SIZE];
+	DexTelemetryMessage message;
+	unsigned long sequence;
+	int size, i, probe;
+
+	while ( ( size = DexUDPGetReply( &udp_parameters, reply ) ) > 0 ) {
+		if ( DexTelemetryDecode( (unsigned char *) reply, size, &message ) <= 0 ) continue;
+		if ( message.type == DEX_TLM_NACK ) {
+			for ( i = 0; i < message.nNacks; i++ ) Retransmit( message.nack[i] );
+		}
+		else if ( message.type == DEX_TLM_ACK ) {
+			EnterCriticalSection( &queueLock );
+			DexTelemetrySenderAcknowledge( &window, &message );
+			LeaveCriticalSection( &queueLock );
+		}
+	}
+
+	// If the end of the last recording was lost, the monitor does not know 
+	// that anything is missing. Send it again until it is acknowledged.
+	EnterCriticalSection( &queueLock );
+	probe = DexTelemetrySenderProbe( &window, timeGetTime(), queue.nQueued == 0, &sequence );
+	LeaveCriticalSection( &queueLock );
+	if ( probe ) Retransmit( sequence );
+
+}
+
+// Give the queue a chance to empty and the monitor a chance to 
+// ask for whatever it missed.
+
+void DexMonitorServerUDP::Flush( void ) {
+
+	unsigned long start = timeGetTime();
+	int pending;
+
+	do {
+		EnterCriticalSection( &queueLock );
+		// Slots that are neither queued nor free are being sent.
+		pending = DEX_SEND_QUEUE_LENGTH - queue.nFree;
+		if ( reliable && DexTelemetrySenderPending( &window ) ) pending++;
+		LeaveCriticalSection( &queueLock );
+		if ( pending ) Sleep( 10 );
+	} while ( pending && timeGetTime() - start < DEX_UDP_FLUSH_TIMEOUT );
+
+}
+
+// Stop the sender.
+
+void DexMonitorServerUDP::Close( void ) {
+
+	// The sender looks at the flag on every pass and never waits long without 
+	// the event, so it will stop. It has to have stopped before the lock, the 
+	// event and the log go away under it.
+	stopSender = true;
+	SetEvent( queueEvent );
+	WaitForSingleObject( senderThread, INFINITE );
+	CloseHandle( senderThread );
+	DexUDPCloseLog( &udp_parameters );
+	CloseHandle( queueEvent );
+	DeleteCriticalSection( &queueLock );
+
+	fOutputDebugString( "DexMonitorServerUDP: %lu packets (%lu bytes) sent, %lu states replaced, dropped %lu %lu %lu (low normal high).\n",
+		sentPackets, sentBytes, queue.replaced, 
+		queue.dropped[DEX_LOW_PRIORITY], queue.dropped[DEX_NORMAL_PRIORITY], queue.dropped[DEX_HIGH_PRIORITY] );
+	fOutputDebugString( "DexMonitorServerUDP: %lu states did not need to be sent.\n", stateFilter.suppressed );
+	if ( reliable ) fOutputDebugString( "DexMonitorServerUDP: %lu packets retransmitted, %lu recordings acknowledged.\n",
+		window.retransmitted, window.completed );
+
 }
 
 /*********************************************************************************/
@@ -700,7 +1182,7 @@ void DexMonitorServerUDP::SendPacket( const char *packet ) {
 
 DexMonitorServerGUI::DexMonitorServerGUI( int n_vertical_targets, int n_horizontal_targets, int n_codas ) {}
 
-void DexMonitorServerGUI::SendPacket( const char *packet ) {
+void DexMonitorServerGUI::SendPacket( const char *packet, int size, int priority ) {
 	// Broadcast the event.
 	DexAddToLogGUI( packet );
 }
@@ -717,9 +1199,39 @@ DexMonitorServerPIPE::DexMonitorServerPIPE( int n_vertical_targets, int n_horizo
 		
 }
 
-void DexMonitorServerPIPE::SendPacket( const char *packet ) {
+void DexMonitorServerPIPE::SendPacket( const char *packet, int size, int priority ) {
 	// Broadcast the event.
 	fprintf( fp, "%s\n", packet );
 	fflush( fp );
 }
 
+/*********************************************************************************/
+
+// Publish the packets in shared memory for local readers.
+
+DexMonitorServerSHM::DexMonitorServerSHM( int n_vertical_targets, int n_horizontal_targets, int n_codas,
+										  const char *name, int slots ) {
+
+	// Same as over UDP. The readers decode them with DexTelemetryDecode().
+	protocol = DEX_BINARY_PROTOCOL;
+	publishedPackets = 0;
+	published = ( DexSHMInitServer( &shm_parameters, name, slots ) == 0 );
+	if ( !published ) fOutputDebugString( "DexMonitorServerSHM: Could not create %s.\n", name );
+
+}
+
+void DexMonitorServerSHM::SendPacket( const char *packet, int size, int priority ) {
+	// Every packet goes into the ring, whatever its priority. 
+	// A reader that cannot keep up loses the oldest ones.
+	if ( !published ) return;
+	DexSHMPublish( &shm_parameters, packet, size );
+	publishedPackets++;
+}
+
+void DexMonitorServerSHM::Close( void ) {
+	if ( !published ) return;
+	published = false;
+	DexSHMClose( &shm_parameters );
+	fOutputDebugString( "DexMonitorServerSHM: %lu packets published.\n", publishedPackets );
+}
+
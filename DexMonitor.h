@@ -11,6 +11,18 @@
 #ifndef DexMonitorH
 #define DexMonitorH
 
+// Messages decoded by the receive thread and waiting to be displayed. 
+// Enough to hold a full second at the server's highest rate: DEX_UDP_RATE
+// allows 28 packets of DEX_UDP_PACKET_SIZE per second, and the state updates
+// come at most every DEX_STATE_INTERVAL (20 per second), which leaves room
+// for the events. Beyond that, the receive thread waits for the display.
+#define DEX_MONITOR_INBOX	64
+// How long the receive thread waits for a packet before it checks on the 
+// reliable ones that are missing (ms).
+#define DEX_MONITOR_POLL	20
+// Time between two refreshes of the display (ms).
+#define DEX_MONITOR_REFRESH	100
+
 class DexMonitor {
 
 private:
@@ -31,6 +43,16 @@ private:
 	int nCodas;
 
 	bool missed_frames;
+	// Recording being received in binary packets and how many samples arrived.
+	unsigned long	recordingID;
+	int				recordingSamples;
+	int				nReceivedFrames;
+	// Which of the reliable packets have arrived, and copies of the protected
+	// ones to rebuild a lost one from the parity. See DexTelemetry.h.
+	DexTelemetryReceiver	link;
+	DexTelemetryRepair		repair;
+	// Samples of the last full resolution record, as in DexTelemetryMessage.data[].
+	float			unpacked[DEX_TLM_MAX_PACKED * DEX_TLM_FLOATS_PER_SAMPLE];
 
 	float targetPosition[DEX_MAX_TARGETS][3];
 
@@ -38,6 +60,29 @@ private:
 	void Plot( void );
 
 	DexUDP udp_parameters;
+	DexUDPPacket received[DEX_UDP_BATCH];
+	DexTelemetryMessage	telemetry;
+
+	// Packets are read and decoded by a thread of their own, so that none are 
+	// lost on the socket while the display is being drawn. The decoded messages
+	// are handed over through inbox[]. Only the receive thread moves inboxTail
+	// and only the display moves inboxHead, so no lock is needed.
+	DexTelemetryMessage	inbox[DEX_MONITOR_INBOX];
+	volatile long		inboxHead;
+	volatile long		inboxTail;
+	unsigned long		inboxFull;		// Times the receive thread had to wait for the display.
+	unsigned long		badPackets;		// Text packets with a field that could not be read.
+	HANDLE				receiveThread;
+	volatile bool		stopReceiving;
+
+	// Where the text records go in the recording being received.
+	unsigned long	textRecording;
+	int				textFrames;
+
+	int  DecodePacket( char *packet, int size, DexTelemetryMessage &message );
+	void ReceivePacket( char *packet, int size );
+	DexTelemetryMessage *NextInboxSlot( void );
+	void PostInboxSlot( void );
 
 
 protected:
@@ -72,7 +117,10 @@ public:
 	int  Update( void );
 	void RunWindow( void );
 	void ParseInputStream( FILE *fp );
-	void ParseInputPacket( char *packet );
+	void ParseInputPacket( char *packet, int size );
+	void ParseTelemetry( DexTelemetryMessage &message );
+	void RunReceiver( void );
+	bool LogPackets( const char *filename );
 
 	
 };
@@ -7,8 +7,28 @@
 #pragma once
 
 #include <DexUDPServices.h>
+#include <DexSHMServices.h>
+#include <DexTelemetry.h>
+#include <DexSendQueue.h>
 #include <Dexterous.h>
 
+// The packets can be sent as text (the original format) or in the binary 
+// format defined in DexTelemetry.h. The monitor understands both.
+typedef enum { DEX_TEXT_PROTOCOL, DEX_BINARY_PROTOCOL } DexMonitorProtocol;
+
+// How badly a packet needs to get through when the link is saturated
+// (DEX_LOW_PRIORITY etc.) is defined with the send queue in DexSendQueue.h.
+
+// State updates are only sent when something has changed. The pose has to move
+// by more than a deadband, and pose changes go out at most once per interval (ms).
+// Changes to the acquisition, targets or visibility are sent right away. A full
+// state goes out every keyframe interval (ms) even if nothing has moved, so that the 
+// ground display is never more than that far behind.
+#define DEX_STATE_POSITION_DEADBAND		1.0		// mm
+#define DEX_STATE_ORIENTATION_DEADBAND	0.002	// Quaternion components.
+#define DEX_STATE_INTERVAL				50
+#define DEX_STATE_KEYFRAME				1000
+
 class DexMonitorServer {
 
 private:
@@ -17,14 +37,46 @@ protected:
 
 	// Count the number of messages sent out;
 	unsigned long		messageCounter;
+	// Count every binary packet, so that the receiver can detect losses.
+	unsigned long		packetCounter;
+	// The packets that have to get through are counted separately (see DexTelemetry.h).
+	unsigned long		reliableCounter;
+	// Binary packets are time stamped relative to this (ms).
+	unsigned long		startTime;
+
+	DexTelemetryMessage	telemetry;
+	// Parity for the block of recording packets being sent.
+	DexTelemetryMessage	parity;
+	void SendTelemetry( DexTelemetryMessage &message, int priority );
 
 public:
 
+	DexMonitorProtocol	protocol;
+	// Have the recordings retransmitted when packets are lost. This only works
+	// in the binary protocol, with a server that can hear back from the monitor.
+	bool				reliable;
+	// Send a parity packet after every parityBlock recording packets (and at the end 
+	// of each recording), so that the monitor can rebuild one lost packet per block
+	// without asking for it. The overhead is one packet in parityBlock. Zero turns it off.
+	int					parityBlock;
+	// Send every sample of the recordings, delta coded, rather than a subset of 
+	// them as floats. Only for the binary protocol. See DexTelemetry.h.
+	bool				fullResolution;
+	// Deadbands, rate and keyframe interval for the state updates (see above),
+	// what went out last and how many calls to SendState() did not need to send
+	// anything. Setting the deadbands and intervals to zero sends every state, as before.
+	DexTelemetryStateFilter	stateFilter;
+
 	DexMonitorServer( int vertical_targets = N_VERTICAL_TARGETS, 
 					  int horizontal_targets = N_HORIZONTAL_TARGETS,
 					  int codas = N_CODAS );
 	void Quit( void );
-	virtual void SendPacket( const char *packet ) = NULL;
+	// Text packets are null terminated, but the size is given for both formats.
+	virtual void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY ) = NULL;
+	// Wait for any packets still queued to go out.
+	virtual void Flush( void );
+	// Stop sending for good.
+	virtual void Close( void );
 
 	int SendState( bool acquisitionState, unsigned long targetState, 
 									 bool manipulandum_visibility, 
@@ -41,6 +93,11 @@ public:
 
 };
 
+// How long Flush() will wait for the queue to empty (ms).
+#define DEX_UDP_FLUSH_TIMEOUT	5000
+// How often the sender listens for NACKs when it has nothing to send (ms).
+#define DEX_UDP_REPLY_POLL		20
+
 class DexMonitorServerUDP : public DexMonitorServer {
 
 private:
@@ -48,15 +105,48 @@ private:
 	// A data structure containing parameters for the UDP broadcast.
 	DexUDP udp_parameters;
 
+	// SendPacket() only queues the packets. A background thread sends them 
+	// out in order under a token bucket rate limit (see DexSendQueue.h).
+	DexSendQueue		queue;
+	CRITICAL_SECTION	queueLock;
+	HANDLE				queueEvent;
+	HANDLE				senderThread;
+	volatile bool		stopSender;
+
+	// The last DEX_TLM_WINDOW reliable packets and what the monitor has acknowledged
+	// (see DexTelemetry.h). It is shared with SendPacket() under the queue lock.
+	DexTelemetrySender	window;
+
+	void Retransmit( unsigned long sequence );
+	void ServiceReplies( void );
+
 protected:
 
 public:
 
+	// What happened to the packets.
+	unsigned long		sentPackets;
+	unsigned long		sentBytes;
 
 	DexMonitorServerUDP( int vertical_targets = N_VERTICAL_TARGETS, 
 					  int horizontal_targets = N_HORIZONTAL_TARGETS,
 					  int codas = N_CODAS );
-	void SendPacket( const char *packet );
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY );
+	void Flush( void );
+	void Close( void );
+
+	// Average rate (bytes per second) and largest burst (bytes). 
+	// A rate of zero sends as fast as possible.
+	void SetRateLimit( double bytes_per_second, double burst_bytes );
+
+	// Throw away a fraction of the packets, to test the monitor over loopback.
+	void SimulateLoss( double fraction, unsigned long seed = 1 );
+
+	// Append every packet sent from here on to a log that DexTelemetryReplay can play back.
+	bool LogPackets( const char *filename );
+
+	// Called by the sender thread.
+	void RunSender( void );
 
 };
 
@@ -72,7 +162,7 @@ public:
 	DexMonitorServerGUI( int vertical_targets = N_VERTICAL_TARGETS, 
 					  int horizontal_targets = N_HORIZONTAL_TARGETS,
 					  int codas = N_CODAS );
-	void SendPacket( const char *packet );
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY );
 
 };
 
@@ -91,6 +181,32 @@ public:
 	DexMonitorServerPIPE( int vertical_targets = N_VERTICAL_TARGETS, 
 					  int horizontal_targets = N_HORIZONTAL_TARGETS,
 					  int codas = N_CODAS );
-	void SendPacket( const char *packet );
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY );
+
+};
+
+// Publish the packets in a ring in shared memory (see DexSHMServices.h), where any 
+// number of programs on the same machine can read them at their own pace. 
+// Nothing waits for the readers, so there is no need for a send queue.
+class DexMonitorServerSHM : public DexMonitorServer {
+
+private:
+
+	DexSHM			shm_parameters;
+	bool			published;
+
+protected:
+
+public:
+
+	unsigned long	publishedPackets;
+
+	DexMonitorServerSHM( int vertical_targets = N_VERTICAL_TARGETS, 
+					  int horizontal_targets = N_HORIZONTAL_TARGETS,
+					  int codas = N_CODAS,
+					  const char *name = DEX_SHM_DEFAULT_NAME,
+					  int slots = DEX_SHM_SLOTS );
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY );
+	void Close( void );
 
 };
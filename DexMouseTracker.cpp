@@ -106,6 +106,8 @@ void DexMouseTracker::GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &ro
 
 int DexMouseTracker::PerformAlignment ( int origin, int x_negative, int x_positive, int xy_negative, int xy_positive ) {
 
+	InvalidateUnitTransforms();
+
 	// Normally one would fill a record with the marker assignments
 	// for the CODA marker alignment procedure, then execute it.
 	// It should return any errors reported by the CODA.
@@ -387,6 +389,13 @@ bool DexMouseTracker::GetCurrentMarkerFrameUnit( CodaFrame &frame, int unit ) {
 
 int DexMouseTracker::Update( void ) {
 
+	// The simulated unit transforms depend on the state of the dialog.
+	// Changing it is like moving the units, so the cached transforms are no good.
+	int placement = SendDlgItemMessage( dlg, IDC_ALIGNMENT, CB_GETCURSEL, 0, 0 ) * 4
+		+ IsDlgButtonChecked( dlg, IDC_CODA_SWAPPED ) * 2 + IsDlgButtonChecked( dlg, IDC_CODA_MIRRORED );
+	if ( placement != simulatedPlacement ) InvalidateUnitTransforms();
+	simulatedPlacement = placement;
+
 	// Store the time series of data.
 	if ( DexTimerTimeout( acquisitionTimer ) ) {
 		acquisitionOn = false;
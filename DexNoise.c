@@ -0,0 +1,29 @@
+/*
+* File:	DexNoise.c
+* Author:	J. McIntyre
+* Rev:		-
+* Desc:	Reproducible random numbers for the synthetic devices. See DexNoise.h.
+*/
+#include <math.h>
+
+#include "DexNoise.h"
+
+#define PI	3.14159265358979
+
+unsigned long DexHash( unsigned long x ) {
+	x &= 0xffffffffUL;
+	x ^= x >> 16;
+	x = ( x * 0x7feb352dUL ) & 0xffffffffUL;
+	x ^= x >> 15;
+	x = ( x * 0x846ca68bUL ) & 0xffffffffUL;
+	x ^= x >> 16;
+	return( x );
+}
+
+double DexHashUniform( unsigned long h ) {
+	return( ( (double) ( h & 0xffffffffUL ) + 0.5 ) / 4294967296.0 );
+}
+
+double DexHashGaussian( unsigned long h1, unsigned long h2 ) {
+	return( sqrt( -2.0 * log( DexHashUniform( h1 ) ) ) * cos( 2.0 * PI * DexHashUniform( h2 ) ) );
+}
@@ -0,0 +1,33 @@
+/*
+ * File:	DexNoise.h
+ * Author:	J. McIntyre
+ */
+
+/*
+ * Reproducible random numbers for the synthetic devices. Each value is a hash
+ * of the seed and of where it is used (sample, channel, marker ...), so that
+ * the data at a given time do not depend on the order in which they are
+ * generated.
+ */
+
+#ifndef _DexNoise_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 32 bit integer hash. Only the low 32 bits of x are used. */
+unsigned long DexHash( unsigned long x );
+
+/* Map a hash to a uniform value in ]0, 1[. */
+double DexHashUniform( unsigned long h );
+
+/* Gaussian with unit variance from two independent hashes (Box-Muller). */
+double DexHashGaussian( unsigned long h1, unsigned long h2 );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _DexNoise_
+#endif
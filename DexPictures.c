@@ -0,0 +1,454 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                  DexPictures.c                                */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+ * A portable .bmp decoder and a cache of decoded, pre-scaled pictures.
+ * ShowStatus() and IllustratedMessageBox() used to read and rescale the
+ * picture from disk with LoadImage() on every call. Now each picture is
+ * decoded once, ideally when the session is loaded, and a change of
+ * status is just a matter of handing over the cached bitmap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "DexPictures.h"
+
+/*********************************************************************************/
+
+// The .bmp format is little-endian, whatever machine we are on.
+
+static unsigned long get_long( const unsigned char *ptr ) {
+	return( (unsigned long) ptr[0] | ( (unsigned long) ptr[1] << 8 ) | ( (unsigned long) ptr[2] << 16 ) | ( (unsigned long) ptr[3] << 24 ) );
+}
+
+// Sizes are signed 32-bit values, whatever the size of a long.
+static long get_signed_long( const unsigned char *ptr ) {
+	unsigned long value = get_long( ptr );
+	if ( value & 0x80000000UL ) return( - (long) ( ~value & 0x7fffffffUL ) - 1 );
+	return( (long) value );
+}
+
+static unsigned short get_short( const unsigned char *ptr ) {
+	return( (unsigned short) ( ptr[0] | ( ptr[1] << 8 ) ) );
+}
+
+// Read a .bmp file into 32-bit pixels.
+// Handles the uncompressed 1, 4, 8, 16, 24 and 32 bit formats, which covers
+// what paint programs normally write. Returns 0 on success, -1 otherwise.
+
+int DexReadPicture( DexPicture *picture, const char *filename ) {
+
+	FILE			*fp;
+	unsigned char	*data;
+	unsigned char	*row;
+	unsigned long	palette[256];
+	long			file_size;
+	unsigned long	offset, header_size, compression, colors, available, stride;
+	long			width, height;
+	int				bits, top_down;
+	int				x, y, i, index;
+	unsigned short	word;
+
+	picture->width = 0;
+	picture->height = 0;
+	picture->pixels = NULL;
+
+	fp = fopen( filename, "rb" );
+	if ( !fp ) return( -1 );
+	fseek( fp, 0, SEEK_END );
+	file_size = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+	if ( file_size < 54 ) {
+		fclose( fp );
+		return( -1 );
+	}
+	data = (unsigned char *) malloc( file_size );
+	if ( !data ) {
+		fclose( fp );
+		return( -1 );
+	}
+	if ( fread( data, 1, file_size, fp ) != (size_t) file_size ) {
+		free( data );
+		fclose( fp );
+		return( -1 );
+	}
+	fclose( fp );
+
+	// BITMAPFILEHEADER followed by at least a BITMAPINFOHEADER.
+	offset = get_long( data + 10 );
+	header_size = get_long( data + 14 );
+	width = get_signed_long( data + 18 );
+	height = get_signed_long( data + 22 );
+	bits = get_short( data + 28 );
+	compression = get_long( data + 30 );
+	colors = get_long( data + 46 );
+	if ( data[0] != 'B' || data[1] != 'M' || header_size < 40 || width <= 0 || height == 0 ) {
+		free( data );
+		return( -1 );
+	}
+	// A negative height means that the top row comes first.
+	top_down = ( height < 0 );
+	if ( top_down ) height = - height;
+	// BI_RGB only, or BI_BITFIELDS if it is the default 32-bit layout.
+	if ( compression != 0 && !( compression == 3 && bits == 32 ) ) {
+		free( data );
+		return( -1 );
+	}
+	if ( bits != 1 && bits != 4 && bits != 8 && bits != 16 && bits != 24 && bits != 32 ) {
+		free( data );
+		return( -1 );
+	}
+	// Rows are padded to a multiple of 4 bytes. The sizes in the header can be
+	// anything, so they are checked against what the file holds by division,
+	// before anything is multiplied with them.
+	if ( offset > (unsigned long) file_size ) {
+		free( data );
+		return( -1 );
+	}
+	available = (unsigned long) file_size - offset;
+	if ( (unsigned long) width / 32 > available / ( 4 * bits ) ) {
+		free( data );
+		return( -1 );
+	}
+	stride = ( (unsigned long) width / 32 ) * 4 * bits + ( ( ( width % 32 ) * bits + 31 ) / 32 ) * 4;
+	if ( (unsigned long) height > available / stride
+		|| (unsigned long) height > ( (size_t) -1 / sizeof( unsigned long ) ) / width ) {
+		free( data );
+		return( -1 );
+	}
+
+	// The palette follows the info header.
+	if ( bits <= 8 ) {
+		if ( colors == 0 || colors > (unsigned long) ( 1 << bits ) ) colors = 1 << bits;
+		for ( i = 0; i < 256; i++ ) palette[i] = 0;
+		for ( i = 0; i < (int) colors && 14 + header_size + 4 * i + 4 <= offset; i++ ) {
+			palette[i] = get_long( data + 14 + header_size + 4 * i ) & 0x00ffffff;
+		}
+	}
+
+	picture->pixels = (unsigned long *) malloc( (size_t) width * height * sizeof( unsigned long ) );
+	if ( !picture->pixels ) {
+		free( data );
+		return( -1 );
+	}
+	picture->width = width;
+	picture->height = height;
+
+	for ( y = 0; y < height; y++ ) {
+		// We store bottom-up, like the file normally does.
+		row = data + offset + stride * ( top_down ? height - 1 - y : y );
+		for ( x = 0; x < width; x++ ) {
+			switch ( bits ) {
+			case 1:
+				index = ( row[x >> 3] >> ( 7 - ( x & 7 ) ) ) & 0x01;
+				picture->pixels[y * width + x] = palette[index];
+				break;
+			case 4:
+				index = ( row[x >> 1] >> ( ( x & 1 ) ? 0 : 4 ) ) & 0x0f;
+				picture->pixels[y * width + x] = palette[index];
+				break;
+			case 8:
+				picture->pixels[y * width + x] = palette[row[x]];
+				break;
+			case 16:
+				// 5-5-5, expanded to 8 bits per component.
+				word = get_short( row + 2 * x );
+				picture->pixels[y * width + x] =
+					( (unsigned long) ( ( word >> 10 ) & 0x1f ) * 255 / 31 ) << 16 |
+					( (unsigned long) ( ( word >> 5 ) & 0x1f ) * 255 / 31 ) << 8 |
+					( (unsigned long) ( word & 0x1f ) * 255 / 31 );
+				break;
+			case 24:
+				picture->pixels[y * width + x] =
+					( (unsigned long) row[3 * x + 2] << 16 ) | ( (unsigned long) row[3 * x + 1] << 8 ) | row[3 * x];
+				break;
+			case 32:
+				picture->pixels[y * width + x] = get_long( row + 4 * x ) & 0x00ffffff;
+				break;
+			}
+		}
+	}
+
+	free( data );
+	return( 0 );
+
+}
+
+// Resample a picture to the given size, interpolating bilinearly between the source pixels.
+
+int DexScalePicture( DexPicture *result, const DexPicture *source, int width, int height ) {
+
+	double	sx, sy, fx, fy;
+	int		x, y, x0, y0, x1, y1, shift;
+	unsigned long	p00, p01, p10, p11;
+	double	c;
+	unsigned long	pixel;
+
+	result->width = 0;
+	result->height = 0;
+	result->pixels = (unsigned long *) malloc( width * height * sizeof( unsigned long ) );
+	if ( !result->pixels ) return( -1 );
+	result->width = width;
+	result->height = height;
+
+	for ( y = 0; y < height; y++ ) {
+		// Map pixel centers onto pixel centers.
+		sy = ( y + 0.5 ) * source->height / (double) height - 0.5;
+		if ( sy < 0.0 ) sy = 0.0;
+		y0 = (int) sy;
+		y1 = ( y0 + 1 < source->height ? y0 + 1 : y0 );
+		fy = sy - y0;
+		for ( x = 0; x < width; x++ ) {
+			sx = ( x + 0.5 ) * source->width / (double) width - 0.5;
+			if ( sx < 0.0 ) sx = 0.0;
+			x0 = (int) sx;
+			x1 = ( x0 + 1 < source->width ? x0 + 1 : x0 );
+			fx = sx - x0;
+			p00 = source->pixels[y0 * source->width + x0];
+			p01 = source->pixels[y0 * source->width + x1];
+			p10 = source->pixels[y1 * source->width + x0];
+			p11 = source->pixels[y1 * source->width + x1];
+			pixel = 0;
+			for ( shift = 0; shift <= 16; shift += 8 ) {
+				c = ( 1.0 - fy ) * ( ( 1.0 - fx ) * ( ( p00 >> shift ) & 0xff ) + fx * ( ( p01 >> shift ) & 0xff ) ) +
+					fy * ( ( 1.0 - fx ) * ( ( p10 >> shift ) & 0xff ) + fx * ( ( p11 >> shift ) & 0xff ) );
+				pixel |= ( (unsigned long) ( c + 0.5 ) & 0xff ) << shift;
+			}
+			result->pixels[y * width + x] = pixel;
+		}
+	}
+
+	return( 0 );
+
+}
+
+void DexFreePicture( DexPicture *picture ) {
+	if ( picture->pixels ) free( picture->pixels );
+	picture->pixels = NULL;
+	picture->width = 0;
+	picture->height = 0;
+}
+
+/*********************************************************************************/
+
+// The cache itself. The pictures are few and the lookups are rare on the
+// scale of a computer, so a linear search is all that is needed.
+
+static DexPictureCacheEntry	cacheEntry[DEX_PICTURE_CACHE_ENTRIES];
+static DexPictureCacheStats	cacheStats;
+static char			cachePrefix[DEX_PICTURE_NAME_LENGTH] = "";
+static int			cacheWidth = DEX_PICTURE_WIDTH;
+static int			cacheHeight = DEX_PICTURE_HEIGHT;
+static unsigned long	cacheMaxBytes = DEX_PICTURE_CACHE_BYTES;
+static unsigned long	cacheClock = 0;
+static void			(*cacheRelease)( void *handle ) = NULL;
+
+// Seconds on a high resolution clock, to compare hits with reads from disk.
+static double cache_time( void ) {
+#ifdef WIN32
+	LARGE_INTEGER	count, frequency;
+	QueryPerformanceCounter( &count );
+	QueryPerformanceFrequency( &frequency );
+	return( (double) count.QuadPart / (double) frequency.QuadPart );
+#else
+	struct timeval	tv;
+	gettimeofday( &tv, NULL );
+	return( tv.tv_sec + tv.tv_usec * 1.0e-6 );
+#endif
+}
+
+static void release_entry( DexPictureCacheEntry *entry ) {
+	if ( entry->handle && cacheRelease ) (*cacheRelease)( entry->handle );
+	entry->handle = NULL;
+	entry->pins = 0;
+	DexFreePicture( &entry->picture );
+	cacheStats.bytes -= entry->bytes;
+	cacheStats.entries--;
+	entry->bytes = 0;
+	entry->name[0] = 0;
+}
+
+// The prefix is put in front of each picture name to find the file.
+// Pictures are scaled to width x height, unless width is 0.
+// The release routine is called to free the platform bitmap when an entry is evicted.
+
+void DexPictureCacheInit( const char *prefix, int width, int height, unsigned long max_bytes, void (*release)( void *handle ) ) {
+
+	DexFlushPictureCache();
+	strncpy( cachePrefix, prefix, sizeof( cachePrefix ) );
+	cachePrefix[sizeof( cachePrefix ) - 1] = 0;
+	cacheWidth = width;
+	cacheHeight = height;
+	cacheMaxBytes = max_bytes;
+	cacheRelease = release;
+	memset( &cacheStats, 0, sizeof( cacheStats ) );
+
+}
+
+void DexFlushPictureCache( void ) {
+	int i;
+	for ( i = 0; i < DEX_PICTURE_CACHE_ENTRIES; i++ ) {
+		if ( cacheEntry[i].name[0] ) release_entry( &cacheEntry[i] );
+	}
+}
+
+// Find a picture in the cache, or read it in if it is not there yet.
+// Returns NULL if the picture cannot be read.
+
+DexPictureCacheEntry *DexGetCachedPicture( const char *name ) {
+
+	DexPictureCacheEntry	*entry, *oldest;
+	DexPicture		decoded;
+	char			filename[2 * DEX_PICTURE_NAME_LENGTH];
+	double			start = cache_time();
+	int				i, free_slot;
+
+	for ( i = 0; i < DEX_PICTURE_CACHE_ENTRIES; i++ ) {
+		if ( cacheEntry[i].name[0] && !strcmp( cacheEntry[i].name, name ) ) {
+			cacheEntry[i].last_used = ++cacheClock;
+			cacheStats.hits++;
+			cacheStats.hit_time += cache_time() - start;
+			return( &cacheEntry[i] );
+		}
+	}
+
+	// Not there. Read it from disk.
+	if ( strlen( name ) >= DEX_PICTURE_NAME_LENGTH ) return( NULL );
+	sprintf( filename, "%s%s", cachePrefix, name );
+	if ( DexReadPicture( &decoded, filename ) ) {
+		cacheStats.failures++;
+		return( NULL );
+	}
+	if ( cacheWidth > 0 && ( decoded.width != cacheWidth || decoded.height != cacheHeight ) ) {
+		DexPicture scaled;
+		if ( DexScalePicture( &scaled, &decoded, cacheWidth, cacheHeight ) ) {
+			DexFreePicture( &decoded );
+			cacheStats.failures++;
+			return( NULL );
+		}
+		DexFreePicture( &decoded );
+		decoded = scaled;
+	}
+
+	// Make room, evicting the least recently used pictures. Those that are
+	// pinned are on the screen, and their bitmaps must stay, so we leave them alone.
+	for ( ; ; ) {
+		free_slot = -1;
+		oldest = NULL;
+		for ( i = 0; i < DEX_PICTURE_CACHE_ENTRIES; i++ ) {
+			if ( !cacheEntry[i].name[0] ) {
+				if ( free_slot < 0 ) free_slot = i;
+			}
+			else if ( cacheEntry[i].pins == 0 && ( !oldest || cacheEntry[i].last_used < oldest->last_used ) ) oldest = &cacheEntry[i];
+		}
+		if ( free_slot >= 0 && cacheStats.bytes + decoded.width * decoded.height * sizeof( unsigned long ) <= cacheMaxBytes ) break;
+		if ( !oldest ) break;
+		release_entry( oldest );
+		cacheStats.evictions++;
+	}
+	if ( free_slot < 0 ) {
+		DexFreePicture( &decoded );
+		cacheStats.failures++;
+		return( NULL );
+	}
+
+	entry = &cacheEntry[free_slot];
+	strcpy( entry->name, name );
+	entry->picture = decoded;
+	entry->handle = NULL;
+	entry->pins = 0;
+	entry->bytes = decoded.width * decoded.height * sizeof( unsigned long );
+	entry->last_used = ++cacheClock;
+	cacheStats.bytes += entry->bytes;
+	cacheStats.entries++;
+	cacheStats.misses++;
+	cacheStats.miss_time += cache_time() - start;
+	return( entry );
+
+}
+
+// Keep a picture in the cache for as long as it is shown.
+// Each pin must be matched by an unpin.
+
+void DexPinCachedPicture( DexPictureCacheEntry *entry ) {
+	entry->pins++;
+}
+
+void DexUnpinCachedPicture( DexPictureCacheEntry *entry ) {
+	if ( entry->pins > 0 ) entry->pins--;
+}
+
+// Read in all the pictures referred to by a script, so that they are ready
+// before the subject sees them. Scripts that refer to other scripts (sessions,
+// protocols) are followed down to the tasks. Stops when the cache is full,
+// so that we do not evict what we have just loaded.
+// Returns the number of pictures that are in the cache.
+
+// Does the name end with the given extension, ignoring case?
+static int has_extension( const char *name, const char *extension ) {
+	size_t	n = strlen( name ), m = strlen( extension );
+	size_t	i;
+	if ( n <= m ) return( 0 );
+	for ( i = 0; i < m; i++ ) {
+		if ( tolower( (unsigned char) name[n - m + i] ) != tolower( (unsigned char) extension[i] ) ) return( 0 );
+	}
+	return( 1 );
+}
+
+static int preload_pictures( const char *filename, int depth ) {
+
+	FILE	*fp;
+	char	line[2048];
+	char	*token, *end;
+	int		count = 0;
+
+	if ( depth > 4 ) return( 0 );
+	fp = fopen( filename, "r" );
+	if ( !fp ) return( 0 );
+
+	while ( fgets( line, sizeof( line ), fp ) ) {
+		// Lines that are commented out will not be run.
+		if ( line[0] == '#' ) continue;
+		for ( token = strtok( line, ",\r\n" ); token; token = strtok( NULL, ",\r\n" ) ) {
+			// Trim the blanks around the token.
+			while ( isspace( (unsigned char) *token ) ) token++;
+			end = token + strlen( token );
+			while ( end > token && isspace( (unsigned char) *( end - 1 ) ) ) *--end = 0;
+			if ( has_extension( token, ".bmp" ) ) {
+				if ( cacheStats.bytes + cacheWidth * cacheHeight * sizeof( unsigned long ) > cacheMaxBytes ) break;
+				if ( DexGetCachedPicture( token ) ) count++;
+			}
+			else if ( has_extension( token, ".dex" ) ) {
+				// strtok() is not re-entrant, so we go down only once we are
+				// done with this line. There is nothing else of interest on it.
+				char	referenced[2048];
+				strcpy( referenced, token );
+				count += preload_pictures( referenced, depth + 1 );
+				break;
+			}
+		}
+	}
+	fclose( fp );
+	return( count );
+
+}
+
+int DexPreloadScriptPictures( const char *filename ) {
+	return( preload_pictures( filename, 0 ) );
+}
+
+void DexGetPictureCacheStats( DexPictureCacheStats *stats ) {
+	*stats = cacheStats;
+}
@@ -0,0 +1,82 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                  DexPictures.h                                */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+ * Decoding of the .bmp pictures shown to the subject and a cache of the
+ * decoded and scaled pictures, so that each one is read from disk only once.
+ * Nothing here depends on Windows. The Windows bitmap made from a picture
+ * is attached to the cache entry by the GUI (see DexSimulatorGUI.cpp).
+ */
+
+#ifndef _DexPictures_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size at which the pictures are displayed (595 x 421 scaled by 0.6).
+#define DEX_PICTURE_WIDTH		357
+#define DEX_PICTURE_HEIGHT		252
+
+#define DEX_PICTURE_CACHE_ENTRIES	256
+#define DEX_PICTURE_CACHE_BYTES		(64 * 1024 * 1024)
+#define DEX_PICTURE_NAME_LENGTH		256
+
+// A decoded picture. Pixels are 0x00RRGGBB, with the bottom row first, as in a DIB.
+typedef struct {
+
+	int				width;
+	int				height;
+	unsigned long	*pixels;
+
+} DexPicture;
+
+typedef struct {
+
+	char			name[DEX_PICTURE_NAME_LENGTH];
+	DexPicture		picture;
+	unsigned long	bytes;
+	unsigned long	last_used;
+	// Pictures that are on the screen are pinned and never evicted.
+	int				pins;
+	// Platform bitmap made from the picture (an HBITMAP under Windows).
+	// It is released through the routine given to DexPictureCacheInit().
+	void			*handle;
+
+} DexPictureCacheEntry;
+
+typedef struct {
+
+	unsigned long	hits;
+	unsigned long	misses;
+	unsigned long	failures;
+	unsigned long	evictions;
+	unsigned long	entries;
+	unsigned long	bytes;
+	// Total time spent on each, in seconds.
+	double			hit_time;
+	double			miss_time;
+
+} DexPictureCacheStats;
+
+int		DexReadPicture( DexPicture *picture, const char *filename );
+int		DexScalePicture( DexPicture *result, const DexPicture *source, int width, int height );
+void	DexFreePicture( DexPicture *picture );
+
+void	DexPictureCacheInit( const char *prefix, int width, int height, unsigned long max_bytes, void (*release)( void *handle ) );
+DexPictureCacheEntry *DexGetCachedPicture( const char *name );
+void	DexPinCachedPicture( DexPictureCacheEntry *entry );
+void	DexUnpinCachedPicture( DexPictureCacheEntry *entry );
+int		DexPreloadScriptPictures( const char *filename );
+void	DexGetPictureCacheStats( DexPictureCacheStats *stats );
+void	DexFlushPictureCache( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _DexPictures_
+#endif
@@ -0,0 +1,280 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                               DexPostHocAnalyzer.cpp                          */
+/*                                                                               */
+/*********************************************************************************/
+
+// An apparatus without devices that reloads an archived trial so that the
+// post hoc measurements of DexPostHocTests.cpp can be repeated off line.
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+
+#include "Dexterous.h"
+#include "DexTracker.h"
+#include "DexApparatus.h"
+
+/*********************************************************************************/
+
+DexPostHocAnalyzer::DexPostHocAnalyzer( void ) {
+
+	// There are no devices. A bare DexTracker is enough to hold
+	// the marker sample period used by TimeToFrame() and the tests.
+	tracker = new DexTracker();
+	tracker->samplePeriod = MARKER_SAMPLE_PERIOD;
+	analogSamplePeriod = ANALOG_SAMPLE_PERIOD;
+
+	targets = NULL;
+	sounds = NULL;
+	adc = NULL;
+	monitor = NULL;
+
+	nCodas = 0;
+	nMarkers = N_MARKERS;
+	nChannels = N_CHANNELS;
+	nTargets = N_TARGETS;
+	nForceTransducers = N_FORCE_TRANSDUCERS;
+	nGauges = N_GAUGES;
+	nSamplesForAverage = N_SAMPLES_FOR_AVERAGE;
+
+	nAcqFrames = 0;
+	nAcqSamples = 0;
+	nEvents = 0;
+
+	// We need the ATI calibrations to recompute the forces from the raw gauges.
+	// The offsets that were nullified on board are not known here, but the
+	// force tests look at peaks relative to the mean, so they do not matter.
+	InitForceTransducers();
+
+}
+
+DexPostHocAnalyzer::~DexPostHocAnalyzer( void ) {
+	ReleaseForceTransducers();
+	delete tracker;
+}
+
+/*********************************************************************************/
+
+// Split a tab separated line of numbers.
+// This is a lot faster than sscanf() for the wide .adc lines.
+
+int DexPostHocAnalyzer::ReadFields( char *line, double value[], int max_values ) {
+
+	char *ptr = line;
+	char *end;
+	int n;
+
+	for ( n = 0; n < max_values; n++ ) {
+		value[n] = strtod( ptr, &end );
+		if ( end == ptr ) break;
+		ptr = end;
+	}
+	return( n );
+
+}
+
+/*********************************************************************************/
+
+bool DexPostHocAnalyzer::LoadTrial( const char *fileroot ) {
+
+	FILE	*fp;
+	char	filename[512];
+	char	line[4096];
+	double	value[DEX_MAX_CHANNELS + 2];
+	int		chan, n;
+
+	// The computed manipulandum position and orientation.
+	sprintf( filename, "%s.mnp", fileroot );
+	fp = fopen( filename, "r" );
+	if ( !fp ) return( false );
+	// Skip the header.
+	fgets( line, sizeof( line ), fp );
+	nAcqFrames = 0;
+	while ( nAcqFrames < DEX_MAX_MARKER_FRAMES && fgets( line, sizeof( line ), fp ) ) {
+		n = ReadFields( line, value, 13 );
+		if ( n < 10 ) continue;
+		ManipulandumState *state = &acquiredManipulandumState[nAcqFrames++];
+		state->time = value[1];
+		state->visibility = ( value[2] != 0.0 );
+		state->position[X] = value[3];
+		state->position[Y] = value[4];
+		state->position[Z] = value[5];
+		state->orientation[X] = value[6];
+		state->orientation[Y] = value[7];
+		state->orientation[Z] = value[8];
+		state->orientation[M] = value[9];
+		// Older archives do not say how well the markers fit.
+		state->residual = ( n > 10 ? (float) value[10] : 0.0f );
+		state->rejectedMarkers = ( n > 11 ? (unsigned long) value[11] : 0 );
+		state->swappedMarkers = ( n > 12 && value[12] != 0.0 );
+	}
+	fclose( fp );
+	if ( nAcqFrames < 1 ) return( false );
+	// The frames were resampled at a constant rate, so we can recover the sample period.
+	if ( nAcqFrames > 1 ) {
+		tracker->samplePeriod = ( acquiredManipulandumState[nAcqFrames - 1].time - acquiredManipulandumState[0].time ) / ( nAcqFrames - 1 );
+	}
+
+	// The raw analog data. The forces are then recomputed exactly as in StopAcquisition().
+	// If there is no analog file, the force tests will just find nothing.
+	nAcqSamples = 0;
+	sprintf( filename, "%s.adc", fileroot );
+	fp = fopen( filename, "r" );
+	if ( fp ) {
+		fgets( line, sizeof( line ), fp );
+		while ( nAcqSamples < DEX_MAX_ANALOG_SAMPLES && fgets( line, sizeof( line ), fp ) ) {
+			n = ReadFields( line, value, nChannels + 2 );
+			if ( n < 2 ) continue;
+			acquiredAnalog[nAcqSamples].time = value[1];
+			for ( chan = 0; chan < nChannels; chan++ ) {
+				acquiredAnalog[nAcqSamples].channel[chan] = ( chan + 2 < n ? (float) value[chan + 2] : 0.0f );
+			}
+			nAcqSamples++;
+		}
+		fclose( fp );
+		if ( nAcqSamples > 1 ) {
+			analogSamplePeriod = ( acquiredAnalog[nAcqSamples - 1].time - acquiredAnalog[0].time ) / ( nAcqSamples - 1 );
+		}
+		ComputeAcquiredForces();
+	}
+
+	// The events marked during the trial. Older archives do not have them,
+	// in which case the whole trial is analyzed, as if there were only the
+	// automatic start and stop events.
+	nEvents = 0;
+	sprintf( filename, "%s.evt", fileroot );
+	fp = fopen( filename, "r" );
+	if ( fp ) {
+		fgets( line, sizeof( line ), fp );
+		while ( nEvents < DEX_MAX_EVENTS && fgets( line, sizeof( line ), fp ) ) {
+			if ( ReadFields( line, value, 4 ) < 4 ) continue;
+			eventList[nEvents].time = value[1];
+			eventList[nEvents].event = (int) value[2];
+			eventList[nEvents].param = (unsigned long) value[3];
+			nEvents++;
+		}
+		fclose( fp );
+	}
+	if ( nEvents == 0 ) {
+		eventList[0].time = acquiredManipulandumState[0].time;
+		eventList[0].event = ACQUISITION_START;
+		eventList[0].param = 0;
+		eventList[1].time = acquiredManipulandumState[nAcqFrames - 1].time;
+		eventList[1].event = ACQUISITION_STOP;
+		eventList[1].param = 0;
+		nEvents = 2;
+	}
+
+	return( true );
+
+}
+
+/*********************************************************************************/
+
+// Same as DexApparatus::TimeToSample(), but without an ADC to ask for the sample period.
+
+int DexPostHocAnalyzer::TimeToSample( float elapsed_time ) {
+	int sample = (int) floor( elapsed_time / analogSamplePeriod );
+	// Make sure that it is a valid sample.
+	if (sample < 0) sample = 0;
+	if (sample >= nAcqSamples ) sample = nAcqSamples - 1;
+	return( sample );
+}
+
+/*********************************************************************************/
+
+// Apply every point of the sweep to the trial. The pass criteria are exactly
+// those of the corresponding Check* routine in DexPostHocTests.cpp, including
+// the types of the thresholds that are passed to them. The measurement is done
+// only once, or once for each value of a when it depends on it.
+
+void DexPostHocAnalyzer::EvaluateSweep( const DexPostHocSweep &sweep, int pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS] ) {
+
+	int ia, ib, i;
+	int N, movements, starts, count, bad;
+	int overall, max_gap;
+	double sd, period;
+
+	switch ( sweep.check ) {
+
+	case VISIBILITY_CHECK:
+		MeasureVisibility( overall, max_gap );
+		period = tracker->GetSamplePeriod();
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				int max_dropout_samples = sweep.b[ib] / period;
+				if ( !( max_gap > max_dropout_samples || overall * period >= sweep.a[ia] ) ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case AMPLITUDE_CHECK:
+		sd = MeasureMovementAmplitude( sweep.direction, N );
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				if ( N > 0 && !( sd < sweep.a[ia] || sd > sweep.b[ib] ) ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case CYCLES_CHECK:
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			count = MeasureMovementCycles( sweep.direction, (float) sweep.a[ia], N );
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				if ( N > 0 && !( count < (int) sweep.b[ib] || count > sweep.maxCount ) ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case EARLY_STARTS_CHECK:
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			count = MeasureEarlyStarts( sweep.holdTime, (float) sweep.a[ia], sweep.filterConstant, N );
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				if ( N > 0 && count <= (int) sweep.b[ib] ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case START_POSITION_CHECK:
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			float tol = (float) sweep.a[ia];
+			count = MeasureBadStartPositions( sweep.targetID, tol, tol, tol, movements );
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				if ( count <= (int) sweep.b[ib] ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case DIRECTION_CHECK:
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			count = MeasureFalseDirections( sweep.direction, (float) sweep.a[ia], movements, starts );
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				if ( count <= (int) sweep.b[ib] ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	case FORCE_PEAKS_CHECK:
+	case ACCELERATION_PEAKS_CHECK:
+		if ( sweep.check == FORCE_PEAKS_CHECK ) movements = MeasureForcePeaks( peak, DEX_MAX_EVENTS );
+		else movements = MeasureAccelerationPeaks( peak, DEX_MAX_EVENTS );
+		for ( ia = 0; ia < sweep.nA; ia++ ) {
+			for ( ib = 0; ib < sweep.nB; ib++ ) {
+				bad = 0;
+				for ( i = 0; i < movements; i++ ) {
+					if ( peak[i] < (float) sweep.a[ia] || peak[i] > (float) sweep.b[ib] ) bad++;
+				}
+				if ( bad <= sweep.maxCount ) pass[ia][ib]++;
+			}
+		}
+		break;
+
+	}
+
+}
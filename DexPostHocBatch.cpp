@@ -0,0 +1,325 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                DexPostHocBatch.cpp                            */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+
+  A command line tool to rerun a post hoc test on a large set of archived trials
+  while sweeping its thresholds. This lets us see what a change to a tolerance
+  in DexParameters.cpp or in a Check* call would have done to the pass rate,
+  without having to run the sessions again.
+
+  Each trial is reloaded from the files written by SaveAcquisition() (.mnp, .adc, .evt)
+  into a DexPostHocAnalyzer (DexPostHocAnalyzer.cpp), a DexApparatus without devices. The measurement
+  is then done by the same DexApparatus::Measure* routines that are used by the
+  Check* routines on board, and DexPostHocAnalyzer::EvaluateSweep() applies the
+  thresholds for every point of the sweep. TestDexPostHoc.cpp checks that it gives
+  the same verdicts as the Check* routines. A trial is read only once. When the measurement itself depends on the first
+  swept parameter (hysteresis, velocity threshold, tolerance) it is repeated for each
+  value of that parameter on the data that is already in memory.
+
+  Trials are shared out between several worker threads. Each thread has its own
+  DexPostHocAnalyzer and its own pass counts, which are summed at the end.
+  Beware that each analyzer holds the full acquisition buffers of DexApparatus.
+
+  The tool is linked with the same modules as DexSimulatorApp, minus DexSimulatorApp.cpp.
+
+  Usage:
+
+	DexPostHocBatch -check=<test> -a=lo:hi:step -b=lo:hi:step [options] [-list=file] [fileroot ...]
+
+  The meaning of the two swept parameters depends on the test:
+
+	visibility	a = max cumulative dropout (s)	b = max continuous dropout (s)
+	amplitude	a = min SD (mm)					b = max SD (mm)					-dir=
+	cycles		a = hysteresis (mm)				b = min cycles					-dir= -max=
+	earlystarts	a = velocity threshold (mm/s)	b = max early starts			-hold= -filter=
+	startpos	a = tolerance on X, Y and Z		b = max bad positions			-target= -targets=
+	direction	a = displacement threshold		b = max false directions		-dir=
+	forcepeaks	a = min peak (N)				b = max peak (N)				-max=
+	accpeaks	a = min peak					b = max peak					-max=
+
+  Each fileroot is the name of a trial without the extension, e.g. DexSimulatorOutput.tag.
+  They can be given on the command line or listed one per line in the file given by -list=.
+
+  */
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+
+#include "Dexterous.h"
+#include "DexTimers.h"
+#include "DexTracker.h"
+#include "DexApparatus.h"
+
+// Limits for the static arrays.
+#define DEX_MAX_BATCH_TRIALS	20000
+#define DEX_MAX_BATCH_THREADS	8
+
+// The stack has to hold the velocity buffer of MeasureEarlyStarts().
+#define DEX_BATCH_STACK_SIZE	( 4 * 1024 * 1024 )
+
+enum { NORMAL_BATCH_EXIT = 0, NO_CHECK, NO_TRIALS, BAD_SWEEP, NO_OUTPUT_FILE };
+
+char *DexBatchCheckName[N_POST_HOC_CHECKS] = {
+	"visibility", "amplitude", "cycles", "earlystarts", "startpos", "direction", "forcepeaks", "accpeaks"
+};
+
+// What is to be done. These are set once from the command line and
+//  then only read by the worker threads.
+static DexPostHocSweep	sweep;
+static char				targetFile[1024] = "";
+
+static char				trialRoot[DEX_MAX_BATCH_TRIALS][256];
+static int				nTrials = 0;
+
+// The next trial to be handed out to a worker.
+static volatile LONG	nextTrial = -1;
+
+typedef struct {
+	DexPostHocAnalyzer	*trial;
+	HANDLE				thread;
+	int					pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS];
+	int					analyzed;
+	int					unreadable;
+} DexBatchWorker;
+
+static DexBatchWorker	worker[DEX_MAX_BATCH_THREADS];
+
+/*********************************************************************************/
+
+// Parse a sweep specification of the form lo:hi:step, or a single value.
+
+static int ParseSweep( const char *spec, double values[] ) {
+
+	double lo, hi, step;
+	int n, items;
+
+	items = sscanf( spec, "%lf:%lf:%lf", &lo, &hi, &step );
+	if ( items == 1 ) {
+		values[0] = lo;
+		return( 1 );
+	}
+	if ( items != 3 || step <= 0.0 || hi < lo ) return( 0 );
+
+	n = (int) floor( ( hi - lo ) / step + 0.5 ) + 1;
+	if ( n > DEX_MAX_SWEEP_POINTS ) n = DEX_MAX_SWEEP_POINTS;
+	for ( int i = 0; i < n; i++ ) values[i] = lo + i * step;
+	return( n );
+
+}
+
+/*********************************************************************************/
+
+// Each worker takes the next trial that nobody has taken yet, until there are none left.
+
+DWORD WINAPI BatchWorkerThread( LPVOID param ) {
+
+	DexBatchWorker *wrk = (DexBatchWorker *) param;
+	LONG trl;
+
+	while ( ( trl = InterlockedIncrement( &nextTrial ) ) < nTrials ) {
+		if ( !wrk->trial->LoadTrial( trialRoot[trl] ) ) {
+			fprintf( stderr, "Could not load trial %s\n", trialRoot[trl] );
+			wrk->unreadable++;
+			continue;
+		}
+		wrk->trial->EvaluateSweep( sweep, wrk->pass );
+		wrk->analyzed++;
+	}
+	return( 0 );
+
+}
+
+/*********************************************************************************/
+
+static void AddTrial( const char *root ) {
+	if ( nTrials < DEX_MAX_BATCH_TRIALS ) {
+		strncpy( trialRoot[nTrials], root, sizeof( trialRoot[nTrials] ) - 1 );
+		trialRoot[nTrials][sizeof( trialRoot[nTrials] ) - 1] = 0;
+		nTrials++;
+	}
+}
+
+static void PrintTable( FILE *fp, int pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS], int analyzed ) {
+
+	int ia, ib;
+
+	fprintf( fp, "Check: %s  Trials analyzed: %d\n", DexBatchCheckName[sweep.check], analyzed );
+	fprintf( fp, "Pass rate (%%) for each threshold. Rows: a  Columns: b\n" );
+	fprintf( fp, "a \\ b" );
+	for ( ib = 0; ib < sweep.nB; ib++ ) fprintf( fp, "\t%.3f", sweep.b[ib] );
+	fprintf( fp, "\n" );
+	for ( ia = 0; ia < sweep.nA; ia++ ) {
+		fprintf( fp, "%.3f", sweep.a[ia] );
+		for ( ib = 0; ib < sweep.nB; ib++ ) {
+			fprintf( fp, "\t%.1f", ( analyzed > 0 ? 100.0 * pass[ia][ib] / analyzed : 0.0 ) );
+		}
+		fprintf( fp, "\n" );
+	}
+
+}
+
+/*********************************************************************************/
+
+int main ( int argc, char *argv[] ) {
+
+	char	list_file[1024] = "";
+	char	output_file[1024] = "";
+	char	line[1024];
+
+	int		n_threads;
+	int		arg, thr, ia, ib, chk;
+
+	int		pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS];
+	int		analyzed = 0, unreadable = 0;
+
+	FILE	*fp;
+	DexTimer batch_timer;
+	SYSTEM_INFO system_info;
+
+	// By default, use one thread per processor.
+	GetSystemInfo( &system_info );
+	n_threads = system_info.dwNumberOfProcessors;
+
+	// The defaults for the sweep, in case one of the parameters is not swept.
+	sweep.check = N_POST_HOC_CHECKS;
+	sweep.a[0] = 0.0; sweep.nA = 1;
+	sweep.b[0] = 0.0; sweep.nB = 1;
+	sweep.direction[X] = 0.0;
+	sweep.direction[Y] = 1.0;
+	sweep.direction[Z] = 0.0;
+	sweep.maxCount = 1000;
+	sweep.holdTime = 0.5;
+	sweep.filterConstant = 1.0;
+	sweep.targetID = 0;
+
+	// Parse the command line arguments.
+	for ( arg = 1; arg < argc; arg++ ) {
+
+		if ( !strncmp( argv[arg], "-check=", strlen( "-check=" ) ) ) {
+			for ( chk = 0; chk < N_POST_HOC_CHECKS; chk++ ) {
+				if ( !strcmp( argv[arg] + strlen( "-check=" ), DexBatchCheckName[chk] ) ) sweep.check = (DexPostHocCheck) chk;
+			}
+		}
+		else if ( !strncmp( argv[arg], "-a=", strlen( "-a=" ) ) ) {
+			sweep.nA = ParseSweep( argv[arg] + strlen( "-a=" ), sweep.a );
+			if ( sweep.nA == 0 ) {
+				fprintf( stderr, "Bad sweep specification: %s\n", argv[arg] );
+				exit( BAD_SWEEP );
+			}
+		}
+		else if ( !strncmp( argv[arg], "-b=", strlen( "-b=" ) ) ) {
+			sweep.nB = ParseSweep( argv[arg] + strlen( "-b=" ), sweep.b );
+			if ( sweep.nB == 0 ) {
+				fprintf( stderr, "Bad sweep specification: %s\n", argv[arg] );
+				exit( BAD_SWEEP );
+			}
+		}
+		// Parameters of the tests that are not swept.
+		else if ( !strncmp( argv[arg], "-dir=", strlen( "-dir=" ) ) ) {
+			sscanf( argv[arg] + strlen( "-dir=" ), "%lf,%lf,%lf", &sweep.direction[X], &sweep.direction[Y], &sweep.direction[Z] );
+		}
+		else if ( !strncmp( argv[arg], "-max=", strlen( "-max=" ) ) ) sweep.maxCount = atoi( argv[arg] + strlen( "-max=" ) );
+		else if ( !strncmp( argv[arg], "-hold=", strlen( "-hold=" ) ) ) sweep.holdTime = (float) atof( argv[arg] + strlen( "-hold=" ) );
+		else if ( !strncmp( argv[arg], "-filter=", strlen( "-filter=" ) ) ) sweep.filterConstant = (float) atof( argv[arg] + strlen( "-filter=" ) );
+		else if ( !strncmp( argv[arg], "-target=", strlen( "-target=" ) ) ) sweep.targetID = atoi( argv[arg] + strlen( "-target=" ) );
+		else if ( !strncmp( argv[arg], "-targets=", strlen( "-targets=" ) ) ) strcpy( targetFile, argv[arg] + strlen( "-targets=" ) );
+		// How to run.
+		else if ( !strncmp( argv[arg], "-threads=", strlen( "-threads=" ) ) ) n_threads = atoi( argv[arg] + strlen( "-threads=" ) );
+		else if ( !strncmp( argv[arg], "-list=", strlen( "-list=" ) ) ) strcpy( list_file, argv[arg] + strlen( "-list=" ) );
+		else if ( !strncmp( argv[arg], "-out=", strlen( "-out=" ) ) ) strcpy( output_file, argv[arg] + strlen( "-out=" ) );
+		// Anything else is taken to be a trial.
+		else if ( argv[arg][0] != '-' ) AddTrial( argv[arg] );
+
+	}
+
+	if ( sweep.check == N_POST_HOC_CHECKS ) {
+		fprintf( stderr, "%s: No valid -check= specified.\n", argv[0] );
+		exit( NO_CHECK );
+	}
+
+	// Add the trials from the list file, if there is one.
+	if ( list_file[0] ) {
+		fp = fopen( list_file, "r" );
+		if ( !fp ) {
+			fprintf( stderr, "Error opening %s for read.\n", list_file );
+			exit( NO_TRIALS );
+		}
+		while ( fgets( line, sizeof( line ), fp ) ) {
+			// Strip the end of line and skip blank lines.
+			line[strcspn( line, "\r\n" )] = 0;
+			if ( strlen( line ) > 0 ) AddTrial( line );
+		}
+		fclose( fp );
+	}
+	if ( nTrials == 0 ) {
+		fprintf( stderr, "%s: No trials to analyze.\n", argv[0] );
+		exit( NO_TRIALS );
+	}
+
+	if ( n_threads < 1 ) n_threads = 1;
+	if ( n_threads > DEX_MAX_BATCH_THREADS ) n_threads = DEX_MAX_BATCH_THREADS;
+	if ( n_threads > nTrials ) n_threads = nTrials;
+
+	// Create the analyzers here, before starting the threads, because
+	//  loading the ATI calibrations is not something I want to do in parallel.
+	for ( thr = 0; thr < n_threads; thr++ ) {
+		worker[thr].trial = new DexPostHocAnalyzer();
+		if ( targetFile[0] ) worker[thr].trial->LoadTargetPositions( targetFile );
+		for ( ia = 0; ia < DEX_MAX_SWEEP_POINTS; ia++ ) {
+			for ( ib = 0; ib < DEX_MAX_SWEEP_POINTS; ib++ ) worker[thr].pass[ia][ib] = 0;
+		}
+		worker[thr].analyzed = 0;
+		worker[thr].unreadable = 0;
+	}
+
+	printf( "%s: %d trials, %s, %d x %d thresholds, %d threads.\n",
+		argv[0], nTrials, DexBatchCheckName[sweep.check], sweep.nA, sweep.nB, n_threads );
+	DexTimerStart( batch_timer );
+
+	for ( thr = 0; thr < n_threads; thr++ ) {
+		worker[thr].thread = CreateThread( NULL, DEX_BATCH_STACK_SIZE, BatchWorkerThread, &worker[thr], 0, NULL );
+	}
+	for ( thr = 0; thr < n_threads; thr++ ) {
+		WaitForSingleObject( worker[thr].thread, INFINITE );
+		CloseHandle( worker[thr].thread );
+	}
+
+	// Sum up the results of the workers.
+	for ( ia = 0; ia < DEX_MAX_SWEEP_POINTS; ia++ ) {
+		for ( ib = 0; ib < DEX_MAX_SWEEP_POINTS; ib++ ) {
+			pass[ia][ib] = 0;
+			for ( thr = 0; thr < n_threads; thr++ ) pass[ia][ib] += worker[thr].pass[ia][ib];
+		}
+	}
+	for ( thr = 0; thr < n_threads; thr++ ) {
+		analyzed += worker[thr].analyzed;
+		unreadable += worker[thr].unreadable;
+	}
+
+	printf( "Analyzed %d trials (%d unreadable) in %.3f s.\n\n", analyzed, unreadable, DexTimerElapsedTime( batch_timer ) );
+	PrintTable( stdout, pass, analyzed );
+
+	if ( output_file[0] ) {
+		fp = fopen( output_file, "w" );
+		if ( !fp ) {
+			fprintf( stderr, "Error opening %s for write.\n", output_file );
+			exit( NO_OUTPUT_FILE );
+		}
+		PrintTable( fp, pass, analyzed );
+		fclose( fp );
+	}
+
+	return( NORMAL_BATCH_EXIT );
+
+}
@@ -53,41 +53,56 @@ int DexApparatus::CheckOverrun(  const char *msg ) {
 
 //
 // Allows to check if the manipulandum goes out of view too often during the trial.
-// There are two thresholds, one on the overall time during the trial that the 
+// There are two thresholds, one on the overall time during the trial that the
 //  manipulandum can be invisible, the other on the maximum gap in the data.
 //
+// Each of the post hoc tests is split in two. A Measure routine computes the
+//  quantity to be tested from the acquired data, and the Check routine compares
+//  it to the thresholds and talks to the subject. The Measure routines do not
+//  touch the devices, so that the very same computations can be rerun off line
+//  on archived trials with different thresholds (see DexPostHocBatch.cpp).
+//
 
-int DexApparatus::CheckVisibility(  double max_cumulative_dropout_time, 
-								    double max_continuous_dropout_time,
-								    const char *msg, const char *picture ) {
+void DexApparatus::MeasureVisibility( int &overall, int &max_gap ) {
 
 	int first, last;
-	
-	// Arguments are in seconds, but it's easier to work in samples.
-	int max_dropout_samples = max_continuous_dropout_time / tracker->GetSamplePeriod();
-	
+
 	// Count the number of samples where the manipulandum is invisible.
-	int overall = 0;
 	int continuous = 0;
-	
+	overall = 0;
+
 	// Keep track of the longest continuous dropout.
-	int max_gap = 0;
-	bool interval_exceeded = false;
+	max_gap = 0;
 
 	// Limit the range of frames used in the analysis, if specified in the script.
 	FindAnalysisFrameRange( first, last );
-	
+
 	for ( int i = first; i < last; i ++ ) {
 		if ( ! acquiredManipulandumState[i].visibility ) {
 			overall++;
 			continuous++;
-			if ( continuous > max_dropout_samples ) interval_exceeded = true;
 			if ( continuous > max_gap ) max_gap = continuous;
 		}
 		else {
 			continuous = 0;
 		}
 	}
+
+}
+
+int DexApparatus::CheckVisibility(  double max_cumulative_dropout_time,
+								    double max_continuous_dropout_time,
+								    const char *msg, const char *picture ) {
+
+	int overall, max_gap;
+
+	// Arguments are in seconds, but it's easier to work in samples.
+	int max_dropout_samples = max_continuous_dropout_time / tracker->GetSamplePeriod();
+
+	// Count the dropouts and see if the longest one is too long.
+	MeasureVisibility( overall, max_gap );
+	bool interval_exceeded = ( max_gap > max_dropout_samples );
+
 	// Compute the duration of the continuous and cumulative gaps in seconds.
 	double overall_time = overall * tracker->GetSamplePeriod();
 	double max_time_gap = max_gap * tracker->GetSamplePeriod();
@@ -128,13 +143,8 @@ int DexApparatus::CheckVisibility(  double max_cumulative_dropout_time,
 //  threshold values for each of the protocols. For instance, what would be the expected SD for 
 //  a set of targeted movements?
 
-int DexApparatus::CheckMovementAmplitude(  double min, double max, 
-										   double dirX, double dirY, double dirZ,
-										   const char *msg, const char *picture ) {
-	
-	const char *fmt;
-	bool  error = false;
-	
+double DexApparatus::MeasureMovementAmplitude( const Vector3 direction, int &valid_frames ) {
+
 	int i, k, m;
 
 	int first, last;
@@ -142,12 +152,7 @@ int DexApparatus::CheckMovementAmplitude(  double min, double max,
 	double N = 0.0, sd;
 	Matrix3x3 Sxy;
 	Vector3  delta, mean;
-	Vector3   direction, vect;
-
-	// TODO: Should normalize the direction vector here.
-	direction[X] = dirX;
-	direction[Y] = dirY;
-	direction[Z] = dirZ;
+	Vector3  vect;
 
 	// First we should look for the start and end of the actual movement based on 
 	// events such as when the subject reaches the first target. 
@@ -158,66 +163,84 @@ int DexApparatus::CheckMovementAmplitude(  double min, double max,
 	CopyVector( mean, zeroVector );
 	for ( i = first; i < last; i++ ) {
 		if ( acquiredManipulandumState[i].visibility ) {
-			if ( abs( acquiredManipulandumState[i].position[X] ) > 1000 ) {
-				i = i;
-			}
 			N++;
 			AddVectors( mean, mean, acquiredManipulandumState[i].position );
 		}
 	}
-	// If there is no valid position data, signal an error.
-	if ( N <= 0.0 ) {
-		monitor->SendEvent( "Movement extent - No valid data." );
-		sd = 0.0;
-		error = true;
-	}
-	else {
-	
-		// This is the mean.
-		ScaleVector( mean, mean, 1.0 / N );;
-
-		// Compute the sums required for the variance calculation.
-		CopyMatrix( Sxy, zeroMatrix );
-		N = 0.0;
-
-		for ( i = first; i < last; i ++ ) {
-			if ( acquiredManipulandumState[i].visibility ) {
-				N++;
-				SubtractVectors( delta, acquiredManipulandumState[i].position, mean );
-				for ( k = 0; k < 3; k++ ) {
-					for ( m = 0; m < 3; m++ ) {
-						Sxy[k][m] += delta[k] * delta[m];
-					}
+	valid_frames = (int) N;
+	// If there is no valid position data, there is nothing to measure.
+	if ( N <= 0.0 ) return( 0.0 );
+
+	// This is the mean.
+	ScaleVector( mean, mean, 1.0 / N );
+
+	// Compute the sums required for the variance calculation.
+	CopyMatrix( Sxy, zeroMatrix );
+	N = 0.0;
+
+	for ( i = first; i < last; i ++ ) {
+		if ( acquiredManipulandumState[i].visibility ) {
+			N++;
+			SubtractVectors( delta, acquiredManipulandumState[i].position, mean );
+			for ( k = 0; k < 3; k++ ) {
+				for ( m = 0; m < 3; m++ ) {
+					Sxy[k][m] += delta[k] * delta[m];
 				}
 			}
 		}
-		
-		// If we have some data, compute the directional variance and then
-		// the standard deviation along that direction;
-		// This is just a scalar times a matrix.
-
-		// Sxy has to be a double or we risk underflow when computing the sums.
-		for ( k = 0; k < 3; k++ ) {
-			vect[k] = 0;
-			for ( m = 0; m < 3; m++ ) {
-				Sxy[k][m] /= N;
-			}
+	}
+	
+	// If we have some data, compute the directional variance and then
+	// the standard deviation along that direction;
+	// This is just a scalar times a matrix.
+
+	// Sxy has to be a double or we risk underflow when computing the sums.
+	for ( k = 0; k < 3; k++ ) {
+		vect[k] = 0;
+		for ( m = 0; m < 3; m++ ) {
+			Sxy[k][m] /= N;
 		}
-		// This is a matrix multiply.
-		for ( k = 0; k < 3; k++ ) {
-			for ( m = 0; m < 3; m++ ) {
-				vect[k] += Sxy[m][k] * direction[m];
-			}
+	}
+	// This is a matrix multiply.
+	for ( k = 0; k < 3; k++ ) {
+		for ( m = 0; m < 3; m++ ) {
+			vect[k] += Sxy[m][k] * direction[m];
 		}
-		// Compute the length of the vector, which is the variance along 
-		// the specified direction. Then take the square root of that 
-		// magnitude to get the standard deviation along that direction.
-		sd = sqrt( VectorNorm( vect ) );
+	}
+	// Compute the length of the vector, which is the variance along 
+	// the specified direction. Then take the square root of that 
+	// magnitude to get the standard deviation along that direction.
+	sd = sqrt( VectorNorm( vect ) );
+
+	return( sd );
+
+}
 
-		// Check if the computed value is in the desired range.
-		error = ( sd < min || sd > max );
+int DexApparatus::CheckMovementAmplitude(  double min, double max, 
+										   double dirX, double dirY, double dirZ,
+										   const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+	
+	int N;
+	double sd;
+	Vector3   direction;
 
+	// TODO: Should normalize the direction vector here.
+	direction[X] = dirX;
+	direction[Y] = dirY;
+	direction[Z] = dirZ;
+
+	sd = MeasureMovementAmplitude( direction, N );
+
+	// If there is no valid position data, signal an error.
+	if ( N <= 0 ) {
+		monitor->SendEvent( "Movement extent - No valid data." );
+		error = true;
 	}
+	// Check if the computed value is in the desired range.
+	else error = ( sd < min || sd > max );
 
 	// If not, signal the error to the subject.
 	// Here I take the approach of calling a method to signal the error.
@@ -259,18 +282,13 @@ int DexApparatus::CheckMovementAmplitude(  double min, double max, const Vector3
 // positive direction. The hysteresis parameter is used to reject noise.
 // 
 
-int DexApparatus::CheckMovementCycles(  int min_cycles, int max_cycles, 
-										   float dirX, float dirY, float dirZ,
-										   float hysteresis, const char *msg, const char *picture ) {
-	
-	const char *fmt;
-	bool  error = false;
+int DexApparatus::MeasureMovementCycles( const Vector3 direction, float hysteresis, int &valid_frames ) {
 
 	float	displacement = 0.0;
 	bool	positive = false;
 	int		cycles = 0;
 
-	Vector3 direction, mean, delta;
+	Vector3 mean, delta;
 	
 	int i;
 
@@ -281,11 +299,6 @@ int DexApparatus::CheckMovementCycles(  int min_cycles, int max_cycles,
 	// Just make sure that the user gave a positive value for hysteresis.
 	hysteresis = fabs( hysteresis );
 
-	// TODO: Should normalize the direction vector here.
-	direction[X] = dirX;
-	direction[Y] = dirY;
-	direction[Z] = dirZ;
-
 	// First we should look for the start and end of the actual movement based on 
 	// events such as when the subject reaches the first target. 
 	FindAnalysisFrameRange( first, last );
@@ -300,42 +313,64 @@ int DexApparatus::CheckMovementCycles(  int min_cycles, int max_cycles,
 			AddVectors( mean, mean, acquiredManipulandumState[i].position );
 		}
 	}
-	// If there is no valid position data, signal an error.
-	if ( N <= 0.0 ) {
-		monitor->SendEvent( "Movement cycles - No valid data." );
-		cycles = 0;
-		error = true;
-	}
-	else {
+	valid_frames = (int) N;
+	// If there is no valid position data, there are no cycles.
+	if ( N <= 0.0 ) return( 0 );
 	
-		// This is the mean.
-		ScaleVector( mean, mean, 1.0 / N );
+	// This is the mean.
+	ScaleVector( mean, mean, 1.0 / N );
 
-		// Step through the trajectory, counting positive zero crossings.
-		for ( i = first; i < last; i ++ ) {
-			// Compute the displacements around the mean.
-			if ( acquiredManipulandumState[i].visibility ) {
-				SubtractVectors( delta, acquiredManipulandumState[i].position, mean );
-				displacement = DotProduct( delta, direction );
-			}
-			// If on the positive side of the mean, just look for the negative transition.
-			if ( positive ) {
-				if ( displacement < - hysteresis ) positive = false;
-			}
-			// If on the negative side, look for the positive transition.
-			// If we find one, count another cycle.
-			else {
-				if ( displacement > hysteresis ) {
-					positive = true;
-					cycles++;
-				}
+	// Step through the trajectory, counting positive zero crossings.
+	for ( i = first; i < last; i ++ ) {
+		// Compute the displacements around the mean.
+		if ( acquiredManipulandumState[i].visibility ) {
+			SubtractVectors( delta, acquiredManipulandumState[i].position, mean );
+			displacement = DotProduct( delta, direction );
+		}
+		// If on the positive side of the mean, just look for the negative transition.
+		if ( positive ) {
+			if ( displacement < - hysteresis ) positive = false;
+		}
+		// If on the negative side, look for the positive transition.
+		// If we find one, count another cycle.
+		else {
+			if ( displacement > hysteresis ) {
+				positive = true;
+				cycles++;
 			}
 		}
+	}
 
-		// Check if the computed number of cycles is in the desired range.
-		error = ( cycles < min_cycles || cycles > max_cycles );
+	return( cycles );
+
+}
 
+int DexApparatus::CheckMovementCycles(  int min_cycles, int max_cycles, 
+										   float dirX, float dirY, float dirZ,
+										   float hysteresis, const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int		cycles = 0;
+	int		N;
+
+	Vector3 direction;
+
+	// TODO: Should normalize the direction vector here.
+	direction[X] = dirX;
+	direction[Y] = dirY;
+	direction[Z] = dirZ;
+
+	cycles = MeasureMovementCycles( direction, hysteresis, N );
+
+	// If there is no valid position data, signal an error.
+	if ( N <= 0 ) {
+		monitor->SendEvent( "Movement cycles - No valid data." );
+		error = true;
 	}
+	// Check if the computed number of cycles is in the desired range.
+	else error = ( cycles < min_cycles || cycles > max_cycles );
 
 	// If not, signal the error to the subject.
 	// Here I take the approach of calling a method to signal the error.
@@ -378,12 +413,8 @@ int DexApparatus::CheckMovementCycles(  int min_cycles, int max_cycles, const Ve
 // 
 // TODO: Not yet tested!
 
-int DexApparatus::CheckEarlyStarts(  int max_early_starts, float hold_time, float threshold, float filter_constant, 
-									 const char *msg, const char *picture ) {
+int DexApparatus::MeasureEarlyStarts( float hold_time, float threshold, float filter_constant, int &valid_frames ) {
 	
-	const char *fmt;
-	bool  error = false;
-
 	int		early_starts = 0;
 	int		first, last;
 	int		i, j, index, frm;
@@ -409,40 +440,56 @@ int DexApparatus::CheckEarlyStarts(  int max_early_starts, float hold_time, floa
 			tangential_velocity[i] = tangential_velocity[i-1];
 		}
 	}
-	// If there is no valid position data, signal an error.
-	if ( N <= 0.0 ) {
-		monitor->SendEvent( "No valid data." );
-		error = true;
-	}
-	else {
+	valid_frames = N;
+	// If there is no valid position data, there is nothing to count.
+	if ( N <= 0 ) return( 0 );
 
-		// Smooth the tangential velocity using a recursive filter.
-		for ( frm = 1; frm < nAcqFrames; frm++ ) {
-			tangential_velocity[frm] = ( filter_constant * tangential_velocity[frm-1] + tangential_velocity[frm] ) / ( 1.0 + filter_constant );
-		}
-		// Run the filter backwards to eliminate the phase lag.
-		for ( frm = nAcqFrames - 2; frm >= 0; frm-- ) {
-			tangential_velocity[frm] = ( filter_constant * tangential_velocity[frm+1] + tangential_velocity[frm] ) / ( 1.0 + filter_constant );
-		}
+	// Smooth the tangential velocity using a recursive filter.
+	for ( frm = 1; frm < nAcqFrames; frm++ ) {
+		tangential_velocity[frm] = ( filter_constant * tangential_velocity[frm-1] + tangential_velocity[frm] ) / ( 1.0 + filter_constant );
+	}
+	// Run the filter backwards to eliminate the phase lag.
+	for ( frm = nAcqFrames - 2; frm >= 0; frm-- ) {
+		tangential_velocity[frm] = ( filter_constant * tangential_velocity[frm+1] + tangential_velocity[frm] ) / ( 1.0 + filter_constant );
+	}
 
-		// Step through each marked movement trigger and verify that the velocity is 
-		// close to zero when the trigger was sent.
-		FindAnalysisEventRange( first, last );
-		for ( i = first; i < last; i++ ) {
-			if ( eventList[i].event == TRIGGER_MOVEMENT ) {
-				index = TimeToFrame( eventList[i].time );
-				for ( j = index; j > index - hold_frames && j > first; j-- ) {
-					if ( tangential_velocity[i] > threshold ) {
-						early_starts++;
-						break;
-					}
+	// Step through each marked movement trigger and verify that the velocity is 
+	// close to zero when the trigger was sent.
+	FindAnalysisEventRange( first, last );
+	for ( i = first; i < last; i++ ) {
+		if ( eventList[i].event == TRIGGER_MOVEMENT ) {
+			index = TimeToFrame( eventList[i].time );
+			for ( j = index; j > index - hold_frames && j > first; j-- ) {
+				if ( tangential_velocity[i] > threshold ) {
+					early_starts++;
+					break;
 				}
 			}
 		}
-		// Check if the computed number of cycles is in the desired range.
-		error = ( early_starts > max_early_starts );
+	}
+
+	return( early_starts );
+
+}
+
+int DexApparatus::CheckEarlyStarts(  int max_early_starts, float hold_time, float threshold, float filter_constant, 
+									 const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int early_starts;
+	int N;
 
+	early_starts = MeasureEarlyStarts( hold_time, threshold, filter_constant, N );
+
+	// If there is no valid position data, signal an error.
+	if ( N <= 0 ) {
+		monitor->SendEvent( "No valid data." );
+		error = true;
 	}
+	// Check if the computed number of early starts is in the desired range.
+	else error = ( early_starts > max_early_starts );
 
 	// If not, signal the error to the subject.
 	// Here I take the approach of calling a method to signal the error.
@@ -479,18 +526,16 @@ int DexApparatus::CheckEarlyStarts(  int max_early_starts, float hold_time, floa
 // 
 // TODO: Not yet tested!
 
-int DexApparatus::CheckCorrectStartPosition(  int target_id, float tolX, float tolY, float tolZ, int max_bad_positions, 
-											const char *msg, const char *picture ) {
+int DexApparatus::MeasureBadStartPositions( int target_id, float tolX, float tolY, float tolZ, int &movements ) {
 	
-	const char *fmt;
-	bool  error = false;
-
-	int		bad_positions = 0, movements = 0;
+	int		bad_positions = 0;
 	int		first, last;
 	int		i, index;
 
 	Vector3 delta;
 
+	movements = 0;
+
 	// First we should look for the start and end of the actual movement based on 
 	// events such as when the subject reaches the first target. 
 	FindAnalysisFrameRange( first, last );
@@ -508,6 +553,21 @@ int DexApparatus::CheckCorrectStartPosition(  int target_id, float tolX, float t
 				 || fabs( delta[Z] ) > tolZ ) bad_positions++;
 		}
 	}
+
+	return( bad_positions );
+
+}
+
+int DexApparatus::CheckCorrectStartPosition(  int target_id, float tolX, float tolY, float tolZ, int max_bad_positions, 
+											const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int		bad_positions, movements;
+
+	bad_positions = MeasureBadStartPositions( target_id, tolX, tolY, tolZ, movements );
+
 	// Check if the computed number of incorrect starting positions is in the desired range.
 	error = ( bad_positions > max_bad_positions );
 
@@ -544,24 +604,19 @@ int DexApparatus::CheckCorrectStartPosition(  int target_id, float tolX, float t
 // 
 // TODO: Not fully tested yet!
 
-int DexApparatus::CheckMovementDirection(  int max_false_directions, float dirX, float dirY, float dirZ, float threshold, 
-											const char *msg, const char *picture ) {
+int DexApparatus::MeasureFalseDirections( const Vector3 dir, float threshold, int &movements, int &starts ) {
 	
-	const char *fmt;
-	bool  error = false;
-
-	int		bad_movements = 0, movements = 0, starts = 0;
+	int		bad_movements = 0;
 	int		first, last;
 	int		i, index;
 
-	Vector3 dir;
-	dir[X] = dirX;
-	dir[Y] = dirY;
-	dir[Z] = dirZ;
 	float displacement;
 
 	Vector3 start_position, delta;
 
+	movements = 0;
+	starts = 0;
+
 	// First we should look for the start and end of the actual movement based on 
 	// events such as when the subject reaches the first target. 
 	FindAnalysisFrameRange( first, last );
@@ -617,6 +672,26 @@ int DexApparatus::CheckMovementDirection(  int max_false_directions, float dirX,
 			}
 		}
 	}
+
+	return( bad_movements );
+
+}
+
+int DexApparatus::CheckMovementDirection(  int max_false_directions, float dirX, float dirY, float dirZ, float threshold, 
+											const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int		bad_movements, movements, starts;
+
+	Vector3 dir;
+	dir[X] = dirX;
+	dir[Y] = dirY;
+	dir[Z] = dirZ;
+
+	bad_movements = MeasureFalseDirections( dir, threshold, movements, starts );
+
 	// Check if the computed number of incorrect starting positions is in the desired range.
 	error = ( bad_movements > max_false_directions );
 
@@ -660,12 +735,8 @@ int DexApparatus::CheckMovementDirection(  int max_false_directions, Vector3 dir
 // 
 // TODO: Not fully tested yet!
 
-int DexApparatus::CheckForcePeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture ) {
+int DexApparatus::MeasureForcePeaks( double peaks[], int max_peaks ) {
 	
-	const char *fmt;
-	bool  error = false;
-
-	int		bad_peaks = 0, lows = 0, highs = 0; 
 	int		movements = 0;
 	int		first, last;
 	int		start_sample, end_sample, smpl;
@@ -679,9 +750,8 @@ int DexApparatus::CheckForcePeaks( float min_amplitude, float max_amplitude, int
 
 	// Step through each marked movement trigger.
 	FindAnalysisEventRange( first, last );
-	for ( i = first; i < last - 1; i++ ) {
+	for ( i = first; i < last - 1 && movements < max_peaks; i++ ) {
 		if ( eventList[i].event == TRIGGER_MOVE_UP || eventList[i].event == TRIGGER_MOVE_DOWN ) {
-			movements++;
 			// Find when the next movement started.
 			for ( j = i + 1; j < last - 1; j++ ) {
 				if ( eventList[j].event == TRIGGER_MOVE_UP || eventList[j].event == TRIGGER_MOVE_DOWN ) break;
@@ -704,13 +774,35 @@ int DexApparatus::CheckForcePeaks( float min_amplitude, float max_amplitude, int
 				delta = fabs( acquiredLoadForce[smpl][Y] - average );
 				if ( delta > peak ) peak = delta;
 			}
-			if ( peak < min_amplitude || peak > max_amplitude ) bad_peaks++;
-			if ( peak < min_amplitude ) lows++;
-			if ( peak > max_amplitude ) highs++;
+			peaks[movements++] = peak;
 
 		}
 	}
 
+	return( movements );
+
+}
+
+int DexApparatus::CheckForcePeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int		bad_peaks = 0, lows = 0, highs = 0; 
+	int		movements;
+	int		i;
+
+	// Too big for the stack.
+	static double peak[DEX_MAX_EVENTS];
+
+	// Measure the peak force for each movement and see if it is in range.
+	movements = MeasureForcePeaks( peak, DEX_MAX_EVENTS );
+	for ( i = 0; i < movements; i++ ) {
+		if ( peak[i] < min_amplitude || peak[i] > max_amplitude ) bad_peaks++;
+		if ( peak[i] < min_amplitude ) lows++;
+		if ( peak[i] > max_amplitude ) highs++;
+	}
+
 	// Check if the computed number of incorrect starting positions is in the desired range.
 	error = ( bad_peaks > max_bad_peaks );
 
@@ -751,12 +843,8 @@ int DexApparatus::CheckForcePeaks( float min_amplitude, float max_amplitude, int
 // Here we use the accelerometer data instead of force data.
 // TODO: Not fully tested yet!
 
-int DexApparatus::CheckAccelerationPeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture ) {
+int DexApparatus::MeasureAccelerationPeaks( double peaks[], int max_peaks ) {
 	
-	const char *fmt;
-	bool  error = false;
-
-	int		bad_peaks = 0, lows = 0, highs = 0; 
 	int		movements = 0;
 	int		first, last;
 	int		start_sample, end_sample, smpl;
@@ -770,9 +858,8 @@ int DexApparatus::CheckAccelerationPeaks( float min_amplitude, float max_amplitu
 
 	// Step through each marked movement trigger.
 	FindAnalysisEventRange( first, last );
-	for ( i = first; i < last - 1; i++ ) {
+	for ( i = first; i < last - 1 && movements < max_peaks; i++ ) {
 		if ( eventList[i].event == TRIGGER_MOVE_UP || eventList[i].event == TRIGGER_MOVE_DOWN ) {
-			movements++;
 			// Find when the next movement started.
 			for ( j = i + 1; j < last - 1; j++ ) {
 				if ( eventList[i].event == TRIGGER_MOVE_UP || eventList[i].event == TRIGGER_MOVE_DOWN ) break;
@@ -795,13 +882,35 @@ int DexApparatus::CheckAccelerationPeaks( float min_amplitude, float max_amplitu
 				delta = fabs( acquiredHighAcceleration[smpl] - average );
 				if ( delta > peak ) peak = delta;
 			}
-			if ( peak < min_amplitude || peak > max_amplitude ) bad_peaks++;
-			if ( peak < min_amplitude ) lows++;
-			if ( peak > max_amplitude ) highs++;
+			peaks[movements++] = peak;
 
 		}
 	}
 
+	return( movements );
+
+}
+
+int DexApparatus::CheckAccelerationPeaks( float min_amplitude, float max_amplitude, int max_bad_peaks, const char *msg, const char *picture ) {
+	
+	const char *fmt;
+	bool  error = false;
+
+	int		bad_peaks = 0, lows = 0, highs = 0; 
+	int		movements;
+	int		i;
+
+	// Too big for the stack.
+	static double peak[DEX_MAX_EVENTS];
+
+	// Measure the peak acceleration for each movement and see if it is in range.
+	movements = MeasureAccelerationPeaks( peak, DEX_MAX_EVENTS );
+	for ( i = 0; i < movements; i++ ) {
+		if ( peak[i] < min_amplitude || peak[i] > max_amplitude ) bad_peaks++;
+		if ( peak[i] < min_amplitude ) lows++;
+		if ( peak[i] > max_amplitude ) highs++;
+	}
+
 	// Check if the computed number of incorrect starting positions is in the desired range.
 	error = ( bad_peaks > max_bad_peaks );
 
@@ -441,6 +441,9 @@ int DexRTnetTracker::GetNumberOfCodas( void ) {
 
 int  DexRTnetTracker::PerformAlignment( int origin, int x_negative, int x_positive, int xy_negative, int xy_positive ) {
 
+	// Whatever the outcome, the transforms that we have are no longer valid.
+	InvalidateUnitTransforms();
+
 	// Get what are the alignment transformations before doing the alignment.
 	// This is just for debugging. Set a breakpoint to see the results.
 	DeviceInfoUnitCoordSystem pre_xforms;
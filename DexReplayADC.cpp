@@ -0,0 +1,204 @@
+/***************************************************************************/
+/*                                                                         */
+/*                               DexReplayADC                              */
+/*                                                                         */
+/***************************************************************************/
+
+// This is an ADC that plays back the analog data of a trial recorded by
+// DexApparatus, typically together with DexReplayTracker.
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <fMessageBox.h>
+#include <DexTimers.h>
+#include "DexADC.h"
+
+#define REPLAY_MAX_LINE		4096
+
+/*********************************************************************************/
+
+DexReplayADC::DexReplayADC( const char *fileroot, double speed ) {
+
+	acquisitionOn = false;
+	overrun = false;
+	duration = 0.0;
+	maxDuration = 0.0;
+	nAcqSamples = 0;
+	nReplaySamples = 0;
+	this->speed = ( speed > 0.0 ? speed : 1.0 );
+
+	if ( !LoadTrial( fileroot ) ) {
+		fMessageBox( MB_OK, "DexReplayADC", "Unable to load the analog recording.\n\n File: %s.adc", fileroot );
+		exit( -1 );
+	}
+
+}
+
+bool DexReplayADC::LoadTrial( const char *fileroot ) {
+
+	FILE	*fp;
+	char	filename[512];
+	char	line[REPLAY_MAX_LINE];
+	char	*token, *ptr, *end;
+	double	value;
+	int		n_channels, n, chan;
+
+	sprintf( filename, "%s.adc", fileroot );
+	fp = fopen( filename, "r" );
+	if ( !fp ) return( false );
+
+	// The header names each channel (CH00, CH01 ...) after the sample number and time.
+	if ( !fgets( line, sizeof( line ), fp ) ) {
+		fclose( fp );
+		return( false );
+	}
+	n_channels = 0;
+	for ( token = strtok( line, "\t\r\n" ); token; token = strtok( NULL, "\t\r\n" ) ) {
+		if ( !strncmp( token, "CH", 2 ) ) n_channels++;
+	}
+	if ( n_channels > N_CHANNELS ) n_channels = N_CHANNELS;
+
+	nReplaySamples = 0;
+	while ( nReplaySamples < DEX_MAX_ANALOG_SAMPLES && fgets( line, sizeof( line ), fp ) ) {
+		AnalogSample *sample = &recordedAnalogSamples[nReplaySamples];
+		// The sample number, then the time and the channels.
+		ptr = line;
+		for ( n = 0; n < n_channels + 2; n++ ) {
+			value = strtod( ptr, &end );
+			if ( end == ptr ) break;
+			ptr = end;
+			if ( n == 1 ) sample->time = value;
+			else if ( n > 1 ) sample->channel[n - 2] = (float) value;
+		}
+		if ( n < 2 ) continue;
+		for ( chan = n - 2; chan < n_channels; chan++ ) sample->channel[chan] = 0.0f;
+		nReplaySamples++;
+	}
+	fclose( fp );
+	if ( nReplaySamples < 1 ) return( false );
+
+	strncpy( this->fileroot, fileroot, sizeof( this->fileroot ) - 1 );
+	this->fileroot[sizeof( this->fileroot ) - 1] = 0;
+	nChannels = n_channels;
+
+	if ( nReplaySamples > 1 ) {
+		samplePeriod = ( recordedAnalogSamples[nReplaySamples - 1].time - recordedAnalogSamples[0].time ) / ( nReplaySamples - 1 );
+	}
+	if ( samplePeriod <= 0.0 ) samplePeriod = ANALOG_SAMPLE_PERIOD;
+
+	acquisitionOn = false;
+	overrun = false;
+	duration = 0.0;
+	return( true );
+
+}
+
+/*********************************************************************************/
+
+void DexReplayADC::Initialize( void ) {}
+void DexReplayADC::Quit( void ) {}
+
+// Same timing as DexReplayTracker::CurrentFrame().
+
+int DexReplayADC::CurrentSample( void ) {
+
+	double	elapsed;
+	int		smpl;
+
+	if ( acquisitionOn ) elapsed = DexTimerElapsedTime( acquisitionTimer );
+	else elapsed = duration;
+	smpl = (int) floor( elapsed * speed / samplePeriod );
+	if ( smpl >= nReplaySamples ) smpl = nReplaySamples - 1;
+	if ( smpl < 0 ) smpl = 0;
+	return( smpl );
+
+}
+
+// A sample of the recording, with its time stamp on the replay clock.
+
+void DexReplayADC::ReplaySample( AnalogSample &sample, int smpl ) {
+	CopyAnalogSample( sample, recordedAnalogSamples[smpl] );
+	sample.time = recordedAnalogSamples[0].time + ( recordedAnalogSamples[smpl].time - recordedAnalogSamples[0].time ) / speed;
+}
+
+bool DexReplayADC::GetCurrentAnalogSample( AnalogSample &sample ) {
+	ReplaySample( sample, CurrentSample() );
+	return( true );
+}
+
+void DexReplayADC::StartAcquisition( float max_duration ) {
+	acquisitionOn = true;
+	overrun = false;
+	duration = 0.0;
+	maxDuration = max_duration;
+	DexTimerSet( acquisitionTimer, max_duration );
+}
+
+void DexReplayADC::StopAcquisition( void ) {
+	if ( acquisitionOn ) duration = DexTimerElapsedTime( acquisitionTimer );
+	acquisitionOn = false;
+	allow_polling = false;
+}
+
+bool DexReplayADC::GetAcquisitionState( void ) {
+	return( acquisitionOn );
+}
+
+bool DexReplayADC::CheckAcquisitionOverrun( void ) {
+	return( overrun );
+}
+
+int DexReplayADC::Update( void ) {
+	if ( acquisitionOn && DexTimerTimeout( acquisitionTimer ) ) {
+		acquisitionOn = false;
+		overrun = true;
+		duration = maxDuration;
+	}
+	return( 0 );
+}
+
+// As for DexReplayTracker::RetrieveMarkerFrames(), on the replay clock.
+
+int DexReplayADC::RetrieveAnalogSamples( AnalogSample samples[], int max_samples ) {
+
+	int n = (int) floor( duration * speed / samplePeriod ) + 1;
+	if ( n > nReplaySamples ) n = nReplaySamples;
+	if ( n > max_samples ) n = max_samples;
+
+	for ( int smpl = 0; smpl < n; smpl++ ) ReplaySample( samples[smpl], smpl );
+
+	nAcqSamples = n;
+	return( nAcqSamples );
+
+}
+
+/*********************************************************************************/
+
+// The .adc file, as written by DexApparatus::SaveAcquisition().
+
+bool DexWriteAnalogFile( const char *filename, const AnalogSample samples[], int n_samples, int n_channels ) {
+
+	FILE *fp;
+	int smpl, chan;
+
+	fp = fopen( filename, "w" );
+	if ( !fp ) return( false );
+	fprintf( fp, "Sample\tTime" );
+	for ( chan = 0; chan < n_channels; chan++ ) fprintf( fp, "\tCH%02d", chan );
+	fprintf( fp, "\n" );
+	for ( smpl = 0; smpl < n_samples; smpl++ ) {
+		fprintf( fp, "%d\t%.3f", smpl, samples[smpl].time );
+		for ( chan = 0; chan < n_channels; chan++ ) fprintf( fp, "\t%f", samples[smpl].channel[chan] );
+		fprintf( fp, "\n" );
+	}
+	fclose( fp );
+	return( true );
+
+}
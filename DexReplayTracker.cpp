@@ -0,0 +1,320 @@
+/***************************************************************************/
+/*                                                                         */
+/*                             DexReplayTracker                            */
+/*                                                                         */
+/***************************************************************************/
+
+// This is a tracker that plays back a trial recorded by DexApparatus, so that
+// the real-time feedback, the post hoc checks and the save pipeline can be
+// run on real data without a CODA. The frames were saved in aligned
+// coordinates, so the unit transforms are the identity.
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <fMessageBox.h>
+#include "DexTracker.h"
+
+// The lines of a .mrk file hold 4 values per marker for each page.
+#define REPLAY_MAX_LINE		32768
+#define REPLAY_MAX_FIELDS	( 2 + 4 * N_MARKERS * DEX_REPLAY_PAGES )
+
+static char		replayLine[REPLAY_MAX_LINE];
+static double	replayValue[REPLAY_MAX_FIELDS];
+
+/*********************************************************************************/
+
+DexReplayTracker::DexReplayTracker( const char *fileroot, double speed ) {
+
+	acquisitionOn = false;
+	overrun = false;
+	duration = 0.0;
+	maxDuration = 0.0;
+	nAcqFrames = 0;
+	nReplayFrames = 0;
+	nReplayPages = 0;
+	for ( int page = 0; page < DEX_REPLAY_PAGES; page++ ) replayFrames[page] = NULL;
+	this->speed = ( speed > 0.0 ? speed : 1.0 );
+
+	if ( !LoadTrial( fileroot ) ) {
+		fMessageBox( MB_OK, "DexReplayTracker", "Unable to load the marker recording.\n\n File: %s.mrk", fileroot );
+		exit( -1 );
+	}
+
+}
+
+DexReplayTracker::~DexReplayTracker( void ) {
+	for ( int page = 0; page < DEX_REPLAY_PAGES; page++ ) delete [] replayFrames[page];
+}
+
+// Split a tab separated line of numbers, as in DexPostHocAnalyzer.
+
+static int ReplayFields( char *line, double value[], int max_values ) {
+
+	char *ptr = line;
+	char *end;
+	int n;
+
+	for ( n = 0; n < max_values; n++ ) {
+		value[n] = strtod( ptr, &end );
+		if ( end == ptr ) break;
+		ptr = end;
+	}
+	return( n );
+
+}
+
+bool DexReplayTracker::LoadTrial( const char *fileroot ) {
+
+	FILE	*fp;
+	char	filename[512];
+	char	*token;
+	int		n_markers, n_fields, n_pages, n_lines;
+	int		frm, page, mrk, field;
+
+	sprintf( filename, "%s.mrk", fileroot );
+	fp = fopen( filename, "r" );
+	if ( !fp ) return( false );
+
+	// The header has 4 columns (M00V, M00X ...) for each marker, followed by 
+	// 4 columns (U0M00V ...) for each marker of each page.
+	if ( !fgets( replayLine, sizeof( replayLine ), fp ) ) {
+		fclose( fp );
+		return( false );
+	}
+	n_markers = 0;
+	for ( token = strtok( replayLine, "\t\r\n" ); token; token = strtok( NULL, "\t\r\n" ) ) {
+		if ( token[0] == 'M' ) n_markers++;
+	}
+	n_markers /= 4;
+	if ( n_markers < 1 ) {
+		fclose( fp );
+		return( false );
+	}
+
+	// Count the lines and see how many pages there are from the first one,
+	// so as to allocate only what the recording needs. Pages beyond what 
+	// we have room for are dropped.
+	n_pages = 0;
+	n_lines = 0;
+	while ( n_lines < DEX_MAX_MARKER_FRAMES && fgets( replayLine, sizeof( replayLine ), fp ) ) {
+		if ( n_pages == 0 ) {
+			n_fields = ReplayFields( replayLine, replayValue, REPLAY_MAX_FIELDS );
+			if ( n_fields < 2 + 4 * n_markers ) continue;
+			n_pages = ( n_fields - 2 ) / ( 4 * n_markers );
+		}
+		n_lines++;
+	}
+	if ( n_lines < 1 ) {
+		fclose( fp );
+		return( false );
+	}
+	if ( n_pages > DEX_REPLAY_PAGES ) n_pages = DEX_REPLAY_PAGES;
+
+	for ( page = 0; page < DEX_REPLAY_PAGES; page++ ) {
+		delete [] replayFrames[page];
+		replayFrames[page] = NULL;
+	}
+	for ( page = 0; page < n_pages; page++ ) {
+		replayFrames[page] = new CodaFrame[n_lines];
+		if ( !replayFrames[page] ) {
+			fclose( fp );
+			return( false );
+		}
+	}
+
+	// Now read the frames.
+	rewind( fp );
+	fgets( replayLine, sizeof( replayLine ), fp );
+	nReplayFrames = 0;
+	while ( nReplayFrames < n_lines && fgets( replayLine, sizeof( replayLine ), fp ) ) {
+		n_fields = ReplayFields( replayLine, replayValue, REPLAY_MAX_FIELDS );
+		if ( n_fields < 2 + 4 * n_markers ) continue;
+		frm = nReplayFrames++;
+		for ( page = 0; page < n_pages; page++ ) {
+			replayFrames[page][frm].time = replayValue[1];
+			for ( mrk = 0; mrk < N_MARKERS; mrk++ ) {
+				field = 2 + 4 * ( page * n_markers + mrk );
+				CodaMarker *marker = &replayFrames[page][frm].marker[mrk];
+				if ( mrk < n_markers && field + 3 < n_fields ) {
+					marker->visibility = ( replayValue[field] != 0.0 );
+					marker->position[X] = replayValue[field + 1];
+					marker->position[Y] = replayValue[field + 2];
+					marker->position[Z] = replayValue[field + 3];
+				}
+				else {
+					marker->visibility = false;
+					marker->position[X] = marker->position[Y] = marker->position[Z] = INVISIBLE;
+				}
+			}
+		}
+	}
+	fclose( fp );
+	if ( nReplayFrames < 1 ) return( false );
+
+	strncpy( this->fileroot, fileroot, sizeof( this->fileroot ) - 1 );
+	this->fileroot[sizeof( this->fileroot ) - 1] = 0;
+	nReplayPages = n_pages;
+	nCodas = n_pages - 1;
+	nMarkers = n_markers;
+
+	// The frames were resampled at a constant rate, so we can recover the sample period.
+	if ( nReplayFrames > 1 ) {
+		samplePeriod = ( replayFrames[0][nReplayFrames - 1].time - replayFrames[0][0].time ) / ( nReplayFrames - 1 );
+	}
+	if ( samplePeriod <= 0.0 ) samplePeriod = MARKER_SAMPLE_PERIOD;
+
+	acquisitionOn = false;
+	overrun = false;
+	duration = 0.0;
+	return( true );
+
+}
+
+/*********************************************************************************/
+
+void DexReplayTracker::Initialize( void ) {
+	InvalidateUnitTransforms();
+}
+
+void DexReplayTracker::Quit( void ) {}
+
+int DexReplayTracker::GetNumberOfCodas( void ) {
+	return( nCodas );
+}
+
+void DexReplayTracker::GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotation ) {
+	CopyVector( offset, zeroVector );
+	CopyMatrix( rotation, identityMatrix );
+}
+
+/*********************************************************************************/
+
+// The recording is played from its start at each acquisition. Before the first
+// one we show the first frame and after the end of an acquisition, the frame
+// where it stopped. Polling more often than samplePeriod gives the same frame.
+
+int DexReplayTracker::CurrentFrame( void ) {
+
+	double	elapsed;
+	int		frm;
+
+	if ( acquisitionOn ) elapsed = DexTimerElapsedTime( acquisitionTimer );
+	else elapsed = duration;
+	frm = (int) floor( elapsed * speed / samplePeriod );
+	if ( frm >= nReplayFrames ) frm = nReplayFrames - 1;
+	if ( frm < 0 ) frm = 0;
+	return( frm );
+
+}
+
+// A frame of the recording, with its time stamp on the replay clock, i.e.
+// counted from the start of the recording at the replay speed. 
+
+void DexReplayTracker::ReplayFrame( CodaFrame &frame, int page, int frm ) {
+	CopyMarkerFrame( frame, replayFrames[page][frm] );
+	frame.time = replayFrames[0][0].time + ( replayFrames[page][frm].time - replayFrames[0][0].time ) / speed;
+}
+
+bool DexReplayTracker::GetCurrentMarkerFrame( CodaFrame &frame ) {
+	ReplayFrame( frame, 0, CurrentFrame() );
+	return( true );
+}
+
+bool DexReplayTracker::GetCurrentMarkerFrameUnit( CodaFrame &frame, int unit ) {
+	// Recordings without the individual units only have the combined page.
+	int page = ( unit + 1 < nReplayPages ? unit + 1 : 0 );
+	ReplayFrame( frame, page, CurrentFrame() );
+	return( true );
+}
+
+void DexReplayTracker::StartAcquisition( float max_duration ) {
+	acquisitionOn = true;
+	overrun = false;
+	duration = 0.0;
+	maxDuration = max_duration;
+	DexTimerSet( acquisitionTimer, max_duration );
+}
+
+void DexReplayTracker::StopAcquisition( void ) {
+	if ( acquisitionOn ) duration = DexTimerElapsedTime( acquisitionTimer );
+	acquisitionOn = false;
+}
+
+bool DexReplayTracker::GetAcquisitionState( void ) {
+	return( acquisitionOn );
+}
+
+bool DexReplayTracker::CheckAcquisitionOverrun( void ) {
+	return( overrun );
+}
+
+int DexReplayTracker::Update( void ) {
+	if ( acquisitionOn && DexTimerTimeout( acquisitionTimer ) ) {
+		acquisitionOn = false;
+		overrun = true;
+		duration = maxDuration;
+	}
+	return( 0 );
+}
+
+// The part of the recording covered by the acquisition, on the replay clock,
+// so that the frames line up with the events marked by the apparatus.
+
+int DexReplayTracker::RetrieveMarkerFrames( CodaFrame frames[], int max_frames, int unit ) {
+
+	int page = ( unit < nReplayPages ? unit : 0 );
+	int n = (int) floor( duration * speed / samplePeriod ) + 1;
+	if ( n > nReplayFrames ) n = nReplayFrames;
+	if ( n > max_frames ) n = max_frames;
+
+	for ( int frm = 0; frm < n; frm++ ) ReplayFrame( frames[frm], page, frm );
+
+	nAcqFrames = n;
+	return( nAcqFrames );
+
+}
+
+/*********************************************************************************/
+
+// The .mrk file, as written by DexApparatus::SaveAcquisition().
+
+bool DexWriteMarkerFile( const char *filename, CodaFrame *pages[], int n_pages, int n_markers, 
+						 const ManipulandumState state[], int n_frames ) {
+
+	FILE *fp;
+	int page, frm, mrk;
+
+	fp = fopen( filename, "w" );
+	if ( !fp ) return( false );
+	fprintf( fp, "Sample\tTime" );
+	for ( mrk = 0; mrk < n_markers; mrk++ ) fprintf( fp, "\tM%02dV\tM%02dX\tM%02dY\tM%02dZ", mrk, mrk, mrk, mrk );
+	for ( page = 0; page < n_pages; page++ ) {
+		for ( mrk = 0; mrk < n_markers; mrk++ ) {
+			fprintf( fp, "\tU%1dM%02dV\tU%1dM%02dX\tU%1dM%02dY\tU%1dM%02dZ", page, mrk, page, mrk, page, mrk, page, mrk );
+		}
+	}
+	fprintf( fp, "\n" );
+	for ( frm = 0; frm < n_frames; frm++ ) {
+		fprintf( fp, "%d\t%.3f", frm, state[frm].time ); 
+		for ( page = 0; page < n_pages; page++ ) {
+			for ( mrk = 0; mrk < n_markers; mrk++ ) {
+				fprintf( fp, "\t%d\t%f\t%f\t%f", 
+					pages[page][frm].marker[mrk].visibility,
+					pages[page][frm].marker[mrk].position[X],
+					pages[page][frm].marker[mrk].position[Y],
+					pages[page][frm].marker[mrk].position[Z] );
+			}
+		}
+		fprintf( fp, "\n" );
+	}
+	fclose( fp );
+	return( true );
+
+}
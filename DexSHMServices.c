@@ -0,0 +1,152 @@
+/*
+* File:	DexSHMServices.c
+* Author:	J. McIntyre
+* Rev:		-
+* Desc:	A ring of telemetry packets in shared memory. See DexSHMServices.h.
+*/
+#include <windows.h>
+#include <string.h>
+
+#include "DexSHMServices.h"
+
+// The counters are read and written with the interlocked functions, which
+// also keep the compiler and the processor from moving the copies of the
+// packets across them. For this the readers need write access to the ring too.
+
+static unsigned long DexSHMLoad( volatile LONG *counter ) {
+	return( (unsigned long) InterlockedExchangeAdd( (LONG *) counter, 0 ) );
+}
+
+static int DexSHMMap( DexSHM *dex_shm_parameters ) {
+
+	dex_shm_parameters->header = (DexSHMHeader *) MapViewOfFile( dex_shm_parameters->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0 );
+	if ( !dex_shm_parameters->header ) {
+		CloseHandle( dex_shm_parameters->mapping );
+		dex_shm_parameters->mapping = NULL;
+		return( DEX_SHM_ERROR );
+	}
+	dex_shm_parameters->slot = (DexSHMSlot *) ( dex_shm_parameters->header + 1 );
+	dex_shm_parameters->lost = 0;
+	return( 0 );
+
+}
+
+/************************************************************************/
+
+int DexSHMInitServer( DexSHM *dex_shm_parameters, const char *name, int slots ) {
+
+	DexSHMHeader *header;
+	unsigned long size = sizeof( DexSHMHeader ) + slots * sizeof( DexSHMSlot );
+	int existed;
+
+	dex_shm_parameters->mapping = CreateFileMapping( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name );
+	if ( !dex_shm_parameters->mapping ) return( DEX_SHM_ERROR );
+	existed = ( GetLastError() == ERROR_ALREADY_EXISTS );
+	if ( DexSHMMap( dex_shm_parameters ) ) return( DEX_SHM_ERROR );
+	header = dex_shm_parameters->header;
+
+	// Carry on with the numbering of a ring that is still there from a previous run.
+	if ( existed ) {
+		if ( header->magic == DEX_SHM_MAGIC && header->slots == (unsigned long) slots ) {
+			InterlockedExchange( (LONG *) &header->claimed, header->published );
+			dex_shm_parameters->next = DexSHMLoad( &header->published );
+			return( 0 );
+		}
+		// A ring of another size is still in use.
+		if ( header->magic == DEX_SHM_MAGIC ) {
+			DexSHMClose( dex_shm_parameters );
+			return( DEX_SHM_ERROR );
+		}
+	}
+	header->slots = slots;
+	header->claimed = 0;
+	header->published = 0;
+	InterlockedExchange( (LONG *) &header->magic, DEX_SHM_MAGIC );
+	dex_shm_parameters->next = 0;
+	return( 0 );
+
+}
+
+void DexSHMPublish( DexSHM *dex_shm_parameters, const char *packet, int size ) {
+
+	DexSHMHeader *header = dex_shm_parameters->header;
+	unsigned long sequence = dex_shm_parameters->next;
+	DexSHMSlot *slot = &dex_shm_parameters->slot[sequence % header->slots];
+
+	if ( size < 0 ) return;
+	if ( size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+	InterlockedExchange( (LONG *) &header->claimed, sequence + 1 );
+	slot->size = size;
+	memcpy( slot->data, packet, size );
+	InterlockedExchange( (LONG *) &header->published, sequence + 1 );
+	dex_shm_parameters->next = sequence + 1;
+
+}
+
+/************************************************************************/
+
+int DexSHMInitClient( DexSHM *dex_shm_parameters, const char *name ) {
+
+	dex_shm_parameters->mapping = OpenFileMapping( FILE_MAP_ALL_ACCESS, FALSE, name );
+	if ( !dex_shm_parameters->mapping ) return( DEX_SHM_ERROR );
+	if ( DexSHMMap( dex_shm_parameters ) ) return( DEX_SHM_ERROR );
+	if ( dex_shm_parameters->header->magic != DEX_SHM_MAGIC ) {
+		DexSHMClose( dex_shm_parameters );
+		return( DEX_SHM_ERROR );
+	}
+	dex_shm_parameters->next = DexSHMLoad( &dex_shm_parameters->header->published );
+	return( 0 );
+
+}
+
+// If the writer has started on the slot of the next packet to read, or gone
+// beyond, move on to the oldest packet that is still whole. Returns how many were skipped.
+static unsigned long DexSHMCatchUp( DexSHM *dex_shm_parameters ) {
+
+	unsigned long claimed = DexSHMLoad( &dex_shm_parameters->header->claimed );
+	unsigned long slots = dex_shm_parameters->header->slots;
+	unsigned long skipped;
+
+	if ( claimed - dex_shm_parameters->next <= slots ) return( 0 );
+	skipped = claimed - slots - dex_shm_parameters->next;
+	dex_shm_parameters->next = claimed - slots;
+	dex_shm_parameters->lost += skipped;
+	return( skipped );
+
+}
+
+int DexSHMRead( DexSHM *dex_shm_parameters, char packet[DEX_UDP_PACKET_SIZE] ) {
+
+	DexSHMHeader *header = dex_shm_parameters->header;
+	DexSHMSlot *slot;
+	int size;
+
+	while ( DexSHMLoad( &header->published ) != dex_shm_parameters->next ) {
+		DexSHMCatchUp( dex_shm_parameters );
+		slot = &dex_shm_parameters->slot[dex_shm_parameters->next % header->slots];
+		// The size may be torn if the slot is being overwritten, hence the check.
+		size = slot->size;
+		if ( size < 0 || size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+		memcpy( packet, slot->data, size );
+		// Only keep the copy if the writer did not get to the slot in the meantime.
+		if ( !DexSHMCatchUp( dex_shm_parameters ) ) {
+			dex_shm_parameters->next++;
+			return( size );
+		}
+	}
+	return( 0 );
+
+}
+
+unsigned long DexSHMBacklog( DexSHM *dex_shm_parameters ) {
+	unsigned long backlog = DexSHMLoad( &dex_shm_parameters->header->published ) - dex_shm_parameters->next;
+	// Whatever is beyond a ring behind is lost already.
+	return( backlog > dex_shm_parameters->header->slots ? dex_shm_parameters->header->slots : backlog );
+}
+
+void DexSHMClose( DexSHM *dex_shm_parameters ) {
+	if ( dex_shm_parameters->header ) UnmapViewOfFile( dex_shm_parameters->header );
+	if ( dex_shm_parameters->mapping ) CloseHandle( dex_shm_parameters->mapping );
+	dex_shm_parameters->header = NULL;
+	dex_shm_parameters->mapping = NULL;
+}
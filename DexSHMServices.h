@@ -0,0 +1,93 @@
+/*
+ * File:	DexSHMServices.h
+ * Author:	J. McIntyre
+ */
+
+/*
+ * A ring of packets in shared memory, so that the apparatus can publish its
+ * telemetry once for any number of programs on the same machine (viewers,
+ * loggers, analysis tools), each reading at its own pace. The apparatus is the
+ * only one to write. It never waits for the readers. A reader that falls more
+ * than a ring behind loses the oldest packets and is told how many.
+ *
+ * The packets are the same as those that go out over UDP (see DexTelemetry.h).
+ * Publishing one costs a copy into the ring and no system call.
+ */
+
+#ifndef _DexSHMServices_
+
+#include <windows.h>
+
+#include "DexUDPServices.h"
+
+#define DEX_SHM_ERROR -1
+
+// Name of the shared memory and number of packets that it holds.
+// The readers take the number of slots from the ring itself.
+#define DEX_SHM_DEFAULT_NAME	"DexTelemetryRing"
+#define DEX_SHM_SLOTS			1024
+#define DEX_SHM_MAGIC			0x44455852
+
+// Packets are numbered from when the ring was created. Packet n is in
+// slot n % slots. The writer raises claimed before it starts to overwrite
+// a slot and published once the packet is complete. A reader checks claimed
+// after its copy to know that the slot was not overwritten in the meantime.
+typedef struct {
+	unsigned long	magic;
+	unsigned long	slots;
+	volatile LONG	claimed;
+	volatile LONG	published;
+} DexSHMHeader;
+
+typedef struct {
+	int		size;
+	char	data[DEX_UDP_PACKET_SIZE];
+} DexSHMSlot;
+
+typedef struct {
+
+	HANDLE			mapping;
+	DexSHMHeader	*header;
+	DexSHMSlot		*slot;
+
+	// For a reader, the next packet to read and how many were overwritten
+	// before it could read them.
+	unsigned long	next;
+	unsigned long	lost;
+
+} DexSHM;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Create the ring, or take over the one left by a previous run if it is the
+ * same size, so that the readers still attached carry on. Returns 0 or DEX_SHM_ERROR.
+ * There must be only one writer. DexSHMPublish() is not to be called from
+ * more than one thread at a time.
+ */
+int  DexSHMInitServer( DexSHM *dex_shm_parameters, const char *name, int slots );
+void DexSHMPublish( DexSHM *dex_shm_parameters, const char *packet, int size );
+
+/*
+ * Attach to the ring. The reader gets the packets published from then on.
+ * Returns 0 or DEX_SHM_ERROR if there is no such ring.
+ * DexSHMRead() returns the size of the next packet, or 0 if there is nothing new.
+ * If the ring went round before some of the packets could be read, it carries
+ * on with the oldest that is left and adds the number that were skipped to lost.
+ */
+int  DexSHMInitClient( DexSHM *dex_shm_parameters, const char *name );
+int  DexSHMRead( DexSHM *dex_shm_parameters, char packet[DEX_UDP_PACKET_SIZE] );
+
+/* How many packets the reader has yet to read. */
+unsigned long DexSHMBacklog( DexSHM *dex_shm_parameters );
+
+void DexSHMClose( DexSHM *dex_shm_parameters );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _DexSHMServices_
+#endif
@@ -0,0 +1,142 @@
+/*
+* File:	DexSendQueue.c
+* Author:	J. McIntyre
+* Rev:		-
+* Desc:	The send queue of DexMonitorServerUDP. See DexSendQueue.h.
+*/
+#include <windows.h>
+#include <string.h>
+#include <math.h>
+
+#include "DexSendQueue.h"
+#include "DexTelemetry.h"
+
+void DexSendQueueInit( DexSendQueue *queue, double rate, double burst, unsigned long now ) {
+
+	int i;
+
+	queue->nQueued = 0;
+	for ( queue->nFree = 0; queue->nFree < DEX_SEND_QUEUE_LENGTH; queue->nFree++ ) queue->free[queue->nFree] = queue->nFree;
+	queue->replaced = 0;
+	for ( i = 0; i < DEX_PRIORITIES; i++ ) queue->dropped[i] = 0;
+
+	DexSendQueueSetRate( queue, rate, burst );
+	queue->tokens = queue->burst;
+	queue->lastRefill = now;
+
+}
+
+void DexSendQueueSetRate( DexSendQueue *queue, double rate, double burst ) {
+	// The bucket has to be able to hold the largest packet.
+	if ( burst < DEX_UDP_PACKET_SIZE ) burst = DEX_UDP_PACKET_SIZE;
+	queue->rate = rate;
+	queue->burst = burst;
+}
+
+// Fold the binary state that is waiting in the slot into the newer one. 
+// Returns the size of the merged packet, or 0 if there is nothing to merge.
+
+static int DexSendQueueMerge( DexQueuedPacket *waiting, const char *packet, int size, unsigned char merged[DEX_TLM_MAX_PACKET_SIZE] ) {
+
+	DexTelemetryMessage newer, older;
+
+	if ( size > DEX_TLM_MAX_PACKET_SIZE || !DexTelemetryIsBinary( (const unsigned char *) packet, size ) ) return( 0 );
+	if ( DexTelemetryDecode( (const unsigned char *) packet, size, &newer ) <= 0 ) return( 0 );
+	if ( DexTelemetryDecode( (const unsigned char *) waiting->data, waiting->size, &older ) <= 0 ) return( 0 );
+	DexTelemetryMergeStates( &newer, &older );
+	size = DexTelemetryEncode( merged, DEX_TLM_MAX_PACKET_SIZE, &newer );
+	return( size > 0 ? size : 0 );
+
+}
+
+int DexSendQueuePut( DexSendQueue *queue, const char *packet, int size, int priority ) {
+
+	unsigned char merged[DEX_TLM_MAX_PACKET_SIZE];
+	int i, slot = -1, victim, merged_size;
+
+	if ( size < 0 || priority < 0 || priority >= DEX_PRIORITIES ) return( 0 );
+	if ( size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+
+	// A newer state makes the one that is still waiting obsolete.
+	if ( priority == DEX_LOW_PRIORITY ) {
+		for ( i = 0; i < queue->nQueued; i++ ) {
+			if ( queue->slot[queue->order[i]].priority == DEX_LOW_PRIORITY ) {
+				slot = queue->order[i];
+				queue->replaced++;
+				merged_size = DexSendQueueMerge( &queue->slot[slot], packet, size, merged );
+				if ( merged_size > 0 ) {
+					packet = (const char *) merged;
+					size = merged_size;
+				}
+				break;
+			}
+		}
+	}
+
+	// If the queue is full, drop the oldest of the least important packets, 
+	// unless the new one is even less important.
+	if ( slot < 0 && queue->nFree == 0 ) {
+		if ( queue->nQueued == 0 ) {
+			// Every slot is being sent.
+			queue->dropped[priority]++;
+			return( 0 );
+		}
+		victim = 0;
+		for ( i = 1; i < queue->nQueued; i++ ) {
+			if ( queue->slot[queue->order[i]].priority < queue->slot[queue->order[victim]].priority ) victim = i;
+		}
+		if ( queue->slot[queue->order[victim]].priority > priority ) {
+			queue->dropped[priority]++;
+			return( 0 );
+		}
+		queue->dropped[queue->slot[queue->order[victim]].priority]++;
+		queue->free[queue->nFree++] = queue->order[victim];
+		for ( i = victim; i < queue->nQueued - 1; i++ ) queue->order[i] = queue->order[i + 1];
+		queue->nQueued--;
+	}
+
+	if ( slot < 0 ) {
+		slot = queue->free[--queue->nFree];
+		queue->order[queue->nQueued++] = slot;
+	}
+	memcpy( queue->slot[slot].data, packet, size );
+	queue->slot[slot].size = size;
+	queue->slot[slot].priority = priority;
+	return( 1 );
+
+}
+
+int DexSendQueueTake( DexSendQueue *queue, unsigned long now, int slot[], int max, unsigned long *wait ) {
+
+	int n, i;
+	double bytes;
+
+	*wait = 0;
+	if ( queue->nQueued == 0 ) return( 0 );
+
+	if ( queue->rate > 0.0 ) {
+		queue->tokens += ( now - queue->lastRefill ) * queue->rate / 1000.0;
+		if ( queue->tokens > queue->burst ) queue->tokens = queue->burst;
+		queue->lastRefill = now;
+		if ( queue->tokens < queue->slot[queue->order[0]].size ) {
+			*wait = (unsigned long) ceil( ( queue->slot[queue->order[0]].size - queue->tokens ) * 1000.0 / queue->rate );
+			return( 0 );
+		}
+	}
+
+	for ( n = 0, bytes = 0.0; n < queue->nQueued && n < max; n++ ) {
+		if ( queue->rate > 0.0 && bytes + queue->slot[queue->order[n]].size > queue->tokens ) break;
+		slot[n] = queue->order[n];
+		bytes += queue->slot[slot[n]].size;
+	}
+	for ( i = 0; i < queue->nQueued - n; i++ ) queue->order[i] = queue->order[i + n];
+	queue->nQueued -= n;
+	if ( queue->rate > 0.0 ) queue->tokens -= bytes;
+	return( n );
+
+}
+
+void DexSendQueueRelease( DexSendQueue *queue, const int slot[], int n ) {
+	int i;
+	for ( i = 0; i < n; i++ ) queue->free[queue->nFree++] = slot[i];
+}
@@ -0,0 +1,94 @@
+/*
+ * File:	DexSendQueue.h
+ * Author:	J. McIntyre
+ */
+
+/*
+ * The packets waiting to be sent by DexMonitorServerUDP, and the token bucket 
+ * that paces them. Nothing here touches the network or takes a lock, so that 
+ * the policy can be tested on its own. The caller keeps the queue locked.
+ *
+ * When the queue is full, the oldest packet of the lowest priority is dropped
+ * to make room, unless the new packet has an even lower priority. A state update
+ * replaces any state update that is still waiting to be sent, taking its place
+ * in the queue. The older state has already been counted as sent, so whatever 
+ * it carried that the newer one leaves out is merged into it (see DexTelemetry.h).
+ *
+ * The bucket fills at the rate (bytes per second) up to the burst size (bytes).
+ * Packets go out in order, as many at a time as there are tokens for.
+ */
+
+#ifndef _DexSendQueue_
+
+#include <windows.h>
+
+#include "DexUDPServices.h"
+
+// How badly a packet needs to get through when the link is saturated.
+#define DEX_LOW_PRIORITY		0	// State updates.
+#define DEX_NORMAL_PRIORITY		1	// Recorded data.
+#define DEX_HIGH_PRIORITY		2	// Events, configuration, start and end of recordings.
+#define DEX_PRIORITIES			3
+
+// Packets waiting to be sent by DexMonitorServerUDP.
+#define DEX_SEND_QUEUE_LENGTH	64
+
+typedef struct {
+	int		size;
+	int		priority;
+	char	data[DEX_UDP_PACKET_SIZE];
+} DexQueuedPacket;
+
+// The slots that are waiting are listed oldest first in order[] and the 
+// others in free[]. Slots that are in neither are being sent.
+typedef struct {
+
+	DexQueuedPacket	slot[DEX_SEND_QUEUE_LENGTH];
+	int				order[DEX_SEND_QUEUE_LENGTH];
+	int				free[DEX_SEND_QUEUE_LENGTH];
+	int				nQueued;
+	int				nFree;
+
+	// Token bucket, in bytes. A rate of zero sends as fast as possible.
+	double			rate;
+	double			burst;
+	double			tokens;
+	unsigned long	lastRefill;
+
+	unsigned long	replaced;
+	unsigned long	dropped[DEX_PRIORITIES];
+
+} DexSendQueue;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Start empty with a full bucket. Times are in ms. The burst is raised
+ * to the size of the largest packet if need be.
+ */
+void DexSendQueueInit( DexSendQueue *queue, double rate, double burst, unsigned long now );
+void DexSendQueueSetRate( DexSendQueue *queue, double rate, double burst );
+
+/*
+ * Queue a copy of the packet. Packets longer than DEX_UDP_PACKET_SIZE are cut
+ * short. Returns 1 if the packet was queued, 0 if it was dropped or refused.
+ */
+int  DexSendQueuePut( DexSendQueue *queue, const char *packet, int size, int priority );
+
+/*
+ * Take the packets at the head that there are tokens for, up to max of them,
+ * and return how many. Their slots are given in slot[] and stay out of the 
+ * queue until they are released, once sent. If the packet at the head has to 
+ * wait for the bucket, returns 0 and the time to wait (ms) in wait.
+ */
+int  DexSendQueueTake( DexSendQueue *queue, unsigned long now, int slot[], int max, unsigned long *wait );
+void DexSendQueueRelease( DexSendQueue *queue, const int slot[], int n );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _DexSendQueue_
+#endif
@@ -24,6 +24,7 @@
 #include "Dexterous.h"
 #include "DexTasks.h"
 #include "DexSimulatorGUI.h"
+#include "DexPictures.h"
 
 #include <3dMatrix.h>
 #include <OglDisplayInterface.h>
@@ -55,6 +56,8 @@ int defaultCameraFrameRate = 2;
 
 char outputScript[256] = "DexSampleScript.dex";
 char inputScript[256] = "DexSampleScript.dex";
+char replayTrial[256] = "DexSimulatorOutput";
+double replaySpeed = 1.0;
 char inputProtocol[256] = "DexSampleProtocol.dex";
 char inputSession[256] = "DexSampleSession.dex";
 char inputSubject[256] = "users.dex";
@@ -587,6 +590,8 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 	bool raz = false;
 	bool instruct_to_sit = false;
 	bool preconfigure = false;
+	bool shared_monitor = false;
+	char shared_monitor_name[256] = DEX_SHM_DEFAULT_NAME;
 
 	int return_code;
 
@@ -616,6 +621,47 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 	}
 
 	if ( strstr( lpCmdLine, "-blaster"   ) ) sound_type = SOUNDBLASTER_SOUNDS;
+	// Generate the marker data and the force sensor signals from scripted movements.
+	if ( strstr( lpCmdLine, "-synthetic"   ) ) {
+		tracker_type = SYNTHETIC_TRACKER;
+		adc_type = SYNTHETIC_ADC;
+	}
+	// Play back the marker and analog data of a recorded trial (.mrk and .adc files),
+	//  at the original pace or faster with -speed=.
+	if ( strstr( lpCmdLine, "-replay" ) ) {
+		char *ptr;
+		if ( ( ptr = strstr( lpCmdLine, "-replay=" ) ) ) {
+			sscanf( ptr + strlen( "-replay=" ), "%s", replayTrial );
+		}
+		if ( ( ptr = strstr( lpCmdLine, "-speed=" ) ) ) {
+			sscanf( ptr + strlen( "-speed=" ), "%lf", &replaySpeed );
+		}
+		tracker_type = REPLAY_TRACKER;
+		adc_type = REPLAY_ADC;
+	}
+
+	// Run on a simulated clock, jumping over the waits. Only makes sense with 
+	//  simulated devices that do not need the subject. Time moves by one step
+	//  per update of the apparatus, never by more than one tracker sample, 
+	//  so that no movement is missed.
+	if ( strstr( lpCmdLine, "-virtual"   ) ) {
+		if ( ( tracker_type != SYNTHETIC_TRACKER && tracker_type != REPLAY_TRACKER )
+			|| ( adc_type != SYNTHETIC_ADC && adc_type != REPLAY_ADC ) || target_type != SCREEN_TARGETS ) {
+			MessageBox( NULL, "-virtual can only be used with -synthetic or -replay devices.", "DexSimulatorApp", MB_OK );
+			exit( -1 );
+		}
+		DexTimerSetVirtual( 1, MARKER_SAMPLE_PERIOD );
+	}
+
+	// Publish the telemetry in shared memory for local readers such as DexTelemetryTap, 
+	//  instead of showing it in the monitor window.
+	if ( strstr( lpCmdLine, "-shm" ) ) {
+		char *ptr;
+		if ( ( ptr = strstr( lpCmdLine, "-shm=" ) ) ) {
+			sscanf( ptr + strlen( "-shm=" ), "%s", shared_monitor_name );
+		}
+		shared_monitor = true;
+	}
 
 	// Now specify what task or protocol to run.
 
@@ -716,6 +762,14 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 			tracker = new DexRTnetTracker();
 			break;
 
+		case SYNTHETIC_TRACKER:
+			tracker = new DexSyntheticTracker();
+			break;
+
+		case REPLAY_TRACKER:
+			tracker = new DexReplayTracker( replayTrial, replaySpeed );
+			break;
+
 		default:
 			MessageBox( NULL, "Unkown tracker type.", "Error", MB_OK );
 
@@ -765,13 +819,22 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 			adc = new DexMouseADC( mouse_tracker_dlg, GLM_CHANNELS ); 
 			break;
 
+		case SYNTHETIC_ADC:
+			adc = new DexSyntheticADC( GLM_CHANNELS ); 
+			break;
+
+		case REPLAY_ADC:
+			adc = new DexReplayADC( replayTrial, replaySpeed ); 
+			break;
+
 		default:
 			MessageBox( NULL, "Unknown adc type.", "Error", MB_OK );
 
 		}
 
 		// Create an interface to a remote monitoring station.
-		monitor = new DexMonitorServerGUI( targets->nVerticalTargets, targets->nHorizontalTargets, tracker->nCodas );
+		if ( shared_monitor ) monitor = new DexMonitorServerSHM( targets->nVerticalTargets, targets->nHorizontalTargets, tracker->nCodas, shared_monitor_name );
+		else monitor = new DexMonitorServerGUI( targets->nVerticalTargets, targets->nHorizontalTargets, tracker->nCodas );
 
 		// Create a dialog box to emulate selection of the extra masses.
 		mass_dlg = DexCreateMassGUI();
@@ -784,6 +847,15 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 
 		// How did we last leave the simulator?
 		LoadGUIState();
+
+		// Decode all the pictures that the task will show now, rather than
+		//  each time that one is shown to the subject.
+		DexGetPictureBitmap( "blank.bmp" );
+		if ( task == RUN_SCRIPT ) DexPreloadScriptPictures( inputScript );
+		else if ( task == RUN_PROTOCOL ) DexPreloadScriptPictures( inputProtocol );
+		else if ( task == RUN_SESSION ) DexPreloadScriptPictures( inputSession );
+		else if ( task == RUN_SUBJECT ) DexPreloadScriptPictures( inputSubject );
+		DexReportPictureCache( apparatus );
 	}
 
 	else apparatus = new DexCompiler( outputScript );
@@ -24,6 +24,7 @@
 #include "Dexterous.h"
 #include "DexTasks.h"
 #include "DexSimulatorGUI.h"
+#include "DexPictures.h"
 
 #include <3dMatrix.h>
 #include <OglDisplayInterface.h>
@@ -42,9 +43,24 @@ HWND	mass_dlg;
 HWND	camera_dlg;
 HWND	workspace_dlg;
 
-// Holds the text of the log messages.
-static char _dexLog[102400] = "";
-static int  _dexLogNext = 0;
+// Holds the log messages. Long messages are spread over consecutive records.
+#define DEX_LOG_RECORDS			4096
+#define DEX_LOG_SLICE			120
+// How many records are put in the log window.
+#define DEX_LOG_VISIBLE_RECORDS	256
+
+typedef struct {
+	// Position in the log plus 1 once the record is complete, 0 while it is being written.
+	LONG	sequence;
+	double	time;
+	bool	continued;
+	bool	last;
+	char	text[DEX_LOG_SLICE + 1];
+} DexLogRecord;
+
+static DexLogRecord	_dexLog[DEX_LOG_RECORDS];
+static LONG			_dexLogHead = 0;
+static DexTimer		_dexLogClock;
 
 // Refresh rate for the log display.
 static DexTimer _refresh_timer;
@@ -105,32 +121,333 @@ void DexInitPlots ( void ) {
 
 }
 
-void DexPlotData( DexApparatus *apparatus ) {
+/**************************************************************************************/
 
-	int i, j, cnt;
+// Drawing a long recording point by point is slow, and mostly wasted because many
+//  samples fall on the same column of pixels. So each time series is reduced to a 
+//  min/max envelope with about one bin per column of the plot window, as wide as it 
+//  is when the data are plotted. Each bin keeps its minimum and its maximum in the 
+//  order in which they occur, so that on the screen the trace looks the same as if 
+//  every sample had been drawn. The trajectories (XY plots) are simply thinned out.
+//  The reduction is done in one pass over the samples, which is much less than it 
+//  costs to draw them, so it is simply done again each time the data are plotted.
+
+#define PLOT_LEVELS				4
+#define PLOT_FINEST_BINS		4096
+// Two points per bin of the finest level.
+#define PLOT_ENVELOPE_POINTS	( 2 * PLOT_FINEST_BINS )
+#define PLOT_MAX_PATH_POINTS	4096
+
+typedef struct {
+	// A series that is short enough is plotted as it is.
+	bool	raw;
+	int		first[PLOT_LEVELS];
+	int		points[PLOT_LEVELS];
+	double	time[PLOT_ENVELOPE_POINTS];
+	double	value[PLOT_ENVELOPE_POINTS];
+} PlotEnvelope;
+
+typedef struct {
+	bool	raw;
+	int		points;
+	double	x[PLOT_MAX_PATH_POINTS];
+	double	y[PLOT_MAX_PATH_POINTS];
+} PlotPath;
+
+typedef struct {
+	double	time;
+	int		event;
+	int		column;
+	double	size;
+} PlotMark;
+
+typedef struct {
+	bool	visible;
+	double	tmin, vmin;
+	double	tmax, vmax;
+} PlotBin;
+
+// The series computed from the recording being plotted.
+static int				_plot_level = 0;
+static PlotEnvelope		_plot_position[3];
+static PlotEnvelope		_plot_velocity;
+static PlotEnvelope		_plot_grip;
+static PlotEnvelope		_plot_load;
+static PlotEnvelope		_plot_cop[N_FORCE_TRANSDUCERS][2];
+static PlotPath			_plot_yz_path;
+static PlotPath			_plot_cop_path[N_FORCE_TRANSDUCERS];
+static PlotMark			_plot_mark[DEX_MAX_EVENTS];
+static int				_plot_marks = 0;
+static PlotBin			_plot_bin[PLOT_FINEST_BINS];
+
+// Pick out the nth value in an array of structures, as the Views routines do.
+#define PLOT_ELEMENT( base, n, size ) ( *(double *)( (char *)( base ) + ( n ) * ( size ) ) )
+
+static int _plotBins( int level ) {
+	return( PLOT_FINEST_BINS >> level );
+}
+
+static void _plotEmitBin( PlotEnvelope *env, int level, PlotBin *bin, double center ) {
+
+	int k = env->first[level] + env->points[level];
+
+	if ( !bin->visible ) {
+		env->time[k] = env->time[k+1] = center;
+		env->value[k] = env->value[k+1] = INVISIBLE;
+	}
+	else if ( bin->tmin <= bin->tmax ) {
+		env->time[k] = bin->tmin; 
+		env->value[k] = bin->vmin;
+		env->time[k+1] = bin->tmax; 
+		env->value[k+1] = bin->vmax;
+	}
+	else {
+		env->time[k] = bin->tmax; 
+		env->value[k] = bin->vmax;
+		env->time[k+1] = bin->tmin; 
+		env->value[k+1] = bin->vmin;
+	}
+	env->points[level] += 2;
+
+}
+
+static void _plotMergeBins( PlotBin *result, PlotBin *a, PlotBin *b ) {
+
+	PlotBin merged;
+
+	if ( !a->visible ) merged = *b;
+	else if ( !b->visible ) merged = *a;
+	else {
+		merged = *a;
+		if ( b->vmin < merged.vmin ) {
+			merged.vmin = b->vmin;
+			merged.tmin = b->tmin;
+		}
+		if ( b->vmax > merged.vmax ) {
+			merged.vmax = b->vmax;
+			merged.tmax = b->tmax;
+		}
+	}
+	*result = merged;
+
+}
+
+static void _plotBuildEnvelope( PlotEnvelope *env, double *time, double *value, int n, int time_size, int value_size, double max_time ) {
+
+	int i, b, level;
+	double t, v;
+	PlotBin *bin;
+
+	// If there are not many more samples than columns, it is not worth it.
+	env->raw = ( n <= 2 * _plotBins( _plot_level ) || max_time <= 0.0 );
+	if ( env->raw ) return;
+
+	for ( b = 0; b < PLOT_FINEST_BINS; b++ ) _plot_bin[b].visible = false;
+	for ( i = 0; i < n; i++ ) {
+		v = PLOT_ELEMENT( value, i, value_size );
+		if ( v == INVISIBLE ) continue;
+		t = PLOT_ELEMENT( time, i, time_size );
+		b = (int) ( t / max_time * PLOT_FINEST_BINS );
+		if ( b < 0 ) b = 0;
+		if ( b >= PLOT_FINEST_BINS ) b = PLOT_FINEST_BINS - 1;
+		bin = &_plot_bin[b];
+		if ( !bin->visible ) {
+			bin->visible = true;
+			bin->tmin = bin->tmax = t;
+			bin->vmin = bin->vmax = v;
+		}
+		else if ( v < bin->vmin ) {
+			bin->vmin = v;
+			bin->tmin = t;
+		}
+		else if ( v > bin->vmax ) {
+			bin->vmax = v;
+			bin->tmax = t;
+		}
+	}
+
+	// Each coarser level is made by merging pairs of bins from the one below.
+	// Only the level that fits the window is kept.
+	for ( level = 1; level <= _plot_level; level++ ) {
+		for ( b = 0; b < _plotBins( level ); b++ ) _plotMergeBins( &_plot_bin[b], &_plot_bin[2 * b], &_plot_bin[2 * b + 1] );
+	}
+	env->first[_plot_level] = 0;
+	env->points[_plot_level] = 0;
+	for ( b = 0; b < _plotBins( _plot_level ); b++ ) {
+		_plotEmitBin( env, _plot_level, &_plot_bin[b], ( b + 0.5 ) * max_time / _plotBins( _plot_level ) );
+	}
+
+}
+
+static void _plotBuildPath( PlotPath *path, double *x, double *y, int n, int x_size, int y_size ) {
+
+	int i, j, step;
+
+	path->raw = ( n <= PLOT_MAX_PATH_POINTS );
+	if ( path->raw ) return;
+
+	// Keep the first visible point out of each group of samples.
+	step = ( n + PLOT_MAX_PATH_POINTS - 1 ) / PLOT_MAX_PATH_POINTS;
+	for ( i = 0, path->points = 0; i < n && path->points < PLOT_MAX_PATH_POINTS; i += step, path->points++ ) {
+		for ( j = i; j < i + step - 1 && j < n - 1 && PLOT_ELEMENT( x, j, x_size ) == INVISIBLE; j++ );
+		path->x[path->points] = PLOT_ELEMENT( x, j, x_size );
+		path->y[path->points] = PLOT_ELEMENT( y, j, y_size );
+	}
+
+}
+
+static void _plotBuildMarks( DexApparatus *apparatus, double max_time ) {
+
+	int i, j, column;
+	double size;
+	int columns = _plotBins( _plot_level );
+
+	for ( i = 0, _plot_marks = 0; i < apparatus->nEvents; i++ ) {
+		// There are a lot of target and sound events, so we plot them as tick marks.
+		// Other events are plotted as full lines.
+		if ( apparatus->eventList[i].event == TARGET_EVENT || apparatus->eventList[i].event == SOUND_EVENT ) size = 0.1;
+		else size = 1.0;
+		column = ( max_time > 0.0 ? (int) ( apparatus->eventList[i].time / max_time * columns ) : 0 );
+		// If 2 events of the same kind fall on the same column, only one would be seen anyway.
+		// The events are in order of time, so we need only look back to the start of the column.
+		for ( j = _plot_marks - 1; j >= 0 && _plot_mark[j].column == column; j-- ) {
+			if ( _plot_mark[j].event == apparatus->eventList[i].event && _plot_mark[j].size == size ) break;
+		}
+		if ( j >= 0 && _plot_mark[j].column == column ) continue;
+		_plot_mark[_plot_marks].time = apparatus->eventList[i].time;
+		_plot_mark[_plot_marks].event = apparatus->eventList[i].event;
+		_plot_mark[_plot_marks].column = column;
+		_plot_mark[_plot_marks].size = size;
+		_plot_marks++;
+	}
+
+}
+
+// Compute everything that is to be plotted from the latest recording, for the 
+//  current size of the plot window.
+
+static void _plotPrepareSeries( DexApparatus *apparatus ) {
+
+	int i, j;
 	Vector3 delta;
 	double max_time;
 	double filtered, filter_constant = 1.0;
+	int frames = apparatus->nAcqFrames;
+	int samples = apparatus->nAcqSamples;
 
-	if ( apparatus->nAcqFrames < 1 ) return;
+	// Use the coarsest envelope that still has a bin for each column of pixels.
+	for ( _plot_level = PLOT_LEVELS - 1; _plot_level > 0 && _plotBins( _plot_level ) < plot_screen_width; _plot_level-- );
 
 	// Compute velocity.
-	for ( i = 0; i < apparatus->nAcqFrames - 1; i++ ) {
+	for ( i = 0; i < frames - 1; i++ ) {
 		apparatus->SubtractVectors( delta, apparatus->acquiredManipulandumState[i+1].position, apparatus->acquiredManipulandumState[i].position );
 		apparatus->ScaleVector( delta, delta, 1.0 / ( apparatus->acquiredManipulandumState[i+1].time - apparatus->acquiredManipulandumState[i].time ) );
 		Vt[i] = apparatus->VectorNorm( delta );
 	}
 	// Back and forth filter to avoid phase lag.
-	for ( i = 0, filtered = 0.0; i < apparatus->nAcqFrames - 1; i++ ) {
+	for ( i = 0, filtered = 0.0; i < frames - 1; i++ ) {
 		filtered = (filter_constant * filtered + Vt[i]) / (1.0 + filter_constant);
 		Vt[i] = filtered;
 	}
-	for ( i = apparatus->nAcqFrames - 2, filtered = 0.0; i >=0 ; i-- ) {
+	for ( i = frames - 2, filtered = 0.0; i >=0 ; i-- ) {
 		filtered = (filter_constant * filtered + Vt[i]) / (1.0 + filter_constant);
 		Vt[i] = filtered;
 	}
 	// There is one less sample, due to the need for the finite difference.
-	Vt[apparatus->nAcqFrames - 1] = INVISIBLE;
+	Vt[frames - 1] = INVISIBLE;
+
+	max_time = apparatus->acquiredManipulandumState[frames-1].time;
+
+	_plotBuildPath( &_plot_yz_path,
+		&apparatus->acquiredManipulandumState[0].position[Z], 
+		&apparatus->acquiredManipulandumState[0].position[Y], 
+		frames, 
+		sizeof( *apparatus->acquiredManipulandumState ), 
+		sizeof( *apparatus->acquiredManipulandumState ) );
+	for ( i = 0; i < N_FORCE_TRANSDUCERS; i++ ) {
+		_plotBuildPath( &_plot_cop_path[i],
+			&apparatus->acquiredCOP[i][0][X], 
+			&apparatus->acquiredCOP[i][0][Y], 
+			samples, 
+			sizeof( *apparatus->acquiredCOP[i] ), 
+			sizeof( *apparatus->acquiredCOP[i] ) );
+	}
+
+	for ( i = 0; i < 3; i++ ) {
+		_plotBuildEnvelope( &_plot_position[i],
+			&apparatus->acquiredManipulandumState[0].time, 
+			&apparatus->acquiredManipulandumState[0].position[i], 
+			frames, 
+			sizeof( *apparatus->acquiredManipulandumState ), 
+			sizeof( *apparatus->acquiredManipulandumState ), 
+			max_time );
+	}
+	_plotBuildEnvelope( &_plot_velocity,
+		&apparatus->acquiredManipulandumState[0].time, 
+		Vt, 
+		frames, 
+		sizeof( *apparatus->acquiredManipulandumState ), 
+		sizeof( *Vt ), 
+		max_time );
+	_plotBuildEnvelope( &_plot_grip,
+		&apparatus->acquiredAnalog[0].time, 
+		&apparatus->acquiredGripForce[0], 
+		samples, 
+		sizeof( *apparatus->acquiredAnalog ), 
+		sizeof( *apparatus->acquiredGripForce ), 
+		max_time );
+	_plotBuildEnvelope( &_plot_load,
+		&apparatus->acquiredAnalog[0].time, 
+		&apparatus->acquiredLoadForceMagnitude[0], 
+		samples, 
+		sizeof( *apparatus->acquiredAnalog ), 
+		sizeof( *apparatus->acquiredLoadForceMagnitude ), 
+		max_time );
+	for ( i = 0; i < N_FORCE_TRANSDUCERS; i++ ) {
+		for ( j = 0; j < 2; j++ ) {
+			_plotBuildEnvelope( &_plot_cop[i][j],
+				&apparatus->acquiredAnalog[0].time, 
+				&apparatus->acquiredCOP[i][0][j], 
+				samples, 
+				sizeof( *apparatus->acquiredAnalog ), 
+				sizeof( *apparatus->acquiredCOP[i] ), 
+				max_time );
+		}
+	}
+
+	_plotBuildMarks( apparatus, max_time );
+
+}
+
+// Plot a series from its envelope, or from the samples themselves if there are not many.
+
+static void _plotSeries( View view, PlotEnvelope *env, double *time, double *value, int n, int time_size, int value_size ) {
+	if ( env->raw ) ViewXYPlotAvailableDoubles( view, time, value, 0, n - 1, time_size, value_size, INVISIBLE );
+	else ViewXYPlotAvailableDoubles( view, 
+			&env->time[env->first[_plot_level]], &env->value[env->first[_plot_level]], 
+			0, env->points[_plot_level] - 1, sizeof( double ), sizeof( double ), INVISIBLE );
+}
+
+// The envelope holds the extremes of the series, so it gives the same scale.
+
+static void _plotAutoScale( View view, PlotEnvelope *env, double *value, int n, int value_size ) {
+	if ( env->raw ) ViewAutoScaleAvailableDoubles( view, value, 0, n - 1, value_size, INVISIBLE );
+	else ViewAutoScaleAvailableDoubles( view, &env->value[env->first[_plot_level]], 0, env->points[_plot_level] - 1, sizeof( double ), INVISIBLE );
+}
+
+static void _plotPath( View view, PlotPath *path, double *x, double *y, int n, int x_size, int y_size ) {
+	if ( path->raw ) ViewXYPlotAvailableDoubles( view, x, y, 0, n - 1, x_size, y_size, INVISIBLE );
+	else ViewXYPlotAvailableDoubles( view, path->x, path->y, 0, path->points - 1, sizeof( double ), sizeof( double ), INVISIBLE );
+}
+
+void DexPlotData( DexApparatus *apparatus ) {
+
+	int i, j, cnt;
+	double max_time;
+
+	if ( apparatus->nAcqFrames < 1 ) return;
+
+	_plotPrepareSeries( apparatus );
 
 	max_time = apparatus->acquiredManipulandumState[apparatus->nAcqFrames-1].time;
 
@@ -151,24 +468,22 @@ void DexPlotData( DexApparatus *apparatus ) {
 
 		ViewColor( yz_view, RED );
 		ViewPenSize( yz_view, 5 );
-		ViewXYPlotAvailableDoubles( yz_view,
+		_plotPath( yz_view, &_plot_yz_path,
 			&apparatus->acquiredManipulandumState[0].position[Z], 
 			&apparatus->acquiredManipulandumState[0].position[Y], 
-			0, frames - 1, 
+			frames, 
 			sizeof( *apparatus->acquiredManipulandumState ), 
-			sizeof( *apparatus->acquiredManipulandumState ), 
-			INVISIBLE );
+			sizeof( *apparatus->acquiredManipulandumState ) );
 
 		for ( i = 0; i < N_FORCE_TRANSDUCERS; i++ ) {
 			ViewSelectColor( cop_view, i );
 			ViewPenSize( cop_view, 5 );
-			ViewXYPlotAvailableDoubles( cop_view,
+			_plotPath( cop_view, &_plot_cop_path[i],
 				&apparatus->acquiredCOP[i][0][X], 
 				&apparatus->acquiredCOP[i][0][Y], 
-				0, samples - 1, 
-				sizeof( *apparatus->acquiredCOP[i] ), 
+				samples, 
 				sizeof( *apparatus->acquiredCOP[i] ), 
-				INVISIBLE );
+				sizeof( *apparatus->acquiredCOP[i] ) );
 		}
 
 		for ( i = 0, cnt = 0; i < 3; i++, cnt++ ) {
@@ -180,21 +495,19 @@ void DexPlotData( DexApparatus *apparatus ) {
 		
 			ViewSetXLimits( view, 0.0, max_time );
 			ViewAutoScaleInit( view );
-			ViewAutoScaleAvailableDoubles( view,
+			_plotAutoScale( view, &_plot_position[i],
 				&apparatus->acquiredManipulandumState[0].position[i], 
-				0, frames - 1, 
-				sizeof( *apparatus->acquiredManipulandumState ), 
-				INVISIBLE );
+				frames, 
+				sizeof( *apparatus->acquiredManipulandumState ) );
 			ViewAutoScaleSetInterval( view, 500.0 );			
 			
 			ViewSelectColor( view, i );
-			ViewXYPlotAvailableDoubles( view,
+			_plotSeries( view, &_plot_position[i],
 				&apparatus->acquiredManipulandumState[0].time, 
 				&apparatus->acquiredManipulandumState[0].position[i], 
-				0, frames - 1, 
+				frames, 
 				sizeof( *apparatus->acquiredManipulandumState ), 
-				sizeof( *apparatus->acquiredManipulandumState ), 
-				INVISIBLE );
+				sizeof( *apparatus->acquiredManipulandumState ) );
 			
 		}
 
@@ -205,20 +518,16 @@ void DexPlotData( DexApparatus *apparatus ) {
 		// Set the span to be covered by autoscale.
 		ViewSetXLimits( view, 0.0, frames );
 		ViewAutoScaleInit( view );
-		ViewAutoScaleAvailableDoubles( view, 
-			Vt, 0, frames - 1, 
-			sizeof( *Vt ), 
-			INVISIBLE );		
+		_plotAutoScale( view, &_plot_velocity, Vt, frames, sizeof( *Vt ) );		
 		ViewColor( view, BLUE );
 		// Now set the span in terms of time.
 		ViewSetXLimits( view, 0.0, max_time );
-		ViewXYPlotAvailableDoubles( view, 
+		_plotSeries( view, &_plot_velocity,
 			&apparatus->acquiredManipulandumState[0].time, 
 			Vt, 
-			0, frames - 1, 
+			frames, 
 			sizeof( *apparatus->acquiredManipulandumState ), 
-			sizeof( *Vt ), 
-			INVISIBLE );
+			sizeof( *Vt ) );
 
 		view = LayoutViewN( layout, cnt++ );
 		ViewColor( view, GREY4 );	
@@ -227,11 +536,10 @@ void DexPlotData( DexApparatus *apparatus ) {
 	
 		ViewSetXLimits( view, 0.0, samples );
 		ViewAutoScaleInit( view );
-		ViewAutoScaleAvailableDoubles( view,
+		_plotAutoScale( view, &_plot_grip,
 			&apparatus->acquiredGripForce[0], 
-			0, samples - 1, 
-			sizeof( *apparatus->acquiredGripForce ), 
-			INVISIBLE );
+			samples, 
+			sizeof( *apparatus->acquiredGripForce ) );
 		ViewAutoScaleSetInterval( view, grip_range );			
 		ViewSetXLimits( view, 0.0, max_time );
 		
@@ -239,13 +547,12 @@ void DexPlotData( DexApparatus *apparatus ) {
 		ViewLine( view, 0.0, 0.0, max_time, 0.0 );
 
 		ViewColor( view, RED );
-		ViewXYPlotAvailableDoubles( view,
+		_plotSeries( view, &_plot_grip,
 			&apparatus->acquiredAnalog[0].time, 
 			&apparatus->acquiredGripForce[0], 
-			0, samples - 1, 
+			samples, 
 			sizeof( *apparatus->acquiredAnalog ), 
-			sizeof( *apparatus->acquiredGripForce ), 
-			INVISIBLE );
+			sizeof( *apparatus->acquiredGripForce ) );
 
 		view = LayoutViewN( layout, cnt++ );
 		ViewColor( view, GREY4 );	
@@ -254,22 +561,20 @@ void DexPlotData( DexApparatus *apparatus ) {
 	
 		ViewSetXLimits( view, 0.0, samples );
 		ViewAutoScaleInit( view );
-		ViewAutoScaleAvailableDoubles( view,
+		_plotAutoScale( view, &_plot_load,
 			&apparatus->acquiredLoadForceMagnitude[0], 
-			0, samples - 1, 
-			sizeof( *apparatus->acquiredLoadForceMagnitude ), 
-			INVISIBLE );
+			samples, 
+			sizeof( *apparatus->acquiredLoadForceMagnitude ) );
 		ViewAutoScaleSetInterval( view, load_range );			
 		ViewSetXLimits( view, 0.0, max_time );
 		
 		ViewColor( view, BLUE );
-		ViewXYPlotAvailableDoubles( view,
+		_plotSeries( view, &_plot_load,
 			&apparatus->acquiredAnalog[0].time, 
 			&apparatus->acquiredLoadForceMagnitude[0], 
-			0, samples - 1, 
+			samples, 
 			sizeof( *apparatus->acquiredAnalog ), 
-			sizeof( *apparatus->acquiredLoadForceMagnitude ), 
-			INVISIBLE );
+			sizeof( *apparatus->acquiredLoadForceMagnitude ) );
 
 		view = LayoutViewN( layout, cnt++ );
 		ViewColor( view, GREY4 );	
@@ -283,30 +588,23 @@ void DexPlotData( DexApparatus *apparatus ) {
 		for ( i = 0; i < N_FORCE_TRANSDUCERS; i++ ) {
 			for ( j = 0; j < 2; j++ ) {
 				ViewSelectColor( view, i * N_FORCE_TRANSDUCERS + j );
-					ViewXYPlotAvailableDoubles( view,
+					_plotSeries( view, &_plot_cop[i][j],
 						&apparatus->acquiredAnalog[0].time, 
 						&apparatus->acquiredCOP[i][0][j], 
-						0, samples - 1, 
+						samples, 
 						sizeof( *apparatus->acquiredAnalog ), 
-						sizeof( *apparatus->acquiredCOP[i] ), 
-						INVISIBLE );
+						sizeof( *apparatus->acquiredCOP[i] ) );
 			}
 		}
 
-		// Plot the events.
-		for ( i = 0; i < apparatus->nEvents; i++ ) {
-			double size;
-			// There are a lot of target and sound events, so we plot them as tick marks.
-			// Other events are plotted as full lines.
-			// If 2 events coincide, you will probably only see one of them.
-			if ( apparatus->eventList[i].event == TARGET_EVENT || apparatus->eventList[i].event == SOUND_EVENT ) size = 0.1;
-			else size = 1.0;
+		// Plot the events, as computed by _plotBuildMarks().
+		for ( i = 0; i < _plot_marks; i++ ) {
 			for ( j = 0; j < cnt; j++ ) {
 				view = LayoutViewN( layout, j );
 				double bottom = view->user_bottom;
-				double top = bottom + size * (view->user_top - view->user_bottom);
-				ViewSelectColor( view, apparatus->eventList[i].event );	
-				ViewLine( view, apparatus->eventList[i].time, bottom, apparatus->eventList[i].time, top );
+				double top = bottom + _plot_mark[i].size * (view->user_top - view->user_bottom);
+				ViewSelectColor( view, _plot_mark[i].event );	
+				ViewLine( view, _plot_mark[i].time, bottom, _plot_mark[i].time, top );
 			}
 		}
 		
@@ -500,6 +798,83 @@ BOOL CALLBACK _dexPopupCallback(HWND hDlg, UINT message, WPARAM wParam, LPARAM l
 }
 
 
+/**************************************************************************************/
+
+// The pictures are decoded and scaled once and kept in the cache of DexPictures.c.
+// The bitmap handed to the static controls belongs to the cache, so the callers 
+//  must not delete it. The caller says where the picture is going to be shown, 
+//  so that it stays pinned in the cache until another one takes its place there.
+
+static DexPictureCacheEntry *_dex_shown_picture[DEX_PICTURE_PLACES] = { NULL, NULL };
+
+static void _dexReleasePictureBitmap( void *handle ) {
+	DeleteObject( (HBITMAP) handle );
+}
+
+static void _dexShowCachedPicture( int place, DexPictureCacheEntry *entry ) {
+	if ( place < 0 || place >= DEX_PICTURE_PLACES ) return;
+	if ( entry ) DexPinCachedPicture( entry );
+	if ( _dex_shown_picture[place] ) DexUnpinCachedPicture( _dex_shown_picture[place] );
+	_dex_shown_picture[place] = entry;
+}
+
+HBITMAP DexGetPictureBitmap( const char *picture, int place ) {
+
+	DexPictureCacheEntry *entry;
+	BITMAPINFO	info;
+	void		*bits;
+	HBITMAP		bitmap;
+	char		filename[512];
+
+	entry = DexGetCachedPicture( picture );
+	if ( entry ) {
+		if ( entry->handle ) {
+			_dexShowCachedPicture( place, entry );
+			return( (HBITMAP) entry->handle );
+		}
+		// First time that it is shown. Make a DIB section out of the decoded pixels.
+		// The DIB holds the only copy that we need from then on.
+		memset( &info, 0, sizeof( info ) );
+		info.bmiHeader.biSize = sizeof( BITMAPINFOHEADER );
+		info.bmiHeader.biWidth = entry->picture.width;
+		info.bmiHeader.biHeight = entry->picture.height;
+		info.bmiHeader.biPlanes = 1;
+		info.bmiHeader.biBitCount = 32;
+		info.bmiHeader.biCompression = BI_RGB;
+		bitmap = CreateDIBSection( NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0 );
+		if ( bitmap ) {
+			memcpy( bits, entry->picture.pixels, entry->picture.width * entry->picture.height * sizeof( unsigned long ) );
+			free( entry->picture.pixels );
+			entry->picture.pixels = NULL;
+			entry->handle = (void *) bitmap;
+			_dexShowCachedPicture( place, entry );
+			return( bitmap );
+		}
+	}
+
+	// Something that our decoder does not handle. Let Windows try, as before.
+	// What was shown here before can go, as far as the cache is concerned.
+	_dexShowCachedPicture( place, NULL );
+	sprintf( filename, "%s%s", PictureFilenamePrefix, picture );
+	return( (HBITMAP) LoadImage( NULL, filename, IMAGE_BITMAP, DEX_PICTURE_WIDTH, DEX_PICTURE_HEIGHT, LR_CREATEDIBSECTION | LR_LOADFROMFILE | LR_VGACOLOR ) );
+
+}
+
+void DexReportPictureCache( DexApparatus *apparatus ) {
+
+	DexPictureCacheStats stats;
+
+	DexGetPictureCacheStats( &stats );
+	apparatus->monitor->SendEvent( "Picture cache: %lu pictures %.1f MB  Hits: %lu %.3f ms  Misses: %lu %.3f ms  Failures: %lu  Evictions: %lu",
+		stats.entries, stats.bytes / ( 1024.0 * 1024.0 ),
+		stats.hits, ( stats.hits ? 1000.0 * stats.hit_time / stats.hits : 0.0 ),
+		stats.misses, ( stats.misses ? 1000.0 * stats.miss_time / stats.misses : 0.0 ),
+		stats.failures, stats.evictions );
+
+}
+
+/**************************************************************************************/
+
 int IllustratedMessageBox( const char *picture, const char *message, const char *label, int buttons ) {
 
 	int return_code;
@@ -514,7 +889,7 @@ int IllustratedMessageBox( const char *picture, const char *message, const char
 			picture, 
 			sizeof( _illustrated_message_picture_filename ) - strlen( PictureFilenamePrefix ) );
 		_illustrated_message_picture_filename[sizeof( _illustrated_message_picture_filename ) - 1] = 0;
-		_illustrated_message_picture_bitmap = (HBITMAP) LoadImage( NULL, _illustrated_message_picture_filename, IMAGE_BITMAP, 595 * .6, 421 * .6, LR_CREATEDIBSECTION | LR_LOADFROMFILE | LR_VGACOLOR );
+		_illustrated_message_picture_bitmap = DexGetPictureBitmap( picture, DEX_POPUP_PICTURE );
 	}
 	else {
 		_illustrated_message_picture_filename[0] = 0;
@@ -549,6 +924,8 @@ int IllustratedMessageBox( const char *picture, const char *message, const char
 	else {
 		return_code = MessageBox( NULL, message, label, buttons );
 	}
+	// The popup is gone, so its picture need not stay in the cache.
+	_dexShowCachedPicture( DEX_POPUP_PICTURE, NULL );
 
 	return( return_code );
 
@@ -571,38 +948,97 @@ int fIllustratedMessageBox( int mb_type, const char *picture, const char *captio
 
 /**************************************************************************************/
 
+// Log messages may come from any thread. Each one is copied into the next records of 
+//  a ring, claimed with a single interlocked add, so that nobody waits on anybody.
+// A record is marked as busy while it is being written. The display takes only the
+//  records that are complete and only the last ones, so the cost of logging stays
+//  the same however long the session. Old messages are simply overwritten.
+
 void DexAddToLogGUI( const char *message ) {
 
-	int i;
+	int		length, slices, i, j, k;
+	long	slot;
+	double	time = DexTimerElapsedTime( _dexLogClock );
+	DexLogRecord *record;
+
+	length = strlen( message );
+	slices = ( length + DEX_LOG_SLICE - 1 ) / DEX_LOG_SLICE;
+	if ( slices < 1 ) slices = 1;
+	if ( slices > DEX_LOG_RECORDS / 4 ) {
+		// Keep just the start of a monster message, rather than wipe out the log.
+		slices = DEX_LOG_RECORDS / 4;
+		length = slices * DEX_LOG_SLICE;
+	}
+	slot = InterlockedExchangeAdd( &_dexLogHead, slices );
+
+	for ( i = 0, k = 0; i < slices; i++, slot++ ) {
+		record = &_dexLog[ slot % DEX_LOG_RECORDS ];
+		InterlockedExchange( &record->sequence, 0 );
+		record->time = time;
+		record->continued = ( i > 0 );
+		record->last = ( i == slices - 1 );
+		for ( j = 0; j < DEX_LOG_SLICE && k < length; j++, k++ ) {
+			if ( message[k] == '\n' ) record->text[j] = '|';
+			else record->text[j] = message[k];
+		}
+		record->text[j] = 0;
+		// Only now can the record be read.
+		InterlockedExchange( &record->sequence, slot + 1 );
+	}
 
-#if 0
-	char date_str [9];
-	char time_str [9];
-	_strdate( date_str);
-	_strtime( time_str );
+	// Only the thread that owns the dialog may update it. 
+	// Otherwise the messages will be shown at the next DexRefreshLogGUI().
+	if ( GetWindowThreadProcessId( workspace_dlg, NULL ) == GetCurrentThreadId() ) DexRefreshLogGUI();
 
-	for ( i = 0; i < strlen( date_str ) && _dexLogNext < sizeof( _dexLog ) - 1; i++, _dexLogNext++ ) _dexLog[_dexLogNext] = date_str[i];
-	if ( _dexLogNext < sizeof( _dexLog ) - 1 ) _dexLog[_dexLogNext++] = ' ';
-	for ( i = 0; i < strlen( time_str ) && _dexLogNext < sizeof( _dexLog ) - 1; i++, _dexLogNext++ ) _dexLog[_dexLogNext] = time_str[i];
-	if ( _dexLogNext < sizeof( _dexLog ) - 1 ) _dexLog[_dexLogNext++] = ' ';
-#endif
+}
 
-	for ( i = 0; i < strlen( message ) && _dexLogNext < sizeof( _dexLog ) - 1; i++ ) {
-		if ( message[i] == '\n' ) _dexLog[ _dexLogNext ] = '|';
-		else _dexLog[ _dexLogNext ] = message[i];
-		if ( _dexLogNext < sizeof( _dexLog ) - 1 ) _dexLogNext++;
+// Show the tail of the log in the dialog, if there is something new.
+// Called by DexAddToLogGUI() and regularly by the apparatus while it updates.
+
+void DexRefreshLogGUI( void ) {
+
+	static char	text[DEX_LOG_VISIBLE_RECORDS * ( DEX_LOG_SLICE + 16 )];
+	static long	shown = 0;
+	long		head, slot, first;
+	int			next, start, lines, i;
+	bool		complete = true;
+	DexLogRecord *record;
+
+	head = _dexLogHead;
+	if ( head == shown || !DexTimerTimeout( _refresh_timer ) ) return;
+
+	// Start at the beginning of a message.
+	first = head - DEX_LOG_VISIBLE_RECORDS;
+	if ( first < 0 ) first = 0;
+	while ( first < head && _dexLog[ first % DEX_LOG_RECORDS ].continued ) first++;
+
+	next = 0;
+	for ( slot = first; slot < head; slot++ ) {
+		record = &_dexLog[ slot % DEX_LOG_RECORDS ];
+		// Skip records still being written. They will be there next time.
+		if ( record->sequence != slot + 1 ) {
+			complete = false;
+			continue;
+		}
+		start = next;
+		// Each message starts with when it was logged, in seconds since the GUI came up.
+		if ( !record->continued ) next += sprintf( text + next, "%9.3f ", record->time );
+		for ( i = 0; i < DEX_LOG_SLICE && record->text[i]; i++ ) text[next++] = record->text[i];
+		if ( record->last ) {
+			text[next++] = '\r';
+			text[next++] = '\n';
+		}
+		// If it was overwritten while we were copying, leave it out.
+		if ( record->sequence != slot + 1 ) next = start;
 	}
-	if ( _dexLogNext < sizeof( _dexLog ) - 1 ) _dexLog[_dexLogNext++] = '\r';
-	if ( _dexLogNext < sizeof( _dexLog ) - 1 ) _dexLog[_dexLogNext++] = '\n';
-	_dexLog[ _dexLogNext ] = 0;
+	text[next] = 0;
+
+	SendDlgItemMessage( workspace_dlg, IDC_LOG, WM_SETTEXT, NULL, (LPARAM) text );
+	lines = SendDlgItemMessage( workspace_dlg, IDC_LOG, EM_GETLINECOUNT, (WPARAM) 0, (LPARAM) 0 );
+	SendDlgItemMessage( workspace_dlg, IDC_LOG, EM_LINESCROLL, (WPARAM) 0, (LPARAM) lines );
+	DexTimerSet( _refresh_timer, _refresh_rate );
+	if ( complete ) shown = head;
 
-	if ( DexTimerTimeout( _refresh_timer ) ) {
-		int lines;
-		SendDlgItemMessage( workspace_dlg, IDC_LOG, WM_SETTEXT, NULL, (LPARAM) _dexLog );
-		lines = SendDlgItemMessage( workspace_dlg, IDC_LOG, EM_GETLINECOUNT, (WPARAM) 0, (LPARAM) 0 );
-		SendDlgItemMessage( workspace_dlg, IDC_LOG, EM_LINESCROLL, (WPARAM) 0, (LPARAM) lines );
-		DexTimerSet( _refresh_timer, _refresh_rate );
-	}
 }
 
 HWND DexInitGUI( HINSTANCE hInstance ) {
@@ -614,8 +1050,11 @@ HWND DexInitGUI( HINSTANCE hInstance ) {
 	workspace_dlg = CreateDialog(hInstance, (LPCSTR)IDD_BACKGROUND, HWND_DESKTOP, dexDlgCallback );
 	hFont = CreateFont (12, 0, 0, 0, FW_DONTCARE, FALSE, FALSE, FALSE, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_SWISS, "Arial");
 	SendDlgItemMessage( workspace_dlg, IDC_LOG, WM_SETFONT, WPARAM (hFont), TRUE);
-	_dexLog[ sizeof( _dexLog ) - 1 ] = 0;
+	DexTimerStart( _dexLogClock );
 	DexTimerSet( _refresh_timer, _refresh_rate );
+
+	// Pictures are kept at the size at which they are displayed.
+	DexPictureCacheInit( PictureFilenamePrefix, DEX_PICTURE_WIDTH, DEX_PICTURE_HEIGHT, DEX_PICTURE_CACHE_BYTES, _dexReleasePictureBitmap );
 	
 	return( workspace_dlg );
 
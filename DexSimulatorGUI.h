@@ -17,6 +17,15 @@ BOOL CALLBACK dexDlgCallback(HWND hDlg, UINT message, WPARAM wParam, LPARAM lPar
 int IllustratedMessageBox( const char *picture, const char *message, const char *label, int buttons );
 int fIllustratedMessageBox( int mb_type, const char *picture, const char *caption, const char *format, ... );
 
+// Where a picture is shown. The one on the screen in each place stays in the cache.
+#define DEX_PICTURE_NOT_SHOWN	-1
+#define DEX_STATUS_PICTURE		0
+#define DEX_POPUP_PICTURE		1
+#define DEX_PICTURE_PLACES		2
+
+HBITMAP DexGetPictureBitmap( const char *picture, int place = DEX_PICTURE_NOT_SHOWN );
+void DexReportPictureCache( DexApparatus *apparatus );
+
 void DexInitPlots ( void );
 void DexPlotData( DexApparatus *apparatus );
 
@@ -24,6 +33,7 @@ HWND DexInitGUI( HINSTANCE hInstance );
 HWND DexCreateMouseTrackerGUI( void );
 HWND DexCreateMassGUI( void );
 void DexAddToLogGUI( const char *message );
+void DexRefreshLogGUI( void );
 
 void SaveGUIState( void );
 void LoadGUIState( void );
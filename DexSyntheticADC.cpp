@@ -0,0 +1,174 @@
+/***************************************************************************/
+/*                                                                         */
+/*                              DexSyntheticADC                            */
+/*                                                                         */
+/***************************************************************************/
+
+// This is a simulated analog interface to the DEX hardware.
+// It generates the voltages that the ATI strain gauges would give for a
+// scripted profile of grip and load forces, by inverting the ATI calibrations.
+// It does not depend on real time, nor on any input from the operator, so
+// it can be used to run and to check the force computations headless.
+// The signal is generated by DexForceSynthesizer. What is here loads the
+// ATI calibrations and puts the samples on the clock of the apparatus.
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <ATIDAQ\ftconfig.h>
+
+#include <fMessageBox.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include <Dexterous.h>
+#include "DexADC.h"
+
+/*********************************************************************************/
+
+DexSyntheticADC::DexSyntheticADC( int channels, char *left_calibration, char *right_calibration, unsigned long seed ) 
+	: synthesizer( channels, seed ) {
+
+	acquisitionOn = false;
+	overrun = false;
+	acquisitionStart = 0.0;
+	duration = 0.0;
+	nChannels = channels;
+	nAcqSamples = 0;
+
+	calibrationFilename[LEFT_ATI] = left_calibration;
+	calibrationFilename[RIGHT_ATI] = right_calibration;
+
+}
+
+void DexSyntheticADC::Initialize( void ) {
+
+	double		ft_from_volts[6][N_GAUGES];
+	Calibration	*calibration;
+
+	acquisitionOn = false;
+	overrun = false;
+	nAcqSamples = 0;
+
+	// Load the same ATI calibrations as DexApparatus, in the same units.
+	// A null filename means that the matrix has been set by SetCalibrationMatrix().
+	for ( int unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+
+		if ( !calibrationFilename[unit] ) continue;
+		calibration = createCalibration( calibrationFilename[unit], 1 );
+		if ( !calibration ) {
+			fMessageBox( MB_OK, "DexSyntheticADC", "Unable to load ATI calibration.\n\n Sensor: %d\n Calibration filename: %s", unit, calibrationFilename[unit] );
+			exit( -1 );
+		}
+		SetForceUnits( calibration, "N" );
+		SetTorqueUnits( calibration, "N-m" );
+
+		// This is the matrix that ConvertToFT() applies to the unbiased voltages.
+		for ( int i = 0; i < 6; i++ ) {
+			for ( int j = 0; j < N_GAUGES; j++ ) ft_from_volts[i][j] = calibration->rt.working_matrix[i][j];
+		}
+		destroyCalibration( calibration );
+
+		if ( !SetCalibrationMatrix( unit, ft_from_volts ) ) {
+			fMessageBox( MB_OK, "DexSyntheticADC", "ATI calibration cannot be inverted.\n\n Sensor: %d\n Calibration filename: %s", unit, calibrationFilename[unit] );
+			exit( -1 );
+		}
+	}
+
+	DexTimerStart( clockTimer );
+
+}
+
+void DexSyntheticADC::Quit( void ) {}
+
+/*********************************************************************************/
+
+// The signal itself comes from DexForceSynthesizer. The ADC only
+// keeps it on the same channels and sample clock as itself.
+
+bool DexSyntheticADC::SetCalibrationMatrix( int unit, const double ft_from_volts[6][N_GAUGES] ) {
+	if ( !synthesizer.SetCalibrationMatrix( unit, ft_from_volts ) ) return( false );
+	calibrationFilename[unit] = NULL;
+	return( true );
+}
+
+void DexSyntheticADC::SetForceProfile( const DexForceKeyframe frames[], int n, bool loop ) {
+	synthesizer.SetForceProfile( frames, n, loop );
+}
+
+void DexSyntheticADC::SynthesizeAnalogSample( AnalogSample &sample, double time ) {
+	synthesizer.nChannels = nChannels;
+	synthesizer.samplePeriod = samplePeriod;
+	synthesizer.SynthesizeAnalogSample( sample, time );
+}
+
+int DexSyntheticADC::SynthesizeAnalogSamples( AnalogSample samples[], int n, double start ) {
+	synthesizer.nChannels = nChannels;
+	synthesizer.samplePeriod = samplePeriod;
+	return( synthesizer.SynthesizeAnalogSamples( samples, n, start ) );
+}
+
+/*********************************************************************************/
+
+// Samples are only defined on the sample clock, so polling more often than
+// samplePeriod gives the same sample again, as with the real hardware.
+
+bool DexSyntheticADC::GetCurrentAnalogSample( AnalogSample &sample ) {
+
+	double time = floor( DexTimerElapsedTime( clockTimer ) / samplePeriod ) * samplePeriod;
+	SynthesizeAnalogSample( sample, time );
+	return( true );
+
+}
+
+void DexSyntheticADC::StartAcquisition( float max_duration ) {
+	acquisitionOn = true;
+	overrun = false;
+	acquisitionStart = floor( DexTimerElapsedTime( clockTimer ) / samplePeriod ) * samplePeriod;
+	duration = max_duration;
+	DexTimerSet( acquisitionTimer, max_duration );
+}
+
+void DexSyntheticADC::StopAcquisition( void ) {
+	if ( acquisitionOn ) duration = DexTimerElapsedTime( acquisitionTimer );
+	acquisitionOn = false;
+}
+
+bool DexSyntheticADC::GetAcquisitionState( void ) {
+	return( acquisitionOn );
+}
+
+bool DexSyntheticADC::CheckAcquisitionOverrun( void ) {
+	return( overrun );
+}
+
+// Nothing needs to be stored during the acquisition, since the
+// samples can be regenerated from their time stamps.
+
+int DexSyntheticADC::Update( void ) {
+
+	if ( acquisitionOn && DexTimerTimeout( acquisitionTimer ) ) {
+		acquisitionOn = false;
+		overrun = true;
+	}
+	return( 0 );
+
+}
+
+int DexSyntheticADC::RetrieveAnalogSamples( AnalogSample samples[], int max_samples ) {
+
+	int n = (int) floor( duration / samplePeriod ) + 1;
+	if ( n > max_samples ) n = max_samples;
+	if ( n > DEX_MAX_ANALOG_SAMPLES ) n = DEX_MAX_ANALOG_SAMPLES;
+
+	SynthesizeAnalogSamples( samples, n, acquisitionStart );
+	for ( int smpl = 0; smpl < n; smpl++ ) samples[smpl].time = (double) smpl * samplePeriod;
+
+	nAcqSamples = n;
+	return( nAcqSamples );
+
+}
@@ -0,0 +1,427 @@
+/***************************************************************************/
+/*                                                                         */
+/*                            DexSyntheticTracker                          */
+/*                                                                         */
+/***************************************************************************/
+
+// This is a simulated tracker that allows us to work without a CODA.
+// The manipulandum follows a scripted movement and each unit sees the markers
+// with its own noise, occlusions and alignment error. Everything is a function
+// of time and of the seed, so that the data can be regenerated at will.
+
+#include <windows.h>
+#include <mmsystem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include "DexTracker.h"
+#include "DexNoise.h"
+
+#define PI	3.14159265358979
+
+// Placement of a unit in front of the subject, as returned by DexMouseTracker
+// for unit 1 in the upright configuration. The other units are spread around
+// the vertical axis, every SYNTHETIC_UNIT_SPACING degrees.
+static Vector3		SyntheticCodaOffset = { 0.0, 1200.0,  2000.0 };
+static Matrix3x3	SyntheticCodaRotation = {{-1.0,  0.0, 0.0},{ 0.0,  0.0, -1.0}, {0.0, -1.0, 0.0}};
+#define SYNTHETIC_UNIT_SPACING	30.0
+
+/*********************************************************************************/
+
+DexSyntheticTracker::DexSyntheticTracker( int n_codas, int n_markers, unsigned long seed ) {
+
+	Quaternion	yaw;
+	Matrix3x3	spin;
+	int			unit;
+
+	acquisitionOn = false;
+	overrun = false;
+	acquisitionStart = 0.0;
+	duration = 0.0;
+	nAcqFrames = 0;
+
+	if ( n_codas > DEX_MAX_CODAS ) n_codas = DEX_MAX_CODAS;
+	if ( n_markers > N_MARKERS ) n_markers = N_MARKERS;
+	nCodas = n_codas;
+	nMarkers = n_markers;
+	samplePeriod = MARKER_SAMPLE_PERIOD;
+
+	// By default, oscillate up and down in front of the target bar.
+	motion.type = OSCILLATION_MOTION;
+	motion.center[X] = 0.0;
+	motion.center[Y] = 115.0;
+	motion.center[Z] = -100.0;
+	CopyVector( motion.direction, jVector );
+	motion.amplitude = 100.0;
+	motion.period = 1.0;
+	motion.hold = 0.25;
+	motion.tilt = 5.0;
+	motion.targets = N_VERTICAL_TARGETS;
+
+	this->seed = seed;
+	jitter = 0.1;
+	occlusionRate = 0.0;
+	occlusionPeriod = 1.0;
+	occlusionDuration = 0.1;
+	occludedMarkers = 0;
+
+	// Place the units.
+	for ( unit = 0; unit < nCodas; unit++ ) {
+		SetQuaterniond( yaw, SYNTHETIC_UNIT_SPACING * ( unit - ( nCodas - 1 ) / 2.0 ), jVector );
+		RotateVector( spin[X], yaw, iVector );
+		RotateVector( spin[Y], yaw, jVector );
+		RotateVector( spin[Z], yaw, kVector );
+		MultiplyMatrices( placementRotation[unit], SyntheticCodaRotation, spin );
+		MultiplyVector( placementOffset[unit], SyntheticCodaOffset, spin );
+	}
+	SetMisalignment( 0.0, 0.0 );
+
+}
+
+void DexSyntheticTracker::Initialize( void ) {
+	acquisitionOn = false;
+	overrun = false;
+	nAcqFrames = 0;
+	DexTimerStart( clockTimer );
+}
+
+void DexSyntheticTracker::Quit( void ) {}
+
+int DexSyntheticTracker::GetNumberOfCodas( void ) {
+	return( nCodas );
+}
+
+/*********************************************************************************/
+
+// The noise and the occlusions at a given time are hashed (see DexNoise.h),
+// so they do not depend on the order in which the frames are generated.
+
+static unsigned long Hash( unsigned long seed, unsigned long a, unsigned long b, unsigned long c ) {
+	return( DexHash( seed ^ DexHash( a ^ DexHash( b ^ DexHash( c ) ) ) ) );
+}
+
+// Uniform between 0 and 1.
+double DexSyntheticTracker::Uniform( unsigned long a, unsigned long b, unsigned long c ) {
+	return( DexHashUniform( Hash( seed, a, b, c ) ) );
+}
+
+// Gaussian with unit variance.
+double DexSyntheticTracker::Noise( unsigned long a, unsigned long b, unsigned long c ) {
+	return( DexHashGaussian( Hash( seed, a, b, 2 * c ), Hash( seed, a, b, 2 * c + 1 ) ) );
+}
+
+void DexSyntheticTracker::SetMisalignment( double mm, double degrees ) {
+
+	Vector3		direction, axis;
+	Quaternion	q;
+	int			unit, i;
+
+	misalignment = mm;
+	misrotation = degrees;
+	for ( unit = 0; unit < nCodas; unit++ ) {
+		// Random directions for the offset and for the axis of rotation.
+		for ( i = 0; i < 3; i++ ) {
+			direction[i] = Noise( unit, 0xa119, i );
+			axis[i] = Noise( unit, 0xa11a, i );
+		}
+		NormalizeVector( direction );
+		NormalizeVector( axis );
+		ScaleVector( errorOffset[unit], direction, mm );
+		SetQuaterniond( q, degrees, axis );
+		RotateVector( errorRotation[unit][X], q, iVector );
+		RotateVector( errorRotation[unit][Y], q, jVector );
+		RotateVector( errorRotation[unit][Z], q, kVector );
+	}
+	// It is as if the units had been moved.
+	InvalidateUnitTransforms();
+
+}
+
+/*********************************************************************************/
+
+// Smooth movement from 0 to 1 as tau goes from 0 to 1.
+static double MinimumJerk( double tau ) {
+	if ( tau <= 0.0 ) return( 0.0 );
+	if ( tau >= 1.0 ) return( 1.0 );
+	return( tau * tau * tau * ( 10.0 - 15.0 * tau + 6.0 * tau * tau ) );
+}
+
+// Time spent moving when each movement of the given duration starts with
+// a pause. The pause is cut short if need be, so that at least one sample
+// is left for the movement itself.
+static double MovementTime( double duration, double hold, double sample_period ) {
+	double travel = duration - ( hold > 0.0 ? hold : 0.0 );
+	if ( travel < sample_period ) travel = sample_period;
+	if ( travel > duration ) travel = duration;
+	return( travel );
+}
+
+void DexSyntheticTracker::ComputeManipulandumPose( Vector3 position, Quaternion orientation, double time ) {
+
+	double	half = motion.amplitude / 2.0;
+	double	cycles, phase, move, travel, from, to;
+	double	excursion = 0.0;
+	long	reach;
+	int		target, previous;
+
+	// Without a period, nothing moves.
+	switch ( motion.period > 0.0 ? motion.type : STILL_MOTION ) {
+
+	case OSCILLATION_MOTION:
+		excursion = half * sin( 2.0 * PI * time / motion.period );
+		break;
+
+	case DISCRETE_MOTION:
+		// Up in the first half of each cycle, down in the second, pausing at each end.
+		cycles = time / motion.period;
+		phase = ( cycles - floor( cycles ) ) * 2.0;
+		travel = MovementTime( motion.period / 2.0, motion.hold, samplePeriod );
+		move = ( phase < 1.0 ? phase : phase - 1.0 ) * motion.period / 2.0 - ( motion.period / 2.0 - travel );
+		move = MinimumJerk( move / travel );
+		excursion = ( phase < 1.0 ? - half + move * motion.amplitude : half - move * motion.amplitude );
+		break;
+
+	case COLLISION_MOTION:
+		// Bounce off a surface at the bottom of the movement.
+		excursion = - half + motion.amplitude * fabs( sin( PI * time / motion.period ) );
+		break;
+
+	case TARGETED_MOTION:
+		// Go from one randomly chosen target to the next once per period.
+		reach = (long) floor( time / motion.period );
+		phase = time - (double) reach * motion.period;
+		if ( motion.targets < 2 ) break;
+		target = (int) ( Uniform( reach, 0x7a6e, 0 ) * motion.targets );
+		previous = ( reach > 0 ? (int) ( Uniform( reach - 1, 0x7a6e, 0 ) * motion.targets ) : motion.targets / 2 );
+		from = - half + previous * motion.amplitude / ( motion.targets - 1 );
+		to = - half + target * motion.amplitude / ( motion.targets - 1 );
+		travel = MovementTime( motion.period, motion.hold, samplePeriod );
+		excursion = from + ( to - from ) * MinimumJerk( ( phase - ( motion.period - travel ) ) / travel );
+		break;
+
+	case STILL_MOTION:
+	default:
+		break;
+
+	}
+
+	ScaleVector( position, motion.direction, excursion );
+	AddVectors( position, motion.center, position );
+	// Tilt with the excursion.
+	SetQuaterniond( orientation, ( half > 0.0 ? motion.tilt * excursion / half : 0.0 ), iVector );
+
+}
+
+// True positions of the markers at a given time, in the aligned frame.
+// present[] says which markers belong to one of the bodies that we simulate.
+
+void DexSyntheticTracker::ComputeMarkerPositions( Vector3 position[], bool present[], double time ) {
+
+	Vector3		pos, rotated;
+	Quaternion	ori;
+	int			mrk, id;
+
+	for ( mrk = 0; mrk < nMarkers; mrk++ ) {
+		CopyVector( position[mrk], zeroVector );
+		present[mrk] = false;
+	}
+
+	// The target frame does not move.
+	for ( mrk = 0; mrk < nFrameMarkers; mrk++ ) {
+		id = FrameMarkerID[mrk];
+		if ( id >= nMarkers ) continue;
+		CopyVector( position[id], TargetFrameBody[mrk] );
+		present[id] = true;
+	}
+
+	ComputeManipulandumPose( pos, ori, time );
+	for ( mrk = 0; mrk < nManipulandumMarkers; mrk++ ) {
+		id = ManipulandumMarkerID[mrk];
+		if ( id >= nMarkers ) continue;
+		RotateVector( rotated, ori, ManipulandumBody[mrk] );
+		AddVectors( position[id], pos, rotated );
+		present[id] = true;
+	}
+
+	// The wrist follows the manipulandum, but does not rotate.
+	for ( mrk = 0; mrk < nWristMarkers; mrk++ ) {
+		id = WristMarkerID[mrk];
+		if ( id >= nMarkers ) continue;
+		AddVectors( position[id], pos, WristBody[mrk] );
+		present[id] = true;
+	}
+
+}
+
+bool DexSyntheticTracker::Occluded( int unit, int mrk, double time ) {
+
+	unsigned long	period, who;
+	double			start, phase;
+
+	if ( occludedMarkers & ( 1UL << mrk ) ) return( true );
+	if ( occlusionRate <= 0.0 || occlusionPeriod <= 0.0 ) return( false );
+
+	// Is this marker hidden from this unit during this period, and if so when?
+	period = (unsigned long) floor( time / occlusionPeriod );
+	who = unit * N_MARKERS + mrk;
+	if ( Uniform( period, who, 0x0cc1 ) >= occlusionRate ) return( false );
+	phase = time - (double) period * occlusionPeriod;
+	start = Uniform( period, who, 0x0cc2 ) * ( occlusionPeriod - occlusionDuration );
+	return( phase >= start && phase < start + occlusionDuration );
+
+}
+
+// What a unit sees, in aligned coordinates.
+
+void DexSyntheticTracker::SynthesizeUnitFrame( CodaFrame &frame, double time, int unit, const Vector3 position[], const bool present[] ) {
+
+	unsigned long	index = (unsigned long) floor( time / samplePeriod + 0.5 );
+	Vector3			seen;
+	int				mrk, i;
+
+	frame.time = time;
+	for ( mrk = 0; mrk < nMarkers; mrk++ ) {
+		frame.marker[mrk].visibility = present[mrk] && !Occluded( unit, mrk, time );
+		if ( !frame.marker[mrk].visibility ) {
+			CopyVector( frame.marker[mrk].position, zeroVector );
+			continue;
+		}
+		MultiplyVector( seen, (double *) position[mrk], errorRotation[unit] );
+		AddVectors( seen, seen, errorOffset[unit] );
+		if ( jitter > 0.0 ) {
+			for ( i = 0; i < 3; i++ ) seen[i] += jitter * Noise( index, unit * N_MARKERS + mrk, i );
+		}
+		CopyVector( frame.marker[mrk].position, seen );
+	}
+
+}
+
+void DexSyntheticTracker::SynthesizeMarkerFrame( CodaFrame &frame, double time, int page ) {
+
+	Vector3		position[N_MARKERS];
+	bool		present[N_MARKERS];
+	CodaFrame	unit_frame;
+	int			n[N_MARKERS];
+	int			unit, mrk;
+
+	ComputeMarkerPositions( position, present, time );
+
+	if ( page > 0 ) {
+		SynthesizeUnitFrame( frame, time, page - 1, position, present );
+		return;
+	}
+
+	// The combined data is the average over the units that see each marker.
+	frame.time = time;
+	for ( mrk = 0; mrk < nMarkers; mrk++ ) {
+		CopyVector( frame.marker[mrk].position, zeroVector );
+		n[mrk] = 0;
+	}
+	for ( unit = 0; unit < nCodas; unit++ ) {
+		SynthesizeUnitFrame( unit_frame, time, unit, position, present );
+		for ( mrk = 0; mrk < nMarkers; mrk++ ) {
+			if ( !unit_frame.marker[mrk].visibility ) continue;
+			AddVectors( frame.marker[mrk].position, frame.marker[mrk].position, unit_frame.marker[mrk].position );
+			n[mrk]++;
+		}
+	}
+	for ( mrk = 0; mrk < nMarkers; mrk++ ) {
+		frame.marker[mrk].visibility = ( n[mrk] > 0 );
+		if ( n[mrk] > 1 ) ScaleVector( frame.marker[mrk].position, frame.marker[mrk].position, 1.0 / (double) n[mrk] );
+	}
+
+}
+
+int DexSyntheticTracker::SynthesizeMarkerFrames( CodaFrame frames[], int n, double start, int page ) {
+
+	for ( int frm = 0; frm < n; frm++ ) {
+		SynthesizeMarkerFrame( frames[frm], start + (double) frm * samplePeriod, page );
+	}
+	return( n );
+
+}
+
+/*********************************************************************************/
+
+void DexSyntheticTracker::GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotation ) {
+	CopyVector( offset, placementOffset[unit] );
+	CopyMatrix( rotation, placementRotation[unit] );
+}
+
+int DexSyntheticTracker::PerformAlignment( int origin, int x_negative, int x_positive, int xy_negative, int xy_positive ) {
+
+	InvalidateUnitTransforms();
+
+	// The alignment fails if a reference marker is never seen.
+	if ( ( occludedMarkers & ( 1UL << origin ) ) || ( occludedMarkers & ( 1UL << x_negative ) )
+		|| ( occludedMarkers & ( 1UL << x_positive ) ) || ( occludedMarkers & ( 1UL << xy_negative ) )
+		|| ( occludedMarkers & ( 1UL << xy_positive ) ) ) return( ERROR_EXIT );
+	return( NORMAL_EXIT );
+
+}
+
+/*********************************************************************************/
+
+// Frames are only defined on the sample clock, so polling more often than
+// samplePeriod gives the same frame again, as with the real hardware.
+
+bool DexSyntheticTracker::GetCurrentMarkerFrame( CodaFrame &frame ) {
+	double time = floor( DexTimerElapsedTime( clockTimer ) / samplePeriod ) * samplePeriod;
+	SynthesizeMarkerFrame( frame, time, 0 );
+	return( true );
+}
+
+bool DexSyntheticTracker::GetCurrentMarkerFrameUnit( CodaFrame &frame, int unit ) {
+	double time = floor( DexTimerElapsedTime( clockTimer ) / samplePeriod ) * samplePeriod;
+	SynthesizeMarkerFrame( frame, time, unit + 1 );
+	return( true );
+}
+
+void DexSyntheticTracker::StartAcquisition( float max_duration ) {
+	acquisitionOn = true;
+	overrun = false;
+	acquisitionStart = floor( DexTimerElapsedTime( clockTimer ) / samplePeriod ) * samplePeriod;
+	duration = max_duration;
+	DexTimerSet( acquisitionTimer, max_duration );
+}
+
+void DexSyntheticTracker::StopAcquisition( void ) {
+	if ( acquisitionOn ) duration = DexTimerElapsedTime( acquisitionTimer );
+	acquisitionOn = false;
+}
+
+bool DexSyntheticTracker::GetAcquisitionState( void ) {
+	return( acquisitionOn );
+}
+
+bool DexSyntheticTracker::CheckAcquisitionOverrun( void ) {
+	return( overrun );
+}
+
+// Nothing needs to be stored during the acquisition, since the
+// frames can be regenerated from their time stamps.
+
+int DexSyntheticTracker::Update( void ) {
+	if ( acquisitionOn && DexTimerTimeout( acquisitionTimer ) ) {
+		acquisitionOn = false;
+		overrun = true;
+	}
+	return( 0 );
+}
+
+int DexSyntheticTracker::RetrieveMarkerFrames( CodaFrame frames[], int max_frames, int unit ) {
+
+	int n = (int) floor( duration / samplePeriod ) + 1;
+	if ( n > max_frames ) n = max_frames;
+	if ( n > DEX_MAX_MARKER_FRAMES ) n = DEX_MAX_MARKER_FRAMES;
+
+	SynthesizeMarkerFrames( frames, n, acquisitionStart, unit );
+	for ( int frm = 0; frm < n; frm++ ) frames[frm].time = (double) frm * samplePeriod;
+
+	nAcqFrames = n;
+	return( nAcqFrames );
+
+}
@@ -11,8 +11,8 @@
 #pragma once
 	
 // Possible apparatii that DexSimulatorApp will put together.
-typedef enum { MOUSE_TRACKER, CODA_TRACKER, RTNET_TRACKER } TrackerType;
-typedef enum { MOUSE_ADC, GLM_ADC } AdcType;
+typedef enum { MOUSE_TRACKER, CODA_TRACKER, RTNET_TRACKER, SYNTHETIC_TRACKER, REPLAY_TRACKER } TrackerType;
+typedef enum { MOUSE_ADC, GLM_ADC, SYNTHETIC_ADC, REPLAY_ADC } AdcType;
 typedef enum { SCREEN_TARGETS, GLM_TARGETS } TargetType;
 typedef enum { SCREEN_SOUNDS, GLM_SOUNDS, SOUNDBLASTER_SOUNDS } SoundType;
 
@@ -0,0 +1,1107 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                 DexTelemetry.c                                */
+/*                                                                               */
+/*********************************************************************************/
+
+// Encode and decode the binary packets described in DexTelemetry.h.
+// The values are packed byte by byte so that the format does not depend 
+// on the alignment or the byte order of the machine at either end.
+
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "DexTelemetry.h"
+
+/*********************************************************************************/
+
+static void PutU16( unsigned char *ptr, unsigned int value ) {
+	ptr[0] = (unsigned char) ( value & 0xff );
+	ptr[1] = (unsigned char) ( ( value >> 8 ) & 0xff );
+}
+
+static void PutU32( unsigned char *ptr, unsigned long value ) {
+	ptr[0] = (unsigned char) ( value & 0xff );
+	ptr[1] = (unsigned char) ( ( value >> 8 ) & 0xff );
+	ptr[2] = (unsigned char) ( ( value >> 16 ) & 0xff );
+	ptr[3] = (unsigned char) ( ( value >> 24 ) & 0xff );
+}
+
+static void PutF32( unsigned char *ptr, float value ) {
+	unsigned int bits;
+	memcpy( &bits, &value, 4 );
+	PutU32( ptr, bits );
+}
+
+static unsigned int GetU16( const unsigned char *ptr ) {
+	return( ptr[0] | ( ptr[1] << 8 ) );
+}
+
+static unsigned long GetU32( const unsigned char *ptr ) {
+	return( (unsigned long) ptr[0] | ( (unsigned long) ptr[1] << 8 ) 
+		| ( (unsigned long) ptr[2] << 16 ) | ( (unsigned long) ptr[3] << 24 ) );
+}
+
+static float GetF32( const unsigned char *ptr ) {
+	unsigned int bits = (unsigned int) GetU32( ptr );
+	float value;
+	memcpy( &value, &bits, 4 );
+	return( value );
+}
+
+/*********************************************************************************/
+
+int DexTelemetryEncode( unsigned char *packet, int max_size, const DexTelemetryMessage *message ) {
+
+	unsigned char *payload = packet + DEX_TLM_HEADER_SIZE;
+	int length, i;
+
+	if ( max_size < DEX_TLM_HEADER_SIZE ) return( DEX_TLM_OVERFLOW );
+
+	switch ( message->type ) {
+
+	case DEX_TLM_QUIT:
+		length = 0;
+		break;
+
+	case DEX_TLM_CONFIGURATION:
+		length = 5;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		payload[0] = (unsigned char) message->codas;
+		payload[1] = (unsigned char) message->nTargets;
+		payload[2] = (unsigned char) message->posture;
+		payload[3] = (unsigned char) message->targetBar;
+		payload[4] = (unsigned char) message->tappingSurface;
+		break;
+
+	case DEX_TLM_STATE:
+		length = 34;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		payload[0] = (unsigned char) ( message->acquisition != 0 );
+		payload[1] = (unsigned char) ( message->visibility != 0 );
+		PutU32( payload + 2, message->targets );
+		for ( i = 0; i < 3; i++ ) PutF32( payload + 6 + 4 * i, message->position[i] );
+		for ( i = 0; i < 4; i++ ) PutF32( payload + 18 + 4 * i, message->orientation[i] );
+		break;
+
+	case DEX_TLM_STATE_CHANGE:
+		length = 5;
+		if ( message->changed & DEX_TLM_POSITION_CHANGED ) length += 12;
+		if ( message->changed & DEX_TLM_ORIENTATION_CHANGED ) length += 16;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		payload[0] = (unsigned char) ( ( message->acquisition != 0 ) | ( ( message->visibility != 0 ) << 1 ) 
+			| ( ( message->changed & ( DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED ) ) << 2 ) );
+		PutU32( payload + 1, message->targets );
+		i = 5;
+		if ( message->changed & DEX_TLM_POSITION_CHANGED ) {
+			PutF32( payload + i, message->position[0] );
+			PutF32( payload + i + 4, message->position[1] );
+			PutF32( payload + i + 8, message->position[2] );
+			i += 12;
+		}
+		if ( message->changed & DEX_TLM_ORIENTATION_CHANGED ) {
+			PutF32( payload + i, message->orientation[0] );
+			PutF32( payload + i + 4, message->orientation[1] );
+			PutF32( payload + i + 8, message->orientation[2] );
+			PutF32( payload + i + 12, message->orientation[3] );
+		}
+		break;
+
+	case DEX_TLM_EVENT:
+		// Long messages are cut short.
+		i = message->length;
+		if ( i > DEX_TLM_MAX_TEXT ) i = DEX_TLM_MAX_TEXT;
+		if ( i < 0 ) i = 0;
+		length = 4 + i;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->clock );
+		memcpy( payload + 4, message->text, i );
+		break;
+
+	case DEX_TLM_RECORDING_START:
+	case DEX_TLM_RECORDING_END:
+		length = 8;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->recording );
+		PutU32( payload + 4, message->samples );
+		break;
+
+	case DEX_TLM_RECORDING_RECORD:
+		if ( message->count < 0 || message->count > DEX_TLM_MAX_SAMPLES ) return( DEX_TLM_BAD_LENGTH );
+		length = DEX_TLM_RECORD_HEADER_SIZE + message->count * DEX_TLM_FLOATS_PER_SAMPLE * 4;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->recording );
+		PutU32( payload + 4, message->first );
+		PutU16( payload + 8, message->count );
+		for ( i = 0; i < message->count * DEX_TLM_FLOATS_PER_SAMPLE; i++ ) {
+			PutF32( payload + DEX_TLM_RECORD_HEADER_SIZE + 4 * i, message->data[i] );
+		}
+		break;
+
+	case DEX_TLM_RECORDING_PACKED:
+		if ( message->packedSize < 0 || message->packedSize > DEX_TLM_MAX_PACKED ) return( DEX_TLM_BAD_LENGTH );
+		if ( message->count < 0 || message->count > message->packedSize ) return( DEX_TLM_BAD_LENGTH );
+		length = DEX_TLM_RECORD_HEADER_SIZE + message->packedSize;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->recording );
+		PutU32( payload + 4, message->first );
+		PutU16( payload + 8, message->count );
+		memcpy( payload + DEX_TLM_RECORD_HEADER_SIZE, message->packed, message->packedSize );
+		break;
+
+	case DEX_TLM_NACK:
+		if ( message->nNacks < 0 || message->nNacks > DEX_TLM_MAX_NACKS ) return( DEX_TLM_BAD_LENGTH );
+		length = 2 + 4 * message->nNacks;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU16( payload, message->nNacks );
+		for ( i = 0; i < message->nNacks; i++ ) PutU32( payload + 2 + 4 * i, message->nack[i] );
+		break;
+
+	case DEX_TLM_ACK:
+		length = 8;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->recording );
+		PutU32( payload + 4, message->acknowledged );
+		break;
+
+	case DEX_TLM_PARITY:
+		if ( message->nProtected < 1 || message->nProtected > DEX_TLM_MAX_PARITY_BLOCK ) return( DEX_TLM_BAD_LENGTH );
+		if ( message->paritySize < 0 || message->paritySize > DEX_TLM_MAX_RECORD_SIZE ) return( DEX_TLM_BAD_LENGTH );
+		length = 5 + 2 * message->nProtected + message->paritySize;
+		if ( max_size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_OVERFLOW );
+		PutU32( payload, message->firstProtected );
+		payload[4] = (unsigned char) message->nProtected;
+		for ( i = 0; i < message->nProtected; i++ ) PutU16( payload + 5 + 2 * i, message->protectedSize[i] );
+		memcpy( payload + 5 + 2 * message->nProtected, message->parity, message->paritySize );
+		break;
+
+	default:
+		return( DEX_TLM_BAD_TYPE );
+
+	}
+
+	packet[0] = DEX_TLM_MAGIC0;
+	packet[1] = DEX_TLM_MAGIC1;
+	packet[2] = DEX_TLM_VERSION;
+	packet[3] = (unsigned char) message->type;
+	PutU16( packet + 4, length );
+	PutU16( packet + 6, message->flags );
+	PutU32( packet + 8, message->sequence );
+	PutU32( packet + 12, message->time );
+
+	return( DEX_TLM_HEADER_SIZE + length );
+
+}
+
+/*********************************************************************************/
+
+int DexTelemetryIsBinary( const unsigned char *packet, int size ) {
+	return( size >= 2 && packet[0] == DEX_TLM_MAGIC0 && packet[1] == DEX_TLM_MAGIC1 );
+}
+
+int DexTelemetryDecodeHeader( const unsigned char *packet, int size, DexTelemetryMessage *message ) {
+
+	int length;
+
+	if ( size < DEX_TLM_HEADER_SIZE ) return( DEX_TLM_TRUNCATED );
+	if ( !DexTelemetryIsBinary( packet, size ) ) return( DEX_TLM_BAD_MAGIC );
+	if ( packet[2] != DEX_TLM_VERSION ) return( DEX_TLM_BAD_VERSION );
+
+	length = GetU16( packet + 4 );
+	if ( size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_TRUNCATED );
+
+	message->type = packet[3];
+	message->flags = GetU16( packet + 6 );
+	message->sequence = GetU32( packet + 8 );
+	message->time = GetU32( packet + 12 );
+
+	return( DEX_TLM_HEADER_SIZE + length );
+
+}
+
+void DexTelemetrySetFlags( unsigned char *packet, unsigned int flags ) {
+	PutU16( packet + 6, GetU16( packet + 6 ) | flags );
+}
+
+int DexTelemetryRenumber( unsigned char *packet, int size, unsigned long offset ) {
+
+	unsigned char	*payload = packet + DEX_TLM_HEADER_SIZE;
+	unsigned char	*parity;
+	unsigned long	first;
+	int				length, count, parity_size, i;
+
+	if ( size < DEX_TLM_HEADER_SIZE ) return( DEX_TLM_TRUNCATED );
+	if ( !DexTelemetryIsBinary( packet, size ) ) return( DEX_TLM_BAD_MAGIC );
+	length = GetU16( packet + 4 );
+	if ( size < DEX_TLM_HEADER_SIZE + length ) return( DEX_TLM_TRUNCATED );
+
+	if ( GetU16( packet + 6 ) & ( DEX_TLM_RELIABLE | DEX_TLM_PROTECTED ) ) PutU32( packet + 8, GetU32( packet + 8 ) + offset );
+
+	if ( packet[3] == DEX_TLM_PARITY ) {
+		if ( length < 5 ) return( DEX_TLM_BAD_LENGTH );
+		first = GetU32( payload );
+		count = payload[4];
+		parity = payload + 5 + 2 * count;
+		parity_size = length - 5 - 2 * count;
+		if ( count < 1 || count > DEX_TLM_MAX_PARITY_BLOCK || parity_size < 0 ) return( DEX_TLM_BAD_LENGTH );
+		// The parity covers the headers, sequence numbers included. Since it is 
+		// an XOR, each old number can be taken out and the new one put in.
+		if ( parity_size >= 12 ) {
+			for ( i = 0; i < count; i++ ) {
+				PutU32( parity + 8, GetU32( parity + 8 ) ^ ( first + i ) ^ ( first + i + offset ) );
+			}
+		}
+		PutU32( payload, first + offset );
+	}
+
+	return( DEX_TLM_HEADER_SIZE + length );
+
+}
+
+// The packets come off the network, so nothing is taken for granted.
+// Every length is checked against both the type and the bytes actually received.
+
+int DexTelemetryDecode( const unsigned char *packet, int size, DexTelemetryMessage *message ) {
+
+	const unsigned char *payload = packet + DEX_TLM_HEADER_SIZE;
+	int length, i;
+
+	length = DexTelemetryDecodeHeader( packet, size, message );
+	if ( length < 0 ) return( length );
+	length -= DEX_TLM_HEADER_SIZE;
+
+	switch ( message->type ) {
+
+	case DEX_TLM_QUIT:
+		if ( length != 0 ) return( DEX_TLM_BAD_LENGTH );
+		break;
+
+	case DEX_TLM_CONFIGURATION:
+		if ( length != 5 ) return( DEX_TLM_BAD_LENGTH );
+		message->codas = payload[0];
+		message->nTargets = payload[1];
+		message->posture = payload[2];
+		message->targetBar = payload[3];
+		message->tappingSurface = payload[4];
+		break;
+
+	case DEX_TLM_STATE:
+		if ( length != 34 ) return( DEX_TLM_BAD_LENGTH );
+		message->acquisition = payload[0];
+		message->visibility = payload[1];
+		message->targets = GetU32( payload + 2 );
+		for ( i = 0; i < 3; i++ ) message->position[i] = GetF32( payload + 6 + 4 * i );
+		for ( i = 0; i < 4; i++ ) message->orientation[i] = GetF32( payload + 18 + 4 * i );
+		break;
+
+	case DEX_TLM_STATE_CHANGE:
+		if ( length < 5 ) return( DEX_TLM_BAD_LENGTH );
+		message->acquisition = payload[0] & 0x01;
+		message->visibility = ( payload[0] >> 1 ) & 0x01;
+		message->changed = ( payload[0] >> 2 ) & ( DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED );
+		message->targets = GetU32( payload + 1 );
+		if ( length != 5 + ( message->changed & DEX_TLM_POSITION_CHANGED ? 12 : 0 ) 
+			+ ( message->changed & DEX_TLM_ORIENTATION_CHANGED ? 16 : 0 ) ) return( DEX_TLM_BAD_LENGTH );
+		i = 5;
+		if ( message->changed & DEX_TLM_POSITION_CHANGED ) {
+			message->position[0] = GetF32( payload + i );
+			message->position[1] = GetF32( payload + i + 4 );
+			message->position[2] = GetF32( payload + i + 8 );
+			i += 12;
+		}
+		if ( message->changed & DEX_TLM_ORIENTATION_CHANGED ) {
+			message->orientation[0] = GetF32( payload + i );
+			message->orientation[1] = GetF32( payload + i + 4 );
+			message->orientation[2] = GetF32( payload + i + 8 );
+			message->orientation[3] = GetF32( payload + i + 12 );
+		}
+		break;
+
+	case DEX_TLM_EVENT:
+		if ( length < 4 || length > 4 + DEX_TLM_MAX_TEXT ) return( DEX_TLM_BAD_LENGTH );
+		message->clock = GetU32( payload );
+		message->length = length - 4;
+		memcpy( message->text, payload + 4, message->length );
+		message->text[message->length] = 0;
+		break;
+
+	case DEX_TLM_RECORDING_START:
+	case DEX_TLM_RECORDING_END:
+		if ( length != 8 ) return( DEX_TLM_BAD_LENGTH );
+		message->recording = GetU32( payload );
+		message->samples = (int) ( GetU32( payload + 4 ) & 0x7fffffff );
+		break;
+
+	case DEX_TLM_RECORDING_RECORD:
+		if ( length < DEX_TLM_RECORD_HEADER_SIZE ) return( DEX_TLM_BAD_LENGTH );
+		message->recording = GetU32( payload );
+		message->first = (int) ( GetU32( payload + 4 ) & 0x7fffffff );
+		message->count = GetU16( payload + 8 );
+		if ( message->count > DEX_TLM_MAX_SAMPLES ) return( DEX_TLM_BAD_LENGTH );
+		if ( length != DEX_TLM_RECORD_HEADER_SIZE + message->count * DEX_TLM_FLOATS_PER_SAMPLE * 4 ) return( DEX_TLM_BAD_LENGTH );
+		for ( i = 0; i < message->count * DEX_TLM_FLOATS_PER_SAMPLE; i++ ) {
+			message->data[i] = GetF32( payload + DEX_TLM_RECORD_HEADER_SIZE + 4 * i );
+		}
+		break;
+
+	case DEX_TLM_RECORDING_PACKED:
+		if ( length < DEX_TLM_RECORD_HEADER_SIZE ) return( DEX_TLM_BAD_LENGTH );
+		message->recording = GetU32( payload );
+		message->first = (int) ( GetU32( payload + 4 ) & 0x7fffffff );
+		message->count = GetU16( payload + 8 );
+		message->packedSize = length - DEX_TLM_RECORD_HEADER_SIZE;
+		if ( message->packedSize > DEX_TLM_MAX_PACKED ) return( DEX_TLM_BAD_LENGTH );
+		// Every sample takes at least one byte.
+		if ( message->count > message->packedSize ) return( DEX_TLM_BAD_LENGTH );
+		memcpy( message->packed, payload + DEX_TLM_RECORD_HEADER_SIZE, message->packedSize );
+		break;
+
+	case DEX_TLM_NACK:
+		if ( length < 2 ) return( DEX_TLM_BAD_LENGTH );
+		message->nNacks = GetU16( payload );
+		if ( message->nNacks > DEX_TLM_MAX_NACKS ) return( DEX_TLM_BAD_LENGTH );
+		if ( length != 2 + 4 * message->nNacks ) return( DEX_TLM_BAD_LENGTH );
+		for ( i = 0; i < message->nNacks; i++ ) message->nack[i] = GetU32( payload + 2 + 4 * i );
+		break;
+
+	case DEX_TLM_ACK:
+		if ( length != 8 ) return( DEX_TLM_BAD_LENGTH );
+		message->recording = GetU32( payload );
+		message->acknowledged = GetU32( payload + 4 );
+		break;
+
+	case DEX_TLM_PARITY:
+		if ( length < 5 ) return( DEX_TLM_BAD_LENGTH );
+		message->firstProtected = GetU32( payload );
+		message->nProtected = payload[4];
+		if ( message->nProtected < 1 || message->nProtected > DEX_TLM_MAX_PARITY_BLOCK ) return( DEX_TLM_BAD_LENGTH );
+		message->paritySize = length - 5 - 2 * message->nProtected;
+		if ( message->paritySize < 0 || message->paritySize > DEX_TLM_MAX_RECORD_SIZE ) return( DEX_TLM_BAD_LENGTH );
+		for ( i = 0; i < message->nProtected; i++ ) {
+			message->protectedSize[i] = GetU16( payload + 5 + 2 * i );
+			if ( message->protectedSize[i] > message->paritySize ) return( DEX_TLM_BAD_LENGTH );
+		}
+		memcpy( message->parity, payload + 5 + 2 * message->nProtected, message->paritySize );
+		break;
+
+	default:
+		return( DEX_TLM_BAD_TYPE );
+
+	}
+
+	return( DEX_TLM_HEADER_SIZE + length );
+
+}
+
+/*********************************************************************************/
+
+// The older text packets. Each field is read where it lies and checked as it
+// is read. Nothing is read past the null that ends the text, nor past the end 
+// of the packet for the samples that follow the header of a text record.
+
+static void SkipSpace( const char **ptr, const char *end ) {
+	while ( *ptr < end && ( **ptr == ' ' || **ptr == '\t' || **ptr == '\r' || **ptr == '\n' ) ) (*ptr)++;
+}
+
+static int ReadWord( const char **ptr, const char *end, const char **word ) {
+	SkipSpace( ptr, end );
+	*word = *ptr;
+	while ( *ptr < end && **ptr != ' ' && **ptr != '\t' && **ptr != '\r' && **ptr != '\n' ) (*ptr)++;
+	return( *ptr - *word );
+}
+
+static int SameWord( const char *word, int length, const char *name ) {
+	return( length == (int) strlen( name ) && !memcmp( word, name, length ) );
+}
+
+static int ReadChar( const char **ptr, const char *end, char c ) {
+	SkipSpace( ptr, end );
+	if ( *ptr >= end || **ptr != c ) return( 0 );
+	(*ptr)++;
+	return( 1 );
+}
+
+// Digits only, with no spaces or sign before them. Returns how many there were.
+static int ReadDigits( const char **ptr, const char *end, unsigned long *value ) {
+	const char *start = *ptr;
+	*value = 0;
+	while ( *ptr < end && **ptr >= '0' && **ptr <= '9' ) {
+		*value = *value * 10 + ( **ptr - '0' );
+		(*ptr)++;
+	}
+	return( *ptr - start );
+}
+
+static int ReadUnsigned( const char **ptr, const char *end, unsigned long *value ) {
+	SkipSpace( ptr, end );
+	return( ReadDigits( ptr, end, value ) > 0 );
+}
+
+static int ReadInt( const char **ptr, const char *end, int *value ) {
+	unsigned long magnitude;
+	int negative = 0;
+	SkipSpace( ptr, end );
+	if ( *ptr < end && ( **ptr == '-' || **ptr == '+' ) ) negative = ( *(*ptr)++ == '-' );
+	if ( !ReadDigits( ptr, end, &magnitude ) ) return( 0 );
+	*value = ( negative ? - (int) magnitude : (int) magnitude );
+	return( 1 );
+}
+
+static int ReadHex( const char **ptr, const char *end, unsigned long *value ) {
+	const char *start;
+	int digit;
+	SkipSpace( ptr, end );
+	if ( end - *ptr >= 2 && (*ptr)[0] == '0' && ( (*ptr)[1] == 'x' || (*ptr)[1] == 'X' ) ) *ptr += 2;
+	start = *ptr;
+	*value = 0;
+	while ( *ptr < end ) {
+		if ( **ptr >= '0' && **ptr <= '9' ) digit = **ptr - '0';
+		else if ( **ptr >= 'a' && **ptr <= 'f' ) digit = **ptr - 'a' + 10;
+		else if ( **ptr >= 'A' && **ptr <= 'F' ) digit = **ptr - 'A' + 10;
+		else break;
+		*value = ( *value << 4 ) | digit;
+		(*ptr)++;
+	}
+	return( *ptr > start );
+}
+
+// Decimal numbers as written by printf( "%f" ), with or without an exponent.
+static int ReadFloat( const char **ptr, const char *end, float *value ) {
+
+	double mantissa = 0.0, scale = 1.0;
+	int negative = 0, digits = 0, decimals = 0, exponent = 0, i;
+	unsigned long e;
+
+	SkipSpace( ptr, end );
+	if ( *ptr < end && ( **ptr == '-' || **ptr == '+' ) ) negative = ( *(*ptr)++ == '-' );
+	for ( ; *ptr < end && **ptr >= '0' && **ptr <= '9'; (*ptr)++, digits++ ) mantissa = mantissa * 10.0 + ( **ptr - '0' );
+	if ( *ptr < end && **ptr == '.' ) {
+		for ( (*ptr)++; *ptr < end && **ptr >= '0' && **ptr <= '9'; (*ptr)++, digits++, decimals++ ) mantissa = mantissa * 10.0 + ( **ptr - '0' );
+	}
+	if ( !digits ) return( 0 );
+	if ( *ptr < end && ( **ptr == 'e' || **ptr == 'E' ) ) {
+		(*ptr)++;
+		if ( !ReadInt( ptr, end, &exponent ) ) return( 0 );
+		e = ( exponent < 0 ? - exponent : exponent );
+		if ( e > 64 ) e = 64;
+		exponent = ( exponent < 0 ? - (int) e : (int) e );
+	}
+	exponent -= decimals;
+	for ( i = ( exponent < 0 ? - exponent : exponent ); i > 0; i-- ) scale *= 10.0;
+	if ( exponent < 0 ) mantissa /= scale;
+	else mantissa *= scale;
+	*value = (float) ( negative ? - mantissa : mantissa );
+	return( 1 );
+
+}
+
+int DexTelemetryDecodeText( const char *packet, int size, DexTelemetryMessage *message ) {
+
+	const char *ptr = packet;
+	const char *end, *word;
+	int length;
+	unsigned long counter, samples, year, month, day, hour, minute, second;
+	struct tm when;
+	time_t wall_clock;
+	int i;
+
+	if ( size <= 0 ) return( DEX_TLM_TRUNCATED );
+	end = (const char *) memchr( packet, 0, size );
+	if ( !end ) end = packet + size;
+
+	message->flags = 0;
+	message->sequence = 0;
+	message->time = 0;
+	message->recording = 0;
+	message->first = 0;
+
+	length = ReadWord( &ptr, end, &word );
+
+	if ( SameWord( word, length, "DEX_QUIT" ) ) {
+		message->type = DEX_TLM_QUIT;
+		return( size );
+	}
+	
+	if ( SameWord( word, length, "DEX_STATE" ) ) {
+		message->type = DEX_TLM_STATE;
+		if ( !ReadUnsigned( &ptr, end, &counter ) 
+			|| !ReadChar( &ptr, end, '(' ) || !ReadInt( &ptr, end, &message->acquisition ) || !ReadChar( &ptr, end, ')' ) 
+			|| !ReadChar( &ptr, end, '|' ) || !ReadHex( &ptr, end, &message->targets ) 
+			|| !ReadChar( &ptr, end, '|' ) || !ReadInt( &ptr, end, &message->visibility ) 
+			|| !ReadChar( &ptr, end, '<' ) ) return( DEX_TLM_BAD_FIELD );
+		for ( i = 0; i < 3; i++ ) if ( !ReadFloat( &ptr, end, &message->position[i] ) ) return( DEX_TLM_BAD_FIELD );
+		if ( !ReadChar( &ptr, end, '>' ) || !ReadChar( &ptr, end, '[' ) ) return( DEX_TLM_BAD_FIELD );
+		for ( i = 0; i < 4; i++ ) if ( !ReadFloat( &ptr, end, &message->orientation[i] ) ) return( DEX_TLM_BAD_FIELD );
+		if ( !ReadChar( &ptr, end, ']' ) ) return( DEX_TLM_BAD_FIELD );
+		return( size );
+	}
+
+	if ( SameWord( word, length, "DEX_RECORDING_RECORD" ) ) {
+		message->type = DEX_TLM_RECORDING_RECORD;
+		if ( !ReadInt( &ptr, end, &message->count ) ) return( DEX_TLM_BAD_FIELD );
+		if ( message->count < 0 || message->count > DEX_TLM_MAX_SAMPLES 
+			|| DEX_TLM_TEXT_HEADER_SIZE + message->count * DEX_TLM_FLOATS_PER_SAMPLE * (int) sizeof( float ) > size ) return( DEX_TLM_BAD_LENGTH );
+		// The samples are floats as they are in memory on the sending machine.
+		memcpy( message->data, packet + DEX_TLM_TEXT_HEADER_SIZE, message->count * DEX_TLM_FLOATS_PER_SAMPLE * sizeof( float ) );
+		return( size );
+	}
+
+	if ( SameWord( word, length, "DEX_RECORDING_SAMPLE" ) ) {
+		message->type = DEX_TLM_RECORDING_RECORD;
+		message->count = 1;
+		message->data[0] = 0.0f;
+		if ( !ReadUnsigned( &ptr, end, &counter ) ) return( DEX_TLM_BAD_FIELD );
+		for ( i = 1; i < DEX_TLM_FLOATS_PER_SAMPLE; i++ ) if ( !ReadFloat( &ptr, end, &message->data[i] ) ) return( DEX_TLM_BAD_FIELD );
+		return( size );
+	}
+
+	if ( SameWord( word, length, "DEX_RECORDING_START" ) || SameWord( word, length, "DEX_RECORDING_END" ) ) {
+		message->type = ( SameWord( word, length, "DEX_RECORDING_START" ) ? DEX_TLM_RECORDING_START : DEX_TLM_RECORDING_END );
+		if ( !ReadUnsigned( &ptr, end, &counter ) || !ReadUnsigned( &ptr, end, &samples ) ) return( DEX_TLM_BAD_FIELD );
+		message->recording = counter;
+		message->samples = (int) ( samples & 0x7fffffff );
+		return( size );
+	}
+
+	if ( SameWord( word, length, "DEX_CONFIGURATION" ) ) {
+		message->type = DEX_TLM_CONFIGURATION;
+		if ( !ReadUnsigned( &ptr, end, &counter ) || !ReadInt( &ptr, end, &message->codas ) || !ReadInt( &ptr, end, &message->nTargets )
+			|| !ReadChar( &ptr, end, '[' ) || !ReadInt( &ptr, end, &message->posture ) || !ReadInt( &ptr, end, &message->targetBar ) 
+			|| !ReadInt( &ptr, end, &message->tappingSurface ) || !ReadChar( &ptr, end, ']' ) ) return( DEX_TLM_BAD_FIELD );
+		return( size );
+	}
+
+	if ( SameWord( word, length, "DEX_EVENT" ) ) {
+		// The time stamp is the local time on the sending machine, as in 2013/05/21 14:02:57.
+		message->type = DEX_TLM_EVENT;
+		if ( !ReadUnsigned( &ptr, end, &counter ) 
+			|| !ReadUnsigned( &ptr, end, &year ) || !ReadChar( &ptr, end, '/' ) || !ReadUnsigned( &ptr, end, &month ) 
+			|| !ReadChar( &ptr, end, '/' ) || !ReadUnsigned( &ptr, end, &day )
+			|| !ReadUnsigned( &ptr, end, &hour ) || !ReadChar( &ptr, end, ':' ) || !ReadUnsigned( &ptr, end, &minute ) 
+			|| !ReadChar( &ptr, end, ':' ) || !ReadUnsigned( &ptr, end, &second ) ) return( DEX_TLM_BAD_FIELD );
+		memset( &when, 0, sizeof( when ) );
+		when.tm_year = (int) ( year % 10000 ) - 1900;
+		when.tm_mon = (int) ( month % 100 ) - 1;
+		when.tm_mday = (int) ( day % 100 );
+		when.tm_hour = (int) ( hour % 100 );
+		when.tm_min = (int) ( minute % 100 );
+		when.tm_sec = (int) ( second % 100 );
+		when.tm_isdst = -1;
+		wall_clock = mktime( &when );
+		message->clock = ( wall_clock == (time_t) -1 ? 0 : (unsigned long) wall_clock );
+		// The text follows the asterisk. The line ending is left off.
+		if ( ReadChar( &ptr, end, '*' ) && ptr < end && *ptr == ' ' ) ptr++;
+		while ( end > ptr && ( end[-1] == '\n' || end[-1] == '\r' ) ) end--;
+		message->length = end - ptr;
+		if ( message->length > DEX_TLM_MAX_TEXT ) message->length = DEX_TLM_MAX_TEXT;
+		memcpy( message->text, ptr, message->length );
+		message->text[message->length] = 0;
+		return( size );
+	}
+
+	return( DEX_TLM_BAD_TYPE );
+
+}
+
+/*********************************************************************************/
+
+// Keep track of the reliable packets as they arrive.
+// Sequence numbers are compared by difference and kept to 32 bits, so that 
+// they wrap around as they do on the wire.
+
+void DexTelemetryReceiverInit( DexTelemetryReceiver *rx ) {
+	memset( rx, 0, sizeof( *rx ) );
+}
+
+int DexTelemetryReceiverAccept( DexTelemetryReceiver *rx, const DexTelemetryMessage *message ) {
+
+	unsigned long sequence = message->sequence;
+	unsigned long next;
+
+	if ( !( message->flags & DEX_TLM_RELIABLE ) ) return( 1 );
+
+	// Whatever was sent before we started listening does not count as missing.
+	if ( !rx->started ) {
+		rx->started = 1;
+		rx->next = rx->end = sequence;
+	}
+
+	// Already seen, or given up on. The sender may be asking whether the 
+	// recording is complete, because the acknowledgement went missing.
+	if ( DEX_TLM_SEQUENCE_DIFFERENCE( sequence, rx->next ) < 0 || rx->received[sequence % DEX_TLM_WINDOW] ) {
+		rx->duplicates++;
+		if ( message->type == DEX_TLM_RECORDING_END ) {
+			rx->ackPending = 1;
+			rx->ackRecording = message->recording;
+			rx->ackSequence = sequence;
+		}
+		return( 0 );
+	}
+
+	// Too far ahead to keep track of what is missing in between.
+	if ( DEX_TLM_SEQUENCE_DIFFERENCE( sequence, rx->next ) >= DEX_TLM_WINDOW ) {
+		next = DEX_TLM_SEQUENCE( sequence - DEX_TLM_WINDOW + 1 );
+		for ( ; rx->next != rx->end && DEX_TLM_SEQUENCE_DIFFERENCE( next, rx->next ) > 0; rx->next = DEX_TLM_SEQUENCE( rx->next + 1 ) ) {
+			if ( rx->received[rx->next % DEX_TLM_WINDOW] ) rx->received[rx->next % DEX_TLM_WINDOW] = 0;
+			else rx->abandoned++;
+		}
+		if ( DEX_TLM_SEQUENCE_DIFFERENCE( next, rx->next ) > 0 ) {
+			rx->abandoned += DEX_TLM_SEQUENCE_DIFFERENCE( next, rx->next );
+			rx->next = rx->end = next;
+		}
+	}
+
+	rx->received[sequence % DEX_TLM_WINDOW] = 1;
+	if ( message->flags & DEX_TLM_RETRANSMITTED ) rx->recovered++;
+	// A new gap is reported right away.
+	if ( DEX_TLM_SEQUENCE_DIFFERENCE( sequence, rx->end ) > 0 ) rx->nackDue = 1;
+	if ( DEX_TLM_SEQUENCE_DIFFERENCE( sequence, rx->end ) >= 0 ) rx->end = DEX_TLM_SEQUENCE( sequence + 1 );
+
+	next = rx->next;
+	while ( rx->next != rx->end && rx->received[rx->next % DEX_TLM_WINDOW] ) {
+		rx->received[rx->next % DEX_TLM_WINDOW] = 0;
+		rx->next = DEX_TLM_SEQUENCE( rx->next + 1 );
+	}
+	if ( rx->next != next ) rx->nackRounds = 0;
+
+	if ( message->type == DEX_TLM_RECORDING_END ) {
+		rx->ackPending = 1;
+		rx->ackRecording = message->recording;
+		rx->ackSequence = sequence;
+	}
+
+	return( 1 );
+
+}
+
+int DexTelemetryReceiverReply( DexTelemetryReceiver *rx, DexTelemetryMessage *reply, unsigned long now ) {
+
+	unsigned long sequence;
+
+	if ( rx->next != rx->end && ( rx->nackDue || now - rx->lastNack >= DEX_TLM_NACK_INTERVAL ) ) {
+
+		if ( rx->nackRounds < DEX_TLM_NACK_RETRIES ) {
+			reply->type = DEX_TLM_NACK;
+			reply->flags = 0;
+			reply->nNacks = 0;
+			for ( sequence = rx->next; sequence != rx->end && reply->nNacks < DEX_TLM_MAX_NACKS; sequence = DEX_TLM_SEQUENCE( sequence + 1 ) ) {
+				if ( !rx->received[sequence % DEX_TLM_WINDOW] ) reply->nack[reply->nNacks++] = sequence;
+			}
+			rx->nackDue = 0;
+			rx->nackRounds++;
+			rx->lastNack = now;
+			return( 1 );
+		}
+
+		// The sender no longer has them, or the link is down. Move on.
+		for ( sequence = rx->next; sequence != rx->end; sequence = DEX_TLM_SEQUENCE( sequence + 1 ) ) {
+			if ( rx->received[sequence % DEX_TLM_WINDOW] ) rx->received[sequence % DEX_TLM_WINDOW] = 0;
+			else rx->abandoned++;
+		}
+		rx->next = rx->end;
+		rx->nackRounds = 0;
+		rx->nackDue = 0;
+
+	}
+
+	// The last recording is complete once everything up to its end is accounted for.
+	if ( rx->ackPending && DEX_TLM_SEQUENCE_DIFFERENCE( rx->next, rx->ackSequence ) > 0 ) {
+		reply->type = DEX_TLM_ACK;
+		reply->flags = 0;
+		reply->recording = rx->ackRecording;
+		reply->acknowledged = DEX_TLM_SEQUENCE( rx->next - 1 );
+		rx->ackPending = 0;
+		return( 1 );
+	}
+
+	return( 0 );
+
+}
+
+/*********************************************************************************/
+
+// Keep the reliable packets on hand until the receiver has them.
+
+void DexTelemetrySenderInit( DexTelemetrySender *tx ) {
+	int i;
+	for ( i = 0; i < DEX_TLM_WINDOW; i++ ) tx->size[i] = 0;
+	tx->sent = 0;
+	tx->acknowledged = 0;
+	tx->lastTime = 0;
+	tx->probes = 0;
+	tx->retransmitted = 0;
+	tx->completed = 0;
+}
+
+void DexTelemetrySenderKeep( DexTelemetrySender *tx, const unsigned char *packet, int size ) {
+
+	DexTelemetryMessage header;
+	int i;
+
+	if ( size <= 0 || size > DEX_TLM_MAX_PACKET_SIZE || DexTelemetryDecodeHeader( packet, size, &header ) <= 0 ) return;
+	if ( !( header.flags & DEX_TLM_RELIABLE ) || ( header.flags & DEX_TLM_RETRANSMITTED ) ) return;
+
+	i = header.sequence % DEX_TLM_WINDOW;
+	memcpy( tx->packet[i], packet, size );
+	tx->size[i] = size;
+	tx->sequence[i] = header.sequence;
+	// If nothing is waiting to be acknowledged, this is where the wait starts,
+	// wherever the numbers start.
+	if ( tx->sent == tx->acknowledged ) tx->acknowledged = header.sequence;
+	tx->sent = DEX_TLM_SEQUENCE( header.sequence + 1 );
+	tx->probes = 0;
+
+}
+
+int DexTelemetrySenderCopy( DexTelemetrySender *tx, unsigned long sequence, unsigned char *packet ) {
+
+	int i = sequence % DEX_TLM_WINDOW;
+
+	if ( tx->size[i] <= 0 || tx->sequence[i] != sequence ) return( 0 );
+	memcpy( packet, tx->packet[i], tx->size[i] );
+	DexTelemetrySetFlags( packet, DEX_TLM_RETRANSMITTED );
+	tx->retransmitted++;
+	return( tx->size[i] );
+
+}
+
+int DexTelemetrySenderAcknowledge( DexTelemetrySender *tx, const DexTelemetryMessage *ack ) {
+	if ( ack->type != DEX_TLM_ACK || DEX_TLM_SEQUENCE_DIFFERENCE( ack->acknowledged + 1, tx->acknowledged ) <= 0 ) return( 0 );
+	tx->acknowledged = DEX_TLM_SEQUENCE( ack->acknowledged + 1 );
+	tx->completed++;
+	return( 1 );
+}
+
+int DexTelemetrySenderProbe( DexTelemetrySender *tx, unsigned long now, int idle, unsigned long *sequence ) {
+	if ( !idle || !DexTelemetrySenderPending( tx ) || now - tx->lastTime <= 2 * DEX_TLM_NACK_INTERVAL ) return( 0 );
+	*sequence = DEX_TLM_SEQUENCE( tx->sent - 1 );
+	tx->lastTime = now;
+	tx->probes++;
+	return( 1 );
+}
+
+int DexTelemetrySenderPending( DexTelemetrySender *tx ) {
+	return( tx->sent != tx->acknowledged && tx->probes < DEX_TLM_NACK_RETRIES );
+}
+
+/*********************************************************************************/
+
+// XOR parity over blocks of protected packets.
+
+void DexTelemetryParityAdd( DexTelemetryMessage *parity, const unsigned char *packet, int size, unsigned long sequence ) {
+
+	int i;
+
+	if ( size > DEX_TLM_MAX_RECORD_SIZE || parity->nProtected >= DEX_TLM_MAX_PARITY_BLOCK ) return;
+
+	if ( parity->nProtected == 0 ) {
+		parity->type = DEX_TLM_PARITY;
+		parity->firstProtected = sequence;
+		parity->paritySize = 0;
+	}
+	// The shorter packets are taken to be padded with zeros.
+	for ( i = parity->paritySize; i < size; i++ ) parity->parity[i] = 0;
+	if ( size > parity->paritySize ) parity->paritySize = size;
+	for ( i = 0; i < size; i++ ) parity->parity[i] ^= packet[i];
+	parity->protectedSize[parity->nProtected++] = size;
+
+}
+
+void DexTelemetryRepairInit( DexTelemetryRepair *repair ) {
+	int i;
+	for ( i = 0; i < DEX_TLM_REPAIR_HISTORY; i++ ) repair->size[i] = 0;
+	repair->rebuilt = 0;
+	repair->unrepairable = 0;
+}
+
+void DexTelemetryRepairKeep( DexTelemetryRepair *repair, const unsigned char *packet, int size, unsigned long sequence ) {
+	int i = sequence % DEX_TLM_REPAIR_HISTORY;
+	if ( size > DEX_TLM_MAX_RECORD_SIZE ) return;
+	memcpy( repair->packet[i], packet, size );
+	// The parity was computed over the packet as first sent, 
+	// so a retransmitted copy is kept without its flag.
+	if ( size >= DEX_TLM_HEADER_SIZE ) PutU16( repair->packet[i] + 6, GetU16( repair->packet[i] + 6 ) & ~DEX_TLM_RETRANSMITTED );
+	repair->size[i] = size;
+	repair->sequence[i] = sequence;
+}
+
+int DexTelemetryRepairRebuild( DexTelemetryRepair *repair, const DexTelemetryMessage *parity, unsigned char *packet ) {
+
+	unsigned long sequence;
+	int missing = -1;
+	int i, j, k, size;
+
+	for ( i = 0; i < parity->nProtected; i++ ) {
+		// Sequence numbers are 32 bits on the wire, even where a long is longer.
+		sequence = DEX_TLM_SEQUENCE( parity->firstProtected + i );
+		k = sequence % DEX_TLM_REPAIR_HISTORY;
+		if ( repair->size[k] > 0 && repair->sequence[k] == sequence ) continue;
+		// Two or more lost in the same block is more than XOR can handle.
+		if ( missing >= 0 ) {
+			repair->unrepairable++;
+			return( 0 );
+		}
+		missing = i;
+	}
+	if ( missing < 0 ) return( 0 );
+
+	size = parity->protectedSize[missing];
+	memcpy( packet, parity->parity, size );
+	for ( i = 0; i < parity->nProtected; i++ ) {
+		if ( i == missing ) continue;
+		k = ( parity->firstProtected + i ) % DEX_TLM_REPAIR_HISTORY;
+		for ( j = 0; j < size && j < repair->size[k]; j++ ) packet[j] ^= repair->packet[k][j];
+	}
+	repair->rebuilt++;
+	return( size );
+
+}
+
+/*********************************************************************************/
+
+// Delta coding of the full resolution recordings.
+// Everything is done modulo 2^31 in unsigned arithmetic, so that nothing
+// can overflow whatever the values thrown at it and the receiver gets back 
+// exactly what the sender quantized.
+
+#define DEX_TLM_QUANTIZED_MAX	0x3fffffffL
+
+static const double quantum[DEX_TLM_FLOATS_PER_SAMPLE] = {
+	DEX_TLM_TIME_QUANTUM, DEX_TLM_POSITION_QUANTUM, DEX_TLM_POSITION_QUANTUM, DEX_TLM_POSITION_QUANTUM
+};
+
+// Sign extend the lower 31 bits.
+static long Wrap( unsigned long value ) {
+	return( (long) ( ( value & 0x7fffffff ) ^ 0x40000000 ) - 0x40000000L );
+}
+
+static long Quantize( float value, int channel ) {
+	double q = value / quantum[channel];
+	// Out of range values and NaNs are clipped.
+	if ( !( q <= DEX_TLM_QUANTIZED_MAX ) ) q = DEX_TLM_QUANTIZED_MAX;
+	if ( q < - DEX_TLM_QUANTIZED_MAX ) q = - DEX_TLM_QUANTIZED_MAX;
+	return( (long) ( q < 0.0 ? q - 0.5 : q + 0.5 ) );
+}
+
+static long Predict( const DexTelemetryPredictor *predictor, int channel ) {
+	const long *value = predictor->value[channel];
+	switch ( predictor->history[channel] ) {
+	case 0:		return( 0 );
+	case 1:		return( value[0] );
+	default:	return( Wrap( 2 * (unsigned long) value[0] - (unsigned long) value[1] ) );
+	}
+}
+
+static void Remember( DexTelemetryPredictor *predictor, int channel, long value ) {
+	predictor->value[channel][1] = predictor->value[channel][0];
+	predictor->value[channel][0] = value;
+	if ( predictor->history[channel] < 2 ) predictor->history[channel]++;
+}
+
+static unsigned long ZigZag( long value ) {
+	return( value < 0 ? ( (unsigned long) ( - ( value + 1 ) ) << 1 ) | 1 : (unsigned long) value << 1 );
+}
+
+static long UnZigZag( unsigned long value ) {
+	return( value & 1 ? - (long) ( value >> 1 ) - 1 : (long) ( value >> 1 ) );
+}
+
+static unsigned char *PutVarint( unsigned char *ptr, unsigned long value ) {
+	while ( value >= 0x80 ) {
+		*ptr++ = (unsigned char) ( ( value & 0x7f ) | 0x80 );
+		value >>= 7;
+	}
+	*ptr++ = (unsigned char) value;
+	return( ptr );
+}
+
+// Returns NULL if the value runs past the end or does not fit in 32 bits.
+static const unsigned char *GetVarint( const unsigned char *ptr, const unsigned char *end, unsigned long *value ) {
+	int shift;
+	*value = 0;
+	for ( shift = 0; ptr < end; shift += 7 ) {
+		if ( shift == 28 && *ptr > 0x0f ) return( NULL );
+		*value |= (unsigned long) ( *ptr & 0x7f ) << shift;
+		if ( !( *ptr++ & 0x80 ) ) return( ptr );
+	}
+	return( NULL );
+}
+
+void DexTelemetryPackStart( DexTelemetryMessage *message, DexTelemetryPredictor *predictor, int first ) {
+	memset( predictor, 0, sizeof( *predictor ) );
+	message->type = DEX_TLM_RECORDING_PACKED;
+	message->first = first;
+	message->count = 0;
+	message->packedSize = 0;
+}
+
+int DexTelemetryPackSample( DexTelemetryMessage *message, DexTelemetryPredictor *predictor, const float sample[], int visible ) {
+
+	unsigned char *ptr = message->packed + message->packedSize;
+	long q;
+	int i;
+
+	// Leave room for the worst case rather than back out of a half written sample.
+	if ( message->packedSize + DEX_TLM_MAX_PACKED_SAMPLE > DEX_TLM_MAX_PACKED || message->count >= 0xffff ) return( 0 );
+
+	q = Quantize( sample[0], 0 );
+	ptr = PutVarint( ptr, ( ZigZag( Wrap( (unsigned long) q - (unsigned long) Predict( predictor, 0 ) ) ) << 1 ) | ( visible ? 0 : 1 ) );
+	Remember( predictor, 0, q );
+
+	if ( visible ) {
+		for ( i = 1; i < DEX_TLM_FLOATS_PER_SAMPLE; i++ ) {
+			q = Quantize( sample[i], i );
+			ptr = PutVarint( ptr, ZigZag( Wrap( (unsigned long) q - (unsigned long) Predict( predictor, i ) ) ) );
+			Remember( predictor, i, q );
+		}
+	}
+
+	message->packedSize = (int) ( ptr - message->packed );
+	message->count++;
+	return( 1 );
+
+}
+
+int DexTelemetryUnpack( const DexTelemetryMessage *message, float *samples, float invisible ) {
+
+	DexTelemetryPredictor predictor;
+	const unsigned char *ptr = message->packed;
+	const unsigned char *end = message->packed + message->packedSize;
+	unsigned long value;
+	long q;
+	int n, i;
+
+	memset( &predictor, 0, sizeof( predictor ) );
+	for ( n = 0; n < message->count; n++, samples += DEX_TLM_FLOATS_PER_SAMPLE ) {
+
+		if ( !( ptr = GetVarint( ptr, end, &value ) ) ) return( DEX_TLM_BAD_LENGTH );
+		q = Wrap( (unsigned long) Predict( &predictor, 0 ) + (unsigned long) UnZigZag( value >> 1 ) );
+		Remember( &predictor, 0, q );
+		samples[0] = (float) ( q * quantum[0] );
+
+		if ( value & 1 ) {
+			for ( i = 1; i < DEX_TLM_FLOATS_PER_SAMPLE; i++ ) samples[i] = invisible;
+			continue;
+		}
+		for ( i = 1; i < DEX_TLM_FLOATS_PER_SAMPLE; i++ ) {
+			if ( !( ptr = GetVarint( ptr, end, &value ) ) ) return( DEX_TLM_BAD_LENGTH );
+			q = Wrap( (unsigned long) Predict( &predictor, i ) + (unsigned long) UnZigZag( value ) );
+			Remember( &predictor, i, q );
+			samples[i] = (float) ( q * quantum[i] );
+		}
+
+	}
+	if ( ptr != end ) return( DEX_TLM_BAD_LENGTH );
+
+	return( n );
+
+}
+
+int DexTelemetryStoreRecord( const DexTelemetryMessage *message, const float *data, float *time, float *position, int max_samples ) {
+
+	int i, frm;
+
+	// The first sample can be anything up to 2^31 - 1, so the end of the record
+	// is never computed as first + count, which could overflow.
+	if ( message->first < 0 || message->count < 0 || message->first > max_samples - message->count ) return( DEX_TLM_OVERFLOW );
+
+	for ( i = 0; i < message->count; i++, data += DEX_TLM_FLOATS_PER_SAMPLE ) {
+		frm = message->first + i;
+		time[frm] = data[0];
+		position[frm * 3] = data[1];
+		position[frm * 3 + 1] = data[2];
+		position[frm * 3 + 2] = data[3];
+	}
+	return( message->count );
+
+}
+
+/*********************************************************************************/
+
+// Which state updates the sender lets through.
+
+void DexTelemetryStateFilterInit( DexTelemetryStateFilter *filter, double position_deadband, double orientation_deadband, 
+								  unsigned long interval, unsigned long keyframe ) {
+	filter->positionDeadband = position_deadband;
+	filter->orientationDeadband = orientation_deadband;
+	filter->stateInterval = interval;
+	filter->keyframeInterval = keyframe;
+	filter->sent = 0;
+	filter->acquisition = 0;
+	filter->visibility = 0;
+	filter->targets = 0;
+	filter->suppressed = 0;
+}
+
+int DexTelemetryFilterState( DexTelemetryStateFilter *filter, DexTelemetryMessage *state, unsigned long now ) {
+
+	unsigned int changed = 0;
+	int acquisition = ( state->acquisition != 0 );
+	int visibility = ( state->visibility != 0 );
+	int keyframe, discrete, i;
+
+	// The pose only counts when the manipulandum is visible, and it goes 
+	// with the first state in which it is visible.
+	keyframe = !filter->sent || now - filter->lastKeyframeTime >= filter->keyframeInterval;
+	discrete = !filter->sent || acquisition != filter->acquisition || state->targets != filter->targets
+		|| visibility != filter->visibility;
+	if ( visibility ) {
+		if ( !filter->visibility ) changed = DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED;
+		for ( i = 0; i < 3; i++ ) {
+			if ( fabs( state->position[i] - filter->position[i] ) > filter->positionDeadband ) changed |= DEX_TLM_POSITION_CHANGED;
+		}
+		for ( i = 0; i < 4; i++ ) {
+			if ( fabs( state->orientation[i] - filter->orientation[i] ) > filter->orientationDeadband ) changed |= DEX_TLM_ORIENTATION_CHANGED;
+		}
+	}
+	// A pose that moved has to wait for the interval, the rest goes out now.
+	if ( !keyframe && !discrete && ( !changed || now - filter->lastStateTime < filter->stateInterval ) ) {
+		filter->suppressed++;
+		return( 0 );
+	}
+	state->type = ( keyframe ? DEX_TLM_STATE : DEX_TLM_STATE_CHANGE );
+	state->changed = changed;
+
+	// Remember what goes out. The pose is kept from the last time it was visible,
+	// except at a keyframe, since that sends the whole pose anyway.
+	filter->acquisition = acquisition;
+	filter->targets = state->targets;
+	filter->visibility = visibility;
+	if ( keyframe || ( changed & DEX_TLM_POSITION_CHANGED ) ) {
+		for ( i = 0; i < 3; i++ ) filter->position[i] = state->position[i];
+	}
+	if ( keyframe || ( changed & DEX_TLM_ORIENTATION_CHANGED ) ) {
+		for ( i = 0; i < 4; i++ ) filter->orientation[i] = state->orientation[i];
+	}
+	if ( changed || keyframe ) filter->lastStateTime = now;
+	if ( keyframe ) filter->lastKeyframeTime = now;
+	filter->sent = 1;
+
+	return( state->type );
+
+}
+
+// The filter has counted the older state as sent, so whatever it carried 
+// that the newer one leaves out has to go with the newer one.
+
+void DexTelemetryMergeStates( DexTelemetryMessage *newer, const DexTelemetryMessage *older ) {
+
+	unsigned int newer_pose, older_pose;
+	int i;
+
+	if ( newer->type != DEX_TLM_STATE && newer->type != DEX_TLM_STATE_CHANGE ) return;
+	if ( older->type != DEX_TLM_STATE && older->type != DEX_TLM_STATE_CHANGE ) return;
+
+	newer_pose = ( newer->type == DEX_TLM_STATE ? DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED : newer->changed );
+	older_pose = ( older->type == DEX_TLM_STATE ? DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED : older->changed );
+	if ( ( older_pose & DEX_TLM_POSITION_CHANGED ) && !( newer_pose & DEX_TLM_POSITION_CHANGED ) ) {
+		for ( i = 0; i < 3; i++ ) newer->position[i] = older->position[i];
+	}
+	if ( ( older_pose & DEX_TLM_ORIENTATION_CHANGED ) && !( newer_pose & DEX_TLM_ORIENTATION_CHANGED ) ) {
+		for ( i = 0; i < 4; i++ ) newer->orientation[i] = older->orientation[i];
+	}
+	if ( older->type == DEX_TLM_STATE ) newer->type = DEX_TLM_STATE;
+	newer->changed = ( newer_pose | older_pose ) & ( DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED );
+
+}
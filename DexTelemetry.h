@@ -0,0 +1,396 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                 DexTelemetry.h                                */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+ * Binary framing of the packets sent by DexMonitorServer to DexMonitor.
+ *
+ * Each packet starts with a fixed header:
+ *
+ *		magic		2 bytes		0xDE 0x78, which cannot start a text packet.
+ *		version		1 byte		DEX_TLM_VERSION
+ *		type		1 byte		One of DexTelemetryType.
+ *		length		2 bytes		Size of the payload that follows the header.
+ *		flags		2 bytes		Used by the transport layers (DEX_TLM_RELIABLE etc.)
+ *		sequence	4 bytes		Counts the packets sent by the server.
+ *		time		4 bytes		Milliseconds since the server started.
+ *
+ * followed by a payload that depends on the type and is sized to the data.
+ * All values are little endian and the floats are IEEE single precision.
+ *
+ * Packets flagged DEX_TLM_RELIABLE are numbered in a sequence of their own, 
+ * so that the receiver can tell exactly which of them went missing. It asks
+ * for those again with a DEX_TLM_NACK and signals that it has everything up to 
+ * the end of a recording with a DEX_TLM_ACK. The sender keeps the last 
+ * DEX_TLM_WINDOW reliable packets on hand to be sent again.
+ *
+ * Where nothing can come back, packets flagged DEX_TLM_PROTECTED are covered
+ * by DEX_TLM_PARITY packets instead. Each one holds the XOR of a block of 
+ * consecutive protected packets (header included, padded with zeros to the 
+ * longest), so that any one packet of the block that is lost can be rebuilt
+ * from the others. Protected packets are numbered in the same sequence as the
+ * reliable ones, and the two can be used together.
+ *
+ * DEX_TLM_RECORDING_PACKED carries every sample of a recording rather than the 
+ * subset sent in DEX_TLM_RECORDING_RECORD. The time and position of each sample
+ * are rounded to DEX_TLM_TIME_QUANTUM and DEX_TLM_POSITION_QUANTUM and predicted
+ * from the two samples before (constant velocity). What is left over is sent as 
+ * a zig-zag varint, i.e. 7 bits per byte, with the sign in the lowest bit, so that
+ * small residuals of either sign take a single byte. For each sample comes:
+ *
+ *		time		residual * 2 + 1 if the manipulandum was not visible
+ *		x, y, z		residuals, only if it was visible
+ *
+ * The prediction starts over in each packet, so that each one can be decoded
+ * on its own. Quantized values are kept to 31 bits and the arithmetic wraps 
+ * around, so that any residual fits in 5 bytes.
+ *
+ * DEX_TLM_STATE_CHANGE goes out between the full DEX_TLM_STATE packets and 
+ * carries the pose only if it has moved. A lost one leaves the display out of 
+ * date until the next full state at the latest. The payload is:
+ *
+ *		flags		1 byte		Acquisition, visibility and which of the pose follows.
+ *		targets		4 bytes
+ *		position	12 bytes	If DEX_TLM_POSITION_CHANGED.
+ *		orientation	16 bytes	If DEX_TLM_ORIENTATION_CHANGED.
+ */
+
+#ifndef _DexTelemetry_
+
+#ifndef _MSC_VER
+#include <stdint.h>
+#endif
+
+#define DEX_TLM_MAGIC0			0xDE
+#define DEX_TLM_MAGIC1			0x78
+#define DEX_TLM_VERSION			1
+#define DEX_TLM_HEADER_SIZE		16
+
+// Same as DEX_SAMPLES_PER_PACKET and DEX_FLOATS_PER_SAMPLE for the text packets.
+#define DEX_TLM_MAX_SAMPLES		128
+#define DEX_TLM_FLOATS_PER_SAMPLE	4
+#define DEX_TLM_MAX_TEXT		1024
+// Same as DEX_UDP_HEADER_SIZE: the samples of a text record start this far in.
+#define DEX_TLM_TEXT_HEADER_SIZE	256
+
+// The largest packet is parity for a block of full recording packets.
+#define DEX_TLM_RECORD_HEADER_SIZE	10
+#define DEX_TLM_MAX_RECORD_SIZE	( DEX_TLM_HEADER_SIZE + DEX_TLM_RECORD_HEADER_SIZE + DEX_TLM_MAX_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE * 4 )
+#define DEX_TLM_MAX_PARITY_BLOCK	16
+#define DEX_TLM_PARITY_HEADER_SIZE	( 5 + 2 * DEX_TLM_MAX_PARITY_BLOCK )
+#define DEX_TLM_MAX_PACKET_SIZE	( DEX_TLM_HEADER_SIZE + DEX_TLM_PARITY_HEADER_SIZE + DEX_TLM_MAX_RECORD_SIZE )
+
+// Packed records are no bigger than the others.
+#define DEX_TLM_MAX_PACKED		( DEX_TLM_MAX_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE * 4 )
+#define DEX_TLM_MAX_PACKED_SAMPLE	( 4 * 5 )
+#define DEX_TLM_TIME_QUANTUM	0.0001	// s
+#define DEX_TLM_POSITION_QUANTUM	0.01	// mm
+
+// Header flags.
+#define DEX_TLM_RELIABLE		0x0001	// Numbered in the reliable sequence.
+#define DEX_TLM_RETRANSMITTED	0x0002	// Sent again in answer to a NACK.
+#define DEX_TLM_PROTECTED		0x0004	// Covered by a parity packet.
+
+// Parts of the pose that are in a DEX_TLM_STATE_CHANGE.
+#define DEX_TLM_POSITION_CHANGED	0x01
+#define DEX_TLM_ORIENTATION_CHANGED	0x02
+
+// Protected packets that the receiver keeps until their parity comes in.
+#define DEX_TLM_REPAIR_HISTORY	64
+
+// Reliable delivery.
+#define DEX_TLM_WINDOW			256		// Reliable packets that are kept for retransmission.
+#define DEX_TLM_MAX_NACKS		64		// Missing packets listed in one NACK.
+#define DEX_TLM_NACK_INTERVAL	100		// Time between repeated requests for the same packets (ms).
+#define DEX_TLM_NACK_RETRIES	10		// Requests made before the receiver gives up on a packet.
+
+// Sequence numbers are 32 bits on the wire and wrap around, so they are compared 
+// by their difference, taken as a signed 32 bit number whatever the size of a long.
+#ifdef _MSC_VER
+typedef __int32 DexTelemetryInt32;
+#else
+typedef int32_t DexTelemetryInt32;
+#endif
+#define DEX_TLM_SEQUENCE_DIFFERENCE( a, b )	( (DexTelemetryInt32) ( (a) - (b) ) )
+#define DEX_TLM_SEQUENCE( x )				( (unsigned long) (x) & 0xffffffffUL )
+
+// Error codes returned by DexTelemetryDecode(), DexTelemetryDecodeText() and DexTelemetryEncode().
+#define DEX_TLM_TRUNCATED		-1
+#define DEX_TLM_BAD_MAGIC		-2
+#define DEX_TLM_BAD_VERSION		-3
+#define DEX_TLM_BAD_TYPE		-4
+#define DEX_TLM_BAD_LENGTH		-5
+#define DEX_TLM_OVERFLOW		-6
+#define DEX_TLM_BAD_FIELD		-7	// A text packet that does not follow its format.
+
+typedef enum { 
+	DEX_TLM_QUIT = 1, 
+	DEX_TLM_CONFIGURATION, 
+	DEX_TLM_STATE, 
+	DEX_TLM_EVENT, 
+	DEX_TLM_RECORDING_START, 
+	DEX_TLM_RECORDING_RECORD, 
+	DEX_TLM_RECORDING_END,
+	// These two go from the receiver back to the sender.
+	DEX_TLM_NACK,
+	DEX_TLM_ACK,
+	DEX_TLM_PARITY,
+	DEX_TLM_RECORDING_PACKED,
+	DEX_TLM_STATE_CHANGE
+} DexTelemetryType;
+
+// A decoded packet. Only the fields that go with the type are meaningful.
+
+typedef struct {
+
+	int				type;
+	unsigned int	flags;
+	unsigned long	sequence;
+	unsigned long	time;
+
+	// DEX_TLM_STATE and DEX_TLM_STATE_CHANGE, which says what it has in changed.
+	int				acquisition;
+	int				visibility;
+	unsigned long	targets;
+	float			position[3];
+	float			orientation[4];
+	unsigned int	changed;
+
+	// DEX_TLM_CONFIGURATION
+	int				codas;
+	int				nTargets;
+	int				posture;
+	int				targetBar;
+	int				tappingSurface;
+
+	// DEX_TLM_EVENT, with the wall clock time (as from time()) and the text.
+	unsigned long	clock;
+	int				length;
+	char			text[DEX_TLM_MAX_TEXT + 1];
+
+	// DEX_TLM_RECORDING_START, _RECORD and _END. Start and end give the number of 
+	// samples in the whole recording. Each record gives the index of its first sample 
+	// and the number of samples it holds. 
+	unsigned long	recording;
+	int				samples;
+	int				first;
+	int				count;
+	float			data[DEX_TLM_MAX_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE];
+
+	// DEX_TLM_RECORDING_PACKED has the same recording, first and count, 
+	// but the samples are coded as described above.
+	int				packedSize;
+	unsigned char	packed[DEX_TLM_MAX_PACKED];
+
+	// DEX_TLM_NACK lists the reliable packets that are missing. DEX_TLM_ACK says
+	// that all the reliable packets up to and including the given one have been 
+	// dealt with, which completes the recording that it names.
+	int				nNacks;
+	unsigned long	nack[DEX_TLM_MAX_NACKS];
+	unsigned long	acknowledged;
+
+	// DEX_TLM_PARITY covers the protected packets numbered from firstProtected on.
+	// It gives the size of each one and the XOR of them all.
+	unsigned long	firstProtected;
+	int				nProtected;
+	int				protectedSize[DEX_TLM_MAX_PARITY_BLOCK];
+	int				paritySize;
+	unsigned char	parity[DEX_TLM_MAX_RECORD_SIZE];
+
+} DexTelemetryMessage;
+
+// What the receiver knows about the reliable packets. The slots of received[]
+// are indexed by sequence number modulo DEX_TLM_WINDOW.
+
+typedef struct {
+
+	int				started;
+	unsigned long	next;			// All reliable packets before this one are accounted for.
+	unsigned long	end;			// One past the highest one that has arrived.
+	unsigned char	received[DEX_TLM_WINDOW];
+
+	int				nackDue;
+	int				nackRounds;
+	unsigned long	lastNack;
+
+	// The last recording to end, and the sequence number of its end packet.
+	int				ackPending;
+	unsigned long	ackRecording;
+	unsigned long	ackSequence;
+
+	unsigned long	duplicates;
+	unsigned long	recovered;
+	unsigned long	abandoned;
+
+} DexTelemetryReceiver;
+
+// What the sender knows about the reliable packets. It keeps the last DEX_TLM_WINDOW
+// of them, by sequence number modulo the window. Everything before acknowledged has
+// been acknowledged by the receiver.
+
+typedef struct {
+
+	unsigned char	packet[DEX_TLM_WINDOW][DEX_TLM_MAX_PACKET_SIZE];
+	int				size[DEX_TLM_WINDOW];
+	unsigned long	sequence[DEX_TLM_WINDOW];
+
+	unsigned long	sent;			// One past the last reliable packet.
+	unsigned long	acknowledged;
+	unsigned long	lastTime;		// When a reliable packet last went out.
+	int				probes;
+
+	unsigned long	retransmitted;
+	unsigned long	completed;
+
+} DexTelemetrySender;
+
+// Copies of the protected packets received, by sequence number modulo the history.
+
+typedef struct {
+
+	unsigned long	sequence[DEX_TLM_REPAIR_HISTORY];
+	int				size[DEX_TLM_REPAIR_HISTORY];
+	unsigned char	packet[DEX_TLM_REPAIR_HISTORY][DEX_TLM_MAX_RECORD_SIZE];
+
+	unsigned long	rebuilt;
+	unsigned long	unrepairable;
+
+} DexTelemetryRepair;
+
+// The last two quantized values of each channel, for the prediction.
+
+typedef struct {
+
+	long			value[DEX_TLM_FLOATS_PER_SAMPLE][2];
+	int				history[DEX_TLM_FLOATS_PER_SAMPLE];
+
+} DexTelemetryPredictor;
+
+// What the sender remembers of the last state that went out, and how far a new
+// state has to be from it to be worth sending. Times are in ms.
+
+typedef struct {
+
+	double			positionDeadband;
+	double			orientationDeadband;
+	unsigned long	stateInterval;
+	unsigned long	keyframeInterval;
+
+	int				sent;
+	int				acquisition;
+	int				visibility;
+	unsigned long	targets;
+	float			position[3];
+	float			orientation[4];
+	unsigned long	lastStateTime;
+	unsigned long	lastKeyframeTime;
+
+	// States that did not need to be sent.
+	unsigned long	suppressed;
+
+} DexTelemetryStateFilter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+// Returns the number of bytes written to the packet or an error code.
+int DexTelemetryEncode( unsigned char *packet, int max_size, const DexTelemetryMessage *message );
+
+// Returns the number of bytes taken by the packet at the start of the buffer,
+// or an error code. Anything that does not follow the format is rejected.
+int DexTelemetryDecode( const unsigned char *packet, int size, DexTelemetryMessage *message );
+
+// Tell binary packets from the older text packets.
+int DexTelemetryIsBinary( const unsigned char *packet, int size );
+
+// Decode one of the older text packets into the same message. The fields are 
+// read where they are in the packet, without sscanf(). Returns the size of 
+// the packet or an error code. Text records do not say which recording they 
+// belong to or where their samples go, so recording and first are left at 0.
+// A DEX_RECORDING_SAMPLE comes back as a record of one sample with no time.
+int DexTelemetryDecodeText( const char *packet, int size, DexTelemetryMessage *message );
+
+// Decode only the header. Returns the size of the whole packet or an error code.
+int DexTelemetryDecodeHeader( const unsigned char *packet, int size, DexTelemetryMessage *message );
+
+// Set flags in the header of a packet that is already encoded.
+void DexTelemetrySetFlags( unsigned char *packet, unsigned int flags );
+
+// Move a packet that is already encoded along the reliable sequence, as when a log 
+// is played over again. Reliable and protected packets get offset added to their 
+// sequence number, and parity packets are changed to cover the renumbered packets.
+// Returns the size of the whole packet or an error code.
+int DexTelemetryRenumber( unsigned char *packet, int size, unsigned long offset );
+
+// Receiver side of the reliable delivery. Accept() returns 1 if the message should 
+// be processed and 0 if it has been seen before. Reply() fills in a NACK or an ACK 
+// if one should be sent back to the server and returns 1 if so. Times are in ms.
+void DexTelemetryReceiverInit( DexTelemetryReceiver *rx );
+int DexTelemetryReceiverAccept( DexTelemetryReceiver *rx, const DexTelemetryMessage *message );
+int DexTelemetryReceiverReply( DexTelemetryReceiver *rx, DexTelemetryMessage *reply, unsigned long now );
+
+// Sender side of the reliable delivery. Keep() takes a copy of each packet as it 
+// is queued, if it is reliable and not itself a copy. Copy() gives back the packet 
+// with the given number, flagged DEX_TLM_RETRANSMITTED, to be sent again for a NACK.
+// It returns its size, or 0 if the packet is no longer kept. Acknowledge() takes 
+// an ACK and returns 1 if it completes a recording. If the end of a recording goes
+// unacknowledged, the receiver does not know that it is missing. Probe() returns 1
+// when it is time to send it again, with its number in sequence, as long as the 
+// sender is idle and has not already done so DEX_TLM_NACK_RETRIES times. The time 
+// at which each reliable packet goes out has to be kept in lastTime. Pending() 
+// returns 1 while the sender is still waiting for an acknowledgement.
+void DexTelemetrySenderInit( DexTelemetrySender *tx );
+void DexTelemetrySenderKeep( DexTelemetrySender *tx, const unsigned char *packet, int size );
+int DexTelemetrySenderCopy( DexTelemetrySender *tx, unsigned long sequence, unsigned char *packet );
+int DexTelemetrySenderAcknowledge( DexTelemetrySender *tx, const DexTelemetryMessage *ack );
+int DexTelemetrySenderProbe( DexTelemetrySender *tx, unsigned long now, int idle, unsigned long *sequence );
+int DexTelemetrySenderPending( DexTelemetrySender *tx );
+
+// Sender side of the parity. Add each protected packet to the parity message 
+// as it is sent. The block starts over once the parity has been sent and 
+// nProtected set back to zero.
+void DexTelemetryParityAdd( DexTelemetryMessage *parity, const unsigned char *packet, int size, unsigned long sequence );
+
+// Receiver side. Keep() takes a copy of each protected packet as it arrives.
+// Rebuild() is given a parity message and, if exactly one packet of the block 
+// is missing, rebuilds it. It returns the size of the rebuilt packet, or 0.
+void DexTelemetryRepairInit( DexTelemetryRepair *repair );
+void DexTelemetryRepairKeep( DexTelemetryRepair *repair, const unsigned char *packet, int size, unsigned long sequence );
+int DexTelemetryRepairRebuild( DexTelemetryRepair *repair, const DexTelemetryMessage *parity, unsigned char *packet );
+
+// Fill a DEX_TLM_RECORDING_PACKED message one sample at a time. Each sample is 
+// the time, x, y and z, as in data[]. PackSample() returns 0 if the packet is 
+// full, in which case the message should be sent and started over at the same
+// sample. Unpack() writes message->count samples in the same layout, with 
+// the position of those that were not visible set to invisible. It returns 
+// the number of samples or DEX_TLM_BAD_LENGTH if the payload does not add up.
+void DexTelemetryPackStart( DexTelemetryMessage *message, DexTelemetryPredictor *predictor, int first );
+int DexTelemetryPackSample( DexTelemetryMessage *message, DexTelemetryPredictor *predictor, const float sample[], int visible );
+int DexTelemetryUnpack( const DexTelemetryMessage *message, float *samples, float invisible );
+
+// Put the samples of a record, from data[] or as unpacked, in their place among the 
+// max_samples time stamps and x, y, z positions of a recording. Returns the number 
+// of samples or DEX_TLM_OVERFLOW, with nothing stored, if they do not all fit.
+int DexTelemetryStoreRecord( const DexTelemetryMessage *message, const float *data, float *time, float *position, int max_samples );
+
+// Sender side of the state updates. FilterState() is given the current state in a 
+// DEX_TLM_STATE message and the time in ms. It returns 0 if the state need not be 
+// sent. Otherwise it sets the type to DEX_TLM_STATE for a keyframe or to 
+// DEX_TLM_STATE_CHANGE, sets changed to the parts of the pose that moved, counts
+// the state as sent and returns the type. A state that replaces one still waiting 
+// to go out has to have the older one merged into it with MergeStates(), so that 
+// neither the keyframe nor a part of the pose that moved is lost on the way.
+void DexTelemetryStateFilterInit( DexTelemetryStateFilter *filter, double position_deadband, double orientation_deadband, 
+								  unsigned long interval, unsigned long keyframe );
+int DexTelemetryFilterState( DexTelemetryStateFilter *filter, DexTelemetryMessage *state, unsigned long now );
+void DexTelemetryMergeStates( DexTelemetryMessage *newer, const DexTelemetryMessage *older );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _DexTelemetry_
+#endif
@@ -0,0 +1,144 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                              DexTelemetryReplay.c                             */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+
+  Play back a log of the packets sent by DexMonitorServerUDP, or received by 
+  DexMonitor, to a monitor on this machine (see DexUDPOpenLog()).
+
+	DexTelemetryReplay [-speed=N] [-max] [-repeat=N] [-to=address] logfile
+
+  -speed=N	plays the log N times faster than it was recorded (default 1).
+  -max		sends the packets one after the other as fast as they will go, 
+			which makes it a load generator for throughput tests of the monitor.
+  -repeat=N	plays the log N times over. Each time through, the reliable and 
+			protected packets are numbered on from where the last pass ended,
+			so that the monitor does not drop them as packets it has seen.
+  -to=		also sends the packets to the given address, as the server would.
+
+  */
+
+#include <windows.h>
+#include <mmsystem.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DexUDPServices.h"
+#include "DexTelemetry.h"
+
+enum { NORMAL_EXIT = 0, NO_LOG_FILE, BAD_LOG_FILE, NO_SOCKET };
+
+int main ( int argc, char *argv[] ) {
+
+	char	*log_file = NULL;
+	char	*address = NULL;
+	double	speed = 1.0;
+	int		full_speed = FALSE;
+	int		repeat = 1;
+
+	FILE	*fp;
+	DexUDP	udp;
+	char	packet[DEX_UDP_PACKET_SIZE];
+	int		size, pass, arg;
+	unsigned long	delay;
+
+	DexTelemetryMessage	header;
+	unsigned long	first_sequence = 0, last_sequence = 0, offset;
+	int		numbered = FALSE;
+
+	LARGE_INTEGER	frequency, start, now;
+	double	schedule, elapsed, late, latest = 0.0;
+	unsigned long	packets = 0, bytes = 0;
+	int		exit_status = NORMAL_EXIT;
+
+	// Parse the command line arguments.
+
+	for ( arg = 1; arg < argc; arg++ ) {
+		if ( !strncmp( argv[arg], "-speed=", strlen( "-speed=" ) ) ) speed = atof( argv[arg] + strlen( "-speed=" ) );
+		else if ( !strcmp( argv[arg], "-max" ) ) full_speed = TRUE;
+		else if ( !strncmp( argv[arg], "-repeat=", strlen( "-repeat=" ) ) ) repeat = atoi( argv[arg] + strlen( "-repeat=" ) );
+		else if ( !strncmp( argv[arg], "-to=", strlen( "-to=" ) ) ) address = argv[arg] + strlen( "-to=" );
+		else log_file = argv[arg];
+	}
+	if ( !log_file || speed <= 0.0 || repeat < 1 ) {
+		fprintf( stderr, "Usage: %s [-speed=N] [-max] [-repeat=N] [-to=address] logfile\n", argv[0] );
+		exit( NO_LOG_FILE );
+	}
+
+	fp = DexUDPOpenReplay( log_file );
+	if ( !fp ) {
+		fprintf( stderr, "Could not open %s as a packet log.\n", log_file );
+		exit( NO_LOG_FILE );
+	}
+	if ( !DexUDPInitServer( &udp, address ) ) exit( NO_SOCKET );
+
+	// Find the span of the reliable sequence in the log, for the passes after the first.
+	if ( repeat > 1 ) {
+		while ( ( size = DexUDPReadLog( fp, packet, &delay ) ) > 0 ) {
+			if ( !DexTelemetryIsBinary( (unsigned char *) packet, size ) ) continue;
+			if ( DexTelemetryDecodeHeader( (unsigned char *) packet, size, &header ) < 0 ) continue;
+			if ( !( header.flags & ( DEX_TLM_RELIABLE | DEX_TLM_PROTECTED ) ) ) continue;
+			if ( !numbered || header.sequence < first_sequence ) first_sequence = header.sequence;
+			if ( !numbered || header.sequence > last_sequence ) last_sequence = header.sequence;
+			numbered = TRUE;
+		}
+	}
+
+	// Sleep() is only good to the millisecond with this.
+	timeBeginPeriod( 1 );
+
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &start );
+	schedule = 0.0;
+
+	for ( pass = 0; pass < repeat && exit_status == NORMAL_EXIT; pass++ ) {
+
+		fseek( fp, strlen( DEX_UDP_LOG_MAGIC ), SEEK_SET );
+		offset = ( numbered ? pass * ( last_sequence - first_sequence + 1 ) : 0 );
+
+		while ( ( size = DexUDPReadLog( fp, packet, &delay ) ) > 0 ) {
+
+			// Text packets are left as they are.
+			if ( offset ) DexTelemetryRenumber( (unsigned char *) packet, size, offset );
+
+			// Each packet goes out when it is due from the start, so that 
+			// the small errors in the sleeps do not add up.
+			if ( !full_speed ) {
+				schedule += delay / speed / 1000000.0;
+				QueryPerformanceCounter( &now );
+				elapsed = (double) ( now.QuadPart - start.QuadPart ) / frequency.QuadPart;
+				if ( schedule - elapsed > 0.001 ) Sleep( (DWORD) ( ( schedule - elapsed ) * 1000.0 ) );
+				else if ( ( late = elapsed - schedule ) > latest ) latest = late;
+			}
+
+			DexUDPSendPacket( &udp, packet, size );
+			packets++;
+			bytes += size;
+
+		}
+		if ( size < 0 ) {
+			fprintf( stderr, "%s is damaged after %lu packets.\n", log_file, packets );
+			exit_status = BAD_LOG_FILE;
+		}
+
+	}
+
+	QueryPerformanceCounter( &now );
+	elapsed = (double) ( now.QuadPart - start.QuadPart ) / frequency.QuadPart;
+	timeEndPeriod( 1 );
+	fclose( fp );
+
+	// A short log played at full speed can take less than the resolution of the clock.
+	if ( elapsed > 0.0 ) printf( "%lu packets (%lu bytes) in %.3f s: %.0f packets/s, %.0f bytes/s.", 
+		packets, bytes, elapsed, packets / elapsed, bytes / elapsed );
+	else printf( "%lu packets (%lu bytes) in no measurable time.", packets, bytes );
+	if ( !full_speed ) printf( " At most %.1f ms late.", latest * 1000.0 );
+	printf( "\n" );
+
+	return( exit_status );
+
+}
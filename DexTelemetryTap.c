@@ -0,0 +1,110 @@
+/*********************************************************************************/
+/*                                                                               */
+/*                                DexTelemetryTap.c                              */
+/*                                                                               */
+/*********************************************************************************/
+
+/*
+
+  Read the packets that DexMonitorServerSHM publishes in shared memory
+  (run DexSimulatorApp with -shm, or -shm=ring for another name),
+  as any local viewer or logger would, and report once a second on what
+  came through and on what was lost because the reader fell behind.
+
+	DexTelemetryTap [-name=ring] [-seconds=N] [-slow=N]
+
+  -name=	the shared memory to attach to (default DEX_SHM_DEFAULT_NAME).
+  -seconds=N	stops after N seconds (default: when the apparatus quits).
+  -slow=N	sleeps N ms after each packet, to see what a slow reader gets.
+
+  */
+
+#include <windows.h>
+#include <mmsystem.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DexSHMServices.h"
+#include "DexTelemetry.h"
+
+enum { NORMAL_EXIT = 0, BAD_ARGUMENTS, NO_RING };
+
+// How often to look for new packets when there are none (ms).
+#define TAP_POLL	5
+
+int main ( int argc, char *argv[] ) {
+
+	char	*name = DEX_SHM_DEFAULT_NAME;
+	int		seconds = 0;
+	int		slow = 0;
+
+	DexSHM	shm;
+	DexTelemetryMessage	message;
+	char	packet[DEX_UDP_PACKET_SIZE];
+	int		size, arg;
+
+	unsigned long	start, now, report;
+	unsigned long	packets = 0, bytes = 0, states = 0, recordings = 0, events = 0;
+	int		quit = FALSE;
+
+	// Parse the command line arguments.
+
+	for ( arg = 1; arg < argc; arg++ ) {
+		if ( !strncmp( argv[arg], "-name=", strlen( "-name=" ) ) ) name = argv[arg] + strlen( "-name=" );
+		else if ( !strncmp( argv[arg], "-seconds=", strlen( "-seconds=" ) ) ) seconds = atoi( argv[arg] + strlen( "-seconds=" ) );
+		else if ( !strncmp( argv[arg], "-slow=", strlen( "-slow=" ) ) ) slow = atoi( argv[arg] + strlen( "-slow=" ) );
+		else {
+			fprintf( stderr, "Usage: %s [-name=ring] [-seconds=N] [-slow=N]\n", argv[0] );
+			exit( BAD_ARGUMENTS );
+		}
+	}
+
+	if ( DexSHMInitClient( &shm, name ) ) {
+		fprintf( stderr, "Could not attach to %s. Is the apparatus running?\n", name );
+		exit( NO_RING );
+	}
+
+	start = report = timeGetTime();
+	while ( !quit && ( seconds <= 0 || timeGetTime() - start < seconds * 1000UL ) ) {
+
+		size = DexSHMRead( &shm, packet );
+		if ( size > 0 ) {
+			packets++;
+			bytes += size;
+			if ( DexTelemetryIsBinary( (unsigned char *) packet, size ) ) {
+				if ( DexTelemetryDecode( (unsigned char *) packet, size, &message ) < 0 ) message.type = -1;
+			}
+			else if ( DexTelemetryDecodeText( packet, size, &message ) < 0 ) message.type = -1;
+			switch ( message.type ) {
+			case DEX_TLM_STATE:
+			case DEX_TLM_STATE_CHANGE:
+				states++;
+				break;
+			case DEX_TLM_RECORDING_START:
+				recordings++;
+				break;
+			case DEX_TLM_EVENT:
+				events++;
+				break;
+			case DEX_TLM_QUIT:
+				quit = TRUE;
+				break;
+			}
+			if ( slow > 0 ) Sleep( slow );
+		}
+		else Sleep( TAP_POLL );
+
+		now = timeGetTime();
+		if ( now - report >= 1000 || quit ) {
+			printf( "%6.1f s: %lu packets (%lu bytes), %lu states, %lu recordings, %lu events. %lu lost, %lu waiting.\n",
+				( now - start ) / 1000.0, packets, bytes, states, recordings, events, shm.lost, DexSHMBacklog( &shm ) );
+			report = now;
+		}
+
+	}
+
+	DexSHMClose( &shm );
+	return( NORMAL_EXIT );
+
+}
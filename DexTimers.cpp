@@ -23,6 +23,75 @@ void DexTimerSetSlowmotion( float factor ) {
 	dex_slow_motion = factor;
 }
 
+/*****************************************************************************/
+
+/*
+ * Virtual clock, counted in microseconds.
+ * We keep the deadline of each timer that has been set, so that the clock
+ * can jump from one to the next. A timer that is set again replaces its 
+ * previous deadline. Deadlines that have passed are dropped.
+ */
+
+#define DEX_VIRTUAL_FREQUENCY	1000000.0
+#define DEX_VIRTUAL_DEADLINES	64
+
+static int		dex_virtual_clock = 0;
+static __int64	dex_virtual_now = 0;
+static __int64	dex_virtual_step = 0;
+
+static DexTimer	*dex_deadline_timer[DEX_VIRTUAL_DEADLINES];
+static __int64	dex_deadline[DEX_VIRTUAL_DEADLINES];
+static int		dex_deadlines = 0;
+
+void DexTimerSetVirtual( int enable, double max_step ) {
+	dex_virtual_clock = enable;
+	dex_virtual_now = 0;
+	dex_virtual_step = (__int64) ( max_step * DEX_VIRTUAL_FREQUENCY );
+	if ( dex_virtual_step < 1 ) dex_virtual_step = 1;
+	dex_deadlines = 0;
+}
+
+
+double DexTimerVirtualTime( void ) {
+	return( (double) dex_virtual_now / DEX_VIRTUAL_FREQUENCY );
+}
+
+static void DexTimerAddDeadline( DexTimer &timer, __int64 deadline ) {
+
+	int i;
+
+	for ( i = 0; i < dex_deadlines; i++ ) {
+		if ( dex_deadline_timer[i] == &timer ) break;
+	}
+	// If there are too many, this one will be found when max_step runs out.
+	if ( i >= DEX_VIRTUAL_DEADLINES ) return;
+	dex_deadline_timer[i] = &timer;
+	dex_deadline[i] = deadline;
+	if ( i == dex_deadlines ) dex_deadlines++;
+
+}
+
+// Jump to the next deadline, but not further than max_step.
+// With the real clock, time goes by on its own.
+
+void DexTimerTick( void ) {
+
+	__int64	next = dex_virtual_now + dex_virtual_step;
+	int		i, kept = 0;
+
+	if ( !dex_virtual_clock ) return;
+	for ( i = 0; i < dex_deadlines; i++ ) {
+		if ( dex_deadline[i] <= dex_virtual_now ) continue;
+		if ( dex_deadline[i] < next ) next = dex_deadline[i];
+		dex_deadline_timer[kept] = dex_deadline_timer[i];
+		dex_deadline[kept] = dex_deadline[i];
+		kept++;
+	}
+	dex_deadlines = kept;
+	dex_virtual_now = next;
+
+}
+
 
 /*****************************************************************************/
 
@@ -30,6 +99,18 @@ void DexTimerSetSlowmotion( float factor ) {
  * Implement a means of timing actions - version Win32.
  */
 
+// Current value of the clock that this timer runs on.
+
+static __int64 DexTimerCounter( DexTimer &timer ) {
+
+	LARGE_INTEGER	li;
+
+	if ( dex_virtual_clock && !timer.wall_clock ) return( dex_virtual_now );
+	QueryPerformanceCounter( &li );
+	return( li.QuadPart );
+
+}
+
 /****************************************************************************/
 
 /*
@@ -41,12 +122,31 @@ void DexTimerStart ( DexTimer &timer ) {
 
 	LARGE_INTEGER	li;
 
+	timer.wall_clock = 0;
+	if ( dex_virtual_clock ) timer.frequency = DEX_VIRTUAL_FREQUENCY;
+	else {
+		QueryPerformanceFrequency( &li );
+		timer.frequency = (double) li.QuadPart;
+	}
+
+	timer.mark = DexTimerCounter( timer );
+	timer.split = timer.mark;
+
+}
+
+/*
+ * Same, but always in real time. Used to measure how long computations take.
+ */
+
+void DexTimerStartWallClock ( DexTimer &timer ) {
+
+	LARGE_INTEGER	li;
+
+	timer.wall_clock = 1;
 	QueryPerformanceFrequency( &li );
 	timer.frequency = (double) li.QuadPart;
 
-	QueryPerformanceCounter( &li );
-	timer.mark = li.QuadPart;
-
+	timer.mark = DexTimerCounter( timer );
 	timer.split = timer.mark;
 
 }
@@ -55,14 +155,12 @@ void DexTimerStart ( DexTimer &timer ) {
 
 double DexTimerElapsedTime ( DexTimer &timer ) {
 	
-	LARGE_INTEGER	li;
 	__int64			current_time;
 	double			duration;
 	
 	/* Compute the true time interval since the timer was started. */
 
-	QueryPerformanceCounter( &li );
-	current_time = li.QuadPart;
+	current_time = DexTimerCounter( timer );
 	duration = (double) (current_time - timer.mark) / timer.frequency / dex_slow_motion;
 
 	return( duration );
@@ -77,14 +175,12 @@ double DexTimerRemainingTime( DexTimer &timer ) {
 
 double DexTimerSplitTime ( DexTimer &timer ) {
 	
-	LARGE_INTEGER	li;
 	__int64			current_time;
 	double			duration;
 	
 	/* Compute the true time interval since the last split was set. */
 
-	QueryPerformanceCounter( &li );
-	current_time = li.QuadPart;
+	current_time = DexTimerCounter( timer );
 	duration = (double) (current_time - timer.split) / timer.frequency / dex_slow_motion;
 
 	return( duration );
@@ -97,6 +193,9 @@ void DexTimerSet( DexTimer &timer, double seconds ) {
 
 	timer.alarm = seconds;
 	DexTimerStart( timer );
+	if ( dex_virtual_clock && seconds > 0.0 ) {
+		DexTimerAddDeadline( timer, timer.mark + (__int64) ( seconds * dex_slow_motion * DEX_VIRTUAL_FREQUENCY + 0.5 ) );
+	}
 
 }
 
@@ -31,11 +31,13 @@ typedef struct {
 
 #endif
 
- 
+	/* Set if the timer measures real time even when the clock is virtual. */
+	int		wall_clock;
 
 } DexTimer;
 
 void	DexTimerStart ( DexTimer &timer );
+void	DexTimerStartWallClock ( DexTimer &timer );
 double	DexTimerElapsedTime ( DexTimer &timer );
 double	DexTimerRemainingTime( DexTimer &timer );
 double	DexTimerSplitTime ( DexTimer &timer );
@@ -43,6 +45,17 @@ void	DexTimerSet( DexTimer &timer, double seconds );
 int	    DexTimerTimeout( DexTimer &timer );
 void	DexTimerSetSlowmotion( float factor );
 
+/*
+ * Virtual time. All the timers then run on a common simulated clock that
+ * only moves when DexTimerTick() is called, i.e. once per DexApparatus::Update().
+ * It then jumps to the next deadline of any timer, or by max_step, whichever
+ * comes first. Looking at a timer never moves the clock. 
+ * This must be set before any timer is started.
+ */
+void	DexTimerSetVirtual( int enable, double max_step );
+void	DexTimerTick( void );
+double	DexTimerVirtualTime( void );
+
 #ifdef __cplusplus 
 }
 #endif
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 
 #include <VectorsMixin.h>
 
@@ -56,24 +57,116 @@ void DexTracker::GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotatio
 	MessageBox( NULL, "GetUnitTransform() undefined.", "DexTracker", MB_OK );
 }
 
+void DexTracker::InvalidateUnitTransforms( void ) {
+	// Everything computed before now belongs to an older generation.
+	alignmentGeneration++;
+}
+
+void DexTracker::CacheUnitTransform( int unit ) {
+	if ( unitTransformGeneration[unit] == alignmentGeneration ) return;
+	// Retrieve the offset and rotation matrix from the Coda for this unit.
+	GetUnitTransform( unit, unitOffset[unit], unitRotation[unit] );
+	// Inverse of a rotation matrix is just its transpose.
+	InverseRigidTransform( unitIntrinsicTransform[unit], unitOffset[unit], unitRotation[unit] );
+	unitTransformGeneration[unit] = alignmentGeneration;
+}
+
 void DexTracker::GetUnitPlacement( int unit, Vector3 &pos, Quaternion &ori ) {
 
-	Vector3		offset;
-	Matrix3x3	rotation;
 	Matrix3x3	ortho;
 
-	GetUnitTransform( unit, offset, rotation );
+	// Computed only once per alignment.
+	if ( unitPlacementGeneration[unit] != alignmentGeneration ) {
+
+		CacheUnitTransform( unit );
+
+		// I have to check: Is the position equal to its offset, 
+		//  or the negative of the offset?
+		// ScaleVector( pos, offset, -1.0 );
+		CopyVector( unitPosition[unit], unitOffset[unit] );
+		// I want to be sure that the rotation matrix is really a rotation matrix.
+		// This means that it must be orthonormal.
+		// In fact, I am not convinced that CODA guarantees an orthonormal matrix.
+		OrthonormalizeMatrix( ortho, unitRotation[unit] );
+		// Express the orientation of the CODA unit as a quaternion.
+		MatrixToQuaternion( unitOrientation[unit], ortho );
+
+		unitPlacementGeneration[unit] = alignmentGeneration;
+		RecordUnitPlacement( unit, unitPosition[unit], unitOrientation[unit], (long) time( NULL ) );
+
+	}
+
+	CopyVector( pos, unitPosition[unit] );
+	CopyQuaternion( ori, unitOrientation[unit] );
+
+}
+
+/**************************************************************************************/
+
+// Keep track of where the units have been, within and across sessions.
+
+void DexTracker::RecordUnitPlacement( int unit, const Vector3 pos, const Quaternion ori, long time ) {
+
+	FILE *fp;
 
-	// I have to check: Is the position equal to its offset, 
-	//  or the negative of the offset?
-	// ScaleVector( pos, offset, -1.0 );
-	CopyVector( pos, offset );
-	// I want to be sure that the rotation matrix is really a rotation matrix.
-	// This means that it must be orthonormal.
-	// In fact, I am not convinced that CODA guarantees an orthonormal matrix.
-	OrthonormalizeMatrix( ortho, rotation );
-	// Express the orientation of the CODA unit as a quaternion.
-	MatrixToQuaternion( ori, ortho );
+	// Drop the oldest one if the history is full.
+	if ( nPlacementHistory >= DEX_PLACEMENT_HISTORY ) {
+		for ( int i = 1; i < DEX_PLACEMENT_HISTORY; i++ ) placementHistory[i-1] = placementHistory[i];
+		nPlacementHistory = DEX_PLACEMENT_HISTORY - 1;
+	}
+	placementHistory[nPlacementHistory].unit = unit;
+	placementHistory[nPlacementHistory].time = time;
+	CopyVector( placementHistory[nPlacementHistory].position, pos );
+	CopyQuaternion( placementHistory[nPlacementHistory].orientation, ori );
+	nPlacementHistory++;
+
+	// Add it to the file for the next sessions.
+	if ( placementHistoryFilename && ( fp = fopen( placementHistoryFilename, "a" ) ) ) {
+		fprintf( fp, "%ld\t%d\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n", time, unit, 
+			pos[X], pos[Y], pos[Z], ori[X], ori[Y], ori[Z], ori[M] );
+		fclose( fp );
+	}
+
+}
+
+void DexTracker::LoadUnitPlacementHistory( const char *filename ) {
+
+	FILE		*fp;
+	long		time;
+	int			unit;
+	Vector3		pos;
+	Quaternion	ori;
+
+	placementHistoryFilename = NULL;
+	nPlacementHistory = 0;
+	fp = fopen( filename, "r" );
+	if ( fp ) {
+		while ( 9 == fscanf( fp, "%ld %d %lf %lf %lf %lf %lf %lf %lf", &time, &unit, 
+			&pos[X], &pos[Y], &pos[Z], &ori[X], &ori[Y], &ori[Z], &ori[M] ) ) {
+			if ( unit >= 0 && unit < DEX_MAX_CODAS ) RecordUnitPlacement( unit, pos, ori, time );
+		}
+		fclose( fp );
+	}
+	// From now on, new placements get appended.
+	placementHistoryFilename = filename;
+
+}
+
+bool DexTracker::GetUnitPlacementDrift( int unit, double &distance, double &angle, long &elapsed ) {
+
+	int latest, previous;
+	Vector3 delta;
+
+	for ( latest = nPlacementHistory - 1; latest >= 0 && placementHistory[latest].unit != unit; latest-- );
+	if ( latest < 0 ) return( false );
+	for ( previous = latest - 1; previous >= 0 && placementHistory[previous].unit != unit; previous-- );
+	if ( previous < 0 ) return( false );
+
+	SubtractVectors( delta, placementHistory[latest].position, placementHistory[previous].position );
+	distance = VectorNorm( delta );
+	angle = ToDegrees( AngleBetween( placementHistory[latest].orientation, placementHistory[previous].orientation ) );
+	elapsed = placementHistory[latest].time - placementHistory[previous].time;
+	return( true );
 
 }
 
@@ -81,6 +174,7 @@ void DexTracker::GetUnitPlacement( int unit, Vector3 &pos, Quaternion &ori ) {
 /**************************************************************************************/
 
 int DexTracker::PerformAlignment( int origin, int x_negative, int x_positive, int xy_negative, int xy_positive ) {
+	InvalidateUnitTransforms();
 	return( NORMAL_EXIT );
 }
 
@@ -105,29 +199,20 @@ bool DexTracker::GetCurrentMarkerFrameIntrinsic( CodaFrame &iframe, int unit ) {
 	CodaFrame	frame;
 	int			status;
 
-	Vector3		offset;
-	Matrix3x3	rotation;
-	Matrix3x3	inverse;
-	Vector3		delta;
-
-	// Retrieve the offset and rotation matrix from the Coda for this unit.
-	GetUnitTransform( unit, offset, rotation );
-	// Inverse of a rotation matrix is just its transpose.
-	TransposeMatrix( inverse, rotation );
+	// The transformation is asked of the Coda only once per alignment.
+	CacheUnitTransform( unit );
 
 	// Get the current frame in aligned coordinates.
 	status = GetCurrentMarkerFrameUnit( frame, unit );
 //	status = GetCurrentMarkerFrameUnit( frame, unit );
 	// I'm not sure what could go wrong, but signal if it does.
 	if ( !status ) return( false );
-	// Compute the position of each maker in intrinsic coordinates.
-	for ( int mrk = 0; mrk < nMarkers; mrk++ ) {
-		iframe.marker[mrk].visibility = frame.marker[mrk].visibility;
-		if ( frame.marker[mrk].visibility ) {
-			SubtractVectors( delta, frame.marker[mrk].position, offset );
-			MultiplyVector( iframe.marker[mrk].position, delta, inverse );
-		}
-	}
+	// Compute the position of each maker in intrinsic coordinates, all in one go.
+	// Positions of markers that are not visible are meaningless anyway.
+	TransformPoints( iframe.marker[0].position, frame.marker[0].position, nMarkers, 
+		unitIntrinsicTransform[unit], sizeof( CodaMarker ) );
+	for ( int mrk = 0; mrk < nMarkers; mrk++ ) iframe.marker[mrk].visibility = frame.marker[mrk].visibility;
+	iframe.time = frame.time;
 
 	return( true );
 }
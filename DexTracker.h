@@ -31,12 +31,47 @@
 
 /********************************************************************************/
 
+// A placement of a CODA unit, as computed after an alignment.
+typedef struct {
+	int			unit;
+	// When it was computed (seconds since 1970, as from time()).
+	long		time;
+	Vector3		position;
+	Quaternion	orientation;
+} DexUnitPlacement;
+
 class DexTracker : public VectorsMixin {
 
 	private:
 
 	protected:
 
+		// The unit transforms only change when the tracker is aligned, so they are
+		// asked of the tracker once and kept here, together with the transformation
+		// from aligned coordinates back to the intrinsic coordinates of each unit
+		// and the placement of the unit. Each is valid if it was computed during 
+		// the current alignment generation. Trackers must call InvalidateUnitTransforms() 
+		// when they are aligned, which starts a new generation.
+		unsigned long	alignmentGeneration;
+		unsigned long	unitTransformGeneration[DEX_MAX_CODAS];
+		Vector3			unitOffset[DEX_MAX_CODAS];
+		Matrix3x3		unitRotation[DEX_MAX_CODAS];
+		Transform3x4	unitIntrinsicTransform[DEX_MAX_CODAS];
+		unsigned long	unitPlacementGeneration[DEX_MAX_CODAS];
+		Vector3			unitPosition[DEX_MAX_CODAS];
+		Quaternion		unitOrientation[DEX_MAX_CODAS];
+
+		void			CacheUnitTransform( int unit );
+		void			InvalidateUnitTransforms( void );
+
+		// The successive placements of the units, oldest first, including those
+		// of previous sessions read from the history file.
+		DexUnitPlacement	placementHistory[DEX_PLACEMENT_HISTORY];
+		int					nPlacementHistory;
+		const char			*placementHistoryFilename;
+
+		void			RecordUnitPlacement( int unit, const Vector3 pos, const Quaternion ori, long time );
+
 	public:
 
 		int nCodas;
@@ -46,7 +81,10 @@ class DexTracker : public VectorsMixin {
 
 		double samplePeriod;
 
-		DexTracker() : nCodas( N_CODAS ), nMarkers( N_MARKERS ), samplePeriod( 0.005 ) {} ;
+		DexTracker() : alignmentGeneration( 1 ), nPlacementHistory( 0 ), placementHistoryFilename( NULL ),
+			nCodas( N_CODAS ), nMarkers( N_MARKERS ), samplePeriod( 0.005 ) {
+			for ( int unit = 0; unit < DEX_MAX_CODAS; unit++ ) unitTransformGeneration[unit] = unitPlacementGeneration[unit] = 0;
+		} ;
 
 		virtual void Initialize( void );
 		virtual int  Update( void );
@@ -65,6 +103,10 @@ class DexTracker : public VectorsMixin {
 		virtual int		GetNumberOfCodas( void );
 		virtual bool	GetAcquisitionState( void );
 		virtual void	GetUnitPlacement( int unit, Vector3 &pos, Quaternion &ori ) ;
+		// Read the placements of previous sessions. New ones will be appended to the same file.
+		void			LoadUnitPlacementHistory( const char *filename );
+		// How far the unit has moved between its last 2 recorded placements (mm and degrees).
+		bool			GetUnitPlacementDrift( int unit, double &distance, double &angle, long &elapsed );
 		virtual void	GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotation ) ;
 		virtual int		PerformAlignment(  int origin, int x_negative, int x_positive, int xy_negative, int xy_positive ) ;
 
@@ -231,6 +273,8 @@ private:
 	int			nPolled;
 
 	HWND		dlg;
+	// Simulated placement of the units at the last update (see Update()).
+	int			simulatedPlacement;
 
 	FILE		*fp;
 
@@ -241,7 +285,7 @@ protected:
 
 public:
 
-	DexMouseTracker( HWND dlg = NULL ) : acquisitionOn(false), overrun(false) {
+	DexMouseTracker( HWND dlg = NULL ) : acquisitionOn(false), overrun(false), simulatedPlacement(-1) {
 		this->dlg = dlg;
 	}
 
@@ -263,4 +307,174 @@ public:
 
 };
 
+/********************************************************************************/
+
+// A simulated tracker that generates the marker data for scripted movements
+// of the manipulandum, seen by any number of units. It does not depend on 
+// real time, on the GUI or on any input from the operator, and the same seed
+// always gives exactly the same data, so it can be used to load and check 
+// the tracker, pose and post hoc computations headless.
+
+typedef enum { 
+	STILL_MOTION = 0, 
+	OSCILLATION_MOTION, 
+	DISCRETE_MOTION, 
+	COLLISION_MOTION, 
+	TARGETED_MOTION 
+} DexMotionType;
+
+typedef struct {
+
+	DexMotionType	type;
+	Vector3			center;		// Middle of the movements (mm, aligned frame).
+	Vector3			direction;	// Unit vector along which the manipulandum moves.
+	double			amplitude;	// Peak to peak (mm).
+	double			period;		// Of one cycle, or of each reach (s).
+	double			hold;		// Pause at the end of each discrete movement or reach (s),
+								// cut short so as to leave at least one sample for moving.
+	double			tilt;		// Rotation around X at the ends of the movement (degrees).
+	int				targets;	// Number of equally spaced targets for the targeted reaches.
+
+} DexMotionScript;
+
+class DexSyntheticTracker : public DexTracker {
+
+private:
+
+	bool		acquisitionOn;
+	bool		overrun;
+	DexTimer	clockTimer;
+	DexTimer	acquisitionTimer;
+	double		acquisitionStart;
+	double		duration;
+
+	// Where each unit is (see GetUnitTransform()) and the error that is added
+	// to what it reports, to simulate units that do not quite agree.
+	Vector3		placementOffset[DEX_MAX_CODAS];
+	Matrix3x3	placementRotation[DEX_MAX_CODAS];
+	Vector3		errorOffset[DEX_MAX_CODAS];
+	Matrix3x3	errorRotation[DEX_MAX_CODAS];
+
+	void	ComputeManipulandumPose( Vector3 position, Quaternion orientation, double time );
+	void	ComputeMarkerPositions( Vector3 position[], bool present[], double time );
+	double	Uniform( unsigned long a, unsigned long b, unsigned long c );
+	double	Noise( unsigned long a, unsigned long b, unsigned long c );
+	bool	Occluded( int unit, int mrk, double time );
+	void	SynthesizeUnitFrame( CodaFrame &frame, double time, int unit, const Vector3 position[], const bool present[] );
+
+protected:
+
+public:
+
+	DexMotionScript	motion;
+	unsigned long	seed;
+	// Standard deviation of the noise added to each coordinate (mm).
+	double			jitter;
+	// Each period, each marker is hidden from each unit with the given 
+	// probability, for the given duration. Markers with their bit set
+	// in occludedMarkers are never seen.
+	double			occlusionRate;
+	double			occlusionPeriod;
+	double			occlusionDuration;
+	unsigned long	occludedMarkers;
+	// Size of the disagreement between units (mm and degrees).
+	double			misalignment;
+	double			misrotation;
+
+	DexSyntheticTracker( int n_codas = N_CODAS, int n_markers = N_MARKERS, unsigned long seed = 1 );
+
+	void Initialize( void );
+	void Quit( void );
+
+	int  Update( void );
+	void StartAcquisition( float max_duration );
+	void StopAcquisition( void );
+	bool GetAcquisitionState( void );
+	bool CheckAcquisitionOverrun( void );
+	int  GetNumberOfCodas( void );
+
+	int	 RetrieveMarkerFrames( CodaFrame frames[], int max_frames, int unit );
+	bool GetCurrentMarkerFrame( CodaFrame &frame );
+	bool GetCurrentMarkerFrameUnit( CodaFrame &frame, int unit );
+
+	void GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotation );
+	int  PerformAlignment( int origin, int x_negative, int x_positive, int xy_negative, int xy_positive );
+
+	// Recompute the placement errors of the units, e.g. after changing the seed or the misalignment.
+	void SetMisalignment( double mm, double degrees );
+	// Fill frames for times start, start + samplePeriod, ... As for RetrieveMarkerFrames(),
+	// page 0 is the combined data and page 1 to nCodas the data from each unit.
+	int  SynthesizeMarkerFrames( CodaFrame frames[], int n, double start, int page = 0 );
+	void SynthesizeMarkerFrame( CodaFrame &frame, double time, int page = 0 );
+
+};
+
+/********************************************************************************/
+
+// A tracker that plays back the marker data of a trial saved by 
+// DexApparatus::SaveAcquisition() (the .mrk file). The recording starts
+// over at each StartAcquisition(). Before that, the first frame is returned
+// and after the end of the recording, the last one. The playback can be
+// sped up by a constant factor, in which case the time stamps are sped up
+// too, so that they agree with the timers of the apparatus.
+
+#define DEX_REPLAY_PAGES	(N_CODAS + 1)
+
+// Write the marker data of a trial in the form that DexReplayTracker reads
+// (the .mrk file). Page 0 is the combined data, then one page per unit.
+// The time of each frame is taken from the manipulandum states.
+// Returns false if the file could not be written.
+bool DexWriteMarkerFile( const char *filename, CodaFrame *pages[], int n_pages, int n_markers, 
+						 const ManipulandumState state[], int n_frames );
+
+class DexReplayTracker : public DexTracker {
+
+private:
+
+	bool		acquisitionOn;
+	bool		overrun;
+	DexTimer	acquisitionTimer;
+	double		duration;
+	double		maxDuration;
+	char		fileroot[256];
+
+	// Page 0 is the combined data, then one page per unit, as in the file.
+	// Only the pages that are in the file are allocated, to the size of the file.
+	CodaFrame	*replayFrames[DEX_REPLAY_PAGES];
+	int			nReplayFrames;
+	int			nReplayPages;
+
+	int			CurrentFrame( void );
+	void		ReplayFrame( CodaFrame &frame, int page, int frm );
+	
+protected:
+
+public:
+
+	double		speed;
+
+	DexReplayTracker( const char *fileroot, double speed = 1.0 );
+	~DexReplayTracker( void );
+
+	// Load another trial. Returns false if the file cannot be read.
+	bool LoadTrial( const char *fileroot );
+
+	void Initialize( void );
+	void Quit( void );
+
+	int  Update( void );
+	void StartAcquisition( float max_duration );
+	void StopAcquisition( void );
+	bool GetAcquisitionState( void );
+	bool CheckAcquisitionOverrun( void );
+	int  GetNumberOfCodas( void );
+
+	int	 RetrieveMarkerFrames( CodaFrame frames[], int max_frames, int unit );
+	bool GetCurrentMarkerFrame( CodaFrame &frame );
+	bool GetCurrentMarkerFrameUnit( CodaFrame &frame, int unit );
+
+	void GetUnitTransform( int unit, Vector3 &offset, Matrix3x3 &rotation );
+
+};
+
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 * Desc:	
 */
 #include <Winsock2.h>
+#include <string.h>
 
 #include "DexUDPServices.h"
 
@@ -18,6 +19,22 @@ static unsigned int defaultPort = DEX_DEFAULT_UDP_PORT;
 static struct sockaddr_in		localXmitAddr;
 static int	  LocalAddrSize = sizeof( localXmitAddr );
 
+// Simulated packet loss. A simple generator of our own, so that 
+// a given seed always drops the same packets.
+static int DexUDPLosePacket( DexUDP *dex_udp_parameters ) {
+	if ( dex_udp_parameters->loss <= 0.0 ) return( FALSE );
+	dex_udp_parameters->loss_state = dex_udp_parameters->loss_state * 1103515245 + 12345;
+	return( ( ( dex_udp_parameters->loss_state >> 16 ) & 0x7fff ) < dex_udp_parameters->loss * 32768.0 );
+}
+
+void DexUDPSetLoss( DexUDP *dex_udp_parameters, double fraction, unsigned long seed ) {
+	dex_udp_parameters->loss = fraction;
+	dex_udp_parameters->loss_state = seed;
+}
+
+// See DexUDPOpenLog() below.
+static void DexUDPLogPacket( DexUDP *dex_udp_parameters, const char *data, int size );
+
 /************************************************************************/
 
 int DexUDPInitServer( DexUDP *dex_udp_parameters, char *broadcast_address ) {
@@ -41,6 +58,8 @@ int DexUDPInitServer( DexUDP *dex_udp_parameters, char *broadcast_address ) {
 		WSACleanup ();
 		return(FALSE);
 	};
+	dex_udp_parameters->loss = 0.0;
+	dex_udp_parameters->log = NULL;
 	
 	// Set up to broadcast to the ethernet network, if a broadcast address was specified.
 	if ( broadcast_address ) {
@@ -68,7 +87,7 @@ int DexUDPInitServer( DexUDP *dex_udp_parameters, char *broadcast_address ) {
 
 /************************************************************************/
 
-unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char data[DEX_UDP_PACKET_SIZE] )
+unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char *data, int size )
 {
 	
 	DWORD	  dwBytesSent = 0;
@@ -79,8 +98,12 @@ unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char data[DEX_U
 	
 	static    count = 0;
 	
+	if ( size < 0 ) return( 0 );
+	if ( size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+	if ( dex_udp_parameters->log ) DexUDPLogPacket( dex_udp_parameters, data, size );
+	if ( DexUDPLosePacket( dex_udp_parameters ) ) return( size );
 	wbSend.buf = (char *) data;	
-	wbSend.len = DEX_UDP_PACKET_SIZE;
+	wbSend.len = size;
 	
 	// Send packet to the local host no matter what.
 	status = WSASendTo( dex_udp_parameters->socket, 
@@ -111,6 +134,16 @@ unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char data[DEX_U
 	
 }
 
+int DexUDPSendPackets( DexUDP *dex_udp_parameters, const char *data[], const int size[], int n )
+{
+	
+	int i;
+	
+	for ( i = 0; i < n; i++ ) DexUDPSendPacket( dex_udp_parameters, data[i], size[i] );
+	return( n );
+	
+}
+
 
 /************************************************************************/
 
@@ -124,6 +157,7 @@ int DexUDPInitClient( DexUDP *dex_udp_parameters, char *server_address ){
 	WORD wVersionRequired = MAKEWORD (2, 2);
 	WSADATA wd;
 	int iReturn;
+	u_long nonblocking = 1;
 	
 	
 	iReturn = WSAStartup (wVersionRequired, &wd);
@@ -140,6 +174,11 @@ int DexUDPInitClient( DexUDP *dex_udp_parameters, char *server_address ){
 		WSACleanup ();
 		return( -2 );
 	};
+	dex_udp_parameters->loss = 0.0;
+	dex_udp_parameters->log = NULL;
+	dex_udp_parameters->sender.sin_family = AF_INET;
+	dex_udp_parameters->sender.sin_port = 0;
+	dex_udp_parameters->sender.sin_addr.s_addr = 0;
 	
 	/* Set up UDP Socket */
 	dex_udp_parameters->sockaddr.sin_family = AF_INET;
@@ -156,6 +195,13 @@ int DexUDPInitClient( DexUDP *dex_udp_parameters, char *server_address ){
 		return( -3 );
 	}
 	
+	/* Reads return right away when there is nothing to read. */
+	if ( ioctlsocket( dex_udp_parameters->socket, FIONBIO, &nonblocking ) == SOCKET_ERROR ) {
+		MessageBox( NULL,  "ioctlsocket() failed.", "DexUDPServices", MB_OK );
+		closesocket( dex_udp_parameters->socket );
+		return( -4 );
+	}
+	
 	return( FALSE );
 	
 }
@@ -164,49 +210,213 @@ int DexUDPInitClient( DexUDP *dex_udp_parameters, char *server_address ){
 
 /************************************************************************/
 
-unsigned int DexUDPGetPacket( DexUDP *dex_udp_parameters, char data[DEX_UDP_PACKET_SIZE] )
+// Packets are no longer all the same size, so each one is returned in turn 
+// rather than keeping only the last one in the queue. 
+
+int DexUDPGetPackets( DexUDP *dex_udp_parameters, DexUDPPacket packet[], int max )
 {
 	
-	DWORD			    dwBytesRecv, available;
+	int		n, bytes_received, code;
+	int		sender_size;
 	
-	fd_set readfds;
-	fd_set writefds;
-	fd_set exceptfds;
-	struct timeval timeout = {0,0};
-	
-	// Make sure that we read all records in the queue.
-	int got_data = FALSE;
-	do  {
-		
-		FD_ZERO( &readfds );
-		FD_ZERO( &writefds );
-		FD_ZERO( &exceptfds );
-		FD_SET( dex_udp_parameters->socket, &readfds );
+	for ( n = 0; n < max; ) {
 		
-		available = select( 0, &readfds, &writefds, &exceptfds, &timeout );
+		sender_size = sizeof( dex_udp_parameters->sender );
+		bytes_received = recvfrom( dex_udp_parameters->socket, packet[n].data, DEX_UDP_PACKET_SIZE, 0,
+			(SOCKADDR*) &dex_udp_parameters->sender, &sender_size );	
+		if ( bytes_received > 0 ) {
+			if ( dex_udp_parameters->log ) DexUDPLogPacket( dex_udp_parameters, packet[n].data, bytes_received );
+			packet[n++].size = bytes_received;
+			continue;
+		}
+		if ( bytes_received == 0 ) continue;
 		
-		if ( available == SOCKET_ERROR ) {
-			int code = WSAGetLastError();
+		code = WSAGetLastError();
+		// Nothing more waiting.
+		if ( code == WSAEWOULDBLOCK ) break;
+		// A packet too big for the buffer is dropped, and Windows reports an
+		// answer that could not be delivered as an error on the next read.
+		if ( code == WSAEMSGSIZE || code == WSAECONNRESET ) continue;
+		// Hand over what we have. The error will come up again next time.
+		if ( n > 0 ) break;
+		{
 			char msg[1024];
-			sprintf( msg, "Error querying tracker socket.\nCode %d", code );
+			sprintf( msg, "Error reading tracker socket.\nCode %d", code );
 			MessageBox( NULL, msg, "Dex UDP Client", MB_OK );
-			return( DEX_UDP_ERROR );
-		}
-		else if ( available ) {
-			// Here is where we actually read the data packet.
-			dwBytesRecv = recv( dex_udp_parameters->socket, (char *) data, DEX_UDP_PACKET_SIZE, 0 );	
-			if ( dwBytesRecv != DEX_UDP_PACKET_SIZE ) { 
-				char msg[1024];
-				sprintf( msg, "Error reading tracker socket.\nBytes received: %d", dwBytesRecv );
-				MessageBox( NULL, msg, "Dex UDP Client", MB_OK );
-				return( DEX_UDP_ERROR );
-			}
-			else got_data = TRUE;
 		}
+		return( DEX_UDP_ERROR );
 		
-	} while( available );
+	}
+	return( n );
+	
+}
+
+int DexUDPWaitForPacket( DexUDP *dex_udp_parameters, int timeout )
+{
+	
+	int		available;
+	fd_set	readfds;
+	struct timeval wait;
+	
+	wait.tv_sec = timeout / 1000;
+	wait.tv_usec = ( timeout % 1000 ) * 1000;
+	FD_ZERO( &readfds );
+	FD_SET( dex_udp_parameters->socket, &readfds );
+	
+	available = select( 0, &readfds, NULL, NULL, &wait );
+	// Do not spin if something is wrong with the socket.
+	if ( available == SOCKET_ERROR ) {
+		Sleep( timeout );
+		return( 0 );
+	}
+	return( available > 0 );
+	
+}
+
+int DexUDPGetPacket( DexUDP *dex_udp_parameters, char data[DEX_UDP_PACKET_SIZE] )
+{
+	
+	DexUDPPacket	packet;
+	int				n;
+	
+	n = DexUDPGetPackets( dex_udp_parameters, &packet, 1 );
+	if ( n < 0 ) return( n );
+	if ( n == 0 ) return( DEX_UDP_NODATA );
+	memcpy( data, packet.data, packet.size );
+	return( packet.size );
+	
+}
+
+/************************************************************************/
+
+// Answer the host that sent the last packet.
+
+unsigned int DexUDPReply( DexUDP *dex_udp_parameters, const char *data, int size )
+{
+	
+	int status;
+	
+	if ( !dex_udp_parameters->sender.sin_port ) return( 0 );
+	if ( size < 0 ) return( 0 );
+	if ( size > (int) DEX_UDP_PACKET_SIZE ) size = DEX_UDP_PACKET_SIZE;
+	if ( DexUDPLosePacket( dex_udp_parameters ) ) return( size );
+	status = sendto( dex_udp_parameters->socket, data, size, 0, 
+		(SOCKADDR*) &dex_udp_parameters->sender, sizeof( dex_udp_parameters->sender ) );
+	if ( status == SOCKET_ERROR ) return( 0 );
+	return( status );
+	
+}
+
+// Read the answers that come back to the server. Errors are not reported:
+// the socket is only bound once something has been sent, and Windows reports
+// an error on it for each packet that was sent to a port where nobody listens.
+
+int DexUDPGetReply( DexUDP *dex_udp_parameters, char data[DEX_UDP_PACKET_SIZE] )
+{
+	
+	int		bytes_received, available;
+	fd_set	readfds;
+	struct timeval timeout = {0,0};
+	
+	FD_ZERO( &readfds );
+	FD_SET( dex_udp_parameters->socket, &readfds );
+	
+	available = select( 0, &readfds, NULL, NULL, &timeout );
+	if ( available == SOCKET_ERROR || !available ) return( DEX_UDP_NODATA );
+	
+	bytes_received = recv( dex_udp_parameters->socket, (char *) data, DEX_UDP_PACKET_SIZE, 0 );	
+	if ( bytes_received <= 0 ) return( DEX_UDP_NODATA );
+	return( bytes_received );
+	
+}
+
+
+/************************************************************************/
+
+// Record the packets that go through, to replay them later.
+
+int DexUDPOpenLog( DexUDP *dex_udp_parameters, const char *filename )
+{
+	
+	FILE	*fp;
+	
+	fp = fopen( filename, "ab" );
+	if ( !fp ) return( DEX_UDP_ERROR );
+	fseek( fp, 0, SEEK_END );
+	if ( ftell( fp ) == 0 ) fwrite( DEX_UDP_LOG_MAGIC, 1, strlen( DEX_UDP_LOG_MAGIC ), fp );
+	QueryPerformanceFrequency( &dex_udp_parameters->log_frequency );
+	QueryPerformanceCounter( &dex_udp_parameters->log_last );
+	dex_udp_parameters->log = fp;
+	return( 0 );
+	
+}
+
+void DexUDPCloseLog( DexUDP *dex_udp_parameters )
+{
+	
+	if ( dex_udp_parameters->log ) fclose( dex_udp_parameters->log );
+	dex_udp_parameters->log = NULL;
+	
+}
+
+static void DexUDPLogPacket( DexUDP *dex_udp_parameters, const char *data, int size )
+{
+	
+	LARGE_INTEGER	now;
+	__int64			microseconds;
+	unsigned long	delay;
+	unsigned char	header[6];
+	
+	QueryPerformanceCounter( &now );
+	microseconds = ( now.QuadPart - dex_udp_parameters->log_last.QuadPart ) * 1000000 / dex_udp_parameters->log_frequency.QuadPart;
+	dex_udp_parameters->log_last = now;
+	// A pause of more than an hour or so is kept short.
+	delay = ( microseconds > 0xffffffff ? 0xffffffff : (unsigned long) microseconds );
+	
+	header[0] = (unsigned char) ( delay & 0xff );
+	header[1] = (unsigned char) ( ( delay >> 8 ) & 0xff );
+	header[2] = (unsigned char) ( ( delay >> 16 ) & 0xff );
+	header[3] = (unsigned char) ( ( delay >> 24 ) & 0xff );
+	header[4] = (unsigned char) ( size & 0xff );
+	header[5] = (unsigned char) ( ( size >> 8 ) & 0xff );
+	fwrite( header, 1, sizeof( header ), dex_udp_parameters->log );
+	fwrite( data, 1, size, dex_udp_parameters->log );
+	
+}
+
+FILE *DexUDPOpenReplay( const char *filename )
+{
+	
+	FILE	*fp;
+	char	magic[sizeof( DEX_UDP_LOG_MAGIC )];
+	
+	fp = fopen( filename, "rb" );
+	if ( !fp ) return( NULL );
+	if ( fread( magic, 1, strlen( DEX_UDP_LOG_MAGIC ), fp ) != strlen( DEX_UDP_LOG_MAGIC ) 
+		|| memcmp( magic, DEX_UDP_LOG_MAGIC, strlen( DEX_UDP_LOG_MAGIC ) ) ) {
+		fclose( fp );
+		return( NULL );
+	}
+	return( fp );
+	
+}
+
+int DexUDPReadLog( FILE *fp, char packet[DEX_UDP_PACKET_SIZE], unsigned long *delay )
+{
+	
+	unsigned char	header[6];
+	size_t			bytes;
+	int				size;
+	
+	bytes = fread( header, 1, sizeof( header ), fp );
+	if ( bytes == 0 ) return( 0 );
+	if ( bytes != sizeof( header ) ) return( DEX_UDP_ERROR );
 	
-	if ( got_data ) return( FALSE );
-	else return( DEX_UDP_NODATA );
+	*delay = (unsigned long) header[0] | ( (unsigned long) header[1] << 8 ) 
+		| ( (unsigned long) header[2] << 16 ) | ( (unsigned long) header[3] << 24 );
+	size = header[4] | ( header[5] << 8 );
+	// A log written by a session that was cut short may end part way through a packet.
+	if ( size == 0 || size > (int) DEX_UDP_PACKET_SIZE || fread( packet, 1, size, fp ) != (size_t) size ) return( DEX_UDP_ERROR );
+	return( size );
 	
 }
@@ -23,6 +23,17 @@ typedef struct {
   struct sockaddr_in  sockaddr;
   SOCKET  socket;
 
+  // Where the last packet came from, so that the client can answer.
+  struct sockaddr_in  sender;
+
+  // Fraction of the packets sent that are thrown away instead, for testing.
+  double  loss;
+  unsigned long  loss_state;
+
+  // Log of the packets that go through, if one is open (see below).
+  FILE  *log;
+  LARGE_INTEGER  log_frequency;
+  LARGE_INTEGER  log_last;
   
 } DexUDP; 
 
@@ -46,13 +57,28 @@ extern "C" {
 // If I send out UDP packets too quickly, one after the other, they get missed.
 // I don't know if one gets overwritten by the next on the send side (i.e. the send doesn't block)
 //  of if it is that on the receive side it can't keep up.
-// After each UDP packet sent I sleep this many milliseconds to work around this problem.
-#define DEX_UDP_WAIT						100
+// DexMonitorServerUDP used to sleep after each packet to work around this problem. 
+// It now hands the packets to a background thread that sends no more than DEX_UDP_RATE 
+// bytes per second on average, in bursts of at most DEX_UDP_BURST bytes.
+#define DEX_UDP_RATE						65536
+#define DEX_UDP_BURST						(4 * DEX_UDP_PACKET_SIZE)
+
+// Most packets that are sent or read in one go (see below).
+#define DEX_UDP_BATCH						32
+
+// Packets read in a batch. The extra byte leaves room to terminate a text packet.
+typedef struct {
+	int		size;
+	char	data[DEX_UDP_PACKET_SIZE + 1];
+} DexUDPPacket;
 
 int DexUDPInitClient( DexUDP *dex_udp_parameters, char *broadcast_address );
 
-/* Read data server and device. */
-unsigned int DexUDPGetPacket( DexUDP *dex_udp_parameters, char *packet );
+/* 
+ * Read one packet, if there is one. Returns the number of bytes received, 
+ * DEX_UDP_NODATA or DEX_UDP_ERROR. The packet buffer must hold DEX_UDP_PACKET_SIZE bytes.
+ */
+int DexUDPGetPacket( DexUDP *dex_udp_parameters, char *packet );
 
 /*
  * Server analog of client services above. However, the 
@@ -62,7 +88,54 @@ unsigned int DexUDPGetPacket( DexUDP *dex_udp_parameters, char *packet );
  */
 
 int DexUDPInitServer( DexUDP *dex_udp_parameters, char *broadcast_address );
-unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char *packet );
+/* Packets can be anything up to DEX_UDP_PACKET_SIZE bytes. */
+unsigned int DexUDPSendPacket( DexUDP *dex_udp_parameters, const char *packet, int size );
+
+/*
+ * A short way back, for acknowledgements and the like. The client answers
+ * whoever sent the last packet that it received. The server reads the answers
+ * on the socket that it sends from. DexUDPGetReply() does not complain if 
+ * nothing is listening at the other end; it just returns DEX_UDP_NODATA.
+ */
+unsigned int DexUDPReply( DexUDP *dex_udp_parameters, const char *packet, int size );
+int DexUDPGetReply( DexUDP *dex_udp_parameters, char *packet );
+
+/*
+ * Several packets at a time. DexUDPGetPackets() reads whatever is waiting, 
+ * up to max packets, and returns how many it read or DEX_UDP_ERROR. The 
+ * client socket does not block, so that there is no need to ask with select() 
+ * before each read. DexUDPSendPackets() returns the number of packets sent.
+ * Winsock has nothing like the sendmmsg() and recvmmsg() of Linux, so each 
+ * packet still takes a call of its own, but the callers take their locks 
+ * and do their bookkeeping once per batch.
+ */
+int DexUDPGetPackets( DexUDP *dex_udp_parameters, DexUDPPacket packet[], int max );
+/* Wait up to timeout ms for a packet. Returns 1 if there is one to read, 0 if not. */
+int DexUDPWaitForPacket( DexUDP *dex_udp_parameters, int timeout );
+int DexUDPSendPackets( DexUDP *dex_udp_parameters, const char *packet[], const int size[], int n );
+
+/* Throw away the given fraction of the packets sent from here on, to test over loopback. */
+void DexUDPSetLoss( DexUDP *dex_udp_parameters, double fraction, unsigned long seed );
+
+/*
+ * A log of the packets sent by a server or received by a client, so that a 
+ * session can be replayed into a monitor (see DexTelemetryReplay.c). The 
+ * server logs each packet before the simulated loss, i.e. what it meant to send.
+ * The file starts with DEX_UDP_LOG_MAGIC. Then, for each packet, come the 
+ * microseconds since the one before (4 bytes), its size (2 bytes), both least 
+ * significant byte first, and the packet itself. The times come from the 
+ * performance counter, so they never go backwards. 
+ * DexUDPOpenLog() appends to the file if it is already there and returns 0, 
+ * or DEX_UDP_ERROR. Packets are logged from the thread that sends or receives. 
+ * DexUDPReadLog() returns the size of the next packet and the delay before it,
+ * 0 at the end of the log or DEX_UDP_ERROR if the log is damaged.
+ */
+#define DEX_UDP_LOG_MAGIC	"DEXUDPLOG1\n"
+
+int  DexUDPOpenLog( DexUDP *dex_udp_parameters, const char *filename );
+void DexUDPCloseLog( DexUDP *dex_udp_parameters );
+FILE *DexUDPOpenReplay( const char *filename );
+int  DexUDPReadLog( FILE *fp, char packet[DEX_UDP_PACKET_SIZE], unsigned long *delay );
 
 #ifdef __cplusplus
 }
@@ -193,6 +193,13 @@ typedef struct {
 	bool		visibility;
 	double		time;
 
+	// How well the markers fit the rigid body model (largest marker residual),
+	// which manipulandum markers had to be left out to get a good fit (one bit 
+	// per marker) and whether two markers appeared to have been exchanged.
+	float			residual;
+	unsigned long	rejectedMarkers;
+	bool			swappedMarkers;
+
 } ManipulandumState;
 
 typedef struct {
@@ -248,6 +255,16 @@ extern Vector3	ManipulandumBody[MANIPULANDUM_MARKERS];
 extern int		nManipulandumMarkers;
 extern int		ManipulandumMarkerID[MANIPULANDUM_MARKERS];
 
+// Real-time reads of the manipulandum refine the previous pose rather than 
+// solving from scratch. These set how many Gauss-Newton steps are taken and the
+// RMS marker residual (mm) beyond which we give up and do the full solution.
+#define POSE_TRACKER_ITERATIONS		2
+#define POSE_TRACKER_MAX_RESIDUAL	2.0
+
+// Largest distance (mm) between a marker and where the model says it should be
+// before the recorded pose is recomputed without it.
+#define ROBUST_POSE_MAX_RESIDUAL	3.0
+
 #define			WRIST_MARKERS 8
 extern Vector3	WristBody[WRIST_MARKERS];
 extern int		nWristMarkers;
@@ -302,6 +319,15 @@ extern TargetArrayConfiguration targetArrayConfiguration[MAX_TARGET_CONFIGURATIO
 // The script interpreter will execute this file, if no other is specified.
 #define DEFAULT_SCRIPT_FILENAME	"DexSampleScript.dex"
 
+// Each new placement of the CODA units is appended to this file, so that
+// the drift from one session to the next can be reported.
+#define DEFAULT_PLACEMENT_HISTORY_FILENAME	"DexPlacementHistory.txt"
+#define DEX_PLACEMENT_HISTORY	64
+
 // Minimum normal force to compute a center of pressure.
 #define DEFAULT_COP_THRESHOLD	0.25	
 
+// Multiple of the standard error that gives the 95% confidence 
+// interval on the mean of a strain gauge offset.
+#define OFFSET_CONFIDENCE_FACTOR	1.96
+
@@ -0,0 +1,333 @@
+// TestDexPictures.cpp
+
+// Check the .bmp decoder of DexPictures.c on pictures of each depth that it
+// handles, written here bottom-up and top-down, and that damaged files or
+// absurd sizes in the header are refused rather than read out of bounds.
+// Then check the cache: least recently used pictures go first when it is
+// full, pinned pictures stay whatever happens, and the bitmaps attached to
+// the entries are released when they go. No Windows calls are needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DexPictures.h"
+
+#define TEST_FILEROOT	"TestDexPictures"
+
+// Odd sizes, so that the rows need padding.
+#define TEST_WIDTH		13
+#define TEST_HEIGHT		7
+
+// Room for this many pictures of TEST_WIDTH x TEST_HEIGHT in the cache.
+#define TEST_CACHED		3
+#define TEST_PICTURES	6
+
+static void put_long( unsigned char *ptr, unsigned long value ) {
+	ptr[0] = (unsigned char) ( value & 0xff );
+	ptr[1] = (unsigned char) ( ( value >> 8 ) & 0xff );
+	ptr[2] = (unsigned char) ( ( value >> 16 ) & 0xff );
+	ptr[3] = (unsigned char) ( ( value >> 24 ) & 0xff );
+}
+
+static void put_short( unsigned char *ptr, unsigned short value ) {
+	ptr[0] = (unsigned char) ( value & 0xff );
+	ptr[1] = (unsigned char) ( ( value >> 8 ) & 0xff );
+}
+
+// The colors of the palette, and the pixels that each depth can hold exactly.
+static unsigned long PaletteColor( int i ) {
+	return( ( ( i * 37 ) & 0xff ) << 16 | ( ( i * 91 + 7 ) & 0xff ) << 8 | ( ( 255 - i ) & 0xff ) );
+}
+
+static int PaletteIndex( int x, int y, int bits ) {
+	return( ( x * 3 + y * 5 ) % ( 1 << bits ) );
+}
+
+static unsigned long Expected( int x, int y, int bits, int seed ) {
+	int r, g, b;
+	if ( bits <= 8 ) return( PaletteColor( PaletteIndex( x, y, bits ) ) );
+	r = ( x * 19 + seed ) & 0x1f;
+	g = ( y * 11 + seed ) & 0x1f;
+	b = ( x + y ) & 0x1f;
+	if ( bits == 16 ) return( ( r * 255 / 31 ) << 16 | ( g * 255 / 31 ) << 8 | ( b * 255 / 31 ) );
+	return( ( ( r << 3 ) | 5 ) << 16 | ( ( g << 3 ) | 2 ) << 8 | ( b << 3 ) );
+}
+
+// Write a picture of the given depth, and return the size of the file, or 0.
+static long WriteBMP( const char *filename, int bits, int top_down, int seed ) {
+
+	FILE			*fp;
+	unsigned char	*data;
+	int				colors = ( bits <= 8 ? 1 << bits : 0 );
+	int				stride = ( ( TEST_WIDTH * bits + 31 ) / 32 ) * 4;
+	unsigned long	offset = 14 + 40 + 4 * colors;
+	long			size = offset + stride * TEST_HEIGHT;
+	unsigned char	*row;
+	unsigned long	pixel;
+	int				x, y, i, index, r, g, b;
+
+	data = (unsigned char *) calloc( size, 1 );
+	data[0] = 'B';
+	data[1] = 'M';
+	put_long( data + 2, size );
+	put_long( data + 10, offset );
+	put_long( data + 14, 40 );
+	put_long( data + 18, TEST_WIDTH );
+	put_long( data + 22, top_down ? (unsigned long) -TEST_HEIGHT : TEST_HEIGHT );
+	put_short( data + 26, 1 );
+	put_short( data + 28, (unsigned short) bits );
+	put_long( data + 30, 0 );
+	put_long( data + 46, colors );
+	for ( i = 0; i < colors; i++ ) put_long( data + 54 + 4 * i, PaletteColor( i ) );
+
+	for ( y = 0; y < TEST_HEIGHT; y++ ) {
+		row = data + offset + stride * ( top_down ? TEST_HEIGHT - 1 - y : y );
+		for ( x = 0; x < TEST_WIDTH; x++ ) {
+			index = PaletteIndex( x, y, bits <= 8 ? bits : 1 );
+			pixel = Expected( x, y, bits, seed );
+			switch ( bits ) {
+			case 1:
+				row[x >> 3] |= index << ( 7 - ( x & 7 ) );
+				break;
+			case 4:
+				row[x >> 1] |= index << ( ( x & 1 ) ? 0 : 4 );
+				break;
+			case 8:
+				row[x] = (unsigned char) index;
+				break;
+			case 16:
+				r = ( x * 19 + seed ) & 0x1f;
+				g = ( y * 11 + seed ) & 0x1f;
+				b = ( x + y ) & 0x1f;
+				put_short( row + 2 * x, (unsigned short) ( r << 10 | g << 5 | b ) );
+				break;
+			case 24:
+				row[3 * x] = (unsigned char) ( pixel & 0xff );
+				row[3 * x + 1] = (unsigned char) ( ( pixel >> 8 ) & 0xff );
+				row[3 * x + 2] = (unsigned char) ( ( pixel >> 16 ) & 0xff );
+				break;
+			case 32:
+				// The unused byte must be ignored.
+				put_long( row + 4 * x, pixel | 0xab000000 );
+				break;
+			}
+		}
+	}
+
+	fp = fopen( filename, "wb" );
+	if ( !fp ) {
+		free( data );
+		return( 0 );
+	}
+	fwrite( data, 1, size, fp );
+	fclose( fp );
+	free( data );
+	return( size );
+
+}
+
+// Change 4 bytes of a file, or cut it short.
+static void Damage( const char *filename, long size, long at, unsigned long value, long keep ) {
+	FILE			*fp;
+	unsigned char	*data = (unsigned char *) malloc( size );
+	fp = fopen( filename, "rb" );
+	fread( data, 1, size, fp );
+	fclose( fp );
+	if ( at >= 0 ) put_long( data + at, value );
+	fp = fopen( filename, "wb" );
+	fwrite( data, 1, keep, fp );
+	fclose( fp );
+	free( data );
+}
+
+int Decode( void ) {
+
+	static const int depth[] = { 1, 4, 8, 16, 24, 32 };
+	DexPicture	picture;
+	char		filename[256];
+	int			d, top_down, x, y, wrong, errors = 0;
+	long		size;
+
+	sprintf( filename, "%s.bmp", TEST_FILEROOT );
+	for ( d = 0; d < (int) ( sizeof( depth ) / sizeof( depth[0] ) ); d++ ) {
+		for ( top_down = 0; top_down <= 1; top_down++ ) {
+			WriteBMP( filename, depth[d], top_down, d );
+			wrong = 0;
+			if ( DexReadPicture( &picture, filename ) || picture.width != TEST_WIDTH || picture.height != TEST_HEIGHT ) wrong = -1;
+			else {
+				for ( y = 0; y < TEST_HEIGHT; y++ ) {
+					for ( x = 0; x < TEST_WIDTH; x++ ) {
+						if ( picture.pixels[y * TEST_WIDTH + x] != Expected( x, y, depth[d], d ) ) wrong++;
+					}
+				}
+			}
+			printf( "%2d bits, %s: %s.\n", depth[d], ( top_down ? "top-down " : "bottom-up" ),
+				( wrong < 0 ? "not read" : ( wrong ? "wrong pixels" : "read back" ) ) );
+			if ( wrong ) errors++;
+			DexFreePicture( &picture );
+		}
+	}
+
+	// Damaged files. None of these may be read, nor read beyond the file.
+	static const struct { const char *what; long at; unsigned long value; long cut; } damage[] = {
+		{ "Cut short",				-1,	0,				1 },
+		{ "Not a BMP",				0,	0x00004142,		0 },
+		{ "Pixels past the end",	10,	0x00001000,		0 },
+		{ "Pixels before the file",	10,	0xfffffff0,		0 },
+		{ "Width that overflows",	18,	0x20000001,		0 },
+		{ "Height that overflows",	22,	0x7fffffff,		0 },
+		{ "Widest possible",		18,	0x7fffffff,		0 },
+		{ "Tallest upside down",	22,	0x80000001,		0 },
+		{ "Run-length encoded",		30,	1,				0 },
+		{ "Depth of 2 bits",		28,	0x00000002,		0 },
+	};
+	for ( d = 0; d < (int) ( sizeof( damage ) / sizeof( damage[0] ) ); d++ ) {
+		size = WriteBMP( filename, 24, 0, 0 );
+		Damage( filename, size, damage[d].at, damage[d].value, size - damage[d].cut );
+		wrong = ( DexReadPicture( &picture, filename ) == 0 );
+		printf( "%-24s %s.\n", damage[d].what, ( wrong ? "read anyway" : "refused" ) );
+		if ( wrong ) errors++;
+		DexFreePicture( &picture );
+	}
+	remove( filename );
+
+	// Scaling a picture of one color gives the same color.
+	DexPicture	plain, scaled;
+	plain.width = TEST_WIDTH;
+	plain.height = TEST_HEIGHT;
+	plain.pixels = (unsigned long *) malloc( TEST_WIDTH * TEST_HEIGHT * sizeof( unsigned long ) );
+	for ( x = 0; x < TEST_WIDTH * TEST_HEIGHT; x++ ) plain.pixels[x] = 0x00c08040;
+	wrong = 0;
+	if ( DexScalePicture( &scaled, &plain, 3 * TEST_WIDTH + 1, TEST_HEIGHT / 2 ) ) wrong++;
+	else for ( x = 0; x < scaled.width * scaled.height; x++ ) if ( scaled.pixels[x] != 0x00c08040 ) wrong++;
+	printf( "Scaling a plain picture from %dx%d to %dx%d: %d pixels changed.\n", TEST_WIDTH, TEST_HEIGHT, scaled.width, scaled.height, wrong );
+	if ( wrong ) errors++;
+	DexFreePicture( &plain );
+	DexFreePicture( &scaled );
+
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+static int released[TEST_PICTURES];
+
+static void Release( void *handle ) {
+	released[(int *) handle - released]++;
+}
+
+static const char *PictureName( int i ) {
+	static char name[TEST_PICTURES][64];
+	sprintf( name[i], "%s%c.bmp", TEST_FILEROOT, 'A' + i );
+	return( name[i] );
+}
+
+// Get a picture from the cache and attach a bitmap to it, as the GUI does.
+static DexPictureCacheEntry *Show( int i ) {
+	DexPictureCacheEntry *entry = DexGetCachedPicture( PictureName( i ) );
+	if ( entry && !entry->handle ) entry->handle = &released[i];
+	return( entry );
+}
+
+
+int Cache( void ) {
+
+	DexPictureCacheEntry	*shown, *entry;
+	DexPictureCacheStats	stats;
+	char		filename[256];
+	FILE		*fp;
+	int			i, errors = 0;
+	unsigned long	bytes = TEST_WIDTH * TEST_HEIGHT * sizeof( unsigned long );
+
+	for ( i = 0; i < TEST_PICTURES; i++ ) WriteBMP( PictureName( i ), 24, i % 2, i );
+	memset( released, 0, sizeof( released ) );
+
+	// Keep the pictures at their own size, with room for TEST_CACHED of them.
+	DexPictureCacheInit( "", 0, 0, TEST_CACHED * bytes, Release );
+
+	// A is on the screen. B, C, D and E come and go, each one shown in turn in a popup.
+	shown = Show( 0 );
+	DexPinCachedPicture( shown );
+	for ( i = 1; i < TEST_PICTURES - 1; i++ ) {
+		entry = Show( i );
+		if ( !entry ) errors++;
+		// What is on the screen is still there, with its bitmap.
+		if ( strcmp( shown->name, PictureName( 0 ) ) || shown->handle != &released[0] || released[0] ) errors++;
+	}
+	DexGetPictureCacheStats( &stats );
+	printf( "\nA pinned, then B to E: %lu pictures (%lu bytes), %lu evictions. Bitmaps released: %d %d %d %d %d %d.\n",
+		stats.entries, stats.bytes, stats.evictions, released[0], released[1], released[2], released[3], released[4], released[5] );
+	// B and C went, in that order, and only once.
+	if ( stats.entries != TEST_CACHED || stats.bytes > TEST_CACHED * bytes || stats.evictions != 2 ) errors++;
+	if ( released[0] || released[1] != 1 || released[2] != 1 || released[3] || released[4] ) errors++;
+
+	// Looking at A again is a hit, and so is D.
+	if ( Show( 0 ) != shown || !Show( 3 ) ) errors++;
+	DexGetPictureCacheStats( &stats );
+	if ( stats.hits != 2 || stats.misses != TEST_PICTURES - 1 ) errors++;
+
+	// Once A is no longer shown, it can go like any other. E is now the oldest, then A.
+	DexUnpinCachedPicture( shown );
+	Show( 5 );
+	Show( 1 );
+	DexGetPictureCacheStats( &stats );
+	printf( "A unpinned, then F and B: %lu pictures, %lu evictions. Bitmaps released: %d %d %d %d %d %d.\n",
+		stats.entries, stats.evictions, released[0], released[1], released[2], released[3], released[4], released[5] );
+	if ( released[4] != 1 || released[0] != 1 || released[3] || released[5] ) errors++;
+
+	// With everything pinned, a new picture is cached all the same, over the limit,
+	// since it is about to be shown. Nothing that is pinned goes.
+	DexPinCachedPicture( Show( 3 ) );
+	DexPinCachedPicture( Show( 5 ) );
+	DexPinCachedPicture( Show( 1 ) );
+	entry = Show( 2 );
+	DexGetPictureCacheStats( &stats );
+	printf( "All pinned, then C: %s, %lu pictures, %lu evictions.\n", ( entry ? "cached" : "not cached" ), stats.entries, stats.evictions );
+	if ( !entry || stats.entries != TEST_CACHED + 1 || stats.evictions != 4 ) errors++;
+	if ( released[3] || released[5] || released[1] != 1 ) errors++;
+
+	// A missing picture is a failure, not an entry.
+	if ( DexGetCachedPicture( "TestDexPicturesMissing.bmp" ) ) errors++;
+
+	// Preloading a script that calls another finds the pictures in both,
+	// but not those in lines that are commented out.
+	DexPictureCacheInit( "", 0, 0, TEST_PICTURES * bytes, NULL );
+	sprintf( filename, "%sTask.dex", TEST_FILEROOT );
+	fp = fopen( filename, "w" );
+	fprintf( fp, "CMD_WAIT_SUBJ_READY,%s,Hold the manipulandum.\n", PictureName( 1 ) );
+	fprintf( fp, "#CMD_WAIT_SUBJ_READY,%s,Not now.\n", PictureName( 2 ) );
+	fprintf( fp, "CMD_ALERT, %s , Ready.\n", PictureName( 3 ) );
+	fclose( fp );
+	sprintf( filename, "%sSession.dex", TEST_FILEROOT );
+	fp = fopen( filename, "w" );
+	fprintf( fp, "0,Start,%s\n", PictureName( 0 ) );
+	fprintf( fp, "0,Task,%sTask.dex\n", TEST_FILEROOT );
+	fclose( fp );
+	i = DexPreloadScriptPictures( filename );
+	DexGetPictureCacheStats( &stats );
+	printf( "Preloading a session and its task: %d pictures, %lu misses.\n", i, stats.misses );
+	if ( i != 3 || stats.misses != 3 ) errors++;
+	remove( filename );
+	sprintf( filename, "%sTask.dex", TEST_FILEROOT );
+	remove( filename );
+
+	DexFlushPictureCache();
+	for ( i = 0; i < TEST_PICTURES; i++ ) remove( PictureName( i ) );
+	printf( "%d errors.\n", errors );
+	return( errors );
+
+}
+
+int main( void ) {
+
+	int failures = 0;
+
+	failures += Decode();
+	failures += Cache();
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
@@ -0,0 +1,222 @@
+// TestDexPoseTracker.cpp
+
+// Check DexApparatus::TrackManipulandumPosition() against the full solution of
+// ComputeManipulandumPosition() along a synthetic trajectory, with markers
+// dropping out and coming back and with the manipulandum turned over from one
+// frame to the next. The tracker must give the same pose, must fall back on the
+// full solution whenever the visible markers change or the pose jumps, and
+// only then. Last, the cost of each per frame, with the model tabulated for
+// each subset of markers, as it is for the manipulandum, and without.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include "Dexterous.h"
+#include "DexMonitorServer.h"
+#include "DexTracker.h"
+#include "DexADC.h"
+#include "DexApparatus.h"
+
+// 10 s at the tracker sample rate.
+#define TEST_FRAMES		2000
+
+// A marker drops out for a while every so often, each in turn.
+#define DROPOUT_PERIOD	200
+#define DROPOUT_LENGTH	20
+
+// The manipulandum is turned over for a while, so that the previous pose is no help.
+#define FLIP_START		1510
+#define FLIP_LENGTH		50
+
+// Noise on each coordinate (mm).
+#define NOISE			0.05
+
+// The full solution is not quite the least squares fit, so with the noise
+// the two can differ by a few tenths of a degree. Both have to stay that
+// close to the true pose.
+#define POSITION_TOLERANCE	0.1		// mm
+#define ANGLE_TOLERANCE		0.5		// degrees
+
+// Passes over the trajectory for the timing.
+#define TIMING_REPEATS	50
+
+CodaFrame	frames[TEST_FRAMES];
+bool		changed[TEST_FRAMES];
+Quaternion	truth[TEST_FRAMES];
+
+// The statistics of the tracker are only for the apparatus and its kin.
+class TrackedApparatus : public DexApparatus {
+public:
+	TrackedApparatus( void ) { monitor = NULL; }
+	int FullSolves( void ) { return( poseTrackerFullSolves ); }
+	int Reads( void ) { return( poseTrackerReads ); }
+	double Time( void ) { return( poseTrackerTime ); }
+	// As if the manipulandum had too many markers to tabulate.
+	void Untabulate( void ) { manipulandumModel.nMarkers = 0; }
+};
+
+// Whether the marker is seen in the frame.
+bool Visible( int frm, int mrk ) {
+	return( !( frm % DROPOUT_PERIOD >= DROPOUT_PERIOD / 2 && frm % DROPOUT_PERIOD < DROPOUT_PERIOD / 2 + DROPOUT_LENGTH
+				&& ( frm / DROPOUT_PERIOD ) % nManipulandumMarkers == mrk ) );
+}
+
+bool Flipped( int frm ) {
+	return( frm >= FLIP_START && frm < FLIP_START + FLIP_LENGTH );
+}
+
+// Up and down along Y, tilting back and forth and turning a little around Z.
+void MakeTrajectory( VectorsMixin &vm ) {
+
+	Vector3		pos, rotated, axis = { 0.3, 0.2, 1.0 }, flip_axis = { 0.0, 0.0, 1.0 };
+	Quaternion	ori, tilt, turn, flip, body;
+	double		t;
+	int			frm, mrk, id, i;
+	unsigned long visibility, previous = 0;
+
+	vm.NormalizeVector( axis );
+	vm.SetQuaterniond( flip, 180.0, flip_axis );
+	srand( 1 );
+
+	for ( frm = 0; frm < TEST_FRAMES; frm++ ) {
+
+		t = frm * MARKER_SAMPLE_PERIOD;
+		frames[frm].time = (float) t;
+		pos[X] = 10.0 * sin( 2.0 * vm.pi * 0.2 * t );
+		pos[Y] = 200.0 + 100.0 * sin( 2.0 * vm.pi * 0.5 * t );
+		pos[Z] = 300.0;
+		vm.SetQuaterniond( tilt, 30.0 * sin( 2.0 * vm.pi * 0.3 * t ), vm.iVector );
+		vm.SetQuaterniond( turn, 20.0 * sin( 2.0 * vm.pi * 0.7 * t ), axis );
+		vm.MultiplyQuaternions( ori, turn, tilt );
+		if ( Flipped( frm ) ) {
+			vm.MultiplyQuaternions( body, ori, flip );
+			vm.CopyQuaternion( ori, body );
+		}
+		vm.CopyQuaternion( truth[frm], ori );
+
+		for ( mrk = 0; mrk < N_MARKERS; mrk++ ) frames[frm].marker[mrk].visibility = false;
+		visibility = 0;
+		for ( mrk = 0; mrk < nManipulandumMarkers; mrk++ ) {
+			id = ManipulandumMarkerID[mrk];
+			vm.RotateVector( rotated, ori, ManipulandumBody[mrk] );
+			vm.AddVectors( frames[frm].marker[id].position, pos, rotated );
+			for ( i = 0; i < 3; i++ ) frames[frm].marker[id].position[i] += (float) ( NOISE * ( 2.0 * rand() / RAND_MAX - 1.0 ) );
+			frames[frm].marker[id].visibility = Visible( frm, mrk );
+			if ( frames[frm].marker[id].visibility ) visibility |= ( 1UL << mrk );
+		}
+
+		// Where the tracker has to start over.
+		changed[frm] = ( frm == 0 || visibility != previous || Flipped( frm ) != Flipped( frm - 1 ) );
+		previous = visibility;
+
+	}
+
+}
+
+// Angle between two orientations, whatever the sign of the quaternions.
+double Difference( Quaternion a, Quaternion b ) {
+	double dot = fabs( a[X] * b[X] + a[Y] * b[Y] + a[Z] * b[Z] + a[M] * b[M] );
+	if ( dot > 1.0 ) dot = 1.0;
+	return( 2.0 * acos( dot ) * 180.0 / VectorsMixin::pi );
+}
+
+// Time per frame (us) of the tracker along the trajectory, and of the full solution.
+void Cost( TrackedApparatus *apparatus, double &track_us, double &full_us ) {
+
+	Vector3		pos;
+	Quaternion	ori;
+	clock_t		start;
+	int			frm, k;
+
+	start = clock();
+	for ( k = 0; k < TIMING_REPEATS; k++ ) {
+		apparatus->ResetPoseTracker();
+		for ( frm = 0; frm < TEST_FRAMES; frm++ ) apparatus->TrackManipulandumPosition( pos, ori, frames[frm] );
+	}
+	track_us = 1e6 * (double) ( clock() - start ) / CLOCKS_PER_SEC / TIMING_REPEATS / TEST_FRAMES;
+
+	start = clock();
+	for ( k = 0; k < TIMING_REPEATS; k++ ) {
+		for ( frm = 0; frm < TEST_FRAMES; frm++ ) apparatus->ComputeManipulandumPosition( pos, ori, frames[frm] );
+	}
+	full_us = 1e6 * (double) ( clock() - start ) / CLOCKS_PER_SEC / TIMING_REPEATS / TEST_FRAMES;
+
+}
+
+int main( void ) {
+
+	TrackedApparatus	*apparatus = new TrackedApparatus();
+	Vector3				tracked_pos, full_pos, delta;
+	Quaternion			tracked_ori, full_ori, previous_ori;
+	double				position_error = 0.0, angle_error = 0.0, tracked_truth = 0.0, full_truth = 0.0, dot;
+	double				track_us, full_us, own_us;
+	bool				tracked_visible, full_visible;
+	int					frm, k, solves, expected = 0, late = 0, needless = 0, mismatches = 0, sign_changes = 0;
+	int					failures = 0;
+
+	MakeTrajectory( *apparatus );
+
+	apparatus->ResetPoseTracker();
+	for ( frm = 0; frm < TEST_FRAMES; frm++ ) {
+
+		solves = apparatus->FullSolves();
+		tracked_visible = apparatus->TrackManipulandumPosition( tracked_pos, tracked_ori, frames[frm] );
+		full_visible = apparatus->ComputeManipulandumPosition( full_pos, full_ori, frames[frm] );
+
+		if ( changed[frm] ) expected++;
+		if ( changed[frm] && apparatus->FullSolves() == solves ) late++;
+		if ( !changed[frm] && apparatus->FullSolves() != solves ) needless++;
+
+		if ( tracked_visible != full_visible ) mismatches++;
+		apparatus->SubtractVectors( delta, tracked_pos, full_pos );
+		if ( apparatus->VectorNorm( delta ) > position_error ) position_error = apparatus->VectorNorm( delta );
+		if ( Difference( tracked_ori, full_ori ) > angle_error ) angle_error = Difference( tracked_ori, full_ori );
+		if ( Difference( tracked_ori, truth[frm] ) > tracked_truth ) tracked_truth = Difference( tracked_ori, truth[frm] );
+		if ( Difference( full_ori, truth[frm] ) > full_truth ) full_truth = Difference( full_ori, truth[frm] );
+
+		// The orientation must not change sign when the tracker starts over,
+		// except where the manipulandum is turned over and either sign will do.
+		if ( frm > 0 && Flipped( frm ) == Flipped( frm - 1 ) ) {
+			for ( k = 0, dot = 0.0; k < 4; k++ ) dot += tracked_ori[k] * previous_ori[k];
+			if ( dot < 0.0 ) sign_changes++;
+		}
+		apparatus->CopyQuaternion( previous_ori, tracked_ori );
+
+	}
+
+	printf( "%d frames, %d changes of the visible markers or jumps of the pose.\n", TEST_FRAMES, expected );
+	printf( "%d full solutions (%d expected): %d changes missed, %d needless.\n",
+		apparatus->FullSolves(), expected, late, needless );
+	printf( "Tracked against full solution: %.6f mm, %.6f degrees, %d visibility mismatches, %d changes of sign.\n",
+		position_error, angle_error, mismatches, sign_changes );
+	printf( "Largest error in orientation: %.6f degrees tracked, %.6f degrees for the full solution.\n",
+		tracked_truth, full_truth );
+
+	if ( late || needless || apparatus->FullSolves() != expected ) failures++;
+	if ( mismatches || sign_changes || position_error > POSITION_TOLERANCE || angle_error > ANGLE_TOLERANCE ) failures++;
+	if ( tracked_truth > ANGLE_TOLERANCE || full_truth > ANGLE_TOLERANCE ) failures++;
+
+	// What each costs per frame, on the same frames. The count kept by the
+	// tracker itself includes reading the clock twice per frame.
+	printf( "\n" );
+	Cost( apparatus, track_us, full_us );
+	own_us = 1e6 * apparatus->Time() / apparatus->Reads();
+	printf( "Tabulated model:   %.3f us per frame tracked (%.3f us by its own count), %.3f us for the full solution.\n",
+		track_us, own_us, full_us );
+	apparatus->Untabulate();
+	Cost( apparatus, track_us, full_us );
+	own_us = 1e6 * apparatus->Time() / apparatus->Reads();
+	printf( "Untabulated model: %.3f us per frame tracked (%.3f us by its own count), %.3f us for the full solution.\n",
+		track_us, own_us, full_us );
+
+	delete apparatus;
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
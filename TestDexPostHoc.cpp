@@ -0,0 +1,275 @@
+// TestDexPostHoc.cpp
+
+// Check that DexPostHocBatch comes to the same verdicts as the Check* routines
+// that are run on board. A trial is written in the files of SaveAcquisition()
+// and reloaded in a DexPostHocAnalyzer. For each test, every point of a sweep
+// of its thresholds is then judged by DexPostHocAnalyzer::EvaluateSweep(), as
+// in the batch tool, and by the Check* routine itself, as on board.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include "Dexterous.h"
+#include "DexMonitorServer.h"
+#include "DexTracker.h"
+#include "DexADC.h"
+#include "DexApparatus.h"
+
+#define TEST_FILEROOT	"TestDexPostHoc"
+
+// 10 s of oscillations along Y, of 40 mm at 0.5 Hz.
+#define TEST_DURATION	10.0
+#define TEST_AMPLITUDE	40.0
+#define TEST_FREQUENCY	0.5
+
+// The target that the start positions are checked against.
+#define TEST_TARGET		0
+
+// Where the manipulandum disappears, and for how many frames.
+#define N_DROPOUTS		3
+int dropoutStart[N_DROPOUTS] = { 150, 800, 1500 };
+int dropoutLength[N_DROPOUTS] = { 5, 10, 20 };
+
+/*********************************************************************************/
+
+// The Check* routines signal an error to the subject and report to ground.
+// Here we just take note of the verdict and carry on.
+
+class QuietMonitor : public DexMonitorServer {
+public:
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY ) {}
+};
+
+class TestAnalyzer : public DexPostHocAnalyzer {
+public:
+	int errors;
+	TestAnalyzer( void ) { errors = 0; }
+	int fSignalError( unsigned int mb_type, const char *picture, const char *format, ... ) {
+		errors++;
+		return( IDIGNORE );
+	}
+};
+
+/*********************************************************************************/
+
+// Write a trial as SaveAcquisition() would.
+
+bool WriteTrial( void ) {
+
+	static AnalogSample samples[(int) ( TEST_DURATION / ANALOG_SAMPLE_PERIOD )];
+	int n_frames = (int) ( TEST_DURATION / MARKER_SAMPLE_PERIOD );
+	int n_samples = (int) ( TEST_DURATION / ANALOG_SAMPLE_PERIOD );
+	int frm, smpl, chan, drp, visible, movement, evt;
+	double t, y, burst;
+	char filename[256];
+	FILE *fp;
+
+	sprintf( filename, "%s.mnp", TEST_FILEROOT );
+	fp = fopen( filename, "w" );
+	if ( !fp ) return( false );
+	fprintf( fp, "Sample\tTime\tVisible\tPx\tPy\tPz\tQx\tQy\tQz\tQm\tResidual\tRejected\tSwapped\n" );
+	for ( frm = 0; frm < n_frames; frm++ ) {
+		t = frm * MARKER_SAMPLE_PERIOD;
+		y = TEST_AMPLITUDE * sin( 2.0 * VectorsMixin::pi * TEST_FREQUENCY * t );
+		visible = 1;
+		for ( drp = 0; drp < N_DROPOUTS; drp++ ) {
+			if ( frm >= dropoutStart[drp] && frm < dropoutStart[drp] + dropoutLength[drp] ) visible = 0;
+		}
+		fprintf( fp, "%d\t%.3f\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%lu\t%d\n",
+			frm, t, visible, 0.0, y, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0UL, 0 );
+	}
+	fclose( fp );
+
+	// A tap of growing strength on the force and acceleration channels after each
+	// of the movement triggers, which are every 0.5 s from 0.5 s on.
+	for ( smpl = 0; smpl < n_samples; smpl++ ) {
+		t = smpl * ANALOG_SAMPLE_PERIOD;
+		movement = (int) floor( t / 0.5 );
+		burst = t - movement * 0.5;
+		if ( movement > 0 && burst < 0.2 ) burst = movement * 0.25 * sin( VectorsMixin::pi * burst / 0.2 );
+		else burst = 0.0;
+		samples[smpl].time = (float) t;
+		for ( chan = 0; chan < N_CHANNELS; chan++ ) samples[smpl].channel[chan] = (float) burst;
+	}
+	sprintf( filename, "%s.adc", TEST_FILEROOT );
+	if ( !DexWriteAnalogFile( filename, samples, n_samples, N_CHANNELS ) ) return( false );
+
+	// Movement triggers halfway between the zero crossings, where the start position
+	// is good only every other time, and triggers for upward and downward movements at
+	// the zero crossings and at the extremes, half of which go the wrong way.
+	sprintf( filename, "%s.evt", TEST_FILEROOT );
+	fp = fopen( filename, "w" );
+	if ( !fp ) return( false );
+	fprintf( fp, "Event\tTime\tCode\tParam\n" );
+	evt = 0;
+	fprintf( fp, "%d\t%.3f\t%d\t%lu\n", evt++, 0.0, ACQUISITION_START, 0UL );
+	for ( movement = 1; movement < (int) ( TEST_DURATION / 0.5 ); movement++ ) {
+		t = movement * 0.5;
+		fprintf( fp, "%d\t%.3f\t%d\t%lu\n", evt++, t, ( movement % 2 ? TRIGGER_MOVEMENT : TRIGGER_MOVE_UP ), 0UL );
+		if ( movement % 2 ) fprintf( fp, "%d\t%.3f\t%d\t%lu\n", evt++, t, TRIGGER_MOVE_DOWN, 0UL );
+	}
+	fprintf( fp, "%d\t%.3f\t%d\t%lu\n", evt++, TEST_DURATION - MARKER_SAMPLE_PERIOD, ACQUISITION_STOP, 0UL );
+	fclose( fp );
+
+	return( true );
+
+}
+
+/*********************************************************************************/
+
+// Run the Check* routine for one point of the sweep. Returns true if it passes.
+
+bool CheckOnBoard( TestAnalyzer *trial, const DexPostHocSweep &sweep, int ia, int ib ) {
+
+	int errors = trial->errors;
+	float tol;
+
+	switch ( sweep.check ) {
+	case VISIBILITY_CHECK:
+		trial->CheckVisibility( sweep.a[ia], sweep.b[ib], NULL, NULL );
+		break;
+	case AMPLITUDE_CHECK:
+		trial->CheckMovementAmplitude( sweep.a[ia], sweep.b[ib], sweep.direction, NULL, NULL );
+		break;
+	case CYCLES_CHECK:
+		trial->CheckMovementCycles( (int) sweep.b[ib], sweep.maxCount, sweep.direction, (float) sweep.a[ia], NULL, NULL );
+		break;
+	case EARLY_STARTS_CHECK:
+		trial->CheckEarlyStarts( (int) sweep.b[ib], sweep.holdTime, (float) sweep.a[ia], sweep.filterConstant, NULL, NULL );
+		break;
+	case START_POSITION_CHECK:
+		tol = (float) sweep.a[ia];
+		trial->CheckCorrectStartPosition( sweep.targetID, tol, tol, tol, (int) sweep.b[ib], NULL, NULL );
+		break;
+	case DIRECTION_CHECK:
+		trial->CheckMovementDirection( (int) sweep.b[ib], sweep.direction, (float) sweep.a[ia], NULL, NULL );
+		break;
+	case FORCE_PEAKS_CHECK:
+		trial->CheckForcePeaks( (float) sweep.a[ia], (float) sweep.b[ib], sweep.maxCount, NULL, NULL );
+		break;
+	case ACCELERATION_PEAKS_CHECK:
+		trial->CheckAccelerationPeaks( (float) sweep.a[ia], (float) sweep.b[ib], sweep.maxCount, NULL, NULL );
+		break;
+	}
+	return( trial->errors == errors );
+
+}
+
+// Compare the two verdicts at every point of the sweep. Returns the number of
+// points where they differ, or one more if the sweep never passes or never fails.
+
+int CompareVerdicts( TestAnalyzer *trial, const DexPostHocSweep &sweep, const char *name ) {
+
+	int pass[DEX_MAX_SWEEP_POINTS][DEX_MAX_SWEEP_POINTS];
+	int ia, ib, passed = 0, differ = 0;
+
+	for ( ia = 0; ia < DEX_MAX_SWEEP_POINTS; ia++ ) {
+		for ( ib = 0; ib < DEX_MAX_SWEEP_POINTS; ib++ ) pass[ia][ib] = 0;
+	}
+	trial->EvaluateSweep( sweep, pass );
+
+	for ( ia = 0; ia < sweep.nA; ia++ ) {
+		for ( ib = 0; ib < sweep.nB; ib++ ) {
+			if ( pass[ia][ib] ) passed++;
+			if ( ( pass[ia][ib] != 0 ) != CheckOnBoard( trial, sweep, ia, ib ) ) differ++;
+		}
+	}
+	printf( "%-12s %2d x %d thresholds: %2d pass, %2d fail, %d verdicts differ.\n",
+		name, sweep.nA, sweep.nB, passed, sweep.nA * sweep.nB - passed, differ );
+
+	if ( passed == 0 || passed == sweep.nA * sweep.nB ) differ++;
+	return( differ );
+
+}
+
+void SetSweep( DexPostHocSweep &sweep, DexPostHocCheck check, int na, const double a[], int nb, const double b[] ) {
+	int i;
+	sweep.check = check;
+	sweep.nA = na;
+	sweep.nB = nb;
+	for ( i = 0; i < na; i++ ) sweep.a[i] = a[i];
+	for ( i = 0; i < nb; i++ ) sweep.b[i] = b[i];
+}
+
+/*********************************************************************************/
+
+int main( int argc, char *argv[] ) {
+
+	TestAnalyzer	*trial;
+	DexPostHocSweep	sweep;
+	char			filename[256];
+	int				failures = 0;
+
+	double visibility_a[] = { 0.05, 0.1, 0.15, 0.2, 0.3 };
+	double visibility_b[] = { 0.02, 0.04, 0.06, 0.1, 0.12 };
+	double amplitude_a[] = { 10.0, 20.0, 27.0, 30.0 };
+	double amplitude_b[] = { 25.0, 29.0, 35.0 };
+	double cycles_a[] = { 1.0, 10.0, 39.0, 50.0 };
+	double cycles_b[] = { 3.0, 4.0, 5.0, 6.0 };
+	double early_a[] = { 10.0, 50.0, 100.0, 200.0 };
+	double early_b[] = { 0.0, 2.0, 5.0, 10.0 };
+	double position_a[] = { 1.0, 10.0, 50.0, 100.0 };
+	double position_b[] = { 0.0, 3.0, 5.0, 10.0 };
+	double direction_a[] = { 1.0, 5.0, 20.0, 100.0 };
+	double direction_b[] = { 0.0, 3.0, 6.0, 10.0 };
+	double peaks_a[] = { 0.0, 0.3, 0.7, 1.3, 2.0 };
+	double peaks_b[] = { 0.1, 1.0, 2.0, 3.0, 100.0 };
+
+	if ( !WriteTrial() ) {
+		printf( "Could not write the trial.\n" );
+		return( 1 );
+	}
+
+	trial = new TestAnalyzer();
+	trial->monitor = new QuietMonitor();
+	if ( !trial->LoadTrial( TEST_FILEROOT ) ) {
+		printf( "Could not load the trial.\n" );
+		return( 1 );
+	}
+	trial->targetPosition[TEST_TARGET][X] = 0.0;
+	trial->targetPosition[TEST_TARGET][Y] = TEST_AMPLITUDE;
+	trial->targetPosition[TEST_TARGET][Z] = 0.0;
+
+	sweep.direction[X] = 0.0;
+	sweep.direction[Y] = 1.0;
+	sweep.direction[Z] = 0.0;
+	sweep.maxCount = 10;
+	sweep.holdTime = 0.5;
+	sweep.filterConstant = 1.0;
+	sweep.targetID = TEST_TARGET;
+
+	SetSweep( sweep, VISIBILITY_CHECK, 5, visibility_a, 5, visibility_b );
+	failures += CompareVerdicts( trial, sweep, "visibility" );
+	SetSweep( sweep, AMPLITUDE_CHECK, 4, amplitude_a, 3, amplitude_b );
+	failures += CompareVerdicts( trial, sweep, "amplitude" );
+	SetSweep( sweep, CYCLES_CHECK, 4, cycles_a, 4, cycles_b );
+	failures += CompareVerdicts( trial, sweep, "cycles" );
+	SetSweep( sweep, EARLY_STARTS_CHECK, 4, early_a, 4, early_b );
+	failures += CompareVerdicts( trial, sweep, "earlystarts" );
+	SetSweep( sweep, START_POSITION_CHECK, 4, position_a, 4, position_b );
+	failures += CompareVerdicts( trial, sweep, "startpos" );
+	SetSweep( sweep, DIRECTION_CHECK, 4, direction_a, 4, direction_b );
+	failures += CompareVerdicts( trial, sweep, "direction" );
+	sweep.maxCount = 3;
+	SetSweep( sweep, FORCE_PEAKS_CHECK, 5, peaks_a, 5, peaks_b );
+	failures += CompareVerdicts( trial, sweep, "forcepeaks" );
+	SetSweep( sweep, ACCELERATION_PEAKS_CHECK, 5, peaks_a, 5, peaks_b );
+	failures += CompareVerdicts( trial, sweep, "accpeaks" );
+
+	delete trial->monitor;
+	delete trial;
+	sprintf( filename, "%s.mnp", TEST_FILEROOT );
+	remove( filename );
+	sprintf( filename, "%s.adc", TEST_FILEROOT );
+	remove( filename );
+	sprintf( filename, "%s.evt", TEST_FILEROOT );
+	remove( filename );
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
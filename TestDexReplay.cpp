@@ -0,0 +1,169 @@
+// TestDexReplay.cpp
+
+// Save a trial in the files written by DexApparatus::SaveAcquisition() and
+// play it back with DexReplayTracker and DexReplayADC, at the recorded pace
+// and faster. The values must come back as written, and the time stamps
+// must follow the timers of the apparatus whatever the replay speed.
+// The virtual clock of DexTimers stands in for real time.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include "Dexterous.h"
+#include "DexTracker.h"
+#include "DexADC.h"
+
+#define TEST_FILEROOT	"TestDexReplay"
+
+// 3 s of markers at 200 Hz for 2 units, and of 8 analog channels at 1 kHz.
+#define TEST_FRAMES		600
+#define TEST_PAGES		( N_CODAS + 1 )
+#define TEST_MARKERS	8
+#define TEST_SAMPLES	3000
+#define TEST_CHANNELS	8
+
+// How long each acquisition lasts, on the apparatus clock.
+#define TEST_ACQUISITION	1.0
+
+// Positions are written with 6 decimals, time stamps with 3.
+#define POSITION_TOLERANCE	0.000001
+#define TIME_TOLERANCE		0.0005
+
+CodaFrame			frames[TEST_PAGES][TEST_FRAMES];
+ManipulandumState	states[TEST_FRAMES];
+AnalogSample		samples[TEST_SAMPLES];
+
+CodaFrame			replayed[TEST_FRAMES];
+AnalogSample		replayedSamples[TEST_SAMPLES];
+
+double Position( int page, int frm, int mrk, int i ) {
+	return( floor( 1000000.0 * ( 100.0 * page + 10.0 * mrk + i + sin( frm * 0.01 ) ) + 0.5 ) / 1000000.0 );
+}
+
+double Channel( int smpl, int chan ) {
+	return( floor( 1000000.0 * ( chan + cos( smpl * 0.003 ) ) + 0.5 ) / 1000000.0 );
+}
+
+void MakeTrial( void ) {
+
+	int page, frm, mrk, i, smpl, chan;
+
+	for ( frm = 0; frm < TEST_FRAMES; frm++ ) {
+		states[frm].time = frm * MARKER_SAMPLE_PERIOD;
+		for ( page = 0; page < TEST_PAGES; page++ ) {
+			frames[page][frm].time = states[frm].time;
+			for ( mrk = 0; mrk < TEST_MARKERS; mrk++ ) {
+				frames[page][frm].marker[mrk].visibility = ( ( frm + mrk + page ) % 7 != 0 );
+				for ( i = 0; i < 3; i++ ) frames[page][frm].marker[mrk].position[i] = Position( page, frm, mrk, i );
+			}
+		}
+	}
+	for ( smpl = 0; smpl < TEST_SAMPLES; smpl++ ) {
+		samples[smpl].time = smpl * ANALOG_SAMPLE_PERIOD;
+		for ( chan = 0; chan < TEST_CHANNELS; chan++ ) samples[smpl].channel[chan] = (float) Channel( smpl, chan );
+	}
+
+}
+
+// Run one acquisition of TEST_ACQUISITION s with the apparatus updating
+// once per tracker sample, then check what the devices return.
+// Returns the number of errors.
+int Replay( double speed ) {
+
+	DexReplayTracker	*tracker = new DexReplayTracker( TEST_FILEROOT, speed );
+	DexReplayADC		*adc = new DexReplayADC( TEST_FILEROOT, speed );
+	DexTimer			trial_timer;
+	CodaFrame			current;
+	int					page, frm, mrk, i, smpl, chan, n_frames, n_samples;
+	int					errors = 0;
+	double				time_error = 0.0;
+
+	DexTimerSetVirtual( 1, MARKER_SAMPLE_PERIOD );
+	DexTimerStart( trial_timer );
+	tracker->StartAcquisition( 10.0 );
+	adc->StartAcquisition( 10.0 );
+	while ( DexTimerElapsedTime( trial_timer ) < TEST_ACQUISITION - TIME_TOLERANCE ) {
+		DexTimerTick();
+		tracker->Update();
+		adc->Update();
+		// The frame shown now was recorded no later than now, on the apparatus clock.
+		tracker->GetCurrentMarkerFrame( current );
+		if ( current.time > DexTimerElapsedTime( trial_timer ) + TIME_TOLERANCE ) errors++;
+	}
+	tracker->StopAcquisition();
+	adc->StopAcquisition();
+
+	for ( page = 0; page < TEST_PAGES; page++ ) {
+		n_frames = tracker->RetrieveMarkerFrames( replayed, TEST_FRAMES, page );
+		// All the frames replayed during the acquisition, and nothing more.
+		if ( n_frames != (int) floor( TEST_ACQUISITION * speed / MARKER_SAMPLE_PERIOD + 0.5 ) + 1
+			&& n_frames != TEST_FRAMES ) errors++;
+		for ( frm = 0; frm < n_frames; frm++ ) {
+			if ( fabs( replayed[frm].time - frames[page][frm].time / speed ) > time_error ) time_error = fabs( replayed[frm].time - frames[page][frm].time / speed );
+			for ( mrk = 0; mrk < TEST_MARKERS; mrk++ ) {
+				if ( replayed[frm].marker[mrk].visibility != frames[page][frm].marker[mrk].visibility ) errors++;
+				for ( i = 0; i < 3; i++ ) {
+					if ( fabs( replayed[frm].marker[mrk].position[i] - frames[page][frm].marker[mrk].position[i] ) > POSITION_TOLERANCE ) errors++;
+				}
+			}
+		}
+		// The last frame is where the acquisition stopped.
+		if ( fabs( replayed[n_frames - 1].time - TEST_ACQUISITION ) > MARKER_SAMPLE_PERIOD / speed + TIME_TOLERANCE ) errors++;
+	}
+
+	n_samples = adc->RetrieveAnalogSamples( replayedSamples, TEST_SAMPLES );
+	if ( n_samples != (int) floor( TEST_ACQUISITION * speed / ANALOG_SAMPLE_PERIOD + 0.5 ) + 1
+		&& n_samples != TEST_SAMPLES ) errors++;
+	for ( smpl = 0; smpl < n_samples; smpl++ ) {
+		if ( fabs( replayedSamples[smpl].time - samples[smpl].time / speed ) > time_error ) time_error = fabs( replayedSamples[smpl].time - samples[smpl].time / speed );
+		for ( chan = 0; chan < TEST_CHANNELS; chan++ ) {
+			if ( fabs( replayedSamples[smpl].channel[chan] - samples[smpl].channel[chan] ) > POSITION_TOLERANCE ) errors++;
+		}
+	}
+	if ( fabs( replayedSamples[n_samples - 1].time - TEST_ACQUISITION ) > ANALOG_SAMPLE_PERIOD / speed + TIME_TOLERANCE ) errors++;
+	if ( time_error > TIME_TOLERANCE / speed ) errors++;
+
+	printf( "Speed %.1f: %d frames and %d samples over %.3f s, last at %.4f s and %.4f s, time stamps within %.6f s, %d errors.\n",
+		speed, n_frames, n_samples, DexTimerElapsedTime( trial_timer ),
+		replayed[n_frames - 1].time, replayedSamples[n_samples - 1].time, time_error, errors );
+
+	delete tracker;
+	delete adc;
+	return( errors );
+
+}
+
+int main( int argc, char *argv[] ) {
+
+	CodaFrame	*pages[TEST_PAGES];
+	char		filename[256];
+	int			page, failures = 0;
+
+	MakeTrial();
+	for ( page = 0; page < TEST_PAGES; page++ ) pages[page] = frames[page];
+	sprintf( filename, "%s.mrk", TEST_FILEROOT );
+	if ( !DexWriteMarkerFile( filename, pages, TEST_PAGES, TEST_MARKERS, states, TEST_FRAMES ) ) failures++;
+	sprintf( filename, "%s.adc", TEST_FILEROOT );
+	if ( !DexWriteAnalogFile( filename, samples, TEST_SAMPLES, TEST_CHANNELS ) ) failures++;
+	if ( failures ) {
+		printf( "Could not write %s.\n", filename );
+		return( 1 );
+	}
+
+	failures += Replay( 1.0 );
+	failures += Replay( 2.0 );
+	failures += Replay( 2.5 );
+
+	sprintf( filename, "%s.mrk", TEST_FILEROOT );
+	remove( filename );
+	sprintf( filename, "%s.adc", TEST_FILEROOT );
+	remove( filename );
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
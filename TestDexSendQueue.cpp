@@ -0,0 +1,280 @@
+// TestDexSendQueue.cpp
+
+// Check the send queue of DexMonitorServerUDP without a socket: which packet
+// is dropped when the queue is full, how a state update replaces the one that
+// is still waiting, and that the token bucket holds the link to its rate.
+// Time is whatever the test says it is, in ms.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "DexUDPServices.h"
+#include "DexTelemetry.h"
+#include "DexSendQueue.h"
+
+// Packets that are not binary telemetry are queued as they are.
+// The first byte tells them apart, the second gives the priority.
+#define TEST_PACKET_SIZE	1000
+
+// Token bucket for the rate tests.
+#define TEST_RATE			10000.0
+#define TEST_BURST			3000.0
+#define TEST_DURATION		10000
+
+DexSendQueue	queue;
+char			packet[DEX_UDP_PACKET_SIZE + 100];
+
+int Put( int tag, int priority ) {
+	memset( packet, 0, sizeof( packet ) );
+	packet[0] = (char) tag;
+	packet[1] = (char) priority;
+	return( DexSendQueuePut( &queue, packet, TEST_PACKET_SIZE, priority ) );
+}
+
+// The tag of the packet waiting at the given place in the queue.
+int Waiting( int i ) {
+	return( queue.slot[queue.order[i]].data[0] );
+}
+
+/*********************************************************************************/
+
+// Returns the number of errors.
+int DropPolicy( void ) {
+
+	int slot[DEX_SEND_QUEUE_LENGTH];
+	int i, n, errors = 0;
+	unsigned long wait;
+
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+
+	// A full queue of recorded data makes room for an event by dropping the oldest.
+	for ( i = 0; i < DEX_SEND_QUEUE_LENGTH; i++ ) if ( !Put( i, DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( queue.nFree != 0 || queue.dropped[DEX_NORMAL_PRIORITY] != 0 ) errors++;
+	if ( !Put( 100, DEX_HIGH_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_NORMAL_PRIORITY] != 1 || Waiting( 0 ) != 1 || Waiting( DEX_SEND_QUEUE_LENGTH - 1 ) != 100 ) errors++;
+
+	// A state update is not worth more than any of them.
+	if ( Put( 101, DEX_LOW_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_LOW_PRIORITY] != 1 || queue.nQueued != DEX_SEND_QUEUE_LENGTH ) errors++;
+
+	// More data pushes out the next oldest, not the event.
+	if ( !Put( 102, DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_NORMAL_PRIORITY] != 2 || Waiting( 0 ) != 2 ) errors++;
+	if ( Waiting( DEX_SEND_QUEUE_LENGTH - 2 ) != 100 || Waiting( DEX_SEND_QUEUE_LENGTH - 1 ) != 102 ) errors++;
+	printf( "Full of data: the event and the new data took the place of the 2 oldest, the state was refused.\n" );
+
+	// The victim is the least important packet, wherever it is in the queue.
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	for ( i = 0; i < DEX_SEND_QUEUE_LENGTH; i++ ) Put( i, ( i == 20 ? DEX_LOW_PRIORITY : i < 10 ? DEX_HIGH_PRIORITY : DEX_NORMAL_PRIORITY ) );
+	if ( !Put( 100, DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_LOW_PRIORITY] != 1 || queue.dropped[DEX_NORMAL_PRIORITY] != 0 ) errors++;
+	for ( i = 0; i < queue.nQueued; i++ ) if ( Waiting( i ) == 20 ) errors++;
+	if ( !Put( 101, DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_NORMAL_PRIORITY] != 1 || Waiting( 10 ) != 11 || Waiting( 0 ) != 0 ) errors++;
+	printf( "Mixed: dropped the state first, then the oldest data, never the events.\n" );
+
+	// Nothing can be dropped while every slot is out being sent.
+	n = DexSendQueueTake( &queue, 0, slot, DEX_SEND_QUEUE_LENGTH, &wait );
+	if ( n != DEX_SEND_QUEUE_LENGTH || queue.nQueued != 0 || queue.nFree != 0 ) errors++;
+	if ( Put( 102, DEX_HIGH_PRIORITY ) ) errors++;
+	if ( queue.dropped[DEX_HIGH_PRIORITY] != 1 ) errors++;
+	DexSendQueueRelease( &queue, slot, n );
+	if ( queue.nFree != DEX_SEND_QUEUE_LENGTH || !Put( 103, DEX_HIGH_PRIORITY ) ) errors++;
+	printf( "All slots out being sent: refused an event, took it once they came back.\n" );
+
+	printf( "Drop policy: %d errors.\n\n", errors );
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+void MakeState( DexTelemetryMessage &msg, int type, unsigned int changed, unsigned long targets, double x, double q ) {
+	memset( &msg, 0, sizeof( msg ) );
+	msg.type = type;
+	msg.changed = changed;
+	msg.acquisition = 1;
+	msg.visibility = 1;
+	msg.targets = targets;
+	msg.position[0] = (float) x;
+	msg.position[1] = 200.0f;
+	msg.position[2] = 300.0f;
+	msg.orientation[0] = (float) q;
+	msg.orientation[3] = 1.0f;
+}
+
+int PutState( DexTelemetryMessage &msg ) {
+	unsigned char encoded[DEX_TLM_MAX_PACKET_SIZE];
+	int size = DexTelemetryEncode( encoded, sizeof( encoded ), &msg );
+	if ( size <= 0 ) return( 0 );
+	return( DexSendQueuePut( &queue, (const char *) encoded, size, DEX_LOW_PRIORITY ) );
+}
+
+// Decode the state waiting at the given place in the queue.
+int WaitingState( int i, DexTelemetryMessage &msg ) {
+	DexQueuedPacket *waiting = &queue.slot[queue.order[i]];
+	return( DexTelemetryDecode( (const unsigned char *) waiting->data, waiting->size, &msg ) > 0 );
+}
+
+// Returns the number of errors.
+int Replacement( void ) {
+
+	DexTelemetryMessage state, waiting;
+	int errors = 0;
+	const unsigned int both = DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED;
+
+	// A text state takes the place of the one that is waiting, nothing more.
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	Put( 1, DEX_NORMAL_PRIORITY );
+	Put( 2, DEX_LOW_PRIORITY );
+	Put( 3, DEX_NORMAL_PRIORITY );
+	if ( !Put( 4, DEX_LOW_PRIORITY ) ) errors++;
+	if ( queue.nQueued != 3 || queue.replaced != 1 ) errors++;
+	if ( Waiting( 0 ) != 1 || Waiting( 1 ) != 4 || Waiting( 2 ) != 3 ) errors++;
+	printf( "Text states: the newer took the place of the older, %lu replaced.\n", queue.replaced );
+
+	// A change that follows a keyframe goes out as a keyframe, with the newer
+	// position and the older orientation.
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	Put( 1, DEX_NORMAL_PRIORITY );
+	MakeState( state, DEX_TLM_STATE, both, 0x01, 10.0, 0.1 );
+	PutState( state );
+	Put( 2, DEX_NORMAL_PRIORITY );
+	MakeState( state, DEX_TLM_STATE_CHANGE, DEX_TLM_POSITION_CHANGED, 0x02, 11.0, 0.0 );
+	if ( !PutState( state ) ) errors++;
+	if ( queue.nQueued != 3 || queue.replaced != 1 || Waiting( 0 ) != 1 || Waiting( 2 ) != 2 ) errors++;
+	if ( !WaitingState( 1, waiting ) ) errors++;
+	else {
+		if ( waiting.type != DEX_TLM_STATE || waiting.targets != 0x02 ) errors++;
+		if ( fabs( waiting.position[0] - 11.0 ) > DEX_TLM_POSITION_QUANTUM ) errors++;
+		if ( fabs( waiting.orientation[0] - 0.1 ) > 0.0001 ) errors++;
+		printf( "Keyframe then position: type %d, targets 0x%02lx, x %.2f, q %.4f.\n",
+			waiting.type, waiting.targets, waiting.position[0], waiting.orientation[0] );
+	}
+
+	// Two changes of different parts of the pose go out as one with both.
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	MakeState( state, DEX_TLM_STATE_CHANGE, DEX_TLM_POSITION_CHANGED, 0x01, 12.0, 0.0 );
+	PutState( state );
+	MakeState( state, DEX_TLM_STATE_CHANGE, DEX_TLM_ORIENTATION_CHANGED, 0x01, 0.0, 0.2 );
+	PutState( state );
+	if ( queue.nQueued != 1 || queue.replaced != 1 ) errors++;
+	if ( !WaitingState( 0, waiting ) ) errors++;
+	else {
+		if ( waiting.type != DEX_TLM_STATE_CHANGE || waiting.changed != both ) errors++;
+		if ( fabs( waiting.position[0] - 12.0 ) > DEX_TLM_POSITION_QUANTUM ) errors++;
+		if ( fabs( waiting.orientation[0] - 0.2 ) > 0.0001 ) errors++;
+		printf( "Position then orientation: type %d, changed 0x%02x, x %.2f, q %.4f.\n",
+			waiting.type, waiting.changed, waiting.position[0], waiting.orientation[0] );
+	}
+
+	printf( "State replacement: %d errors.\n\n", errors );
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// Returns the number of errors.
+int TokenBucket( void ) {
+
+	int slot[DEX_SEND_QUEUE_LENGTH];
+	int i, n, errors = 0;
+	unsigned long now, wait, longest_wait = 0;
+	double sent = 0.0;
+
+	// The bucket starts full and lets out a burst, then makes the next one wait.
+	DexSendQueueInit( &queue, TEST_RATE, TEST_BURST, 0 );
+	for ( i = 0; i < 10; i++ ) Put( i, DEX_NORMAL_PRIORITY );
+	n = DexSendQueueTake( &queue, 0, slot, 8, &wait );
+	if ( n != (int) ( TEST_BURST / TEST_PACKET_SIZE ) || wait != 0 ) errors++;
+	DexSendQueueRelease( &queue, slot, n );
+	printf( "Burst of %d packets", n );
+	n = DexSendQueueTake( &queue, 0, slot, 8, &wait );
+	if ( n != 0 || wait != (unsigned long) ( TEST_PACKET_SIZE * 1000.0 / TEST_RATE ) ) errors++;
+	printf( ", then a wait of %lu ms", wait );
+	n = DexSendQueueTake( &queue, 40, slot, 8, &wait );
+	if ( n != 0 || wait != (unsigned long) ( TEST_PACKET_SIZE * 1000.0 / TEST_RATE ) - 40 ) errors++;
+	printf( ", %lu ms left after 40 ms", wait );
+	n = DexSendQueueTake( &queue, 100, slot, 8, &wait );
+	if ( n != 1 ) errors++;
+	DexSendQueueRelease( &queue, slot, n );
+	printf( ", then %d packet.\n", n );
+
+	// The burst can never be less than one packet, or the largest would never go.
+	DexSendQueueSetRate( &queue, TEST_RATE, 10.0 );
+	if ( queue.burst < DEX_UDP_PACKET_SIZE ) errors++;
+
+	// Kept busy for a long time, the link gets no more than the rate allows.
+	DexSendQueueInit( &queue, TEST_RATE, TEST_BURST, 0 );
+	for ( now = 0; now <= TEST_DURATION; now++ ) {
+		while ( queue.nFree > 0 ) Put( (int) ( now & 0x7f ), DEX_NORMAL_PRIORITY );
+		n = DexSendQueueTake( &queue, now, slot, DEX_SEND_QUEUE_LENGTH, &wait );
+		if ( n == 0 && wait > longest_wait ) longest_wait = wait;
+		for ( i = 0; i < n; i++ ) sent += queue.slot[slot[i]].size;
+		DexSendQueueRelease( &queue, slot, n );
+	}
+	if ( sent > TEST_BURST + TEST_RATE * TEST_DURATION / 1000.0 ) errors++;
+	if ( sent < TEST_RATE * TEST_DURATION / 1000.0 - TEST_PACKET_SIZE ) errors++;
+	if ( longest_wait > TEST_PACKET_SIZE * 1000.0 / TEST_RATE ) errors++;
+	printf( "%d s at %.0f bytes/s: %.0f bytes sent, %.0f allowed, longest wait %lu ms.\n",
+		TEST_DURATION / 1000, TEST_RATE, sent, TEST_BURST + TEST_RATE * TEST_DURATION / 1000.0, longest_wait );
+
+	// Without a rate, everything goes at once, up to the size of the batch.
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	for ( i = 0; i < 10; i++ ) Put( i, DEX_NORMAL_PRIORITY );
+	n = DexSendQueueTake( &queue, 0, slot, 8, &wait );
+	if ( n != 8 || wait != 0 || Waiting( 0 ) != 8 ) errors++;
+	DexSendQueueRelease( &queue, slot, n );
+	n = DexSendQueueTake( &queue, 0, slot, 8, &wait );
+	if ( n != 2 ) errors++;
+	DexSendQueueRelease( &queue, slot, n );
+	n = DexSendQueueTake( &queue, 0, slot, 8, &wait );
+	if ( n != 0 || wait != 0 ) errors++;
+	printf( "No rate: 10 packets went in batches of 8 and 2.\n" );
+
+	printf( "Token bucket: %d errors.\n\n", errors );
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// Returns the number of errors.
+int Sizes( void ) {
+
+	int errors = 0;
+
+	DexSendQueueInit( &queue, 0.0, 0.0, 0 );
+	memset( packet, 1, sizeof( packet ) );
+	if ( DexSendQueuePut( &queue, packet, -1, DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( DexSendQueuePut( &queue, packet, 10, DEX_PRIORITIES ) ) errors++;
+	if ( DexSendQueuePut( &queue, packet, 10, -1 ) ) errors++;
+	if ( queue.nQueued != 0 ) errors++;
+	if ( !DexSendQueuePut( &queue, packet, sizeof( packet ), DEX_NORMAL_PRIORITY ) ) errors++;
+	if ( queue.nQueued != 1 || queue.slot[queue.order[0]].size != DEX_UDP_PACKET_SIZE ) errors++;
+	if ( !DexSendQueuePut( &queue, packet, 0, DEX_NORMAL_PRIORITY ) ) errors++;
+	printf( "Negative sizes and unknown priorities refused, %d bytes cut to %d.\n",
+		(int) sizeof( packet ), queue.slot[queue.order[0]].size );
+
+	printf( "Sizes: %d errors.\n\n", errors );
+	return( errors );
+
+}
+
+int main( int argc, char *argv[] ) {
+
+	int failures = 0;
+
+	failures += DropPolicy();
+	failures += Replacement();
+	failures += TokenBucket();
+	failures += Sizes();
+
+	printf( "%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
@@ -0,0 +1,255 @@
+// TestDexSyntheticADC.cpp
+
+// Round trip of the synthetic force signal: gauge voltages generated by
+// DexForceSynthesizer from a force profile are put through the force path of
+// DexApparatus, after the gauge offsets have been nullified as on board. The
+// grip, load, centers of pressure and twist must come back as in the profile.
+// The synthesizer is calibrated from the same ATI calibrations as the apparatus.
+// Then the offsets are measured from the noisy stream of a DexSyntheticADC by
+// MeasureAndNullifyStrainGaugeOffsets(), on the virtual clock.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <ATIDAQ\ftconfig.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include "Dexterous.h"
+#include "DexMonitorServer.h"
+#include "DexTracker.h"
+#include "DexADC.h"
+#include "DexApparatus.h"
+#include "DexForceSynthesizer.h"
+
+// The gauges are held as floats, which limits the precision of the forces.
+#define FORCE_TOLERANCE		0.001
+#define TORQUE_TOLERANCE	0.00001
+#define COP_TOLERANCE		0.00001
+
+// Rest, squeeze, then pull up, sideways and down with the grip following
+// the load, with the center of pressure moving and a twist.
+static DexForceKeyframe profile[] = {
+	{ 0.00,  0.0, {  0.0,  0.0,  0.0 }, {  0.000,  0.000, 0.0 },  0.00 },
+	{ 0.50,  0.0, {  0.0,  0.0,  0.0 }, {  0.000,  0.000, 0.0 },  0.00 },
+	{ 1.00,  5.0, {  0.0,  0.0,  0.0 }, {  0.002, -0.001, 0.0 },  0.00 },
+	{ 1.25, 10.0, {  0.0,  6.0,  0.0 }, {  0.004,  0.003, 0.0 },  0.02 },
+	{ 1.50,  8.0, {  3.0, -2.0,  0.0 }, { -0.003,  0.001, 0.0 }, -0.01 },
+	{ 1.75, 12.0, { -2.0, -6.0,  1.0 }, {  0.001, -0.004, 0.0 },  0.01 },
+	{ 2.00,  5.0, {  0.0,  0.0, -1.0 }, {  0.000,  0.002, 0.0 },  0.00 }
+};
+#define N_KEYFRAMES		( sizeof( profile ) / sizeof( profile[0] ) )
+#define REST_TIME		0.25
+#define TEST_DURATION	2.0
+
+// Noise on the gauges (V) and the confidence interval asked of the offsets.
+// It takes ( 1.96 * 0.002 / 0.0002 )^2, i.e. about 400 samples to reach.
+#define OFFSET_NOISE		0.002
+#define OFFSET_TOLERANCE	0.0002
+#define UNREACHABLE			0.00001
+#define OFFSET_DURATION		2.0
+// The standard deviation is estimated from a few hundred samples.
+#define NOISE_TOLERANCE		0.1		// fraction
+
+// Keeps the noise that the apparatus reports on each sensor.
+class QuietMonitor : public DexMonitorServer {
+public:
+	float	noise[N_FORCE_TRANSDUCERS][N_GAUGES];
+	int		reports;
+	QuietMonitor( void ) { reports = 0; }
+	void SendPacket( const char *packet, int size, int priority = DEX_NORMAL_PRIORITY ) {
+		const char	*text;
+		float		value[N_GAUGES];
+		int			unit;
+		if ( !strstr( packet, "Strain gauge noise" ) || !( text = strstr( packet, "Unit:" ) ) ) return;
+		if ( sscanf( text, "Unit: %d < %f %f %f %f %f %f >", &unit, 
+			&value[0], &value[1], &value[2], &value[3], &value[4], &value[5] ) != 7 ) return;
+		if ( unit < 0 || unit >= N_FORCE_TRANSDUCERS ) return;
+		for ( int j = 0; j < N_GAUGES; j++ ) noise[unit][j] = value[j];
+		reports++;
+	}
+};
+
+// An apparatus with only the synthetic ADC. It keeps the offsets that it applies
+// and answers Ignore when the offsets cannot be measured to the tolerance.
+class OffsetApparatus : public DexPostHocAnalyzer {
+public:
+	float	applied[N_FORCE_TRANSDUCERS][N_GAUGES];
+	int		errors;
+	OffsetApparatus( void ) { errors = 0; }
+	// The clock moves one step per update, as in DexApparatus::Update().
+	void Update( void ) { DexTimerTick(); adc->Update(); }
+	void NullifyStrainGaugeOffsets( int unit, float gauge_offsets[N_GAUGES] ) {
+		for ( int j = 0; j < N_GAUGES; j++ ) applied[unit][j] = gauge_offsets[j];
+		DexPostHocAnalyzer::NullifyStrainGaugeOffsets( unit, gauge_offsets );
+	}
+	int fSignalError( unsigned int mb_type, const char *picture, const char *format, ... ) {
+		errors++;
+		return( IDIGNORE );
+	}
+};
+
+// Measure the offsets once. Returns the number of errors.
+int MeasureOffsets( OffsetApparatus *apparatus, double tolerance, bool reachable ) {
+
+	DexSyntheticADC	*adc = (DexSyntheticADC *) apparatus->adc;
+	QuietMonitor	*monitor = (QuietMonitor *) apparatus->monitor;
+	AnalogSample	sample;
+	DexTimer		timer;
+	double			bias, elapsed, offset_error = 0.0, noise_error = 0.0;
+	double			noise = adc->synthesizer.noise;
+	int				unit, j, status, errors = 0;
+
+	apparatus->errors = 0;
+	monitor->reports = 0;
+	DexTimerStart( timer );
+	status = apparatus->MeasureAndNullifyStrainGaugeOffsets( "offsets", OFFSET_DURATION, tolerance, NULL, NULL );
+	elapsed = DexTimerElapsedTime( timer );
+
+	// The true bias of each gauge is what the synthesizer gives without noise.
+	adc->synthesizer.noise = 0.0;
+	adc->SynthesizeAnalogSample( sample, 0.0 );
+	adc->synthesizer.noise = noise;
+	for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+		for ( j = 0; j < N_GAUGES; j++ ) {
+			bias = sample.channel[apparatus->ftAnalogChannel[unit] + j];
+			if ( fabs( apparatus->applied[unit][j] - bias ) > offset_error ) offset_error = fabs( apparatus->applied[unit][j] - bias );
+			if ( fabs( monitor->noise[unit][j] - noise ) > noise_error ) noise_error = fabs( monitor->noise[unit][j] - noise );
+		}
+	}
+
+	printf( "Tolerance %.5f V: stopped after %.3f s (%.3f s allowed), %d errors signalled, exit %d.\n",
+		tolerance, elapsed, OFFSET_DURATION, apparatus->errors, status );
+	printf( "  offsets within %.6f V of the bias, noise within %.6f V of %.6f V.\n", offset_error, noise_error, noise );
+
+	// The offsets and the noise are applied and reported either way.
+	if ( monitor->reports != N_FORCE_TRANSDUCERS ) errors++;
+	if ( offset_error > 2.0 * ( reachable ? tolerance : OFFSET_TOLERANCE ) ) errors++;
+	if ( noise_error > NOISE_TOLERANCE * noise ) errors++;
+	if ( reachable ) {
+		if ( elapsed >= OFFSET_DURATION || apparatus->errors || status != NORMAL_EXIT ) errors++;
+	}
+	else {
+		if ( elapsed < OFFSET_DURATION || apparatus->errors != 1 || status != IGNORE_EXIT ) errors++;
+	}
+	return( errors );
+
+}
+
+int main( int argc, char *argv[] ) {
+
+	DexPostHocAnalyzer	*apparatus;
+	DexForceSynthesizer	synthesizer;
+	DexForceKeyframe	expected;
+	AnalogSample		sample;
+	double				ft_from_volts[6][N_GAUGES];
+	float				offsets[N_GAUGES];
+	Vector3				force[N_FORCE_TRANSDUCERS], torque[N_FORCE_TRANSDUCERS], cop[N_FORCE_TRANSDUCERS], load;
+	double				grip, twist;
+	double				grip_error = 0.0, load_error = 0.0, cop_error = 0.0, twist_error = 0.0;
+	double				time;
+	float				first;
+	int					unit, i, j, n = 0, failures = 0;
+
+	// The apparatus loads the ATI calibrations itself.
+	apparatus = new DexPostHocAnalyzer();
+	apparatus->monitor = new QuietMonitor();
+
+	// Offsets on the gauges, but no noise so that the comparison is exact.
+	synthesizer.noise = 0.0;
+	synthesizer.drift = 0.0;
+	for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+		for ( i = 0; i < 6; i++ ) {
+			for ( j = 0; j < N_GAUGES; j++ ) ft_from_volts[i][j] = apparatus->ftCalibration[unit]->rt.working_matrix[i][j];
+		}
+		if ( !synthesizer.SetCalibrationMatrix( unit, ft_from_volts ) ) {
+			printf( "The calibration of sensor %d cannot be inverted.\n", unit );
+			failures++;
+		}
+	}
+	synthesizer.SetForceProfile( profile, N_KEYFRAMES, false );
+
+	// Nullify the offsets at rest, as ZeroForceTransducers() does.
+	synthesizer.SynthesizeAnalogSample( sample, REST_TIME );
+	for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+		for ( j = 0; j < N_GAUGES; j++ ) offsets[j] = sample.channel[apparatus->ftAnalogChannel[unit] + j];
+		apparatus->NullifyStrainGaugeOffsets( unit, offsets );
+	}
+
+	for ( time = 0.0; time <= TEST_DURATION; time += ANALOG_SAMPLE_PERIOD ) {
+
+		synthesizer.SynthesizeAnalogSample( sample, time );
+		synthesizer.InterpolateProfile( expected, time );
+		for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+			apparatus->ComputeForceTorque( force[unit], torque[unit], unit, sample );
+		}
+		grip = apparatus->ComputeGripForce( force[LEFT_ATI], force[RIGHT_ATI] );
+		apparatus->ComputeLoadForce( load, force[LEFT_ATI], force[RIGHT_ATI] );
+		twist = torque[LEFT_ATI][Z] + torque[RIGHT_ATI][Z];
+
+		if ( fabs( grip - expected.grip ) > grip_error ) grip_error = fabs( grip - expected.grip );
+		for ( i = 0; i < 3; i++ ) {
+			if ( fabs( load[i] - expected.load[i] ) > load_error ) load_error = fabs( load[i] - expected.load[i] );
+		}
+		if ( fabs( twist - expected.twist ) > twist_error ) twist_error = fabs( twist - expected.twist );
+		// The center of pressure is only defined when the finger pushes.
+		if ( expected.grip > 1.0 ) {
+			for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+				apparatus->ComputeCOP( cop[unit], force[unit], torque[unit] );
+				for ( i = 0; i < 2; i++ ) {
+					if ( fabs( cop[unit][i] - expected.cop[i] ) > cop_error ) cop_error = fabs( cop[unit][i] - expected.cop[i] );
+				}
+			}
+		}
+		n++;
+
+	}
+
+	printf( "%d samples over %.1f s, largest errors:\n", n, TEST_DURATION );
+	printf( "  grip  %.6f N\n  load  %.6f N\n  COP   %.6f m\n  twist %.6f N-m\n", grip_error, load_error, cop_error, twist_error );
+	if ( grip_error > FORCE_TOLERANCE || load_error > FORCE_TOLERANCE ) failures++;
+	if ( cop_error > COP_TOLERANCE || twist_error > TORQUE_TOLERANCE ) failures++;
+
+	// The same seed gives the same noise, whatever the order of the samples.
+	synthesizer.noise = 0.002;
+	synthesizer.SynthesizeAnalogSample( sample, 1.234 );
+	first = sample.channel[LEFT_ATI_FIRST_CHANNEL];
+	synthesizer.SynthesizeAnalogSample( sample, 0.5 );
+	synthesizer.SynthesizeAnalogSample( sample, 1.234 );
+	if ( sample.channel[LEFT_ATI_FIRST_CHANNEL] != first ) failures++;
+
+	delete apparatus->monitor;
+	delete apparatus;
+
+	// Offsets measured from the stream of samples, one sample per update.
+	printf( "\nStrain gauge offsets from %.4f V of noise:\n", OFFSET_NOISE );
+	DexTimerSetVirtual( 1, ANALOG_SAMPLE_PERIOD );
+	OffsetApparatus *offsets_apparatus = new OffsetApparatus();
+	DexSyntheticADC *adc = new DexSyntheticADC();
+	offsets_apparatus->monitor = new QuietMonitor();
+	offsets_apparatus->adc = adc;
+	for ( unit = 0; unit < N_FORCE_TRANSDUCERS; unit++ ) {
+		for ( i = 0; i < 6; i++ ) {
+			for ( j = 0; j < N_GAUGES; j++ ) ft_from_volts[i][j] = offsets_apparatus->ftCalibration[unit]->rt.working_matrix[i][j];
+		}
+		adc->SetCalibrationMatrix( unit, ft_from_volts );
+	}
+	adc->synthesizer.noise = OFFSET_NOISE;
+	adc->synthesizer.drift = 0.0;
+	adc->SetForceProfile( profile, 1, false );
+	adc->Initialize();
+
+	failures += MeasureOffsets( offsets_apparatus, OFFSET_TOLERANCE, true );
+	failures += MeasureOffsets( offsets_apparatus, UNREACHABLE, false );
+
+	delete offsets_apparatus->monitor;
+	delete offsets_apparatus;
+	delete adc;
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
@@ -0,0 +1,136 @@
+// TestDexSyntheticTracker.cpp
+
+// Check DexSyntheticTracker: the scripted movements stay finite and reach
+// their ends whatever the hold, the frames do not depend on the order in
+// which they are generated, and they are generated much faster than real time.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <VectorsMixin.h>
+#include <DexTimers.h>
+#include "Dexterous.h"
+#include "DexTracker.h"
+
+// 20 cycles of 1 s for the movements.
+#define TEST_PERIOD		1.0
+#define TEST_DURATION	20.0
+#define TEST_FRAMES		( (int) ( TEST_DURATION / MARKER_SAMPLE_PERIOD ) + 1 )
+
+// Frames generated for the timing, in chunks so as not to need them all at once.
+#define SPEED_DURATION	60.0
+#define SPEED_CHUNK		1000
+// Well short of the ratio measured on the development machine, for slower ones.
+#define SPEED_REQUIRED	50.0
+
+#define TOLERANCE		0.000001
+
+CodaFrame	frames[TEST_FRAMES];
+CodaFrame	frame;
+
+static double holds[] = { -0.5, 0.0, 0.25, 0.4999, 0.5, 0.75, 1.0, 1.5, 10.0 };
+#define N_HOLDS ( sizeof( holds ) / sizeof( holds[0] ) )
+
+// Excursion of the first manipulandum marker along the direction of
+// the movement, over all the frames. Returns the number of frames where
+// it is missing or not finite.
+int Excursion( DexSyntheticTracker *tracker, double &lowest, double &highest, double &largest_step ) {
+
+	int		frm, bad = 0;
+	int		mrk = ManipulandumMarkerID[0];
+	double	along, previous = 0.0;
+
+	lowest = 1e30;
+	highest = -1e30;
+	largest_step = 0.0;
+	tracker->SynthesizeMarkerFrames( frames, TEST_FRAMES, 0.0 );
+	for ( frm = 0; frm < TEST_FRAMES; frm++ ) {
+		if ( !frames[frm].marker[mrk].visibility ) {
+			bad++;
+			continue;
+		}
+		along = tracker->DotProduct( frames[frm].marker[mrk].position, tracker->motion.direction );
+		// NaN fails both.
+		if ( !( along > -1e6 && along < 1e6 ) ) {
+			bad++;
+			continue;
+		}
+		if ( along < lowest ) lowest = along;
+		if ( along > highest ) highest = along;
+		if ( frm > 0 && fabs( along - previous ) > largest_step ) largest_step = fabs( along - previous );
+		previous = along;
+	}
+	return( bad );
+
+}
+
+int main( int argc, char *argv[] ) {
+
+	DexSyntheticTracker	*tracker = new DexSyntheticTracker();
+	DexTimer			timer;
+	DexMotionType		type[] = { DISCRETE_MOTION, TARGETED_MOTION };
+	char				*name[] = { "Discrete", "Targeted" };
+	double				lowest, highest, step, elapsed;
+	unsigned int		h;
+	int					t, bad, frm, mrk, i, differences, failures = 0;
+
+	// No noise and no tilt, so that the marker moves exactly with the manipulandum.
+	tracker->jitter = 0.0;
+	tracker->motion.tilt = 0.0;
+	tracker->motion.period = TEST_PERIOD;
+	tracker->SetMisalignment( 0.0, 0.0 );
+
+	for ( t = 0; t < 2; t++ ) {
+		tracker->motion.type = type[t];
+		for ( h = 0; h < N_HOLDS; h++ ) {
+			tracker->motion.hold = holds[h];
+			bad = Excursion( tracker, lowest, highest, step );
+			printf( "%s, hold %7.4f s: %d bad frames, range %.3f mm, largest step %.3f mm.\n",
+				name[t], holds[h], bad, highest - lowest, step );
+			if ( bad ) failures++;
+			// The discrete movements go from one end to the other every half cycle.
+			// The reaches go to some of the targets, never beyond the ends.
+			if ( type[t] == DISCRETE_MOTION && fabs( highest - lowest - tracker->motion.amplitude ) > TOLERANCE ) failures++;
+			if ( highest - lowest > tracker->motion.amplitude + TOLERANCE ) failures++;
+			if ( step > tracker->motion.amplitude + TOLERANCE ) failures++;
+		}
+	}
+
+	// Noise and occlusions are a function of time. Frames generated one by
+	// one, backwards, are the same as those generated in a row.
+	tracker->motion.type = TARGETED_MOTION;
+	tracker->motion.hold = 0.25;
+	tracker->motion.tilt = 5.0;
+	tracker->jitter = 0.1;
+	tracker->occlusionRate = 0.2;
+	tracker->SetMisalignment( 2.0, 0.5 );
+	tracker->SynthesizeMarkerFrames( frames, TEST_FRAMES, 0.0 );
+	differences = 0;
+	for ( frm = TEST_FRAMES - 1; frm >= 0; frm-- ) {
+		tracker->SynthesizeMarkerFrame( frame, frm * MARKER_SAMPLE_PERIOD );
+		for ( mrk = 0; mrk < N_MARKERS; mrk++ ) {
+			if ( frame.marker[mrk].visibility != frames[frm].marker[mrk].visibility ) differences++;
+			else for ( i = 0; i < 3; i++ ) if ( frame.marker[mrk].position[i] != frames[frm].marker[mrk].position[i] ) differences++;
+		}
+	}
+	printf( "\n%d frames generated backwards: %d differences.\n", TEST_FRAMES, differences );
+	if ( differences ) failures++;
+
+	// Combined data from all the units, with noise and occlusions.
+	DexTimerStartWallClock( timer );
+	for ( frm = 0; frm < (int) ( SPEED_DURATION / MARKER_SAMPLE_PERIOD ); frm += SPEED_CHUNK ) {
+		tracker->SynthesizeMarkerFrames( frames, SPEED_CHUNK, frm * MARKER_SAMPLE_PERIOD );
+	}
+	elapsed = DexTimerElapsedTime( timer );
+	printf( "%.0f s of frames from %d units in %.3f s: %.0f times faster than real time.\n",
+		SPEED_DURATION, tracker->GetNumberOfCodas(), elapsed, SPEED_DURATION / elapsed );
+	if ( elapsed * SPEED_REQUIRED > SPEED_DURATION ) failures++;
+
+	delete tracker;
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
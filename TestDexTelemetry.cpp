@@ -0,0 +1,1382 @@
+// TestDexTelemetry.cpp
+
+// Check that the binary telemetry packets survive a round trip through the
+// encoder and the decoder, and that the decoder stands up to damaged packets.
+// The same for the decoder of the older text packets. That the sender only lets
+// through the states that are worth sending, and that a state replaced in the
+// send queue loses nothing that the sender counted as sent. Last, that the readers
+// of the shared memory ring get whole packets and learn of those they missed,
+// taking turns with the writer and then in threads of their own.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "DexUDPServices.h"
+#include "DexSHMServices.h"
+#include "DexTelemetry.h"
+
+#define FUZZ_TRIALS	200000
+
+// Packets decoded to time each decoder.
+#define DECODE_REPEATS	200000
+
+// Size of the simulated downlink for the reliable delivery.
+#define LINK_RECORDINGS	50
+#define LINK_PACKETS	40
+
+DexTelemetryMessage	original, decoded;
+unsigned char		packet[DEX_TLM_MAX_PACKET_SIZE];
+unsigned char		damaged[DEX_TLM_MAX_PACKET_SIZE];
+
+// Full recording packets to be protected by the parity.
+#define PARITY_PACKETS	4800
+#define PARITY_REPEATS	20
+
+// The link, as seen by the sender and by the receiver.
+DexTelemetrySender		sender;
+DexTelemetryRepair		repair;
+unsigned char			records[PARITY_PACKETS][DEX_TLM_MAX_RECORD_SIZE];
+int						recordSize[PARITY_PACKETS];
+DexTelemetryReceiver	receiver;
+int						delivered[LINK_RECORDINGS][LINK_PACKETS];
+int						firstArrival;
+unsigned long			now;
+double					loss;
+int						firstPass;
+int						retransmissions;
+
+// A full resolution recording of 20 s at 200 Hz.
+#define TRIAL_SAMPLES	4000
+#define TRIAL_REPEATS	20
+
+float		trial[TRIAL_SAMPLES][DEX_TLM_FLOATS_PER_SAMPLE];
+int			trialVisible[TRIAL_SAMPLES];
+float		unpacked[DEX_TLM_MAX_PACKED][DEX_TLM_FLOATS_PER_SAMPLE];
+
+// Packets published in a shared memory ring that is smaller than the 
+// backlog of the slowest reader.
+#define SHM_NAME	"DexTestTelemetryRing"
+#define SHM_SLOTS	64
+#define SHM_PACKETS	100000
+// With the readers in threads of their own, spinning for so long after each packet.
+#define SHM_THREADED_PACKETS	300000
+#define SHM_THREADED_READERS	3
+static const int shmSpin[SHM_THREADED_READERS] = { 0, 200, 2000 };
+
+// Fill a message of the given type with arbitrary values.
+void MakeMessage( DexTelemetryMessage &msg, int type ) {
+
+	int i;
+
+	memset( &msg, 0, sizeof( msg ) );
+	msg.type = type;
+	msg.sequence = rand();
+	msg.time = rand();
+
+	msg.acquisition = rand() % 2;
+	msg.visibility = rand() % 2;
+	msg.targets = rand();
+	for ( i = 0; i < 3; i++ ) msg.position[i] = (float) ( rand() % 2000 - 1000 ) / 3.0f;
+	for ( i = 0; i < 4; i++ ) msg.orientation[i] = (float) rand() / RAND_MAX;
+
+	msg.codas = rand() % 8;
+	msg.nTargets = rand() % 32;
+	msg.posture = rand() % 4;
+	msg.targetBar = rand() % 4;
+	msg.tappingSurface = rand() % 4;
+
+	msg.clock = (unsigned long) time( NULL );
+	msg.length = rand() % ( DEX_TLM_MAX_TEXT + 1 );
+	for ( i = 0; i < msg.length; i++ ) msg.text[i] = 'a' + rand() % 26;
+
+	msg.recording = rand();
+	msg.samples = rand() % 20000;
+	msg.first = rand() % 20000;
+	msg.count = rand() % ( DEX_TLM_MAX_SAMPLES + 1 );
+	for ( i = 0; i < msg.count * DEX_TLM_FLOATS_PER_SAMPLE; i++ ) msg.data[i] = (float) rand() / 7.0f;
+
+	msg.nNacks = rand() % ( DEX_TLM_MAX_NACKS + 1 );
+	for ( i = 0; i < msg.nNacks; i++ ) msg.nack[i] = rand();
+	msg.acknowledged = rand();
+
+	msg.firstProtected = rand();
+	msg.nProtected = 1 + rand() % DEX_TLM_MAX_PARITY_BLOCK;
+	if ( type == DEX_TLM_PARITY ) {
+		msg.paritySize = rand() % ( DEX_TLM_MAX_RECORD_SIZE + 1 );
+		for ( i = 0; i < msg.nProtected; i++ ) msg.protectedSize[i] = rand() % ( msg.paritySize + 1 );
+		for ( i = 0; i < msg.paritySize; i++ ) msg.parity[i] = (unsigned char) rand();
+	}
+
+	if ( type == DEX_TLM_STATE_CHANGE ) msg.changed = rand() % 4;
+
+	if ( type == DEX_TLM_RECORDING_PACKED ) {
+		msg.packedSize = rand() % ( DEX_TLM_MAX_PACKED + 1 );
+		msg.count = rand() % ( msg.packedSize + 1 );
+		for ( i = 0; i < msg.packedSize; i++ ) msg.packed[i] = (unsigned char) rand();
+	}
+
+}
+
+// Compare the fields that go with the type.
+int SameMessage( DexTelemetryMessage &a, DexTelemetryMessage &b ) {
+
+	if ( a.type != b.type || a.sequence != b.sequence || a.time != b.time ) return( 0 );
+
+	switch ( a.type ) {
+	case DEX_TLM_CONFIGURATION:
+		return( a.codas == b.codas && a.nTargets == b.nTargets && a.posture == b.posture 
+			&& a.targetBar == b.targetBar && a.tappingSurface == b.tappingSurface );
+	case DEX_TLM_STATE:
+		return( a.acquisition == b.acquisition && a.visibility == b.visibility && a.targets == b.targets
+			&& !memcmp( a.position, b.position, sizeof( a.position ) ) 
+			&& !memcmp( a.orientation, b.orientation, sizeof( a.orientation ) ) );
+	case DEX_TLM_STATE_CHANGE:
+		return( a.acquisition == b.acquisition && a.visibility == b.visibility && a.targets == b.targets && a.changed == b.changed
+			&& ( !( a.changed & DEX_TLM_POSITION_CHANGED ) || !memcmp( a.position, b.position, sizeof( a.position ) ) )
+			&& ( !( a.changed & DEX_TLM_ORIENTATION_CHANGED ) || !memcmp( a.orientation, b.orientation, sizeof( a.orientation ) ) ) );
+	case DEX_TLM_EVENT:
+		return( a.clock == b.clock && a.length == b.length && !memcmp( a.text, b.text, a.length ) );
+	case DEX_TLM_RECORDING_START:
+	case DEX_TLM_RECORDING_END:
+		return( a.recording == b.recording && a.samples == b.samples );
+	case DEX_TLM_RECORDING_RECORD:
+		return( a.recording == b.recording && a.first == b.first && a.count == b.count 
+			&& !memcmp( a.data, b.data, a.count * DEX_TLM_FLOATS_PER_SAMPLE * sizeof( float ) ) );
+	case DEX_TLM_NACK:
+		return( a.nNacks == b.nNacks && !memcmp( a.nack, b.nack, a.nNacks * sizeof( a.nack[0] ) ) );
+	case DEX_TLM_ACK:
+		return( a.recording == b.recording && a.acknowledged == b.acknowledged );
+	case DEX_TLM_PARITY:
+		return( a.firstProtected == b.firstProtected && a.nProtected == b.nProtected && a.paritySize == b.paritySize
+			&& !memcmp( a.protectedSize, b.protectedSize, a.nProtected * sizeof( a.protectedSize[0] ) )
+			&& !memcmp( a.parity, b.parity, a.paritySize ) );
+	case DEX_TLM_RECORDING_PACKED:
+		return( a.recording == b.recording && a.first == b.first && a.count == b.count 
+			&& a.packedSize == b.packedSize && !memcmp( a.packed, b.packed, a.packedSize ) );
+	}
+	return( 1 );
+
+}
+
+/*********************************************************************************/
+
+// The same packet as DexMonitorServer sends it when it is not using the binary 
+// format. Returns the size of the packet.
+int MakeText( char *text, DexTelemetryMessage &msg ) {
+
+	time_t wall_clock = (time_t) msg.clock;
+	struct tm *when;
+
+	memset( text, 0, DEX_UDP_PACKET_SIZE );
+	switch ( msg.type ) {
+	case DEX_TLM_QUIT:
+		sprintf( text, "DEX_QUIT\n" );
+		break;
+	case DEX_TLM_CONFIGURATION:
+		sprintf( text, "DEX_CONFIGURATION %8u %1d %2d [%d %d %d]", 
+			(unsigned int) msg.sequence, msg.codas, msg.nTargets, msg.posture, msg.targetBar, msg.tappingSurface );
+		break;
+	case DEX_TLM_STATE:
+		sprintf( text, "DEX_STATE %8u (%1d) | 0x%08x | %1d < %.3f %.3f %.3f >  [ %.3f %.3f %.3f %.3f ] ", 
+			(unsigned int) msg.sequence, msg.acquisition, (unsigned int) msg.targets, msg.visibility, 
+			msg.position[0], msg.position[1], msg.position[2], 
+			msg.orientation[0], msg.orientation[1], msg.orientation[2], msg.orientation[3] );
+		break;
+	case DEX_TLM_EVENT:
+		when = localtime( &wall_clock );
+		sprintf( text, "DEX_EVENT %8u %4d/%02d/%02d %02d:%02d:%02d * %.*s", (unsigned int) msg.sequence, 
+			when->tm_year + 1900, when->tm_mon + 1, when->tm_mday, when->tm_hour, when->tm_min, when->tm_sec, 
+			( msg.length < 1000 ? msg.length : 1000 ), msg.text );
+		break;
+	case DEX_TLM_RECORDING_START:
+		sprintf( text, "DEX_RECORDING_START %8u %d", (unsigned int) msg.recording, msg.samples );
+		break;
+	case DEX_TLM_RECORDING_END:
+		sprintf( text, "DEX_RECORDING_END %8u %d", (unsigned int) msg.recording, msg.samples );
+		break;
+	case DEX_TLM_RECORDING_RECORD:
+		sprintf( text, "DEX_RECORDING_RECORD %8d", msg.count );
+		memcpy( text + DEX_UDP_HEADER_SIZE, msg.data, msg.count * DEX_FLOATS_PER_SAMPLE * sizeof( float ) );
+		return( DEX_UDP_HEADER_SIZE + msg.count * DEX_FLOATS_PER_SAMPLE * sizeof( float ) );
+	}
+	return( strlen( text ) + 1 );
+
+}
+
+// Compare the fields that the text packets carry. Floats are written with 3 decimals.
+int SameText( DexTelemetryMessage &a, DexTelemetryMessage &b ) {
+
+	int i;
+
+	if ( a.type != b.type ) return( 0 );
+	switch ( a.type ) {
+	case DEX_TLM_STATE:
+		for ( i = 0; i < 3; i++ ) if ( fabs( a.position[i] - b.position[i] ) > 0.0006 ) return( 0 );
+		for ( i = 0; i < 4; i++ ) if ( fabs( a.orientation[i] - b.orientation[i] ) > 0.0006 ) return( 0 );
+		return( a.acquisition == b.acquisition && a.visibility == b.visibility && a.targets == b.targets );
+	case DEX_TLM_EVENT:
+		return( a.clock == b.clock && b.length == ( a.length < 1000 ? a.length : 1000 ) && !memcmp( a.text, b.text, b.length ) );
+	case DEX_TLM_RECORDING_RECORD:
+		return( a.count == b.count && !memcmp( a.data, b.data, a.count * DEX_TLM_FLOATS_PER_SAMPLE * sizeof( float ) ) );
+	case DEX_TLM_CONFIGURATION:
+		return( a.codas == b.codas && a.nTargets == b.nTargets && a.posture == b.posture 
+			&& a.targetBar == b.targetBar && a.tappingSurface == b.tappingSurface );
+	case DEX_TLM_RECORDING_START:
+	case DEX_TLM_RECORDING_END:
+		return( a.recording == b.recording && a.samples == b.samples );
+	}
+	return( 1 );
+
+}
+
+// What DexMonitor did with the text packets before DexTelemetryDecodeText().
+int ScanText( char *text, int size, DexTelemetryMessage &msg ) {
+
+	char token[256];
+	int counter;
+
+	sscanf( text, "%s", token );
+	if ( !strcmp( token, "DEX_STATE" ) ) {
+		if ( sscanf( text, "%s %d (%d) | %lx | %d < %f %f %f > [ %f %f %f %f ]",
+			token, &counter, &msg.acquisition, &msg.targets, &msg.visibility, 
+			&msg.position[0], &msg.position[1], &msg.position[2], 
+			&msg.orientation[0], &msg.orientation[1], &msg.orientation[2], &msg.orientation[3] ) < 12 ) return( 0 );
+		return( size );
+	}
+	if ( !strcmp( token, "DEX_RECORDING_RECORD" ) ) {
+		sscanf( text, "%s %d", token, &msg.count );
+		if ( msg.count < 0 || msg.count > DEX_SAMPLES_PER_PACKET 
+			|| DEX_UDP_HEADER_SIZE + msg.count * DEX_FLOATS_PER_SAMPLE * (int) sizeof( float ) > size ) return( 0 );
+		memcpy( msg.data, text + DEX_UDP_HEADER_SIZE, msg.count * DEX_FLOATS_PER_SAMPLE * sizeof( float ) );
+		return( size );
+	}
+	return( 0 );
+
+}
+
+// Time to decode a packet of the given type with sscanf(), from text in place 
+// and from binary, in microseconds.
+void TimeDecode( int type, double &scan_us, double &text_us, double &binary_us ) {
+
+	char text[DEX_UDP_PACKET_SIZE];
+	int text_size, binary_size, k;
+	clock_t start;
+
+	MakeMessage( original, type );
+	if ( type == DEX_TLM_RECORDING_RECORD ) original.count = DEX_TLM_MAX_SAMPLES;
+	text_size = MakeText( text, original );
+	binary_size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+
+	start = clock();
+	for ( k = 0; k < DECODE_REPEATS; k++ ) ScanText( text, text_size, decoded );
+	scan_us = (double) ( clock() - start ) / CLOCKS_PER_SEC / DECODE_REPEATS * 1e6;
+
+	start = clock();
+	for ( k = 0; k < DECODE_REPEATS; k++ ) DexTelemetryDecodeText( text, text_size, &decoded );
+	text_us = (double) ( clock() - start ) / CLOCKS_PER_SEC / DECODE_REPEATS * 1e6;
+
+	start = clock();
+	for ( k = 0; k < DECODE_REPEATS; k++ ) DexTelemetryDecode( packet, binary_size, &decoded );
+	binary_us = (double) ( clock() - start ) / CLOCKS_PER_SEC / DECODE_REPEATS * 1e6;
+
+}
+
+/*********************************************************************************/
+
+// Where DexMonitor::ParseTelemetry() puts the records, but smaller, 
+// with one more sample at the end that must never be written.
+#define RECORDING_SAMPLES	1000
+#define UNTOUCHED			-12345.0f
+
+float	recordedTime[RECORDING_SAMPLES + 1];
+float	recordedPosition[( RECORDING_SAMPLES + 1 ) * 3];
+
+// A record through the wire and then through what the monitor does with it.
+// Returns what DexTelemetryStoreRecord() returns, or 0 if the packet is refused before.
+int ReceiveRecord( DexTelemetryMessage &msg ) {
+	int size = DexTelemetryEncode( packet, sizeof( packet ), &msg );
+	if ( size <= 0 || DexTelemetryDecode( packet, size, &decoded ) != size ) return( 0 );
+	if ( decoded.type == DEX_TLM_RECORDING_PACKED ) {
+		if ( DexTelemetryUnpack( &decoded, unpacked[0], UNTOUCHED ) != decoded.count ) return( 0 );
+		return( DexTelemetryStoreRecord( &decoded, unpacked[0], recordedTime, recordedPosition, RECORDING_SAMPLES ) );
+	}
+	return( DexTelemetryStoreRecord( &decoded, decoded.data, recordedTime, recordedPosition, RECORDING_SAMPLES ) );
+}
+
+void MakeRecord( DexTelemetryMessage &msg, unsigned long first, int count ) {
+	int i;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.type = DEX_TLM_RECORDING_RECORD;
+	msg.recording = 1;
+	msg.first = (int) first;
+	msg.count = count;
+	for ( i = 0; i < count * DEX_TLM_FLOATS_PER_SAMPLE; i++ ) msg.data[i] = (float) i;
+}
+
+// Records at the end of the recording and beyond, including those whose end 
+// does not fit in an int. Returns the number of errors.
+int RecordsOutOfRange( void ) {
+
+	DexTelemetryMessage msg;
+	DexTelemetryPredictor predictor;
+	float invisible[DEX_TLM_FLOATS_PER_SAMPLE] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	int i, result, errors = 0;
+
+	for ( i = 0; i <= RECORDING_SAMPLES; i++ ) recordedTime[i] = UNTOUCHED;
+	for ( i = 0; i < ( RECORDING_SAMPLES + 1 ) * 3; i++ ) recordedPosition[i] = UNTOUCHED;
+
+	// The last record that fits, then one sample too many.
+	MakeRecord( msg, RECORDING_SAMPLES - DEX_TLM_MAX_SAMPLES, DEX_TLM_MAX_SAMPLES );
+	result = ReceiveRecord( msg );
+	if ( result != DEX_TLM_MAX_SAMPLES ) errors++;
+	if ( recordedTime[RECORDING_SAMPLES - 1] != msg.data[( DEX_TLM_MAX_SAMPLES - 1 ) * DEX_TLM_FLOATS_PER_SAMPLE] ) errors++;
+	if ( recordedPosition[RECORDING_SAMPLES * 3 - 1] != msg.data[DEX_TLM_MAX_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE - 1] ) errors++;
+	printf( "Record of samples %d to %d: %d stored.\n", msg.first, msg.first + msg.count - 1, result );
+	MakeRecord( msg, RECORDING_SAMPLES - DEX_TLM_MAX_SAMPLES + 1, DEX_TLM_MAX_SAMPLES );
+	result = ReceiveRecord( msg );
+	if ( result != DEX_TLM_OVERFLOW ) errors++;
+	printf( "Record of samples %d to %d: %d.\n", msg.first, msg.first + msg.count - 1, result );
+
+	// Far beyond, where first + count no longer fits in an int.
+	MakeRecord( msg, 0x7fffff90, DEX_TLM_MAX_SAMPLES );
+	result = ReceiveRecord( msg );
+	if ( result != DEX_TLM_OVERFLOW ) errors++;
+	printf( "Record of %d samples from 0x%08x: %d.\n", msg.count, msg.first, result );
+	MakeRecord( msg, 0xffffffffUL, 1 );
+	result = ReceiveRecord( msg );
+	if ( result != DEX_TLM_OVERFLOW ) errors++;
+	printf( "Record of %d sample from 0x%08x on the wire: %d.\n", msg.count, 0xffffffffU, result );
+
+	// Packed records can hold many more samples.
+	DexTelemetryPackStart( &msg, &predictor, 0x7fffff00 );
+	msg.recording = 1;
+	for ( i = 0; i < 0x200; i++ ) DexTelemetryPackSample( &msg, &predictor, invisible, 0 );
+	result = ReceiveRecord( msg );
+	if ( result != DEX_TLM_OVERFLOW || decoded.count != 0x200 ) errors++;
+	printf( "Packed record of %d samples from 0x%08x: %d.\n", decoded.count, decoded.first, result );
+
+	if ( recordedTime[RECORDING_SAMPLES] != UNTOUCHED ) errors++;
+	for ( i = RECORDING_SAMPLES * 3; i < ( RECORDING_SAMPLES + 1 ) * 3; i++ ) if ( recordedPosition[i] != UNTOUCHED ) errors++;
+	for ( i = 0; i < RECORDING_SAMPLES - DEX_TLM_MAX_SAMPLES; i++ ) if ( recordedTime[i] != UNTOUCHED ) errors++;
+
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// A packet goes one way or the other, unless it is lost.
+// The receiver notes which packet of which recording it was given to process.
+
+bool Lost( void ) {
+	return( rand() < loss * RAND_MAX );
+}
+
+bool Deliver( const unsigned char *data, int size ) {
+	int i;
+	now++;
+	if ( Lost() ) return( false );
+	if ( DexTelemetryDecode( data, size, &decoded ) != size || decoded.recording >= LINK_RECORDINGS ) return( false );
+	if ( !DexTelemetryReceiverAccept( &receiver, &decoded ) ) return( false );
+	// Only the records say where they go.
+	if ( decoded.type == DEX_TLM_RECORDING_START ) i = 0;
+	else if ( decoded.type == DEX_TLM_RECORDING_END ) i = LINK_PACKETS - 1;
+	else i = decoded.first;
+	delivered[decoded.recording][i]++;
+	if ( firstArrival < 0 ) firstArrival = decoded.recording * LINK_PACKETS + i;
+	return( true );
+}
+
+// As DexMonitorServerUDP sends a packet: it keeps a copy and notes the time.
+void Send( DexTelemetryMessage &msg ) {
+	int size = DexTelemetryEncode( packet, sizeof( packet ), &msg );
+	DexTelemetrySenderKeep( &sender, packet, size );
+	sender.lastTime = now;
+	if ( Deliver( packet, size ) ) firstPass++;
+}
+
+// Let the receiver ask for what it is missing and the sender answer as 
+// DexMonitorServerUDP::ServiceReplies() does, probing with the end packet
+// if the receiver stays silent, until the sender has its acknowledgement
+// or gives up.
+
+void Settle( void ) {
+
+	DexTelemetryMessage reply;
+	unsigned char copy[DEX_TLM_MAX_PACKET_SIZE];
+	unsigned long sequence;
+	int step, i, size;
+
+	for ( step = 0; step < 1000 && DexTelemetrySenderPending( &sender ); step++ ) {
+		now += 10;
+		while ( DexTelemetryReceiverReply( &receiver, &reply, now ) ) {
+			if ( Lost() ) continue;
+			size = DexTelemetryEncode( copy, sizeof( copy ), &reply );
+			if ( DexTelemetryDecode( copy, size, &reply ) != size ) continue;
+			if ( reply.type == DEX_TLM_NACK ) {
+				for ( i = 0; i < reply.nNacks; i++ ) {
+					size = DexTelemetrySenderCopy( &sender, reply.nack[i], copy );
+					if ( size <= 0 ) continue;
+					sender.lastTime = now;
+					Deliver( copy, size );
+				}
+			}
+			else DexTelemetrySenderAcknowledge( &sender, &reply );
+		}
+		if ( DexTelemetrySenderProbe( &sender, now, 1, &sequence ) ) {
+			size = DexTelemetrySenderCopy( &sender, sequence, copy );
+			if ( size > 0 ) Deliver( copy, size );
+		}
+	}
+
+}
+
+// Send recordings through a link that loses the given fraction of the packets 
+// in both directions, starting with the numbers about to wrap around. Each packet
+// has to be processed exactly once, unless the receiver gave up on it after 
+// DEX_TLM_NACK_RETRIES requests, or it was lost before the first one arrived, which
+// the receiver cannot know about. Every recording has to be acknowledged, and 
+// without loss nothing is sent twice. Returns the number of errors.
+
+int ReliableDelivery( double fraction ) {
+
+	unsigned long sequence = 0xffffffffUL - LINK_RECORDINGS * LINK_PACKETS / 2;
+	int recording, i, size, errors = 0, missing = 0;
+	DexTelemetryMessage msg;
+
+	loss = fraction;
+	now = 0;
+	DexTelemetryReceiverInit( &receiver );
+	DexTelemetrySenderInit( &sender );
+	memset( delivered, 0, sizeof( delivered ) );
+	firstArrival = -1;
+	firstPass = 0;
+
+	for ( recording = 0; recording < LINK_RECORDINGS; recording++ ) {
+		for ( i = 0; i < LINK_PACKETS; i++ ) {
+			msg.type = ( i == 0 ? DEX_TLM_RECORDING_START : ( i == LINK_PACKETS - 1 ? DEX_TLM_RECORDING_END : DEX_TLM_RECORDING_RECORD ) );
+			msg.flags = DEX_TLM_RELIABLE;
+			msg.sequence = DEX_TLM_SEQUENCE( sequence++ );
+			msg.time = now;
+			msg.recording = recording;
+			msg.samples = LINK_PACKETS;
+			msg.first = i;
+			msg.count = 0;
+			Send( msg );
+		}
+		Settle();
+	}
+
+	for ( recording = 0; recording < LINK_RECORDINGS; recording++ ) {
+		for ( i = 0; i < LINK_PACKETS; i++ ) {
+			if ( delivered[recording][i] > 1 ) errors++;
+			else if ( delivered[recording][i] == 0 && recording * LINK_PACKETS + i > firstArrival ) missing++;
+		}
+	}
+	if ( missing > (int) receiver.abandoned ) errors += missing - receiver.abandoned;
+	if ( sender.completed != LINK_RECORDINGS ) errors++;
+	if ( fraction == 0.0 && sender.retransmitted ) errors++;
+	retransmissions = sender.retransmitted;
+
+	// Only the packets still in the window can be sent again, flagged as copies,
+	// and a copy that comes back through the queue is not kept over the original.
+	size = DexTelemetrySenderCopy( &sender, DEX_TLM_SEQUENCE( sender.sent - 1 ), packet );
+	if ( size <= 0 || DexTelemetryDecodeHeader( packet, size, &msg ) != size || !( msg.flags & DEX_TLM_RETRANSMITTED ) ) errors++;
+	sequence = sender.sent;
+	DexTelemetrySenderKeep( &sender, packet, size );
+	if ( sender.sent != sequence ) errors++;
+	if ( DexTelemetrySenderCopy( &sender, DEX_TLM_SEQUENCE( sender.sent - DEX_TLM_WINDOW - 1 ), packet ) ) errors++;
+
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// Send full recording packets in blocks followed by their parity, through a link
+// that loses the given fraction of all packets. Returns the fraction of the lost 
+// recording packets that were rebuilt, or -1 if one was rebuilt wrong. 
+// Also gives the time to compute the parity and to rebuild, per packet sent.
+
+double ParityRecovery( int block, double fraction, double &encode_us, double &decode_us ) {
+
+	DexTelemetryMessage parity;
+	unsigned char rebuilt[DEX_TLM_MAX_RECORD_SIZE];
+	int first, i, k, size, lost = 0, recovered = 0, wrong = 0;
+	clock_t start;
+
+	loss = fraction;
+	DexTelemetryRepairInit( &repair );
+	encode_us = decode_us = 0.0;
+
+	for ( first = 0; first < PARITY_PACKETS; first += block ) {
+
+		int n = ( PARITY_PACKETS - first < block ? PARITY_PACKETS - first : block );
+		bool arrived[DEX_TLM_MAX_PARITY_BLOCK];
+
+		start = clock();
+		for ( k = 0; k < PARITY_REPEATS; k++ ) {
+			parity.nProtected = 0;
+			for ( i = 0; i < n; i++ ) DexTelemetryParityAdd( &parity, records[first + i], recordSize[first + i], first + i );
+			size = DexTelemetryEncode( packet, sizeof( packet ), &parity );
+		}
+		encode_us += (double) ( clock() - start ) / CLOCKS_PER_SEC / PARITY_REPEATS;
+
+		for ( i = 0; i < n; i++ ) {
+			arrived[i] = !Lost();
+			if ( arrived[i] ) DexTelemetryRepairKeep( &repair, records[first + i], recordSize[first + i], first + i );
+			else lost++;
+		}
+		if ( Lost() ) continue;
+
+		DexTelemetryDecode( packet, size, &decoded );
+		start = clock();
+		for ( k = 0; k < PARITY_REPEATS; k++ ) size = DexTelemetryRepairRebuild( &repair, &decoded, rebuilt );
+		decode_us += (double) ( clock() - start ) / CLOCKS_PER_SEC / PARITY_REPEATS;
+		if ( size > 0 ) {
+			for ( i = 0; i < n && arrived[i]; i++ );
+			if ( size != recordSize[first + i] || memcmp( rebuilt, records[first + i], size ) ) wrong++;
+			else recovered++;
+		}
+
+	}
+
+	encode_us *= 1e6 / PARITY_PACKETS;
+	decode_us *= 1e6 / PARITY_PACKETS;
+	if ( wrong ) return( -1.0 );
+	return( lost ? (double) recovered / lost : 1.0 );
+
+}
+
+// Renumber a block of protected packets and its parity, as DexTelemetryReplay 
+// does on each pass, then lose each packet in turn, with the next one arriving
+// as a retransmitted copy. It must come back as renumbered. Returns the number 
+// of packets that do not.
+
+int RenumberedParity( int block, unsigned long offset ) {
+
+	static unsigned char renumbered[DEX_TLM_MAX_PARITY_BLOCK][DEX_TLM_MAX_RECORD_SIZE];
+	unsigned long sequence[DEX_TLM_MAX_PARITY_BLOCK];
+	DexTelemetryMessage parity;
+	unsigned char rebuilt[DEX_TLM_MAX_RECORD_SIZE];
+	unsigned char copy[DEX_TLM_MAX_RECORD_SIZE];
+	int i, j, size, errors = 0;
+
+	parity.nProtected = 0;
+	for ( i = 0; i < block; i++ ) DexTelemetryParityAdd( &parity, records[i], recordSize[i], i );
+	size = DexTelemetryEncode( packet, sizeof( packet ), &parity );
+	if ( DexTelemetryRenumber( packet, size, offset ) != size ) errors++;
+	DexTelemetryDecode( packet, size, &decoded );
+	// The numbers are 32 bits on the wire, whatever the size of a long.
+	if ( ( decoded.firstProtected ^ offset ) & 0xffffffffUL ) errors++;
+
+	for ( i = 0; i < block; i++ ) {
+		memcpy( renumbered[i], records[i], recordSize[i] );
+		if ( DexTelemetryRenumber( renumbered[i], recordSize[i], offset ) != recordSize[i] ) errors++;
+		DexTelemetryDecodeHeader( renumbered[i], recordSize[i], &original );
+		sequence[i] = original.sequence;
+		if ( ( sequence[i] ^ ( i + offset ) ) & 0xffffffffUL ) errors++;
+	}
+	for ( i = 0; i < block; i++ ) {
+		DexTelemetryRepairInit( &repair );
+		for ( j = 0; j < block; j++ ) {
+			if ( j == ( i + 1 ) % block ) {
+				memcpy( copy, renumbered[j], recordSize[j] );
+				DexTelemetrySetFlags( copy, DEX_TLM_RETRANSMITTED );
+				DexTelemetryRepairKeep( &repair, copy, recordSize[j], sequence[j] );
+			}
+			else if ( j != i ) DexTelemetryRepairKeep( &repair, renumbered[j], recordSize[j], sequence[j] );
+		}
+		size = DexTelemetryRepairRebuild( &repair, &decoded, rebuilt );
+		if ( size != recordSize[i] || memcmp( rebuilt, renumbered[i], size ) ) errors++;
+	}
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+double Gaussian( void ) {
+	double u1 = ( rand() + 1.0 ) / ( RAND_MAX + 2.0 );
+	double u2 = ( rand() + 1.0 ) / ( RAND_MAX + 2.0 );
+	return( sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * 3.14159265358979 * u2 ) );
+}
+
+// Something like what DexSyntheticTracker produces: the manipulandum going up 
+// and down by 100 mm once a second, either smoothly or in discrete movements 
+// with a pause at each end, with noise on each coordinate and the odd occlusion.
+
+void MakeTrial( bool discrete, double jitter ) {
+
+	double t, phase, excursion;
+	int i, j, hidden = 0;
+
+	for ( i = 0; i < TRIAL_SAMPLES; i++ ) {
+		t = i * 0.005;
+		if ( discrete ) {
+			phase = 2.0 * ( t - floor( t ) );
+			excursion = ( phase < 1.0 ? phase : 2.0 - phase ) * 2.0;
+			if ( excursion > 1.0 ) excursion = 1.0;
+			excursion = excursion * excursion * excursion * ( 10.0 - 15.0 * excursion + 6.0 * excursion * excursion );
+			excursion = 100.0 * excursion - 50.0;
+		}
+		else excursion = 50.0 * sin( 2.0 * 3.14159265358979 * t );
+		trial[i][0] = (float) t;
+		trial[i][1] = (float) ( 150.0 + jitter * Gaussian() );
+		trial[i][2] = (float) ( 200.0 + excursion + jitter * Gaussian() );
+		trial[i][3] = (float) ( -300.0 + 0.1 * excursion + jitter * Gaussian() );
+		// About 2% of the samples lost in runs of 20.
+		if ( hidden == 0 && rand() % 1000 == 0 ) hidden = 20;
+		trialVisible[i] = ( hidden == 0 );
+		if ( hidden > 0 ) {
+			hidden--;
+			for ( j = 1; j < DEX_TLM_FLOATS_PER_SAMPLE; j++ ) trial[i][j] = 0.0f;
+		}
+	}
+
+}
+
+// Send the trial in packed records and check that each sample comes back to 
+// within half a quantum. Returns the number that do not. Also gives the bytes 
+// sent (headers included) and the time to pack and to unpack, per sample.
+
+int PackTrial( int &bytes, int &packets, double &pack_us, double &unpack_us ) {
+
+	DexTelemetryPredictor predictor;
+	int sample, i, j, n, errors = 0;
+	clock_t start;
+
+	bytes = packets = 0;
+	pack_us = unpack_us = 0.0;
+	DexTelemetryPackStart( &original, &predictor, 0 );
+	for ( sample = 0; sample < TRIAL_SAMPLES; ) {
+
+		if ( DexTelemetryPackSample( &original, &predictor, trial[sample], trialVisible[sample] ) ) sample++;
+		if ( sample < TRIAL_SAMPLES && original.count < 0xffff && original.packedSize + DEX_TLM_MAX_PACKED_SAMPLE <= DEX_TLM_MAX_PACKED ) continue;
+
+		// Time the packing of a full packet again, without the extra checks.
+		start = clock();
+		for ( n = 0; n < TRIAL_REPEATS; n++ ) {
+			DexTelemetryPackStart( &decoded, &predictor, original.first );
+			for ( i = 0; i < original.count; i++ ) DexTelemetryPackSample( &decoded, &predictor, trial[original.first + i], trialVisible[original.first + i] );
+		}
+		pack_us += (double) ( clock() - start ) / CLOCKS_PER_SEC / TRIAL_REPEATS;
+
+		original.recording = 1;
+		original.sequence = packets++;
+		bytes += DexTelemetryEncode( packet, sizeof( packet ), &original );
+		if ( DexTelemetryDecode( packet, sizeof( packet ), &decoded ) <= 0 ) return( TRIAL_SAMPLES );
+
+		start = clock();
+		for ( n = 0; n < TRIAL_REPEATS; n++ ) i = DexTelemetryUnpack( &decoded, unpacked[0], -999.999f );
+		unpack_us += (double) ( clock() - start ) / CLOCKS_PER_SEC / TRIAL_REPEATS;
+		if ( i != decoded.count ) return( TRIAL_SAMPLES );
+
+		for ( i = 0; i < decoded.count; i++ ) {
+			float *expected = trial[decoded.first + i];
+			bool ok = ( fabs( unpacked[i][0] - expected[0] ) <= 0.51 * DEX_TLM_TIME_QUANTUM + 1e-5 );
+			for ( j = 1; j < DEX_TLM_FLOATS_PER_SAMPLE; j++ ) {
+				if ( trialVisible[decoded.first + i] ) ok = ok && ( fabs( unpacked[i][j] - expected[j] ) <= 0.51 * DEX_TLM_POSITION_QUANTUM + 1e-4 );
+				else ok = ok && ( unpacked[i][j] == -999.999f );
+			}
+			if ( !ok ) errors++;
+		}
+
+		DexTelemetryPackStart( &original, &predictor, sample );
+
+	}
+
+	pack_us *= 1e6 / TRIAL_SAMPLES;
+	unpack_us *= 1e6 / TRIAL_SAMPLES;
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// State updates, as SendState() hands them to the filter every STATE_STEP ms.
+
+#define STATE_STEP		10
+#define STATE_TRIAL		3000
+
+// As set by DexMonitorServer.
+#define DEX_STATE_POSITION_DEADBAND		1.0
+#define DEX_STATE_ORIENTATION_DEADBAND	0.002
+#define DEX_STATE_INTERVAL				50
+#define DEX_STATE_KEYFRAME				1000
+
+DexTelemetryStateFilter	stateFilter;
+DexTelemetryMessage		display;
+
+void MakeState( DexTelemetryMessage &msg, int acquisition, unsigned long targets, int visibility, double x, double q ) {
+	msg.type = DEX_TLM_STATE;
+	msg.acquisition = acquisition;
+	msg.targets = targets;
+	msg.visibility = visibility;
+	msg.position[0] = (float) x;
+	msg.position[1] = 200.0f;
+	msg.position[2] = 300.0f;
+	msg.orientation[0] = (float) q;
+	msg.orientation[1] = 0.0f;
+	msg.orientation[2] = 0.0f;
+	msg.orientation[3] = 1.0f;
+}
+
+// What the monitor does with a state that arrives.
+void ShowState( DexTelemetryMessage &msg ) {
+	int i;
+	display.acquisition = msg.acquisition;
+	display.targets = msg.targets;
+	display.visibility = msg.visibility;
+	if ( msg.type == DEX_TLM_STATE || ( msg.changed & DEX_TLM_POSITION_CHANGED ) ) {
+		for ( i = 0; i < 3; i++ ) display.position[i] = msg.position[i];
+	}
+	if ( msg.type == DEX_TLM_STATE || ( msg.changed & DEX_TLM_ORIENTATION_CHANGED ) ) {
+		for ( i = 0; i < 4; i++ ) display.orientation[i] = msg.orientation[i];
+	}
+}
+
+// The display has to show what the filter believes was sent.
+bool ShowsWhatWasSent( void ) {
+	int i;
+	if ( display.acquisition != stateFilter.acquisition || display.targets != stateFilter.targets 
+		|| display.visibility != stateFilter.visibility ) return( false );
+	for ( i = 0; i < 3; i++ ) if ( display.position[i] != stateFilter.position[i] ) return( false );
+	for ( i = 0; i < 4; i++ ) if ( display.orientation[i] != stateFilter.orientation[i] ) return( false );
+	return( true );
+}
+
+// Feed the filter one state and check what it decides against what is expected:
+// 0 for nothing, otherwise the type and the parts of the pose that go with it.
+int ExpectState( unsigned long t, int expected_type, unsigned int expected_changed ) {
+	int type = DexTelemetryFilterState( &stateFilter, &original, t );
+	if ( type != expected_type ) return( 1 );
+	if ( type && ( original.type != type || original.changed != expected_changed ) ) return( 1 );
+	return( 0 );
+}
+
+// Each decision of the filter on its own. Returns the number of errors.
+int StateDecisions( void ) {
+
+	unsigned long t, last, keyframe;
+	int sent, errors = 0;
+	const unsigned int both = DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED;
+
+	DexTelemetryStateFilterInit( &stateFilter, DEX_STATE_POSITION_DEADBAND, DEX_STATE_ORIENTATION_DEADBAND, DEX_STATE_INTERVAL, DEX_STATE_KEYFRAME );
+
+	// Still, give or take less than the deadbands: a keyframe each second and nothing else.
+	for ( t = 0; t < STATE_TRIAL; t += STATE_STEP ) {
+		MakeState( original, 1, 0x01, 1, 0.45 * DEX_STATE_POSITION_DEADBAND * ( t % 20 ? 1 : -1 ), 
+			0.45 * DEX_STATE_ORIENTATION_DEADBAND * ( t % 30 ? 1 : -1 ) );
+		if ( t % DEX_STATE_KEYFRAME == 0 ) errors += ExpectState( t, DEX_TLM_STATE, ( t == 0 ? both : 0 ) );
+		else errors += ExpectState( t, 0, 0 );
+	}
+	if ( stateFilter.suppressed != STATE_TRIAL / STATE_STEP - STATE_TRIAL / DEX_STATE_KEYFRAME ) errors++;
+	printf( "Still within the deadbands: %lu of %d states suppressed.\n", stateFilter.suppressed, STATE_TRIAL / STATE_STEP );
+
+	// Moving, but the pose goes out no more than once per interval and only what moved.
+	last = t - DEX_STATE_INTERVAL;
+	for ( sent = 0; t < 2 * STATE_TRIAL; t += STATE_STEP ) {
+		MakeState( original, 1, 0x01, 1, t / 10.0, 0.0 );
+		switch ( DexTelemetryFilterState( &stateFilter, &original, t ) ) {
+		case DEX_TLM_STATE:
+			if ( t % DEX_STATE_KEYFRAME ) errors++;
+			sent++;
+			break;
+		case DEX_TLM_STATE_CHANGE:
+			if ( t - last < DEX_STATE_INTERVAL || original.changed != DEX_TLM_POSITION_CHANGED ) errors++;
+			last = t;
+			sent++;
+			break;
+		}
+	}
+	if ( sent != STATE_TRIAL / DEX_STATE_INTERVAL ) errors++;
+	printf( "Moving 100 mm/s: %d of %d states sent.\n", sent, STATE_TRIAL / STATE_STEP );
+
+	// Changes to the acquisition, targets and visibility do not wait for the interval, 
+	// even with the pose still. The pose goes along when the manipulandum reappears.
+	MakeState( original, 1, 0x01, 1, 0.0, 0.0 );
+	errors += ExpectState( keyframe = t, DEX_TLM_STATE, DEX_TLM_POSITION_CHANGED );
+	original.targets = 0x02;
+	errors += ExpectState( t += STATE_STEP, DEX_TLM_STATE_CHANGE, 0 );
+	errors += ExpectState( t += STATE_STEP, 0, 0 );
+	original.acquisition = 0;
+	errors += ExpectState( t += STATE_STEP, DEX_TLM_STATE_CHANGE, 0 );
+	original.visibility = 0;
+	original.position[0] = 50.0f;
+	errors += ExpectState( t += STATE_STEP, DEX_TLM_STATE_CHANGE, 0 );
+	errors += ExpectState( t += STATE_STEP, 0, 0 );
+	original.visibility = 1;
+	errors += ExpectState( t += STATE_STEP, DEX_TLM_STATE_CHANGE, both );
+	errors += ExpectState( t += STATE_STEP, 0, 0 );
+	// The keyframe comes a whole interval after the last one, whatever went in between.
+	errors += ExpectState( t = keyframe + DEX_STATE_KEYFRAME - 1, 0, 0 );
+	errors += ExpectState( ++t, DEX_TLM_STATE, 0 );
+
+	// With everything at zero, every state goes out as a keyframe.
+	DexTelemetryStateFilterInit( &stateFilter, 0.0, 0.0, 0, 0 );
+	for ( sent = 0; sent < 10; sent++ ) errors += ExpectState( t, DEX_TLM_STATE, ( sent ? 0 : both ) );
+
+	printf( "Discrete changes, reappearance, keyframe timing and no filter: %d errors.\n", errors );
+	return( errors );
+
+}
+
+// Merge a state into the one that it replaces, by way of the packets in the queue.
+int MergedState( DexTelemetryMessage &newer, DexTelemetryMessage &older, DexTelemetryMessage &merged ) {
+	unsigned char older_packet[DEX_TLM_MAX_PACKET_SIZE];
+	int older_size = DexTelemetryEncode( older_packet, sizeof( older_packet ), &older );
+	int size = DexTelemetryEncode( packet, sizeof( packet ), &newer );
+	DexTelemetryDecode( packet, size, &merged );
+	DexTelemetryDecode( older_packet, older_size, &decoded );
+	DexTelemetryMergeStates( &merged, &decoded );
+	size = DexTelemetryEncode( packet, sizeof( packet ), &merged );
+	return( DexTelemetryDecode( packet, size, &merged ) == size ? 0 : 1 );
+}
+
+// Returns the number of errors.
+int StateMerges( void ) {
+
+	DexTelemetryMessage older, newer, merged;
+	int errors = 0;
+
+	// A keyframe replaced by a change keeps the pose it was sending.
+	MakeState( older, 1, 0x01, 1, 10.0, 0.1 );
+	MakeState( newer, 1, 0x02, 1, 10.5, 0.1005 );
+	newer.type = DEX_TLM_STATE_CHANGE;
+	newer.changed = 0;
+	errors += MergedState( newer, older, merged );
+	if ( merged.type != DEX_TLM_STATE || merged.targets != 0x02 
+		|| merged.position[0] != 10.0f || merged.orientation[0] != 0.1f ) errors++;
+
+	// Parts of the pose from each.
+	older.type = DEX_TLM_STATE_CHANGE;
+	older.changed = DEX_TLM_POSITION_CHANGED;
+	newer.changed = DEX_TLM_ORIENTATION_CHANGED;
+	errors += MergedState( newer, older, merged );
+	if ( merged.type != DEX_TLM_STATE_CHANGE || merged.changed != ( DEX_TLM_POSITION_CHANGED | DEX_TLM_ORIENTATION_CHANGED )
+		|| merged.position[0] != 10.0f || merged.orientation[0] != 0.1005f ) errors++;
+
+	// What is newer wins.
+	newer.changed = DEX_TLM_POSITION_CHANGED;
+	errors += MergedState( newer, older, merged );
+	if ( merged.changed != DEX_TLM_POSITION_CHANGED || merged.position[0] != 10.5f ) errors++;
+	newer.type = DEX_TLM_STATE;
+	errors += MergedState( newer, older, merged );
+	if ( merged.type != DEX_TLM_STATE || merged.position[0] != 10.5f || merged.orientation[0] != 0.1005f ) errors++;
+
+	// Anything but a state is left alone.
+	older.type = DEX_TLM_EVENT;
+	merged = newer;
+	DexTelemetryMergeStates( &merged, &older );
+	if ( !SameMessage( merged, newer ) ) errors++;
+
+	printf( "States merged in the queue: %d errors.\n", errors );
+	return( errors );
+
+}
+
+// 3 s of the manipulandum held still, with noise, except for a reach of 50 mm
+// once the target has changed and a short occlusion. Each state is passed through
+// the filter (or not) and put in a send queue that holds only the latest state.
+// The queue goes out every drain ms. What arrives is shown as the monitor shows it,
+// which has to be what the filter believes was sent. Returns the number of errors.
+int StateLink( bool filter, unsigned long drain, int &packets, int &bytes ) {
+
+	unsigned long t, keyframe = 0;
+	int size = 0, errors = 0;
+	double x, reach;
+
+	if ( filter ) DexTelemetryStateFilterInit( &stateFilter, DEX_STATE_POSITION_DEADBAND, DEX_STATE_ORIENTATION_DEADBAND, DEX_STATE_INTERVAL, DEX_STATE_KEYFRAME );
+	else DexTelemetryStateFilterInit( &stateFilter, 0.0, 0.0, 0, 0 );
+	srand( 3 );
+	packets = bytes = 0;
+
+	for ( t = 0; t <= STATE_TRIAL; t += STATE_STEP ) {
+
+		reach = ( t < 1200 ? 0.0 : t > 1600 ? 1.0 : ( 1.0 - cos( 3.14159265358979 * ( t - 1200 ) / 400.0 ) ) / 2.0 );
+		x = 50.0 * reach + 0.2 * Gaussian();
+		MakeState( original, 1, ( t < 1030 ? 0x01 : 0x02 ), ( t < 2020 || t >= 2120 ), x, 0.0005 * Gaussian() );
+		if ( DexTelemetryFilterState( &stateFilter, &original, t ) ) {
+			if ( size > 0 ) {
+				// Replace the one that is waiting.
+				DexTelemetryDecode( packet, size, &decoded );
+				DexTelemetryMergeStates( &original, &decoded );
+			}
+			size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+		}
+
+		if ( size > 0 && t % drain == 0 ) {
+			if ( DexTelemetryDecode( packet, size, &decoded ) != size ) errors++;
+			ShowState( decoded );
+			if ( !ShowsWhatWasSent() ) errors++;
+			if ( decoded.type == DEX_TLM_STATE ) keyframe = t;
+			packets++;
+			bytes += size;
+			size = 0;
+		}
+		// The display is never more than a keyframe behind.
+		if ( t - keyframe > DEX_STATE_KEYFRAME + drain ) errors++;
+
+	}
+	return( errors );
+
+}
+
+/*********************************************************************************/
+
+// Publish packets in a shared memory ring with readers that each take one packet
+// in so many published. Each packet carries its own number and the reader checks
+// that what it gets is whole, in order, and that what it read plus what it was 
+// told it lost add up to what was published. Returns the number of errors.
+int SharedRing( const int pace[], int readers, unsigned long read[], unsigned long lost[], 
+			    double &publish_us, double &read_us ) {
+
+	DexSHM			writer, reader[8];
+	char			data[DEX_UDP_PACKET_SIZE];
+	unsigned long	sequence, expected[8], reported[8], n;
+	int				size, k, j, errors = 0;
+	clock_t			start;
+
+	if ( DexSHMInitServer( &writer, SHM_NAME, SHM_SLOTS ) ) return( 1 );
+	for ( k = 0; k < readers; k++ ) {
+		if ( DexSHMInitClient( &reader[k], SHM_NAME ) ) return( 1 );
+		expected[k] = 0;
+		reported[k] = 0;
+		read[k] = 0;
+	}
+
+	for ( sequence = 0; sequence <= SHM_PACKETS; sequence++ ) {
+		if ( sequence < SHM_PACKETS ) {
+			size = sizeof( sequence ) + sequence % ( DEX_UDP_PACKET_SIZE - sizeof( sequence ) );
+			memcpy( data, &sequence, sizeof( sequence ) );
+			for ( j = sizeof( sequence ); j < size; j++ ) data[j] = (char) ( sequence + j );
+			DexSHMPublish( &writer, data, size );
+		}
+		for ( k = 0; k < readers; k++ ) {
+			// At the end, each reader takes whatever is left.
+			while ( sequence == SHM_PACKETS || sequence % pace[k] == 0 ) {
+				size = DexSHMRead( &reader[k], data );
+				if ( size == 0 ) break;
+				memcpy( &n, data, sizeof( n ) );
+				// Anything skipped must have been reported as lost.
+				if ( n < expected[k] || n - expected[k] != reader[k].lost - reported[k] ) errors++;
+				reported[k] = reader[k].lost;
+				if ( size != (int) ( sizeof( n ) + n % ( DEX_UDP_PACKET_SIZE - sizeof( n ) ) ) ) errors++;
+				for ( j = sizeof( n ); j < size; j++ ) if ( data[j] != (char) ( n + j ) ) errors++;
+				expected[k] = n + 1;
+				read[k]++;
+				if ( sequence < SHM_PACKETS ) break;
+			}
+		}
+	}
+
+	for ( k = 0; k < readers; k++ ) {
+		lost[k] = reader[k].lost;
+		if ( read[k] + lost[k] != SHM_PACKETS ) errors++;
+	}
+
+	// The time to publish a full packet, alone and then with one reader that keeps up.
+	memset( data, 0, sizeof( data ) );
+	start = clock();
+	for ( sequence = 0; sequence < SHM_PACKETS; sequence++ ) DexSHMPublish( &writer, data, sizeof( data ) );
+	publish_us = (double) ( clock() - start ) / CLOCKS_PER_SEC / SHM_PACKETS * 1e6;
+	start = clock();
+	for ( sequence = 0; sequence < SHM_PACKETS; sequence++ ) {
+		DexSHMPublish( &writer, data, sizeof( data ) );
+		DexSHMRead( &reader[0], data );
+	}
+	read_us = (double) ( clock() - start ) / CLOCKS_PER_SEC / SHM_PACKETS * 1e6 - publish_us;
+
+	for ( k = 0; k < readers; k++ ) DexSHMClose( &reader[k] );
+	DexSHMClose( &writer );
+	return( errors );
+
+}
+
+// Each packet carries its own number, and the rest is a pattern that depends on it.
+static int SharedRingPacket( char data[DEX_UDP_PACKET_SIZE], unsigned long n ) {
+	int size = sizeof( n ) + n % ( DEX_UDP_PACKET_SIZE - sizeof( n ) );
+	memcpy( data, &n, sizeof( n ) );
+	for ( int j = sizeof( n ); j < size; j++ ) data[j] = (char) ( n + j );
+	return( size );
+}
+
+// Whether a packet read from the ring is the one that was published with that number.
+static bool SharedRingPacketIsWhole( const char data[DEX_UDP_PACKET_SIZE], int size, unsigned long &n ) {
+	memcpy( &n, data, sizeof( n ) );
+	if ( size != (int) ( sizeof( n ) + n % ( DEX_UDP_PACKET_SIZE - sizeof( n ) ) ) ) return( false );
+	for ( int j = sizeof( n ); j < size; j++ ) if ( data[j] != (char) ( n + j ) ) return( false );
+	return( true );
+}
+
+typedef struct {
+	DexSHM			shm;
+	int				spin;
+	volatile LONG	*done;
+	unsigned long	read;
+	unsigned long	errors;
+} SharedRingReaderState;
+
+// A reader that runs alongside the writer, as another program would.
+static DWORD WINAPI SharedRingReader( LPVOID param ) {
+
+	SharedRingReaderState *reader = (SharedRingReaderState *) param;
+	char			data[DEX_UDP_PACKET_SIZE];
+	unsigned long	expected = reader->shm.next, reported = 0, n;
+	volatile int	i;
+	int				size;
+	LONG			finished;
+
+	for ( ;; ) {
+		// Once the writer is done, stop at the first empty read.
+		finished = InterlockedExchangeAdd( (LONG *) reader->done, 0 );
+		size = DexSHMRead( &reader->shm, data );
+		if ( size == 0 ) {
+			if ( finished ) break;
+			Sleep( 0 );
+			continue;
+		}
+		if ( !SharedRingPacketIsWhole( data, size, n ) ) reader->errors++;
+		// Anything skipped must have been reported as lost.
+		if ( n < expected || n - expected != reader->shm.lost - reported ) reader->errors++;
+		reported = reader->shm.lost;
+		expected = n + 1;
+		reader->read++;
+		for ( i = 0; i < reader->spin; i++ );
+	}
+	return( 0 );
+
+}
+
+// The same with the readers in threads of their own, so that the writer
+// overwrites slots while they are being copied. Returns the number of errors.
+int SharedRingThreads( unsigned long read[], unsigned long lost[] ) {
+
+	DexSHM					writer;
+	SharedRingReaderState	reader[SHM_THREADED_READERS];
+	HANDLE					thread[SHM_THREADED_READERS];
+	volatile LONG			done = 0;
+	char					data[DEX_UDP_PACKET_SIZE];
+	unsigned long			first, sequence;
+	int						k, errors = 0;
+
+	if ( DexSHMInitServer( &writer, SHM_NAME, SHM_SLOTS ) ) return( 1 );
+	first = writer.next;
+	for ( k = 0; k < SHM_THREADED_READERS; k++ ) {
+		if ( DexSHMInitClient( &reader[k].shm, SHM_NAME ) ) return( 1 );
+		reader[k].spin = shmSpin[k];
+		reader[k].done = &done;
+		reader[k].read = 0;
+		reader[k].errors = 0;
+		thread[k] = CreateThread( NULL, 0, SharedRingReader, &reader[k], 0, NULL );
+	}
+
+	for ( sequence = first; sequence < first + SHM_THREADED_PACKETS; sequence++ ) {
+		DexSHMPublish( &writer, data, SharedRingPacket( data, sequence ) );
+	}
+	InterlockedExchange( (LONG *) &done, 1 );
+
+	for ( k = 0; k < SHM_THREADED_READERS; k++ ) {
+		WaitForSingleObject( thread[k], INFINITE );
+		CloseHandle( thread[k] );
+		read[k] = reader[k].read;
+		lost[k] = reader[k].shm.lost;
+		errors += reader[k].errors;
+		if ( read[k] + lost[k] != SHM_THREADED_PACKETS ) errors++;
+		DexSHMClose( &reader[k].shm );
+	}
+	DexSHMClose( &writer );
+	return( errors );
+
+}
+
+int main( int argc, char *argv[] ) {
+
+	int type, trial, size, result, i;
+	int failures = 0;
+	int accepted = 0, rejected = 0;
+	char text[DEX_UDP_PACKET_SIZE];
+
+	srand( 1 );
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Round trip of each type of packet.\n\n" );
+
+	for ( type = DEX_TLM_QUIT; type <= DEX_TLM_STATE_CHANGE; type++ ) {
+		int errors = 0;
+		for ( trial = 0; trial < 1000; trial++ ) {
+			MakeMessage( original, type );
+			size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+			result = DexTelemetryDecode( packet, size, &decoded );
+			if ( size <= 0 || result != size || !SameMessage( original, decoded ) ) errors++;
+		}
+		printf( "Type %d: %d errors  (last packet %d bytes)\n", type, errors, size );
+		failures += errors;
+	}
+
+	// The size of a state packet in each format.
+	MakeMessage( original, DEX_TLM_STATE );
+	size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+	sprintf( text, "DEX_STATE %8u (%1d) | 0x%08x | %1d < %.3f %.3f %.3f >  [ %.3f %.3f %.3f %.3f ] ", 
+		(unsigned int) original.sequence, original.acquisition, (unsigned int) original.targets, original.visibility, 
+		original.position[0], original.position[1], original.position[2], 
+		original.orientation[0], original.orientation[1], original.orientation[2], original.orientation[3] );
+	printf( "\nState: %d bytes binary, %d bytes of text in a %d byte packet.\n", size, (int) strlen( text ) + 1, DEX_UDP_PACKET_SIZE );
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Decoding damaged packets.\n\n" );
+
+	// Start from a valid packet and flip bytes, cut it short or both. 
+	// The decoder has to either reject it or return something that fits in what it was given.
+	for ( trial = 0; trial < FUZZ_TRIALS; trial++ ) {
+
+		MakeMessage( original, DEX_TLM_QUIT + rand() % ( DEX_TLM_STATE_CHANGE - DEX_TLM_QUIT + 1 ) );
+		size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+		memcpy( damaged, packet, size );
+
+		switch ( rand() % 4 ) {
+		case 0:
+			for ( i = rand() % 4; i >= 0; i-- ) damaged[rand() % size] = (unsigned char) rand();
+			break;
+		case 1:
+			size = rand() % ( size + 1 );
+			break;
+		case 2:
+			// Target the header, where the lengths are.
+			damaged[rand() % DEX_TLM_HEADER_SIZE] = (unsigned char) rand();
+			break;
+		case 3:
+			for ( i = 0; i < size; i++ ) damaged[i] = (unsigned char) rand();
+			if ( rand() % 2 ) damaged[0] = DEX_TLM_MAGIC0, damaged[1] = DEX_TLM_MAGIC1, damaged[2] = DEX_TLM_VERSION;
+			break;
+		}
+
+		// Decode from a buffer of exactly the size received, so that a memory 
+		// checker will see any read past the end.
+		unsigned char *received = (unsigned char *) malloc( size > 0 ? size : 1 );
+		memcpy( received, damaged, size );
+		result = DexTelemetryDecode( received, size, &decoded );
+		free( received );
+		if ( result > 0 ) {
+			accepted++;
+			if ( result > size 
+				|| ( decoded.type == DEX_TLM_RECORDING_RECORD && ( decoded.count < 0 || decoded.count > DEX_TLM_MAX_SAMPLES ) )
+				|| ( decoded.type == DEX_TLM_EVENT && ( decoded.length < 0 || decoded.length > DEX_TLM_MAX_TEXT ) ) 
+				|| ( decoded.type == DEX_TLM_NACK && ( decoded.nNacks < 0 || decoded.nNacks > DEX_TLM_MAX_NACKS ) )
+				|| ( decoded.type == DEX_TLM_PARITY && ( decoded.nProtected < 1 || decoded.nProtected > DEX_TLM_MAX_PARITY_BLOCK
+					|| decoded.paritySize < 0 || decoded.paritySize > DEX_TLM_MAX_RECORD_SIZE ) )
+				|| ( decoded.type == DEX_TLM_RECORDING_PACKED && ( decoded.packedSize < 0 || decoded.packedSize > DEX_TLM_MAX_PACKED
+					|| decoded.count < 0 || decoded.count > decoded.packedSize ) ) ) {
+				printf( "Trial %d: accepted a packet that does not fit (%d of %d bytes).\n", trial, result, size );
+				failures++;
+			}
+			// Whatever is in the payload, the samples have to fit in the count.
+			else if ( decoded.type == DEX_TLM_RECORDING_PACKED ) {
+				float *samples = (float *) malloc( ( decoded.count > 0 ? decoded.count : 1 ) * DEX_TLM_FLOATS_PER_SAMPLE * sizeof( float ) );
+				result = DexTelemetryUnpack( &decoded, samples, 0.0f );
+				if ( result != decoded.count && result != DEX_TLM_BAD_LENGTH ) failures++;
+				free( samples );
+			}
+		}
+		else rejected++;
+
+	}
+	printf( "%d damaged packets: %d accepted, %d rejected.\n", FUZZ_TRIALS, accepted, rejected );
+
+	{
+		printf( "\nRecords stored as by the monitor.\n\n" );
+		int errors = RecordsOutOfRange();
+		printf( "%d errors\n", errors );
+		failures += errors;
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Text packets.\n\n" );
+
+	for ( type = DEX_TLM_QUIT; type <= DEX_TLM_RECORDING_END; type++ ) {
+		int errors = 0;
+		for ( trial = 0; trial < 1000; trial++ ) {
+			MakeMessage( original, type );
+			size = MakeText( text, original );
+			result = DexTelemetryDecodeText( text, size, &decoded );
+			if ( result != size || !SameText( original, decoded ) ) errors++;
+		}
+		printf( "Type %d: %d errors\n", type, errors );
+		failures += errors;
+	}
+
+	// Same as for the binary packets, except that the text is kept printable
+	// some of the time, so that the damage gets past the first word.
+	accepted = rejected = 0;
+	for ( trial = 0; trial < FUZZ_TRIALS; trial++ ) {
+
+		MakeMessage( original, DEX_TLM_QUIT + rand() % ( DEX_TLM_RECORDING_END - DEX_TLM_QUIT + 1 ) );
+		size = MakeText( text, original );
+
+		switch ( rand() % 3 ) {
+		case 0:
+			for ( i = rand() % 4; i >= 0; i-- ) text[rand() % size] = (char) rand();
+			break;
+		case 1:
+			size = rand() % ( size + 1 );
+			break;
+		case 2:
+			for ( i = rand() % 4; i >= 0; i-- ) text[rand() % ( strlen( text ) + 1 )] = " -+.0123456789x:/*[]()<>|"[rand() % 25];
+			break;
+		}
+
+		char *received = (char *) malloc( size > 0 ? size : 1 );
+		memcpy( received, text, size );
+		result = DexTelemetryDecodeText( received, size, &decoded );
+		free( received );
+		if ( result > 0 ) {
+			accepted++;
+			if ( result > size 
+				|| ( decoded.type == DEX_TLM_RECORDING_RECORD && ( decoded.count < 0 || decoded.count > DEX_TLM_MAX_SAMPLES ) )
+				|| ( decoded.type == DEX_TLM_EVENT && ( decoded.length < 0 || decoded.length > DEX_TLM_MAX_TEXT ) ) ) {
+				printf( "Trial %d: accepted a text packet that does not fit (%d of %d bytes).\n", trial, result, size );
+				failures++;
+			}
+		}
+		else rejected++;
+
+	}
+	printf( "%d damaged text packets: %d accepted, %d rejected.\n\n", FUZZ_TRIALS, accepted, rejected );
+
+	{
+		double scan_us, text_us, binary_us;
+		TimeDecode( DEX_TLM_STATE, scan_us, text_us, binary_us );
+		printf( "State:  %.3f us with sscanf(), %.3f us from the text in place, %.3f us from binary.\n", scan_us, text_us, binary_us );
+		TimeDecode( DEX_TLM_RECORDING_RECORD, scan_us, text_us, binary_us );
+		printf( "Record: %.3f us with sscanf(), %.3f us from the text in place, %.3f us from binary (%d samples).\n", 
+			scan_us, text_us, binary_us, DEX_TLM_MAX_SAMPLES );
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Reliable delivery of %d recordings of %d packets.\n\n", LINK_RECORDINGS, LINK_PACKETS );
+
+	for ( i = 0; i <= 30; i += 10 ) {
+		int errors = ReliableDelivery( i / 100.0 );
+		printf( "Loss %2d%%: %5.1f%% through the first time, %4d retransmissions, %4lu duplicates, %lu given up, %2lu recordings acknowledged, %d errors.\n", 
+			i, 100.0 * firstPass / ( LINK_RECORDINGS * LINK_PACKETS ), retransmissions, receiver.duplicates, receiver.abandoned, sender.completed, errors );
+		failures += errors;
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Parity over %d full recording packets.\n\n", PARITY_PACKETS );
+
+	for ( i = 0; i < PARITY_PACKETS; i++ ) {
+		MakeMessage( original, DEX_TLM_RECORDING_RECORD );
+		original.flags = DEX_TLM_PROTECTED;
+		original.sequence = i;
+		original.count = DEX_TLM_MAX_SAMPLES - rand() % 2;
+		recordSize[i] = DexTelemetryEncode( records[i], DEX_TLM_MAX_RECORD_SIZE, &original );
+	}
+	{
+		static int blocks[] = { 2, 4, 8, 16 };
+		static int losses[] = { 1, 5, 10, 20 };
+		int b, l;
+		for ( b = 0; b < 4; b++ ) {
+			double encode_us, decode_us, recovered;
+			printf( "1 parity per %2d packets (%3.0f%% overhead), recovered:", blocks[b], 100.0 / blocks[b] );
+			for ( l = 0; l < 4; l++ ) {
+				recovered = ParityRecovery( blocks[b], losses[l] / 100.0, encode_us, decode_us );
+				if ( recovered < 0.0 ) failures++;
+				printf( "  %2d%% loss %5.1f%%", losses[l], 100.0 * recovered );
+			}
+			printf( "\n    %.2f us to compute and %.2f us to rebuild, per packet sent.\n", encode_us, decode_us );
+		}
+	}
+	{
+		// A log played over again, and numbers that go round.
+		static unsigned long offsets[] = { 0, 1, 12345, 0xfffffffc };
+		int k, errors = 0;
+		for ( k = 0; k < 4; k++ ) errors += RenumberedParity( DEX_TLM_MAX_PARITY_BLOCK, offsets[k] );
+		printf( "\nA block of %d renumbered by 0, 1, 12345 and 2^32-4, with each packet lost in turn and the next one retransmitted: %d not rebuilt as renumbered.\n",
+			DEX_TLM_MAX_PARITY_BLOCK, errors );
+		failures += errors;
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "State updates every %d ms.\n\n", STATE_STEP );
+
+	failures += StateDecisions();
+	failures += StateMerges();
+	{
+		static unsigned long drains[] = { STATE_STEP, 70 };
+		int k, filter, packets, bytes, errors;
+		printf( "\n" );
+		for ( k = 0; k < 2; k++ ) {
+			for ( filter = 0; filter < 2; filter++ ) {
+				errors = StateLink( filter != 0, drains[k], packets, bytes );
+				printf( "%d s still but for one reach, %s, queue emptied every %3lu ms: %3d packets, %5d bytes, %d errors.\n",
+					STATE_TRIAL / 1000, ( filter ? "filtered  " : "unfiltered" ), drains[k], packets, bytes, errors );
+				failures += errors;
+			}
+		}
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Full resolution recordings of %d samples.\n\n", TRIAL_SAMPLES );
+
+	// As sent today: about DEX_TLM_MAX_SAMPLES of them, in one record.
+	MakeMessage( original, DEX_TLM_RECORDING_RECORD );
+	original.count = TRIAL_SAMPLES / ( TRIAL_SAMPLES / DEX_SAMPLES_PER_PACKET + 1 );
+	size = DexTelemetryEncode( packet, sizeof( packet ), &original );
+	printf( "Decimated: %d samples in %d bytes. All samples as floats: %d bytes.\n\n", original.count, size,
+		( TRIAL_SAMPLES + DEX_TLM_MAX_SAMPLES - 1 ) / DEX_TLM_MAX_SAMPLES * ( DEX_TLM_HEADER_SIZE + DEX_TLM_RECORD_HEADER_SIZE ) 
+		+ TRIAL_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE * 4 );
+	{
+		static double jitters[] = { 0.0, 0.1, 0.5 };
+		int discrete, k, bytes, packets, errors;
+		double pack_us, unpack_us;
+		for ( discrete = 0; discrete < 2; discrete++ ) {
+			for ( k = 0; k < 3; k++ ) {
+				MakeTrial( discrete != 0, jitters[k] );
+				errors = PackTrial( bytes, packets, pack_us, unpack_us );
+				printf( "%s, %.1f mm noise: %6d bytes in %2d packets (%.2f bytes per sample, %4.1f:1), %d errors.\n",
+					( discrete ? "Discrete   " : "Oscillation" ), jitters[k], bytes, packets, (double) bytes / TRIAL_SAMPLES,
+					(double) TRIAL_SAMPLES * DEX_TLM_FLOATS_PER_SAMPLE * 4 / bytes, errors );
+				printf( "    %.3f us to pack and %.3f us to unpack, per sample.\n", pack_us, unpack_us );
+				failures += errors;
+			}
+		}
+	}
+
+	printf( "\n**********************************************************************\n\n" );
+	printf( "Shared memory ring of %d slots, %d packets published.\n\n", SHM_SLOTS, SHM_PACKETS );
+
+	{
+		static int paces[] = { 1, 2, 10 };
+		int k;
+		unsigned long read[3], lost[3];
+		double publish_us, read_us;
+		failures += SharedRing( paces, 3, read, lost, publish_us, read_us );
+		for ( k = 0; k < 3; k++ ) {
+			printf( "Reader of 1 packet in %2d: %6lu read, %6lu lost.\n", paces[k], read[k], lost[k] );
+		}
+		printf( "    %.3f us to publish and %.3f us to read, per packet.\n", publish_us, read_us );
+	}
+
+	printf( "\n%d packets published with %d readers in threads of their own.\n\n", SHM_THREADED_PACKETS, SHM_THREADED_READERS );
+
+	{
+		int k, errors;
+		unsigned long read[SHM_THREADED_READERS], lost[SHM_THREADED_READERS];
+		errors = SharedRingThreads( read, lost );
+		for ( k = 0; k < SHM_THREADED_READERS; k++ ) {
+			printf( "Reader spinning %4d times per packet: %6lu read, %6lu lost.\n", shmSpin[k], read[k], lost[k] );
+		}
+		printf( "%d errors.\n", errors );
+		failures += errors;
+	}
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
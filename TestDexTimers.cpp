@@ -0,0 +1,84 @@
+// TestDexTimers.cpp
+
+// Check the virtual clock of DexTimers. No hardware is needed: the waits are
+// run the way DexApparatus::Wait() runs them, with one tick per update.
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "DexTimers.h"
+
+// One tracker sample, the step used by the simulator with -virtual.
+#define MAX_STEP		0.005
+#define WAIT_TIME		10.0
+#define BLINK_PERIOD	0.25
+
+// Deadlines are kept to the microsecond.
+#define TOLERANCE		0.000001
+
+int main( int argc, char *argv[] ) {
+
+	DexTimer	wait_timer, blink_timer, elapsed_timer;
+	double		before, after, largest_step = 0.0;
+	int			ticks = 0, blinks = 0, late_blinks = 0, query_moves = 0, i;
+	int			failures = 0;
+
+	DexTimerSetVirtual( 1, MAX_STEP );
+
+	// Looking at the timers must not move the clock.
+	DexTimerSet( wait_timer, WAIT_TIME );
+	before = DexTimerVirtualTime();
+	for ( i = 0; i < 1000; i++ ) {
+		DexTimerTimeout( wait_timer );
+		DexTimerElapsedTime( wait_timer );
+		DexTimerRemainingTime( wait_timer );
+	}
+	if ( DexTimerVirtualTime() != before ) query_moves++;
+	printf( "1000 queries of an unexpired timer moved the clock by %.6f s.\n", DexTimerVirtualTime() - before );
+
+	// A wait with a blink timer, as in WaitUntilAtTarget().
+	DexTimerSet( wait_timer, WAIT_TIME );
+	DexTimerSet( blink_timer, BLINK_PERIOD );
+	DexTimerStart( elapsed_timer );
+	while ( !DexTimerTimeout( wait_timer ) ) {
+		before = DexTimerVirtualTime();
+		DexTimerTick();
+		after = DexTimerVirtualTime();
+		ticks++;
+		if ( after - before > largest_step ) largest_step = after - before;
+		// Checking the timers several times per update changes nothing.
+		DexTimerTimeout( wait_timer );
+		DexTimerTimeout( blink_timer );
+		if ( DexTimerVirtualTime() != after ) query_moves++;
+		if ( DexTimerTimeout( blink_timer ) ) {
+			blinks++;
+			if ( fabs( DexTimerElapsedTime( elapsed_timer ) - blinks * BLINK_PERIOD ) > TOLERANCE ) late_blinks++;
+			DexTimerSet( blink_timer, BLINK_PERIOD );
+		}
+	}
+
+	printf( "%.1f s wait with a %.2f s blink timer: %d updates, largest step %.6f s.\n",
+		WAIT_TIME, BLINK_PERIOD, ticks, largest_step );
+	printf( "%d blinks, %d of them off their deadline. Wait ended at %.6f s.\n",
+		blinks, late_blinks, DexTimerElapsedTime( elapsed_timer ) );
+
+	if ( query_moves ) failures++;
+	if ( largest_step > MAX_STEP + TOLERANCE ) failures++;
+	if ( ticks != (int) ( WAIT_TIME / MAX_STEP + 0.5 ) ) failures++;
+	if ( blinks != (int) ( WAIT_TIME / BLINK_PERIOD + 0.5 ) || late_blinks ) failures++;
+	if ( fabs( DexTimerElapsedTime( elapsed_timer ) - WAIT_TIME ) > TOLERANCE ) failures++;
+
+	// A wall clock timer is not affected.
+	DexTimerStartWallClock( elapsed_timer );
+	before = DexTimerVirtualTime();
+	for ( i = 0; i < 100; i++ ) DexTimerTick();
+	if ( DexTimerElapsedTime( elapsed_timer ) > 0.1 ) failures++;
+	printf( "100 updates moved the virtual clock by %.3f s and the wall clock by %.6f s.\n",
+		DexTimerVirtualTime() - before, DexTimerElapsedTime( elapsed_timer ) );
+
+	printf( "\n%s\n", ( failures ? "FAILED" : "OK" ) );
+	return( failures ? 1 : 0 );
+
+}
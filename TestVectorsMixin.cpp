@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <VectorsMixin.h>
 #include <math.h>
+#include <time.h>
 
 double noise = 0.0;
 
@@ -29,11 +30,11 @@ Matrix3x3	best;
 
 // Compute a random number between -1 and +1.
 // It doesn't need to be perfect.
-double random() {
-	return( rand() / 32767.0 * 2.0 - 1.0 );
+double RandomValue() {
+	return( rand() / (double) RAND_MAX * 2.0 - 1.0 );
 }
 
-int main( int argc, char *argv[] ) {
+int main( void ) {
 
 	VectorsMixin	vm;
 
@@ -46,7 +47,6 @@ int main( int argc, char *argv[] ) {
 
 	Vector3 check;
 	Vector3 delta;
-	double	error;
 
 
 	int i, j;
@@ -75,7 +75,7 @@ int main( int argc, char *argv[] ) {
 	for ( int n = 0; n < 10; n++ ) {
 		for ( i = 0; i < 3; i++ ) {
 			for ( j = 0; j < 3; j++ ) {
-				m[i][j] = random();
+				m[i][j] = RandomValue();
 			}
 		}
 		printf( "M:          %s\n", vm.mstr( m ) );
@@ -101,7 +101,7 @@ int main( int argc, char *argv[] ) {
  
 	for ( i = 0; i < 3; i++ ) {
 		for ( j = 0; j < 3; j++ ) {
-			m[i][j] = random();
+			m[i][j] = RandomValue();
 		}
 	}
 
@@ -117,12 +117,12 @@ int main( int argc, char *argv[] ) {
 	printf( "\n**********************************************************************\n\n" );
 	printf( "Test quaternion calculations.\n\n" );
 	Quaternion q1, q2;
-	double angle1 = 180.0 * random();
-	double angle2 = 180.0 * random();
+	double angle1 = 180.0 * RandomValue();
+	double angle2 = 180.0 * RandomValue();
 	// Compute a random rotation transformation.
 	Vector3	axis;
 	// Random axis;
-	for ( j = 0; j < 3; j++ ) axis[j] = random();
+	for ( j = 0; j < 3; j++ ) axis[j] = RandomValue();
 	// Make it a unit vector.
 	vm.NormalizeVector( axis );
 	vm.SetQuaterniond( q1, angle1, axis );
@@ -143,11 +143,11 @@ int main( int argc, char *argv[] ) {
 
 	// Compute a random rotation transformation.
 	// Random axis;
-	for ( j = 0; j < 3; j++ ) axis[j] = random();
+	for ( j = 0; j < 3; j++ ) axis[j] = RandomValue();
 	// Make it a unit vector.
 	vm.ScaleVector( axis, axis, 1.0 / vm.VectorNorm( axis ) );
 	// Random angle.
-	double angle = vm.pi * random();
+	double angle = vm.pi * RandomValue();
 	vm.SetQuaterniond( rotation, angle, axis );
 	printf( "Angle: %f  Axis: %s  Quaternion: %s\n\n",
 		angle, vm.vstr( axis ), vm.qstr( rotation ) );
@@ -165,7 +165,7 @@ int main( int argc, char *argv[] ) {
 	for ( i = 0; i < N; i++ ) {
 		vm.RotateVector( output[i], rotation, input[i] );
 		// Add some noise.
-		for ( j = 0; j < 3; j++ ) output[i][j] += noise * random();
+		for ( j = 0; j < 3; j++ ) output[i][j] += noise * RandomValue();
 	}
 	// Compute the best-fit transformation that maps input to output.
 	vm.BestFitTransformation( best, input, output, N );
@@ -212,8 +212,9 @@ int main( int argc, char *argv[] ) {
 	Vector3 output_centroid;
 	double count;
 	int n_sel;
+	int combo;
 
-	for ( int combo = 0; combo < 256; combo++ ) {
+	for ( combo = 0; combo < 256; combo++ ) {
 
 		// Select the visible output markers and the corresponding inputs.
 		count = 0.0;
@@ -277,8 +278,7 @@ int main( int argc, char *argv[] ) {
 			vm.MultiplyVector( check, selected_input[i], best );
 			vm.AddVectors( check, check, average_displacement );
 			vm.SubtractVectors( delta, selected_output[i], check );
-			error = vm.VectorNorm( delta );
-//			printf( "Check: %d %s %s %f\n", i, vm.vstr( selected_output[i] ), vm.vstr( check ), error );
+//			printf( "Check: %d %s %s %f\n", i, vm.vstr( selected_output[i] ), vm.vstr( check ), vm.VectorNorm( delta ) );
 		}
 
 		// Construct a visibility string.
@@ -333,6 +333,224 @@ int main( int argc, char *argv[] ) {
 			( visible ? "YES" : "NO " ), displacement_residual, rotation_residual );
 	}
 
+	/***********************************************************************************************/
+
+	//
+	// Compare with the tabulated version of ComputeRigidBodyPose() and time them both.
+	//
+
+	RigidBodyModel	*body = new RigidBodyModel;
+	Vector3			tabulated_displacement;
+	Quaternion		tabulated_rotation;
+	bool			tabulated_visible;
+	double			max_displacement_difference = 0.0;
+	double			max_rotation_difference = 0.0;
+	int				mismatches = 0;
+
+	printf( "\nTabulated ComputeRigidBodyPose():\n\n" );
+
+	vm.PrepareRigidBodyModel( *body, input, N );
+
+	for ( combo = 0; combo < 256; combo += 1 ) {
+
+		int n_markers = 0;
+		for ( i = 0; i < N; i++ ) {
+			if ( ( 0x01 << i ) & combo ) {
+				vm.CopyVector( selected_input[n_markers], input[i] );
+				vm.CopyVector( selected_output[n_markers], output[i] );
+				n_markers++;
+			}
+		}
+		visible = vm.ComputeRigidBodyPose( estimated_displacement, estimated_rotation, selected_input, selected_output, n_markers, NULL );
+		tabulated_visible = vm.ComputeRigidBodyPose( tabulated_displacement, tabulated_rotation, *body, combo, selected_output, NULL );
+
+		// Degenerate subsets are now reported as not visible.
+		if ( visible != tabulated_visible ) {
+			if ( !body->subset[combo].degenerate ) mismatches++;
+			continue;
+		}
+		if ( !visible ) continue;
+		vm.SubtractVectors( delta, estimated_displacement, tabulated_displacement );
+		if ( vm.VectorNorm( delta ) > max_displacement_difference ) max_displacement_difference = vm.VectorNorm( delta );
+		double angle = vm.ToDegrees( vm.AngleBetween( estimated_rotation, tabulated_rotation ) );
+		if ( angle > max_rotation_difference ) max_rotation_difference = angle;
+	}
+	printf( "Max differences: %f (position) %f (degrees)  Visibility mismatches: %d\n", 
+		max_displacement_difference, max_rotation_difference, mismatches );
+
+	// Time a 20000-frame trial, cycling through the subsets with 4 or more markers.
+	int		subsets[256];
+	int		n_subsets = 0;
+	int		frame, trial;
+	int		n_trials = 10;
+	int		n_frames = 20000;
+	clock_t start;
+	double	plain_time, tabulated_time;
+
+	for ( combo = 0; combo < 256; combo++ ) {
+		if ( body->subset[combo].nMarkers >= 4 && !body->subset[combo].degenerate ) subsets[n_subsets++] = combo;
+	}
+
+	start = clock();
+	for ( trial = 0; trial < n_trials; trial++ ) {
+		for ( frame = 0; frame < n_frames; frame++ ) {
+			combo = subsets[frame % n_subsets];
+			int n_markers = 0;
+			for ( i = 0; i < N; i++ ) {
+				if ( ( 0x01 << i ) & combo ) {
+					vm.CopyVector( selected_input[n_markers], input[i] );
+					vm.CopyVector( selected_output[n_markers], output[i] );
+					n_markers++;
+				}
+			}
+			vm.ComputeRigidBodyPose( estimated_displacement, estimated_rotation, selected_input, selected_output, n_markers, NULL );
+		}
+	}
+	plain_time = (double) ( clock() - start ) / (double) CLOCKS_PER_SEC / (double) n_trials;
+
+	start = clock();
+	for ( trial = 0; trial < n_trials; trial++ ) {
+		for ( frame = 0; frame < n_frames; frame++ ) {
+			combo = subsets[frame % n_subsets];
+			int n_markers = 0;
+			for ( i = 0; i < N; i++ ) {
+				if ( ( 0x01 << i ) & combo ) {
+					vm.CopyVector( selected_output[n_markers], output[i] );
+					n_markers++;
+				}
+			}
+			vm.ComputeRigidBodyPose( tabulated_displacement, tabulated_rotation, *body, combo, selected_output, NULL );
+		}
+	}
+	tabulated_time = (double) ( clock() - start ) / (double) CLOCKS_PER_SEC / (double) n_trials;
+
+	printf( "Plain:     %8.3f ms per trial  %8.3f us per call\n", 1000.0 * plain_time, 1.0e6 * plain_time / n_frames );
+	printf( "Tabulated: %8.3f ms per trial  %8.3f us per call\n", 1000.0 * tabulated_time, 1.0e6 * tabulated_time / n_frames );
+
+	/***********************************************************************************************/
+
+	//
+	// Robust version. Make one marker a ghost, then exchange two markers, 
+	// and see if ComputeRigidBodyPoseRobust() finds them. Then time it.
+	//
+
+	double			robust_residual;
+	unsigned long	rejected;
+	bool			swapped;
+	Vector3			corrupted[8];
+	double			robust_time;
+
+	printf( "\nComputeRigidBodyPoseRobust():\n\n" );
+
+	for ( i = 0; i < N; i++ ) vm.CopyVector( corrupted[i], output[i] );
+	corrupted[3][X] += 0.5;
+	visible = vm.ComputeRigidBodyPoseRobust( estimated_displacement, estimated_rotation, *body, 0xff, corrupted, 0.05, robust_residual, rejected, swapped );
+	vm.SubtractVectors( delta, estimated_displacement, displacement );
+	printf( "Ghost marker 3:  rejected: %02lx swapped: %d residual: %f position error: %f\n", rejected, swapped, robust_residual, vm.VectorNorm( delta ) );
+
+	for ( i = 0; i < N; i++ ) vm.CopyVector( corrupted[i], output[i] );
+	vm.CopyVector( corrupted[2], output[5] );
+	vm.CopyVector( corrupted[5], output[2] );
+	visible = vm.ComputeRigidBodyPoseRobust( estimated_displacement, estimated_rotation, *body, 0xff, corrupted, 0.05, robust_residual, rejected, swapped );
+	vm.SubtractVectors( delta, estimated_displacement, displacement );
+	printf( "Swapped 2 and 5: rejected: %02lx swapped: %d residual: %f position error: %f\n", rejected, swapped, robust_residual, vm.VectorNorm( delta ) );
+
+	start = clock();
+	for ( trial = 0; trial < n_trials; trial++ ) {
+		for ( frame = 0; frame < n_frames; frame++ ) {
+			combo = subsets[frame % n_subsets];
+			int n_markers = 0;
+			for ( i = 0; i < N; i++ ) {
+				if ( ( 0x01 << i ) & combo ) {
+					vm.CopyVector( selected_output[n_markers], output[i] );
+					n_markers++;
+				}
+			}
+			vm.ComputeRigidBodyPoseRobust( tabulated_displacement, tabulated_rotation, *body, combo, selected_output, 0.05, robust_residual, rejected, swapped );
+		}
+	}
+	robust_time = (double) ( clock() - start ) / (double) CLOCKS_PER_SEC / (double) n_trials;
+	printf( "Robust:    %8.3f ms per trial  %8.3f us per call\n", 1000.0 * robust_time, 1.0e6 * robust_time / n_frames );
+
+	delete body;
+
+	/***********************************************************************************************/
+
+	//
+	// Marker positions back into the intrinsic frame of a CODA unit, 
+	// marker by marker as before, and in one go with TransformPoints().
+	// The markers are in an array of structures, like in a CodaFrame.
+	//
+
+	struct {
+		Vector3	position;
+		bool	visibility;
+	} aligned[28], intrinsic[28], batched[28];
+	int				n_markers = 28;
+	int				n_units = 2;
+	int				unit;
+	Matrix3x3		unit_rotation, unit_inverse;
+	Vector3			unit_offset;
+	Transform3x4	unit_xform;
+	double			marker_time, batch_time, max_error;
+
+	printf( "\nTransformPoints():\n\n" );
+
+	vm.SetQuaterniond( rotation, 60.0, vm.kVector );
+	for ( j = 0; j < 3; j++ ) {
+		Vector3 row;
+		vm.CopyVector( row, vm.zeroVector );
+		row[j] = 1.0;
+		vm.RotateVector( unit_rotation[j], rotation, row );
+		unit_offset[j] = 1000.0 * RandomValue();
+	}
+	for ( i = 0; i < n_markers; i++ ) {
+		for ( j = 0; j < 3; j++ ) aligned[i].position[j] = 500.0 * RandomValue();
+		aligned[i].visibility = true;
+	}
+
+	vm.TransposeMatrix( unit_inverse, unit_rotation );
+	vm.InverseRigidTransform( unit_xform, unit_offset, unit_rotation );
+	for ( i = 0; i < n_markers; i++ ) {
+		vm.SubtractVectors( delta, aligned[i].position, unit_offset );
+		vm.MultiplyVector( intrinsic[i].position, delta, unit_inverse );
+	}
+	vm.TransformPoints( batched[0].position, aligned[0].position, n_markers, unit_xform, sizeof( aligned[0] ) );
+	for ( i = 0, max_error = 0.0; i < n_markers; i++ ) {
+		vm.SubtractVectors( delta, batched[i].position, intrinsic[i].position );
+		if ( vm.VectorNorm( delta ) > max_error ) max_error = vm.VectorNorm( delta );
+	}
+	printf( "Largest difference: %g\n", max_error );
+
+	// What it used to cost: the transform from the unit on each call, then marker by marker.
+	start = clock();
+	for ( trial = 0; trial < n_trials; trial++ ) {
+		for ( frame = 0; frame < n_frames; frame++ ) {
+			for ( unit = 0; unit < n_units; unit++ ) {
+				vm.TransposeMatrix( unit_inverse, unit_rotation );
+				for ( i = 0; i < n_markers; i++ ) {
+					if ( aligned[i].visibility ) {
+						vm.SubtractVectors( delta, aligned[i].position, unit_offset );
+						vm.MultiplyVector( intrinsic[i].position, delta, unit_inverse );
+					}
+				}
+			}
+		}
+	}
+	marker_time = (double) ( clock() - start ) / (double) CLOCKS_PER_SEC / (double) n_trials;
+
+	start = clock();
+	for ( trial = 0; trial < n_trials; trial++ ) {
+		for ( frame = 0; frame < n_frames; frame++ ) {
+			for ( unit = 0; unit < n_units; unit++ ) {
+				vm.TransformPoints( batched[0].position, aligned[0].position, n_markers, unit_xform, sizeof( aligned[0] ) );
+			}
+		}
+	}
+	batch_time = (double) ( clock() - start ) / (double) CLOCKS_PER_SEC / (double) n_trials;
+	printf( "Per marker: %8.3f ms per trial  %8.3f us per frame\n", 1000.0 * marker_time, 1.0e6 * marker_time / n_frames );
+	printf( "Batched:    %8.3f ms per trial  %8.3f us per frame\n", 1000.0 * batch_time, 1.0e6 * batch_time / n_frames );
+
 	printf( "\nPress <RETURN> to continue ..." );
 	fflush( stdout );
 	getchar();
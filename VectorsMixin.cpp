@@ -260,6 +260,35 @@ void VectorsMixin::MultiplyVector( Vector3f result, Vector3 v, const Matrix3x3 m
 	}
 }
 
+void VectorsMixin::InverseRigidTransform( Transform3x4 result, const Vector3 offset, const Matrix3x3 rotation ) {
+	// x = ( x' - offset ) * transpose( rotation ), so output coordinate i
+	//  is the dot product of row i of the rotation with x' - offset.
+	for ( int i = 0; i < 3; i++ ) {
+		result[i][3] = 0.0;
+		for ( int j = 0; j < 3; j++ ) {
+			result[i][j] = rotation[i][j];
+			result[i][3] -= rotation[i][j] * offset[j];
+		}
+	}
+}
+
+void VectorsMixin::TransformPoints( double *result, const double *points, int n, const Transform3x4 xform, int stride ) {
+	// Everything is spelled out, so that this is a single tight loop over the points.
+	const double a00 = xform[0][0], a01 = xform[0][1], a02 = xform[0][2], b0 = xform[0][3];
+	const double a10 = xform[1][0], a11 = xform[1][1], a12 = xform[1][2], b1 = xform[1][3];
+	const double a20 = xform[2][0], a21 = xform[2][1], a22 = xform[2][2], b2 = xform[2][3];
+	const char *in = (const char *) points;
+	char *out = (char *) result;
+	for ( int k = 0; k < n; k++, in += stride, out += stride ) {
+		const double *p = (const double *) in;
+		double x = p[X], y = p[Y], z = p[Z];
+		double *r = (double *) out;
+		r[X] = a00 * x + a01 * y + a02 * z + b0;
+		r[Y] = a10 * x + a11 * y + a12 * z + b1;
+		r[Z] = a20 * x + a21 * y + a22 * z + b2;
+	}
+}
+
 
 
 // Let left and right be matrices of N 3-element row vectors.
@@ -625,6 +654,286 @@ bool VectorsMixin::ComputeRigidBodyPose( Vector3 position, Quaternion orientatio
 }
 								
 										
+/***********************************************************************************/
+
+// Tabulate, for each subset of visible markers, the quantities that 
+// ComputeRigidBodyPose() would otherwise recompute from the model on each call.
+// This is limited to MAX_TABULATED_BODY_MARKERS, since there are 2^N subsets.
+
+bool VectorsMixin::PrepareRigidBodyModel( RigidBodyModel &body, Vector3 model[], int N ) {
+
+	Vector3		selected[MAX_TABULATED_BODY_MARKERS];
+	Vector3		shifted[MAX_TABULATED_BODY_MARKERS];
+	Vector3		center_of_rotation, temp;
+	Matrix3x3	local, left, left_inverse;
+	double		det, scale;
+
+	unsigned long subset;
+	int i, j, k, n;
+
+	if ( N > MAX_TABULATED_BODY_MARKERS ) {
+		body.nMarkers = 0;
+		return( false );
+	}
+	body.nMarkers = N;
+
+	for ( subset = 0; subset < ( 0x01UL << N ); subset++ ) {
+
+		RigidBodySubset *sub = &body.subset[subset];
+
+		// Select the model markers that are visible in this subset.
+		n = 0;
+		for ( i = 0; i < N; i++ ) {
+			if ( subset & ( 0x01UL << i ) ) CopyVector( selected[n++], model[i] );
+		}
+		sub->nMarkers = n;
+		sub->degenerate = ( n < 3 );
+		sub->deltaNorm = 0.0;
+
+		// Centroid and offsets from the centroid.
+		CopyVector( sub->centroid, zeroVector );
+		for ( i = 0; i < n; i++ ) AddVectors( sub->centroid, sub->centroid, selected[i] );
+		if ( n > 0 ) ScaleVector( sub->centroid, sub->centroid, 1.0 / (double) n );
+		for ( i = 0; i < n; i++ ) SubtractVectors( sub->delta[i], selected[i], sub->centroid );
+
+		if ( n > 3 ) {
+
+			// Move the center of rotation off the plane of the first two deltas,
+			// exactly as ComputeRigidBodyPose() does.
+			sub->deltaNorm = VectorNorm( sub->delta[0] );
+			ComputeCrossProduct( center_of_rotation, sub->delta[0], sub->delta[1] );
+			ScaleVector( center_of_rotation, center_of_rotation, sub->deltaNorm / VectorNorm( sub->delta[0] ) / VectorNorm( sub->delta[1] ) );
+			for ( i = 0; i < n; i++ ) SubtractVectors( shifted[i], sub->delta[i], center_of_rotation );
+
+			// The model half of BestFitTransformation().
+			CrossVectors( left, shifted, shifted, n );
+			det = InvertMatrix( left_inverse, left );
+			scale = ( left[0][0] + left[1][1] + left[2][2] ) / 3.0;
+			// Written this way so that a NaN is also taken to be degenerate.
+			if ( !( fabs( det ) > 1.0e-6 * scale * scale * scale ) ) sub->degenerate = true;
+			else {
+				for ( j = 0; j < 3; j++ ) {
+					for ( k = 0; k < n; k++ ) {
+						sub->pseudoInverse[j][k] = 0.0;
+						for ( i = 0; i < 3; i++ ) sub->pseudoInverse[j][k] += left_inverse[j][i] * shifted[k][i];
+						sub->pseudoInverse[j][k] /= (double) n;
+					}
+				}
+			}
+		}
+
+		else if ( n == 3 ) {
+
+			// Local reference frame of the 3 markers, as in ComputeRigidBodyPose().
+			SubtractVectors( local[X], selected[1], selected[0] );
+			NormalizeVector( local[X] );
+			SubtractVectors( temp, selected[2], selected[0] );
+			ComputeCrossProduct( local[Z], local[X], temp );
+			// If the 3 markers are aligned, we cannot define the frame.
+			if ( !( VectorNorm( local[Z] ) > 1.0e-6 * VectorNorm( temp ) ) ) sub->degenerate = true;
+			else {
+				NormalizeVector( local[Z] );
+				ComputeCrossProduct( local[Y], local[Z], local[X] );
+				NormalizeVector( local[Y] );
+				InvertMatrix( sub->localInverse, local );
+			}
+		}
+	}
+
+	return( true );
+
+}
+
+// Compute the position and orientation of a rigid body from the tabulated model.
+// The result is the same as for the routine above, except that subsets for which
+// the orientation cannot be determined fall back on the default orientation.
+
+bool VectorsMixin::ComputeRigidBodyPose( Vector3 position, Quaternion orientation,
+										 RigidBodyModel &body, unsigned long subset, Vector3 actual[], 
+										 Quaternion default_orientation ) {
+
+	Vector3		actual_centroid, rotated;
+	Vector3		actual_delta[MAX_TABULATED_BODY_MARKERS];
+	Vector3		actual_center_of_rotation, temp;
+	Matrix3x3	actual_local, best, exact;
+
+	int i, j, k;
+
+	RigidBodySubset *sub = &body.subset[subset & ( ( 0x01UL << body.nMarkers ) - 1 )];
+	int N = sub->nMarkers;
+
+	if ( N < 1 || ( sub->degenerate && ! default_orientation ) ) {
+		position[X] = position[Y] = position[Z] = -999.999;
+		orientation[X] = orientation[Y] = orientation[Z] = orientation[M] = -999.999;
+		return( false );
+	}
+
+	CopyVector( actual_centroid, zeroVector );
+	for ( i = 0; i < N; i++ ) AddVectors( actual_centroid, actual_centroid, actual[i] );
+	ScaleVector( actual_centroid, actual_centroid, 1.0 / (double) N );
+
+	if ( sub->degenerate ) {
+
+		CopyQuaternion( orientation, default_orientation );
+
+	}
+
+	else if ( N > 3 ) {
+
+		for ( i = 0; i < N; i++ ) SubtractVectors( actual_delta[i], actual[i], actual_centroid );
+
+		// Only the data side of the center of rotation and of the best fit remain to be done.
+		ComputeCrossProduct( actual_center_of_rotation, actual_delta[0], actual_delta[1] );
+		ScaleVector( actual_center_of_rotation, actual_center_of_rotation, sub->deltaNorm / VectorNorm( actual_delta[0] ) / VectorNorm( actual_delta[1] ) );
+		for ( i = 0; i < N; i++ ) SubtractVectors( actual_delta[i], actual_delta[i], actual_center_of_rotation );
+
+		for ( j = 0; j < 3; j++ ) {
+			for ( k = 0; k < 3; k++ ) {
+				best[j][k] = 0.0;
+				for ( i = 0; i < N; i++ ) best[j][k] += sub->pseudoInverse[j][i] * actual_delta[i][k];
+			}
+		}
+		MatrixToQuaternion( orientation, best );
+
+	}
+
+	else {
+
+		SubtractVectors( actual_local[X], actual[1], actual[0] );
+		NormalizeVector( actual_local[X] );
+		SubtractVectors( temp, actual[2], actual[0] );
+		ComputeCrossProduct( actual_local[Z], actual_local[X], temp );
+		NormalizeVector( actual_local[Z] );
+		ComputeCrossProduct( actual_local[Y], actual_local[Z], actual_local[X] );
+		NormalizeVector( actual_local[Y] );
+
+		MultiplyMatrices( exact, sub->localInverse, actual_local );
+		MatrixToQuaternion( orientation, exact );
+
+	}
+
+	// The average displacement between rotated model and actual
+	// is the displacement between the two centroids.
+	RotateVector( rotated, orientation, sub->centroid );
+	SubtractVectors( position, actual_centroid, rotated );
+
+	return( true );
+
+}
+
+// Compute how far each of the actual markers is from where the given pose 
+// puts the corresponding model marker. Fills in the residual for each 
+// visible marker, in the same order as actual[], and returns the largest.
+
+double VectorsMixin::RigidBodyResiduals( double residual[], RigidBodyModel &body, unsigned long subset, 
+										 const Vector3 position, const Quaternion orientation, Vector3 actual[] ) {
+
+	Vector3 offset, rotated, delta;
+	double	worst = 0.0;
+	int		i;
+
+	RigidBodySubset *sub = &body.subset[subset & ( ( 0x01UL << body.nMarkers ) - 1 )];
+
+	// Model markers are tabulated relative to their centroid.
+	RotateVector( offset, orientation, sub->centroid );
+	AddVectors( offset, offset, position );
+	for ( i = 0; i < sub->nMarkers; i++ ) {
+		RotateVector( rotated, orientation, sub->delta[i] );
+		AddVectors( rotated, rotated, offset );
+		SubtractVectors( delta, actual[i], rotated );
+		residual[i] = VectorNorm( delta );
+		if ( residual[i] > worst ) worst = residual[i];
+	}
+	return( worst );
+
+}
+
+// Compute the pose of a rigid body while guarding against a ghost marker or 
+// a pair of markers that have been exchanged by the tracker. If all the markers
+// fit the pose within max_residual, this costs only the computation of the
+// residuals on top of the tabulated solution. Otherwise we try exchanging the
+// two worst markers and then leaving out each marker in turn, keeping the first
+// solution that fits. If none does, the pose from all the markers is returned,
+// and the caller can look at the residual to decide what to make of it.
+
+bool VectorsMixin::ComputeRigidBodyPoseRobust( Vector3 position, Quaternion orientation,
+											   RigidBodyModel &body, unsigned long subset, Vector3 actual[], 
+											   double max_residual, double &residual, 
+											   unsigned long &rejected, bool &swapped ) {
+
+	Vector3		trial_actual[MAX_TABULATED_BODY_MARKERS];
+	Vector3		trial_position;
+	Quaternion	trial_orientation;
+	double		marker_residual[MAX_TABULATED_BODY_MARKERS];
+	double		trial_residual[MAX_TABULATED_BODY_MARKERS];
+	int			model_index[MAX_TABULATED_BODY_MARKERS];
+	double		worst, best;
+	unsigned long trial_subset;
+	int			i, j, k, first, second, best_k;
+
+	rejected = 0;
+	swapped = false;
+	residual = 0.0;
+
+	subset &= ( ( 0x01UL << body.nMarkers ) - 1 );
+	int N = body.subset[subset].nMarkers;
+
+	if ( !ComputeRigidBodyPose( position, orientation, body, subset, actual, NULL ) ) return( false );
+	worst = RigidBodyResiduals( marker_residual, body, subset, position, orientation, actual );
+	residual = worst;
+
+	// With only 3 markers we can see that something is wrong, but not what.
+	if ( worst <= max_residual || N < 4 ) return( true );
+
+	// Find the two markers that fit the worst.
+	first = 0;
+	for ( i = 1; i < N; i++ ) if ( marker_residual[i] > marker_residual[first] ) first = i;
+	second = ( first == 0 ? 1 : 0 );
+	for ( i = 0; i < N; i++ ) if ( i != first && marker_residual[i] > marker_residual[second] ) second = i;
+
+	// See if the tracker has mixed up those two.
+	for ( i = 0; i < N; i++ ) CopyVector( trial_actual[i], actual[i] );
+	CopyVector( trial_actual[first], actual[second] );
+	CopyVector( trial_actual[second], actual[first] );
+	if ( ComputeRigidBodyPose( trial_position, trial_orientation, body, subset, trial_actual, NULL ) ) {
+		best = RigidBodyResiduals( trial_residual, body, subset, trial_position, trial_orientation, trial_actual );
+		if ( best <= max_residual ) {
+			CopyVector( position, trial_position );
+			CopyQuaternion( orientation, trial_orientation );
+			residual = best;
+			swapped = true;
+			return( true );
+		}
+	}
+
+	// Which model marker corresponds to each of the actual ones.
+	for ( i = 0, j = 0; i < body.nMarkers; i++ ) if ( subset & ( 0x01UL << i ) ) model_index[j++] = i;
+
+	// Leave out each marker in turn and keep the subset that fits best.
+	best = worst;
+	best_k = -1;
+	for ( k = 0; k < N; k++ ) {
+		for ( i = 0, j = 0; i < N; i++ ) if ( i != k ) CopyVector( trial_actual[j++], actual[i] );
+		trial_subset = subset & ~( 0x01UL << model_index[k] );
+		if ( !ComputeRigidBodyPose( trial_position, trial_orientation, body, trial_subset, trial_actual, NULL ) ) continue;
+		double fit = RigidBodyResiduals( trial_residual, body, trial_subset, trial_position, trial_orientation, trial_actual );
+		if ( fit < best ) {
+			best = fit;
+			best_k = k;
+		}
+	}
+	if ( best_k >= 0 && best <= max_residual ) {
+		for ( i = 0, j = 0; i < N; i++ ) if ( i != best_k ) CopyVector( trial_actual[j++], actual[i] );
+		trial_subset = subset & ~( 0x01UL << model_index[best_k] );
+		ComputeRigidBodyPose( position, orientation, body, trial_subset, trial_actual, NULL );
+		rejected = ( 0x01UL << model_index[best_k] );
+		residual = best;
+	}
+
+	return( true );
+
+}
+
 /***********************************************************************************/
 
 // These routines create ascii strings from vector and matrix objects.
@@ -639,7 +948,7 @@ char *VectorsMixin::vstr( const Vector3 v ) {
 	// This assumes that we will never need the results of more than 256 at the same time.
 
 	static char str[256][256];
-	static instance = 0;
+	static int instance = 0;
 	instance++;
 	instance %= 256;
 
@@ -654,7 +963,7 @@ char *VectorsMixin::vstr( const Vector3 v ) {
 // The others work in a similar fashion.
 char *VectorsMixin::qstr( const Quaternion q ) {
 	static char str[256][256];
-	static instance = 0;
+	static int instance = 0;
 	instance++;
 	instance %= 256;
 	sprintf( str[instance], "{%8.3fi + %8.3fj + %8.3fk + %8.3f}", q[X], q[Y], q[Z], q[M] );
@@ -663,7 +972,7 @@ char *VectorsMixin::qstr( const Quaternion q ) {
 
 char *VectorsMixin::mstr( const Matrix3x3 m ) {
 	static char str[256][256];
-	static instance = 0;
+	static int instance = 0;
 	instance++;
 	instance %= 256;
 	sprintf( str[instance], "[%8.3f %8.3f %8.3f | %8.3f %8.3f %8.3f | %8.3f %8.3f %8.3f ]", 
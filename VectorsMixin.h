@@ -19,12 +19,42 @@ typedef double Vector3[3];
 typedef float  Vector3f[3];
 typedef double Quaternion[4];
 typedef double Matrix3x3[3][3];
+// An affine transformation. Each row gives one output coordinate, 
+// with the 3 coefficients of the input point followed by the constant.
+typedef double Transform3x4[3][4];
 
 // I am also putting here support for calculations on 3D rigid bodies.
 // It should probably be a separate class, but I will deal with that later.
 
 #define MAX_RIGID_BODY_MARKERS	256
 
+// For small rigid bodies, everything that depends only on the model
+// can be computed once for each possible subset of visible markers.
+// A subset is a bit mask, with bit i set if model marker i is visible.
+#define MAX_TABULATED_BODY_MARKERS	8
+#define MAX_TABULATED_BODY_SUBSETS	(1 << MAX_TABULATED_BODY_MARKERS)
+
+typedef struct {
+	int			nMarkers;
+	// True if the visible markers do not define an orientation.
+	bool		degenerate;
+	Vector3		centroid;
+	// The visible markers relative to their centroid.
+	Vector3		delta[MAX_TABULATED_BODY_MARKERS];
+	// What is needed from the model to compute the orientation.
+	// 4 or more markers: Moore-Penrose pseudo-inverse of the model deltas and the
+	//  norm of the first delta, used to scale the out-of-plane center of rotation.
+	// 3 markers: inverse of the local reference frame defined by the markers.
+	double		pseudoInverse[3][MAX_TABULATED_BODY_MARKERS];
+	double		deltaNorm;
+	Matrix3x3	localInverse;
+} RigidBodySubset;
+
+typedef struct {
+	int				nMarkers;
+	RigidBodySubset	subset[MAX_TABULATED_BODY_SUBSETS];
+} RigidBodyModel;
+
 class VectorsMixin {
 
 protected:	
@@ -89,6 +119,12 @@ public:
 	void MultiplyVector( Vector3f result, Vector3f v, const Matrix3x3 m );
 	void MultiplyVector( Vector3f result, Vector3 v, const Matrix3x3 m );
 
+	// Transformation that undoes x' = x * rotation + offset, for an orthonormal rotation.
+	void InverseRigidTransform( Transform3x4 result, const Vector3 offset, const Matrix3x3 rotation );
+	// Apply a transformation to n points at once. The points may be inside an array of 
+	// structures, in which case stride is the size of the structure in bytes.
+	void TransformPoints( double *result, const double *points, int n, const Transform3x4 xform, int stride = sizeof( Vector3 ) );
+
 	void CrossVectors( Matrix3x3 result, const Vector3 left[], const Vector3 right[], int rows );
 	void BestFitTransformation( Matrix3x3 result, const Vector3 input[], const Vector3 output[], int rows );
 		
@@ -104,6 +140,25 @@ public:
 								Vector3 model[], Vector3 actual[], 
 								int N, Quaternion default_orientation );
 
+	// Same as above, but using the quantities tabulated for the visible subset.
+	// The actual marker positions are listed in the same order as in the model.
+	bool PrepareRigidBodyModel( RigidBodyModel &body, Vector3 model[], int N );
+	bool ComputeRigidBodyPose( Vector3 position, Quaternion orientation,
+								RigidBodyModel &body, unsigned long subset, Vector3 actual[], 
+								Quaternion default_orientation );
+
+	// Distance of each actual marker from where the pose puts the model marker.
+	// Returns the largest one. 
+	double RigidBodyResiduals( double residual[], RigidBodyModel &body, unsigned long subset, 
+								const Vector3 position, const Quaternion orientation, Vector3 actual[] );
+	// As above, but if some markers do not fit within max_residual, try exchanging
+	// the two worst markers, then try leaving out each marker in turn. The model
+	// markers that had to be left out are flagged in 'rejected'.
+	bool ComputeRigidBodyPoseRobust( Vector3 position, Quaternion orientation,
+								RigidBodyModel &body, unsigned long subset, Vector3 actual[], 
+								double max_residual, double &residual, 
+								unsigned long &rejected, bool &swapped );
+
 	char *vstr( const Vector3 v );
 	char *qstr( const Quaternion q );
 	char *mstr( const Matrix3x3 m );